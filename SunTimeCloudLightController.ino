@@ -6,19 +6,41 @@
 #include <TimeLib.h>
 #include <ArduinoOTA.h> 
 #include <sunset.h>
-#include <ESP8266WebServer.h>
 #include <EEPROM.h>
 #include <WiFiClient.h>
 #include <ArduinoJson.h>
-#include <ESP8266HTTPClient.h>
+#include <base64.h>
 #include "index_html.h"
 #include "logging.h"  // Include the new logging system
+#include "scratch_arena.h"
+#include "trace.h"
+#include "metrics.h"
+#include "profiler.h"
+#include "controller_core.h"
+#include "zones.h"
+#include "day_plan.h"
+#include "energy.h"
+#include "bench.h"
+#include "forecast_cache.h"
+#include "forecast_client.h"
+#include "forecast_share.h"
+#include "input_trace.h"
+#include "mqtt_publisher.h"
+#include "admission.h"
+#include "async_http.h"
+#include "gzip_stream.h"
+#include "hmac.h"
+#include "session.h"
 
 //================ GLOBAL VARIABLES ================
-float currentCloudCoverage = -1;
-bool isMonitoring = false;
-bool cloudTriggeredActivation = false;
-String cloudStatus = "Not monitoring";
+// Decision state lives in one struct shared with controller_core.h; the
+// names below are the aliases the rest of the sketch uses.
+DecisionState decision = { true, true, 0, false, false, -1, NORMAL, CLOUD_NOT_MONITORING };
+
+float &currentCloudCoverage = decision.cloudCoverage;
+bool &isMonitoring = decision.isMonitoring;
+bool &cloudTriggeredActivation = decision.cloudTriggered;
+CloudStatus &cloudStatus = decision.cloudStatus;
 
 bool manualOverride = false;
 unsigned long manualOverrideStartTime = 0;
@@ -26,17 +48,49 @@ int manualOverrideDuration = 60; // Duration in minutes
 bool manualLightState = false;
 
 char buffer[BUFFER_SIZE]; 
+ScratchArena scratch(buffer, BUFFER_SIZE); // Reset before each request is handled
+
+uint32_t minFreeHeap = 0xFFFFFFFF;
+
+ForecastCache forecastCache;     // Filled by our own fetches or by the site's leader
+uint32_t lastCloudLogHour = 0;   // Forecast hour of the last logged cloud sample
+
+DayPlan dayPlan;                 // Main circuit's schedule for today
+uint32_t lastPlanFetchMs = 0;    // Forecast fetches made to keep the plan current
+
+EnergyMeter energyMeter;         // On-time per circuit; circuit 0 is the main relay
+bool energyLoaded = false;       // Commits before loadEnergy() must not overwrite the stored counters
+uint32_t lastEnergyCheckpointMs = 0;
+
+uint8_t inputTraceRing[INPUT_TRACE_ENABLED ? INPUT_TRACE_SIZE : 1];
+InputTrace inputTrace;           // External inputs, for replay on a host
+uint32_t lastInputCheckpointMs = 0;
+uint32_t tracedForecastAt = 0;   // fetchedAt of the last forecast recorded
+InputTraceSettings tracedSettings;
+int8_t tracedWifi = -1;          // Wi-Fi state last recorded, -1 before the first
+
+// Forecast sample for the current loop pass, shared by the main circuit and every zone
+bool tickCloudSampled = false;
+float tickCloudCoverage = -1;
+
+ZoneConfig zones[MAX_ZONES];          // Extra circuits; the main relay is zone 0 in logs
+ZoneRuntime zoneRuntime[MAX_ZONES];
 
 unsigned long lastTimeSync = 0;
 bool wifiEnabled = true;
 
+AdmissionControl admission;
+uint32_t lastCloudCheckMs = 0;     // /cloudcheck requests this soon after one share its result
+float lastCloudCheckValue = -1;
+uint32_t rebootAtMs = 0;           // Set by /reboot so the response goes out before the restart
+
 int TIME_RISE_OFFSET_ADDITIONAL = 0;  
 int TIME_SET_OFFSET_ADDITIONAL = 0;   
 
 //================ MONITORING FLAGS ================
-bool monitoring_sunrise = true;
-bool monitoring_sunset = true;
-int monitoring_retry_count = 0;
+bool &monitoring_sunrise = decision.monitoringSunrise;
+bool &monitoring_sunset = decision.monitoringSunset;
+int &monitoring_retry_count = decision.retryCount;
 
 int relayOn = LOW;
 int relayOff = HIGH; 
@@ -64,26 +118,94 @@ int localtime_h, localtime_m;
 
 WiFiUDP ntpUDP;
 NTPClient timeClient(ntpUDP, NTP_SERVER, TIMEZONE_OFFSET + DAYLIGHT_OFFSET);
-ESP8266WebServer server(80);
+AsyncHttpServer server(80);
 SunSet sun;
 
 char deviceName[32] = "LightController"; // Device name for OTA and display
 int maxRetries = MAX_MONITORING_RETRIES;
 
-//================ SYSTEM STATE ENUM ================
-enum SystemState {
-    NORMAL,
-    MONITORING,
-    ACTIVE,
-    SCHEDULED,
-    MANUAL     // New state for manual override
+//================ SYSTEM STATE ================
+SystemState &currentState = decision.state;
+
+// Staged copy of every persisted setting, used by the bulk /api/config endpoint
+struct ControllerConfig {
+    int sunriseHour, sunriseMinute, sunsetHour, sunsetMinute;
+    int cloudThreshold, cloudHysteresis, monitoringWindow, overrideDuration;
+    int sunriseOffset, sunsetOffset, maxRetries;
+    int timezoneOffset, daylightOffset;
+    float latitude, longitude;
+    bool relayActiveHigh;
+    char username[32];
+    char password[32];
+    char deviceName[32];
+};
+
+enum ForecastParseResult {
+    FORECAST_PARSE_OK,
+    FORECAST_PARSE_NO_MATCH,
+    FORECAST_PARSE_JSON_ERROR
 };
 
-SystemState currentState = NORMAL;
+//================ FORWARD DECLARATIONS ================
+// Functions used above their definition. The Arduino build would generate
+// these, the host build (CMakeLists.txt) compiles the sketch as plain C++.
+uint32_t utcNow();
+void logCloudSample(float cloudCoverage);
+void traceForecast();
+bool admitBlocking();
+void setupWebServer();
+void handleGetLogs();
+void handleGetTrace();
+void handleGetInputTrace();
+void handleMetrics();
+void handleGetProfile();
+void handleBench();
 
 //================ EEPROM FUNCTIONS ================
+// Zone table after the settings block: a magic and count, then the array.
+// It is committed on its own so zone edits don't rewrite the settings.
+#define ZONE_EEPROM_START 168
+#define ZONE_EEPROM_MAGIC 0x5A4E
+static_assert(ZONE_EEPROM_START + 4 + sizeof(ZoneConfig) * MAX_ZONES <= LOG_EEPROM_START,
+              "zone table overlaps the log area");
+
+// Energy counters after the log area, up to the end of the sector
+#define ENERGY_EEPROM_START (LOG_EEPROM_START + LOG_EEPROM_SIZE)
+static_assert(ENERGY_EEPROM_START + sizeof(EnergyRecord) <= EEPROM_IMAGE_SIZE,
+              "energy record doesn't fit the EEPROM sector");
+
+// Copies the energy counters into the image so the commit under way carries
+// them; returns false while they can't be written yet
+bool stageEnergy() {
+  if (!energyLoaded || !clockIsSet(utcNow())) return false;
+  static EnergyRecord record;
+  energyMeter.settle(timeClient.getEpochTime());
+  energyMeter.save(record);
+  EEPROM.put(ENERGY_EEPROM_START, record);
+  return true;
+}
+
+// Commits the EEPROM image, timing it for /metrics. Every commit rewrites
+// the whole flash sector, so the energy counters ride along for free.
+bool commitEeprom() {
+  bool energyStaged = stageEnergy();
+  uint32_t commitStart = micros();
+  bool success = EEPROM.commit();
+  metrics.observe(MH_EEPROM_COMMIT, micros() - commitStart);
+  if (!success) {
+    metrics.inc(MC_EEPROM_COMMIT_FAILED);
+  } else if (energyStaged) {
+    metrics.inc(MC_ENERGY_CHECKPOINTS);
+    energyMeter.markClean();
+    lastEnergyCheckpointMs = millis();
+  }
+  return success;
+}
+
+// Settings share the EEPROM image with the log area, so keep the whole image
+// mapped; a smaller begin()/end() pair here would drop pending log writes.
 void saveSettings() {
-  EEPROM.begin(512);
+  EEPROM.begin(EEPROM_IMAGE_SIZE);
   
   // Save all time settings
   EEPROM.put(0, sunriseHour);
@@ -125,15 +247,18 @@ void saveSettings() {
     if (deviceName[i] == 0) break;
   }
   
-  bool success = EEPROM.commit();
-  EEPROM.end();
-  
-  Serial.printf("EEPROM save %s\n", success ? "successful" : "failed");
+  if (commitEeprom()) {
+    TRACE_INFO_S(TR_EEPROM_SAVE, "successful");
+  } else {
+    TRACE_ERROR_S(TR_EEPROM_SAVE, "failed");
+  }
+  // Sessions made with the old credentials stop working
+  sessionSetCredentials(http_username, http_password);
 }
 
 
 void loadSettings() {
-  EEPROM.begin(512);
+  EEPROM.begin(EEPROM_IMAGE_SIZE);
   
   EEPROM.get(0, sunriseHour);
   EEPROM.get(sizeof(int), sunriseMinute);
@@ -215,25 +340,93 @@ void loadSettings() {
   
   strcpy(http_username, adminUsername);
   strcpy(http_password, adminPassword);
+  sessionSetCredentials(http_username, http_password);
+  
+  TRACE_INFO(TR_SETTINGS_SUNRISE, sunriseHour, sunriseMinute, sunriseOffset);
+  TRACE_INFO(TR_SETTINGS_SUNSET, sunsetHour, sunsetMinute, sunsetOffset);
+  TRACE_INFO(TR_SETTINGS_CLOUD, cloudThreshold, cloudHysteresis, monitoringWindow);
+  TRACE_INFO_F(TR_SETTINGS_LOCATION, locationLatitude, locationLongitude);
+  TRACE_INFO_S(TR_SETTINGS_TIME, relayOn == HIGH ? "active HIGH" : "active LOW", timezoneOffsetSec, daylightOffsetSec);
+  TRACE_DEBUG_S(TR_SETTINGS_AUTH, http_username);
+  TRACE_INFO_S(TR_SETTINGS_DEVICE, deviceName);
+}
+
+// A zone may use a pin from ZONE_PINS that no other zone in `table` has taken
+bool zonePinAllowed(const ZoneConfig *table, int index, int pin) {
+  if (pin == ZONE_NO_PIN) return true;
+  
+  bool listed = false;
+  for (size_t i = 0; i < sizeof(ZONE_PINS); i++) {
+    if (ZONE_PINS[i] == pin) listed = true;
+  }
+  if (!listed) return false;
+  
+  for (int i = 0; i < MAX_ZONES; i++) {
+    if (i != index && table[i].pin == pin) return false;
+  }
+  return true;
+}
+
+void saveZones() {
+  EEPROM.begin(EEPROM_IMAGE_SIZE);
+  
+  uint16_t magic = ZONE_EEPROM_MAGIC;
+  uint16_t count = MAX_ZONES;
+  EEPROM.put(ZONE_EEPROM_START, magic);
+  EEPROM.put(ZONE_EEPROM_START + 2, count);
+  EEPROM.put(ZONE_EEPROM_START + 4, zones);
+  
+  if (commitEeprom()) {
+    TRACE_INFO_S(TR_EEPROM_SAVE, "successful");
+  } else {
+    TRACE_ERROR_S(TR_EEPROM_SAVE, "failed");
+  }
+}
+
+void loadZones() {
+  EEPROM.begin(EEPROM_IMAGE_SIZE);
+  
+  uint16_t magic, count;
+  EEPROM.get(ZONE_EEPROM_START, magic);
+  EEPROM.get(ZONE_EEPROM_START + 2, count);
+  
+  // Units that never stored zones start with every zone disabled
+  if (magic == ZONE_EEPROM_MAGIC && count == MAX_ZONES) {
+    EEPROM.get(ZONE_EEPROM_START + 4, zones);
+  } else {
+    for (int i = 0; i < MAX_ZONES; i++) {
+      initZoneConfig(zones[i], i, cloudThreshold, cloudHysteresis, monitoringWindow);
+    }
+  }
   
-  EEPROM.end();
+  for (int i = 0; i < MAX_ZONES; i++) {
+    ZoneConfig &z = zones[i];
+    z.name[ZONE_NAME_SIZE - 1] = 0;
+    if (!zonePinAllowed(zones, i, z.pin)) z.pin = ZONE_NO_PIN;
+    z.sunriseOffset = constrain(z.sunriseOffset, -120, 120);
+    z.sunsetOffset = constrain(z.sunsetOffset, -120, 120);
+    z.cloudThreshold = constrain(z.cloudThreshold, 0, 100);
+    z.cloudHysteresis = constrain(z.cloudHysteresis, 0, 20);
+    z.monitoringWindow = constrain(z.monitoringWindow, 5, 120);
+    initZoneRuntime(zoneRuntime[i]);
+  }
+}
+
+void loadEnergy() {
+  EEPROM.begin(EEPROM_IMAGE_SIZE);
   
-  Serial.println("Loaded settings:");
-  Serial.printf("Sunrise: %d:%d (offset %d min)\n", sunriseHour, sunriseMinute, sunriseOffset);
-  Serial.printf("Sunset: %d:%d (offset %d min)\n", sunsetHour, sunsetMinute, sunsetOffset);
-  Serial.printf("Cloud Threshold: %d%% with %d%% hysteresis\n", cloudThreshold, cloudHysteresis);
-  Serial.printf("Monitoring Window: %d mins\n", monitoringWindow);
-  Serial.printf("Location: %f, %f\n", locationLatitude, locationLongitude);
-  Serial.printf("Time settings: TZ=%d, DST=%d\n", timezoneOffsetSec, daylightOffsetSec);
-  Serial.printf("Relay Logic: %s\n", relayOn == HIGH ? "Active HIGH" : "Active LOW");
-  Serial.printf("Auth credentials: %s / %s\n", http_username, http_password);
-  Serial.printf("Device Name: %s\n", deviceName);
+  static EnergyRecord record;
+  EEPROM.get(ENERGY_EEPROM_START, record);
+  if (!energyMeter.load(record)) {
+    TRACE_WARN(TR_ENERGY_RESET);
+  }
+  energyLoaded = true;
 }
 
 
 //================ WIFI FUNCTIONS ================
 void connectToWiFi() {
-  Serial.println("Connecting to WiFi");
+  TRACE_INFO(TR_WIFI_CONNECTING);
   WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
 
   unsigned long startAttemptTime = millis();
@@ -246,12 +439,11 @@ void connectToWiFi() {
   }
 
   if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("Connected to WiFi");
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
+    IPAddress ip = WiFi.localIP();
+    TRACE_INFO(TR_WIFI_CONNECTED, ip[0], ip[1], ip[2], ip[3]);
     digitalWrite(ERROR_LED_PIN, LOW);
   } else {
-    Serial.println("Failed to connect to WiFi");
+    TRACE_ERROR(TR_WIFI_FAILED);
   }
 }
 
@@ -261,7 +453,7 @@ void enableWiFi() {
     WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
     wifiEnabled = true;
     lastTimeSync = 0; 
-    Serial.println("WiFi enabled");
+    TRACE_INFO(TR_WIFI_ENABLED);
   }
 }
 
@@ -275,9 +467,11 @@ void updateLocalTime() {
         delay(100);
     }
   
-  Serial.print("Current time (GMT): ");
-  Serial.println(timeClient.getFormattedTime());
+  TRACE_INFO(TR_NTP_TIME, timeClient.getHours(), timeClient.getMinutes(), timeClient.getSeconds());
+  metrics.set(MG_NTP_OFFSET, (int32_t)(timeClient.getEpochTime() - now()));
   setTime(timeClient.getEpochTime());
+  uint32_t epoch = timeClient.getEpochTime();
+  inputTrace.record(IT_NTP, millis(), &epoch, sizeof(epoch));
   digitalWrite(ERROR_LED_PIN, LOW);
 }
 
@@ -294,285 +488,337 @@ void setTime_lf(int hours, int minutes) {
   setTime(newTime);
 }
 
-//================ SYSTEM STATE STRING HELPER ================
-String getSystemStateString() {
-    String stateStr = "";
+//================ STATUS FORMATTING HELPERS ================
+size_t formatSystemState(char *out, size_t size) {
     int currentTime = hour() * 60 + minute();
     int sunriseTime = sunriseHour * 60 + sunriseMinute;
-    int sunsetTime = sunsetHour * 60 + sunsetMinute;
     
     switch (currentState) {
-        case MONITORING: {
-            stateStr = "Monitoring clouds (" + 
-                      String(TIME_OFFSET_MONITORING) + " min before ";
-            if (currentTime < sunriseTime) {
-                stateStr += "sunrise)";
-            } else {
-                stateStr += "sunset)";
-            }
-            break;
-        }
-        case ACTIVE: {
-            stateStr = "Triggered";
-            break;
-        }
-        case SCHEDULED: {
-            stateStr = "Scheduled ";
-            break;
-        }
+        case MONITORING:
+            return snprintf_P(out, size, PSTR("Monitoring clouds (%d min before %s)"), 
+                              TIME_OFFSET_MONITORING, currentTime < sunriseTime ? "sunrise" : "sunset");
+        case ACTIVE:
+            return snprintf_P(out, size, PSTR("Triggered"));
+        case SCHEDULED:
+            return snprintf_P(out, size, PSTR("Scheduled "));
         case MANUAL: {
             int remainingMinutes = manualOverrideDuration - ((millis() - manualOverrideStartTime) / 60000);
-            stateStr = "Manual override (" + String(remainingMinutes) + " min remaining)";
-            break;
-        }
-        case NORMAL: {
-            stateStr = "Normal";
-            break;
-        }
-        default: {
-            stateStr = "Normal Operation";
+            return snprintf_P(out, size, PSTR("Manual override (%d min remaining)"), remainingMinutes);
         }
+        case NORMAL:
+            return snprintf_P(out, size, PSTR("Normal"));
+        default:
+            return snprintf_P(out, size, PSTR("Normal Operation"));
+    }
+}
+
+size_t formatCloudStatus(char *out, size_t size) {
+    switch (cloudStatus) {
+        case CLOUD_WIFI_DISCONNECTED:
+            return snprintf_P(out, size, PSTR("WiFi disconnected"));
+        case CLOUD_FETCH_ERROR:
+            return snprintf_P(out, size, PSTR("Error fetching data"));
+        case CLOUD_MAX_RETRIES:
+            return snprintf_P(out, size, PSTR("Max retries reached"));
+        case CLOUD_COVERAGE_READ:
+            return snprintf_P(out, size, PSTR("%.2f%% cloud coverage"), currentCloudCoverage);
+        case CLOUD_ACTIVATING:
+            return snprintf_P(out, size, PSTR("Activating (Cloud coverage: %.2f%%)"), currentCloudCoverage);
+        case CLOUD_NORMAL:
+            return snprintf_P(out, size, PSTR("Normal (Cloud coverage: %.2f%%)"), currentCloudCoverage);
+        case CLOUD_SCHEDULED:
+            return snprintf_P(out, size, PSTR("Scheduled"));
+        case CLOUD_NOT_MONITORING:
+        default:
+            return snprintf_P(out, size, PSTR("Not monitoring"));
     }
-    return stateStr;
+}
+
+void trackHeapUsage() {
+    uint32_t freeHeap = ESP.getFreeHeap();
+    if (freeHeap < minFreeHeap) minFreeHeap = freeHeap;
 }
 
 //================ MONITORING WINDOW CHECK ================
+DecisionParams currentDecisionParams() {
+    DecisionParams params;
+    params.sunriseTime = sunriseHour * 60 + sunriseMinute;
+    params.sunsetTime = sunsetHour * 60 + sunsetMinute;
+    params.monitoringWindow = monitoringWindow;
+    params.cloudThreshold = cloudThreshold;
+    params.cloudHysteresis = cloudHysteresis;
+    params.maxRetries = maxRetries;
+    return params;
+}
+
 bool isWithinMonitoringWindow(int currentHour, int currentMinute) {
-    int currentTime = currentHour * 60 + currentMinute;
-    int sunriseTime = sunriseHour * 60 + sunriseMinute;
-    int sunsetTime = sunsetHour * 60 + sunsetTime;
-    
-    bool beforeSunrise = (currentTime >= (sunriseTime - monitoringWindow) && 
-                         currentTime < sunriseTime);
-    bool beforeSunset = (currentTime >= (sunsetTime - monitoringWindow) && 
-                        currentTime < sunsetTime);
-    
-    isMonitoring = (beforeSunrise || beforeSunset);
-    
-    return isMonitoring;
+    return updateMonitoringWindow(decision, currentDecisionParams(), currentHour * 60 + currentMinute);
 }
 
-String getFormattedTimeForAPI() {
-    time_t now = timeClient.getEpochTime();
-    char buffer[25];
-    
-    // Format: YYYY-MM-DDThh:00
-    sprintf(buffer, "%04d-%02d-%02dT%02d:00", 
-            year(now),
-            month(now),
-            day(now),
-            hour(now));
-            
-    return String(buffer);
+// The forecast is requested and cached in GMT, while timeClient runs on local time
+uint32_t utcNow() {
+    return timeClient.getEpochTime() - (timezoneOffsetSec + daylightOffsetSec);
 }
 
-float getCloudCoverage() {
+// Fills `cache` from an Open-Meteo hourly payload with the variables in
+// FORECAST_COLUMN_NAMES. The payload is parsed in place, so its strings are
+// not copied into the document.
+ForecastParseResult parseForecast(char *payload, ForecastCache &cache) {
+  // Every array element but the last is followed by a comma, so this bounds
+  // the number of values whatever the forecast length
+  size_t elements = 2;
+  for (const char *c = payload; *c; c++) {
+    if (*c == ',') elements++;
+  }
+  DynamicJsonDocument doc(JSON_OBJECT_SIZE(16) + JSON_ARRAY_SIZE(elements));
 
-  if (WiFi.status() != WL_CONNECTED) {
-    cloudStatus = "WiFi disconnected";
-    return -1;
+  DeserializationError error = deserializeJson(doc, payload);
+  if (error) return FORECAST_PARSE_JSON_ERROR;
+
+  JsonObject hourly = doc["hourly"];
+  JsonArray timeArray = hourly["time"];
+
+  // Hours are consecutive, so only the first timestamp is needed
+  const char *firstTime = timeArray[0];
+  tmElements_t tm;
+  int y, mo, d, h, mi;
+  if (firstTime == NULL || sscanf(firstTime, "%d-%d-%dT%d:%d", &y, &mo, &d, &h, &mi) != 5) {
+    return FORECAST_PARSE_NO_MATCH;
+  }
+  tm.Year = y - 1970;
+  tm.Month = mo;
+  tm.Day = d;
+  tm.Hour = h;
+  tm.Minute = 0;
+  tm.Second = 0;
+
+  size_t hours = timeArray.size();
+  if (hours > FORECAST_CACHE_HOURS) hours = FORECAST_CACHE_HOURS;
+  // A variable the provider left out reads as missing for every hour
+  for (uint8_t c = 0; c < FC_COUNT; c++) {
+    FlashName name = forecastColumnName(c);
+    JsonArray column = hourly[name.c_str()];
+    for (size_t i = 0; i < hours; i++) {
+      JsonVariant value = column[i];
+      cache.set((ForecastColumn)c, i, value.isNull() ? NAN : value.as<float>());
+    }
+  }
+  cache.startEpoch = makeTime(tm);
+  cache.hours = hours;
+  return FORECAST_PARSE_OK;
+}
+
+// ForecastBodyHandler for forecastClient: a provider's answer only counts
+// once it parses, so a broken one leaves the race to the others
+bool acceptForecast(char *body, size_t len, void *ctx) {
+  ForecastParseResult result = parseForecast(body, forecastCache);
+  if (result == FORECAST_PARSE_NO_MATCH) {
+    metrics.inc(MC_FORECAST_NO_MATCH);
+  } else if (result == FORECAST_PARSE_JSON_ERROR) {
+    metrics.inc(MC_FORECAST_JSON_ERROR);
+    TRACE_ERROR(TR_FORECAST_JSON_ERROR);
   }
+  return result == FORECAST_PARSE_OK;
+}
 
-  WiFiClient client;
-  HTTPClient http;
+// Fetches the forecast into forecastCache from the first provider to answer;
+// the leader of a sharing site then passes it on to its peers
+bool fetchForecast(uint32_t utc) {
+  MetricTimer timer(MH_FORECAST_FETCH);
 
-  String timeStr = getFormattedTimeForAPI();
-  String url = String("http://") + API_HOST + "/v1/forecast?latitude=" +
-               String(LATITUDE, 4) + "&longitude=" + String(LONGITUDE, 4) +
-               "&hourly=cloud_cover";
+  if (WiFi.status() != WL_CONNECTED) {
+    metrics.inc(MC_FORECAST_WIFI_DOWN);
+    cloudStatus = CLOUD_WIFI_DISCONNECTED;
+    inputTrace.record(IT_FETCH_FAILED, millis());
+    return false;
+  }
 
-  http.begin(client, url);
-  int httpCode = http.GET();
+  char path[224];
+  int len = snprintf_P(path, sizeof(path), PSTR("/v1/forecast?latitude=%.4f&longitude=%.4f&forecast_days=%d&hourly="),
+                       locationLatitude, locationLongitude, FORECAST_DAYS);
+  for (uint8_t c = 0; c < FC_COUNT; c++) {
+    len += snprintf_P(path + len, sizeof(path) - len, PSTR("%s%s"), c == 0 ? "" : ",", forecastColumnName(c).c_str());
+  }
 
-  if (httpCode > 0) {
-    String payload = http.getString();
+  bool fetched = forecastClient.fetch(path, FORECAST_TIMEOUT_MS, acceptForecast, NULL) >= 0;
+  if (fetched) {
+    metrics.inc(MC_FORECAST_OK);
+    forecastCache.fetchedAt = utc;
+  } else if (forecastClient.getLastStatus() != 200) {
+    metrics.inc(MC_FORECAST_HTTP_ERROR);
+    TRACE_ERROR(TR_FORECAST_HTTP_ERROR, forecastClient.getLastStatus());
+  }
 
-    const size_t capacity = 500;
-    DynamicJsonDocument doc(capacity);
+  if (fetched) {
+    traceForecast();
+    forecastShare.publish(forecastCache, utc, locationLatitude, locationLongitude);
+  } else {
+    inputTrace.record(IT_FETCH_FAILED, millis());
+  }
+  return fetched;
+}
 
-    DeserializationError error = deserializeJson(doc, payload);
+// Cloud cover for the decision: the sky model's darkness for the current
+// hour, from cloud layers, precipitation and radiation
+bool lookupCloudCoverage(uint32_t utc, float &cloudCover) {
+  ForecastHour hour;
+  if (!forecastCache.lookup(utc, hour)) return false;
+  cloudCover = effectiveCloudCover(hour, solarElevation(utc, locationLatitude, locationLongitude));
+  return cloudCover >= 0;
+}
 
-    if (!error) {
-      JsonArray timeArray = doc["hourly"]["time"];
-      JsonArray cloudCoverArray = doc["hourly"]["cloud_cover"];
+float getCloudCoverage() {
+  uint32_t utc = utcNow();
+  float cloudCover;
 
-      int indexMatch = -1;
-      for (int i = 0; i < timeArray.size(); i++) {
-        if (timeArray[i].as<String>() == timeStr) {
-          indexMatch = i;
-          break;
-        }
-      }
+  if (forecastCache.isFresh(utc) && lookupCloudCoverage(utc, cloudCover)) {
+    metrics.inc(MC_FORECAST_CACHE_HIT);
+    return cloudCover;
+  }
 
-      if (indexMatch != -1) {
-        float cloudCover = cloudCoverArray[indexMatch];
-        http.end();
-        return cloudCover;
-      }
-    } else {
-      Serial.println("JSON deserialization error");
+  // Followers use whatever the leader last sent rather than fetching
+  if (forecastShare.getRole() == SHARE_FOLLOWER) {
+    if (lookupCloudCoverage(utc, cloudCover)) {
+      metrics.inc(MC_FORECAST_CACHE_HIT);
+      return cloudCover;
     }
-  } else {
-    Serial.printf("HTTP GET failed, error: %s\n", http.errorToString(httpCode).c_str());
+  } else if (fetchForecast(utc) && lookupCloudCoverage(utc, cloudCover)) {
+    return cloudCover;
   }
 
-  http.end();
-  cloudStatus = "Error fetching data";
+  metrics.inc(MC_FORECAST_CACHE_MISS);
+  cloudStatus = CLOUD_FETCH_ERROR;
   return -1;
 }
 
 //================ MODIFIED CLOUD MONITORING FUNCTION ================
-bool monitorCloudConditions(bool isSunrise) {
-    if (monitoring_retry_count >= maxRetries) {
-        monitoring_retry_count = 0;
-        cloudStatus = "Max retries reached";
-        
-        if (isSunrise) {
-            monitoring_sunrise = false;
-            TIME_RISE_OFFSET_ADDITIONAL = 0;
-        } else {
-            monitoring_sunset = false;
-            TIME_SET_OFFSET_ADDITIONAL = 0;
-        }
-        
-        return false; // Don't activate lights on retry failure
-    }
-    
+// Cloud sample source for the decision core: logs good samples and backs off briefly on errors
+float sampleCloudCoverage() {
     float cloudCoverage = getCloudCoverage();
-    currentCloudCoverage = cloudCoverage; 
     
     if (cloudCoverage < 0) {
-        cloudStatus = "Error fetching data";
-        monitoring_retry_count++;
         delay(1000); // Short delay
-        return false; // Don't activate yet, will retry later
+        return cloudCoverage;
     }
     
-    logManager.logCloudCoverage(cloudCoverage);
-    
-    monitoring_retry_count = 0;
-    cloudStatus = String(cloudCoverage) + "% cloud coverage";
-    
-    bool shouldActivate = false;
-    
-    if (cloudCoverage > cloudThreshold) {
-        shouldActivate = true;
-        cloudStatus = "Activating (Cloud coverage: " + String(cloudCoverage) + "%)";
-        cloudTriggeredActivation = true;
-        currentState = ACTIVE;
-    } else if (cloudCoverage < (cloudThreshold - cloudHysteresis)) {
-        shouldActivate = false;
-        cloudStatus = "Normal (Cloud coverage: " + String(cloudCoverage) + "%)";
-    } else {
-        shouldActivate = cloudTriggeredActivation;
+    logCloudSample(cloudCoverage);
+    return cloudCoverage;
+}
+
+// Samples come from the cache on every pass, so log each forecast hour once
+void logCloudSample(float cloudCoverage) {
+    uint32_t forecastHour = utcNow() / 3600;
+    if (forecastHour != lastCloudLogHour) {
+        logManager.logCloudCoverage(cloudCoverage);
+        lastCloudLogHour = forecastHour;
     }
-    
-    if (isSunrise) {
-        monitoring_sunrise = !shouldActivate; 
-    } else {
-        monitoring_sunset = !shouldActivate; 
+}
+
+//================ DAY PLAN ================
+#define PLAN_FORECAST_LEAD_MIN 60    // The forecast is kept fresh from this long before a window
+#define PLAN_FETCH_RETRY_MS 60000
+
+// PlanCloudLookup over forecastCache; ctx is the plan's local midnight
+float planCloudAt(void *ctx, int minute) {
+    uint32_t utc = *(uint32_t *)ctx - (timezoneOffsetSec + daylightOffsetSec) + minute * 60;
+    float cloudCover;
+    return lookupCloudCoverage(utc, cloudCover) ? cloudCover : -1;
+}
+
+void rebuildDayPlan(uint32_t dayStart, const DecisionParams &params) {
+    uint32_t start = micros();
+    buildDayPlan(dayPlan, params, dayStart, forecastCache.fetchedAt, planCloudAt, &dayStart);
+    metrics.inc(MC_PLAN_BUILDS);
+    TRACE_INFO(TR_PLAN_BUILT, dayPlan.count, micros() - start);
+}
+
+// Today's plan entry for the current minute, rebuilt first when the day,
+// the settings or the forecast changed. NULL until the clock is set.
+const PlanEntry *currentPlanEntry(time_t localNow) {
+    if (!clockIsSet(utcNow())) return NULL;
+    uint32_t dayStart = localNow - localNow % SECS_PER_DAY;
+    DecisionParams params = currentDecisionParams();
+    if (!dayPlan.valid || dayPlan.dayStart != dayStart || dayPlan.forecastFetchedAt != forecastCache.fetchedAt ||
+        !sameDecisionParams(dayPlan.params, params)) {
+        rebuildDayPlan(dayStart, params);
     }
-    
-    return shouldActivate;
+    return planEntryAt(dayPlan, (localNow - dayStart) / 60);
+}
+
+bool isNearWindow(const DecisionParams &p, int minute, int eventTime) {
+    return minute >= eventTime - p.monitoringWindow - PLAN_FORECAST_LEAD_MIN && minute < eventTime;
+}
+
+// Nothing samples the forecast while the plan runs, so it is fetched here
+// ahead of and during the windows; a new forecast rebuilds the plan
+void refreshPlanForecast(int minute) {
+    const DecisionParams &p = dayPlan.params;
+    if (!isNearWindow(p, minute, p.sunriseTime) && !isNearWindow(p, minute, p.sunsetTime)) return;
+    uint32_t utc = utcNow();
+    if (forecastCache.isFresh(utc) || forecastShare.getRole() == SHARE_FOLLOWER) return;
+    if (lastPlanFetchMs != 0 && millis() - lastPlanFetchMs < PLAN_FETCH_RETRY_MS) return;
+    lastPlanFetchMs = millis();
+    fetchForecast(utc);
+}
+
+// Puts the decision state where the live evaluation would have left it
+bool applyPlanEntry(const PlanEntry &e) {
+    currentState = (SystemState)e.state;
+    cloudStatus = (CloudStatus)e.cloudStatus;
+    cloudTriggeredActivation = e.cloudTriggered;
+    currentCloudCoverage = e.cloudCoverage;
+    if (isMonitoring && e.cloudCoverage >= 0) logCloudSample(e.cloudCoverage);
+    return e.lightOn;
 }
 
 //================ LIGHT CONTROL FUNCTION ================
-bool shouldActivateLights(int currentHour, int currentMinute) {
-    int currentTime = currentHour * 60 + currentMinute;
-    int sunriseTime = sunriseHour * 60 + sunriseMinute;
-    int sunsetTime = sunsetHour * 60 + sunsetMinute;
-    
-    // Check if we're in a monitoring window
-    bool beforeSunrise = (currentTime >= (sunriseTime - monitoringWindow) && 
-                         currentTime < sunriseTime);
-    bool beforeSunset = (currentTime >= (sunsetTime - monitoringWindow) && 
-                        currentTime < sunsetTime);
-                        
-    // Normal light activation schedule (night time)
-    bool isNightTime = (currentTime < sunriseTime || currentTime >= sunsetTime);
-    
-    // Check if we should be monitoring clouds
-    if (beforeSunrise && monitoring_sunrise) {
-        bool activateEarly = monitorCloudConditions(true);
-        if (activateEarly) {
-            return true;
-        }
-    }
-    
-    if (beforeSunset && monitoring_sunset) {
-        bool activateEarly = monitorCloudConditions(false);
-        if (activateEarly) {
-            return true;
-        }
-    }
-    
-    if (cloudTriggeredActivation && (beforeSunrise || beforeSunset)) {
-        return true;
-    }
-    
-    // Normal schedule (night time) activation
-    if (isNightTime) {
-        currentState = SCHEDULED;
-        cloudStatus = "Scheduled";
-        if (!beforeSunrise && !beforeSunset) {
-            cloudTriggeredActivation = false;
-        }
-        return true;
+// The first caller in a loop pass takes the sample; the rest reuse it
+float tickCloudSample() {
+    if (!tickCloudSampled) {
+        tickCloudCoverage = sampleCloudCoverage();
+        tickCloudSampled = true;
     }
-    
-    currentState = NORMAL;
-    return false;
+    return tickCloudCoverage;
+}
+
+bool shouldActivateLights(int currentHour, int currentMinute) {
+    return shouldActivateLights(decision, currentDecisionParams(), currentHour * 60 + currentMinute,
+                                tickCloudSample);
 }
 
 //================ MODIFIED TIME FORMATTING FUNCTION ================
-String formatTime(double minutesFromMidnight, bool isSunrise) {
-    int hours = int(minutesFromMidnight / 60);
-    int minutes = int(minutesFromMidnight) % 60;
-    
+// Applies the configured offsets and returns minutes from midnight (0-1439)
+int adjustSunTime(double minutesFromMidnight, bool isSunrise) {
     int timeOffset = isSunrise ? sunriseOffset : sunsetOffset;
     int additionalOffset = isSunrise ? TIME_RISE_OFFSET_ADDITIONAL : TIME_SET_OFFSET_ADDITIONAL;
     
-    int totalOffset = timeOffset + additionalOffset;
-    int totalMinutes = (hours * 60 + minutes) - totalOffset;
-    
-    if (totalMinutes < 0) {
-        totalMinutes += 24 * 60;
-    }
-    
-    hours = (totalMinutes / 60) % 24;
-    minutes = totalMinutes % 60;
-    
-    char timeStr[6];
-    sprintf(timeStr, "%d:%02d", hours, minutes);
-    return String(timeStr);
+    return applySunOffset(minutesFromMidnight, timeOffset + additionalOffset);
 }
 
-void updateSunriseSunsetTime() {
+// Today's sun times with offsets applied, in minutes from midnight
+void computeSunTimes(int &sunriseTime, int &sunsetTime) {
     sun.setCurrentDate(year(), month(), day());
     sun.setTZOffset((timezoneOffsetSec + daylightOffsetSec) / 3600.0);
     sun.setPosition(locationLatitude, locationLongitude, (timezoneOffsetSec + daylightOffsetSec) / 3600.0);
     
-    double sunrise = sun.calcSunrise();
-    double sunset = sun.calcSunset();
-    
-    String sunriseTime = formatTime(sunrise, true);
-    String sunsetTime = formatTime(sunset, false);
-    
-    int colonIndex = sunriseTime.indexOf(':');
-    if (colonIndex > 0) {
-        sunriseHour = sunriseTime.substring(0, colonIndex).toInt();
-        sunriseMinute = sunriseTime.substring(colonIndex + 1).toInt();
-    }
-    
-    colonIndex = sunsetTime.indexOf(':');
-    if (colonIndex > 0) {
-        sunsetHour = sunsetTime.substring(0, colonIndex).toInt();
-        sunsetMinute = sunsetTime.substring(colonIndex + 1).toInt();
-    }
+    sunriseTime = adjustSunTime(sun.calcSunrise(), true);
+    sunsetTime = adjustSunTime(sun.calcSunset(), false);
+}
+
+void recomputeSunTimes() {
+    int sunriseTime, sunsetTime;
+    computeSunTimes(sunriseTime, sunsetTime);
     
-    Serial.printf("Updated sun times - Sunrise: %02d:%02d, Sunset: %02d:%02d\n", 
-                 sunriseHour, sunriseMinute, sunsetHour, sunsetMinute);
+    sunriseHour = sunriseTime / 60;
+    sunriseMinute = sunriseTime % 60;
+    sunsetHour = sunsetTime / 60;
+    sunsetMinute = sunsetTime % 60;
     
+    TRACE_INFO(TR_SUN_TIMES, sunriseHour, sunriseMinute, sunsetHour, sunsetMinute);
+}
+
+void updateSunriseSunsetTime() {
+    recomputeSunTimes();
     saveSettings();
 }
 
@@ -586,229 +832,736 @@ bool isDaylight(int currentHour, int currentMinute, int sunriseHour, int sunrise
     return (currentTime >= sunriseTime && currentTime < sunsetTime);
 }
 
+// Every relay change goes through here so switch counts stay accurate
+void writeRelay(bool on) {
+    int level = on ? relayOn : relayOff;
+    if (digitalRead(RELAY_PIN) != level) {
+        metrics.inc(MC_RELAY_SWITCHES);
+    }
+    digitalWrite(RELAY_PIN, level);
+}
+
 void toggleLights(bool on) {
-    digitalWrite(RELAY_PIN, on ? relayOn : relayOff);
+    writeRelay(on);
     digitalWrite(STATUS_LED_PIN, on);
     
+    uint8_t state = on;
+    inputTrace.record(IT_RELAY, millis(), &state, sizeof(state));
+    
     logManager.logLightState(on);
 }
 
-
-//================ WEB SERVER HANDLERS ================
-void handleRoot() {
-    Serial.println("Auth header: " + server.header("Authorization"));
+void writeZoneRelay(int index, bool on) {
+    const ZoneConfig &z = zones[index];
+    if (z.pin == ZONE_NO_PIN) return;
     
-    if (!server.authenticate(http_username, http_password)) {
-        Serial.printf("Authentication failed. Expected: %s/%s\n", http_username, http_password);
-        for (int i = 0; i < server.headers(); i++) {
-            Serial.printf("Header[%s]: %s\n", 
-                        server.headerName(i).c_str(), 
-                        server.header(i).c_str());
-        }
-        return server.requestAuthentication(BASIC_AUTH, "Light Controller", "Authentication Failed");
+    int level = on == ((z.flags & ZONE_ACTIVE_HIGH) != 0) ? HIGH : LOW;
+    if (digitalRead(z.pin) != level) {
+        metrics.inc(MC_RELAY_SWITCHES);
     }
-    
-    Serial.println("Authentication successful, sending root page");
-    String page = String(INDEX_HTML);
-    bool isLightOn = (digitalRead(RELAY_PIN) == relayOn);
-    String stateInfo = getSystemStateString();
-    
-    page.replace("[COLOR_STATUS]", isLightOn ? "#4CAF50" : "#ff4444");
-    page.replace("[LIGHT_STATE]", isLightOn ? "ON" : "OFF");
-    page.replace("[CURRENT_TIME]", timeClient.getFormattedTime());
-    page.replace("[BUTTON_TEXT]", isLightOn ? "Turn Off" : "Turn On");
-    page.replace("[BUTTON_ICON]", isLightOn ? "&#127769;" : "&#9728;");
-    page.replace("[CLOUD_COVERAGE]", currentCloudCoverage < 0 ? "Unknown" : String(currentCloudCoverage, 1));
-    page.replace("[CLOUD_STATUS]", isMonitoring ? stateInfo : cloudStatus);
-    page.replace("[CLOUD_THRESHOLD]", String(cloudThreshold));
-    page.replace("[CLOUD_HYSTERESIS]", String(cloudHysteresis));
-    page.replace("[MONITORING_WINDOW]", String(monitoringWindow));
-    page.replace("[OVERRIDE_DURATION]", String(manualOverrideDuration)); 
-    page.replace("[SUNRISE_HOUR]", String(sunriseHour));
-    page.replace("[SUNRISE_MINUTE]", String(sunriseMinute < 10 ? "0" : "") + String(sunriseMinute));
-    page.replace("[SUNSET_HOUR]", String(sunsetHour));
-    page.replace("[SUNSET_MINUTE]", String(sunsetMinute < 10 ? "0" : "") + String(sunsetMinute));
-    page.replace("[ADMIN_USERNAME]", String(adminUsername));
-    page.replace("[MAX_RETRIES]", String(maxRetries));
-    page.replace("[TIMEZONE_OFFSET]", String(timezoneOffsetSec));
-    page.replace("[DAYLIGHT_OFFSET]", String(daylightOffsetSec));
-    page.replace("[SUNRISE_OFFSET]", String(sunriseOffset));
-    page.replace("[SUNSET_OFFSET]", String(sunsetOffset));
-    page.replace("[LATITUDE]", String(locationLatitude, 6));
-    page.replace("[LONGITUDE]", String(locationLongitude, 6));
-    page.replace("[DEVICE_NAME]", String(deviceName));
-    page.replace("[RELAY_LOW_SELECTED]", relayOn == LOW ? "selected" : "");
-    page.replace("[RELAY_HIGH_SELECTED]", relayOn == HIGH ? "selected" : "");
-    
-    server.send(200, "text/html", page);
-    ESP.wdtFeed();
+    digitalWrite(z.pin, level);
 }
 
-void handleSetTime() {
-    if (!server.authenticate(http_username, http_password)) {
-        return server.requestAuthentication();
-    }
-
-    bool changed = false;
+void setZoneLight(int index, bool on) {
+    zoneRuntime[index].lightOn = on;
+    writeZoneRelay(index, on);
+    logManager.logLightState(on, index + 1);
+    TRACE_INFO_S(TR_ZONE_LIGHTS, on ? "ON" : "OFF", index + 1);
+}
 
-    if (server.hasArg("sunriseHour")) {
-        int newHour = constrain(server.arg("sunriseHour").toInt(), 0, 23);
-        if (sunriseHour != newHour) {
-            sunriseHour = newHour;
-            changed = true;
-        }
-    }
-    
-    if (server.hasArg("sunriseMinute")) {
-        int newMinute = constrain(server.arg("sunriseMinute").toInt(), 0, 59);
-        if (sunriseMinute != newMinute) {
-            sunriseMinute = newMinute;
-            changed = true;
-        }
-    }
-    
-    if (server.hasArg("sunsetHour")) {
-        int newHour = constrain(server.arg("sunsetHour").toInt(), 0, 23);
-        if (sunsetHour != newHour) {
-            sunsetHour = newHour;
-            changed = true;
-        }
+// Drives every assigned zone pin to its zone's current state
+void setupZonePins() {
+    for (int i = 0; i < MAX_ZONES; i++) {
+        if (zones[i].pin == ZONE_NO_PIN) continue;
+        pinMode(zones[i].pin, OUTPUT);
+        writeZoneRelay(i, zoneRuntime[i].lightOn);
     }
-    
-    if (server.hasArg("sunsetMinute")) {
-        int newMinute = constrain(server.arg("sunsetMinute").toInt(), 0, 59);
-        if (sunsetMinute != newMinute) {
-            sunsetMinute = newMinute;
-            changed = true;
+}
+
+// All zones in one pass against this tick's sun times and cloud sample
+void updateZones() {
+    time_t now = timeClient.getEpochTime();
+    ZoneTick tick;
+    tick.currentTime = hour(now) * 60 + minute(now);
+    tick.sunriseTime = sunriseHour * 60 + sunriseMinute;
+    tick.sunsetTime = sunsetHour * 60 + sunsetMinute;
+    tick.maxRetries = maxRetries;
+    tick.nowMs = millis();
+    tick.overrideMs = manualOverrideDuration * 60000UL;
+    tick.cloudSource = tickCloudSample;
+    
+    uint32_t changed = evaluateZones(zones, zoneRuntime, MAX_ZONES, tick);
+    for (int i = 0; changed != 0; i++, changed >>= 1) {
+        if (changed & 1) {
+            setZoneLight(i, zoneRuntime[i].lightOn);
         }
     }
+}
 
-    if (changed) {
-        Serial.printf("Saving new times - Sunrise: %02d:%02d, Sunset: %02d:%02d\n", 
-                    sunriseHour, sunriseMinute, sunsetHour, sunsetMinute);
-        saveSettings();
-        monitoring_sunrise = true;
-        monitoring_sunset = true;
-    }
-    
-    server.sendHeader("Location", "/");
-    server.send(303);
+
+//================ ENERGY ================
+EnergyCause zoneEnergyCause(const ZoneRuntime &rt) {
+    if (rt.override) return CAUSE_MANUAL;
+    return rt.decision.cloudTriggered ? CAUSE_CLOUD : CAUSE_SCHEDULE;
 }
 
-void handleToggle() {
-    if (!server.authenticate(http_username, http_password)) {
-        return server.requestAuthentication();
+float circuitLoadWatts(int circuit) {
+    return circuit == 0 ? MAIN_LOAD_WATTS : zones[circuit - 1].loadTensW * 10.0f;
+}
+
+// Hands every relay's state to the meter, which only does work when one
+// switched, and checkpoints counters that changed once the interval is up
+void trackEnergy() {
+    if (!clockIsSet(utcNow())) return;
+    uint32_t now = timeClient.getEpochTime();
+    
+    EnergyCause mainCause = manualOverride ? CAUSE_MANUAL : cloudTriggeredActivation ? CAUSE_CLOUD : CAUSE_SCHEDULE;
+    energyMeter.update(0, digitalRead(RELAY_PIN) == relayOn, mainCause, now);
+    for (int i = 0; i < MAX_ZONES; i++) {
+        bool on = zoneRuntime[i].lightOn && zones[i].pin != ZONE_NO_PIN;
+        energyMeter.update(i + 1, on, zoneEnergyCause(zoneRuntime[i]), now);
     }
     
-    manualOverride = true;
-    manualOverrideStartTime = millis();
-    manualLightState = !(digitalRead(RELAY_PIN) == relayOn);
-    
-    digitalWrite(RELAY_PIN, manualLightState ? relayOn : relayOff);
-    digitalWrite(STATUS_LED_PIN, manualLightState);
-    
-    currentState = MANUAL;
-    
-    Serial.print("Manual light toggled to: ");
-    Serial.println(manualLightState ? "ON" : "OFF");
-    
-    if (server.hasArg("api")) {
-        String jsonResponse = "{\"success\":true,\"state\":\"" + String(manualLightState ? "on" : "off") + "\"}";
-        server.send(200, "application/json", jsonResponse);
-    } else {
-        server.sendHeader("Location", "/");
-        server.send(303);
+    if (energyMeter.needsCheckpoint() && millis() - lastEnergyCheckpointMs >= ENERGY_CHECKPOINT_MS) {
+        commitEeprom();
     }
 }
 
-void handleCloudMonitoring() {
-    if (!server.authenticate(http_username, http_password)) {
-        return server.requestAuthentication();
+void writeEnergyPeriod(ScratchWriter &out, const char *name, int circuit, EnergyPeriod period, uint32_t now) {
+    uint32_t total = energyMeter.getTotalSeconds(circuit, period, now);
+    out.printf_P(PSTR("\"%s\":{"), name);
+    for (int cause = 0; cause < CAUSE_COUNT; cause++) {
+        out.printf_P(PSTR("\"%s\":%u,"), energyCauseName(cause).c_str(), energyMeter.getSeconds(circuit, period, (EnergyCause)cause, now));
     }
+    out.printf_P(PSTR("\"totalSec\":%u,\"kWh\":%.3f}"), total, energyKWh(total, circuitLoadWatts(circuit)));
+}
 
-    float newCloudCoverage = getCloudCoverage();
-    bool success = (newCloudCoverage >= 0);
-    
-    if (success) { 
-        currentCloudCoverage = newCloudCoverage;
-        
-        if (isWithinMonitoringWindow(hour(), minute())) {
-            if (currentCloudCoverage > CLOUD_COVERAGE_THRESHOLD) {
-                cloudTriggeredActivation = true;
-                currentState = ACTIVE;
-                digitalWrite(RELAY_PIN, relayOn);
-            }
-        }
-    }
-    if (server.hasArg("api")) {
-        String jsonResponse = "{\"success\":" + String(success ? "true" : "false") + 
-                             ",\"cloudCoverage\":" + String(currentCloudCoverage) +
-                             ",\"isMonitoring\":" + String(isMonitoring ? "true" : "false") +
-                             ",\"status\":\"" + cloudStatus + "\"}";
-        server.send(200, "application/json", jsonResponse);
+void writeEnergyCircuit(ScratchWriter &out, int circuit, uint32_t now) {
+    out.printf_P(PSTR("{\"id\":%d,\"on\":%s,\"cause\":"), circuit, energyMeter.isOn(circuit) ? "true" : "false");
+    if (energyMeter.isOn(circuit)) {
+        out.printf_P(PSTR("\"%s\""), energyCauseName(energyMeter.getCause(circuit)).c_str());
     } else {
-        server.sendHeader("Location", "/");
-        server.send(303);
+        out.printf_P(PSTR("null"));
     }
+    out.printf_P(PSTR(",\"loadWatts\":%.0f,"), circuitLoadWatts(circuit));
+    writeEnergyPeriod(out, "today", circuit, PERIOD_TODAY, now);
+    out.printf_P(PSTR(","));
+    writeEnergyPeriod(out, "week", circuit, PERIOD_WEEK, now);
+    out.printf_P(PSTR(","));
+    writeEnergyPeriod(out, "lifetime", circuit, PERIOD_LIFETIME, now);
+    out.printf_P(PSTR("}"));
 }
 
-void handleSystemStatus() {
-    if (!server.authenticate(http_username, http_password)) {
-        return server.requestAuthentication();
+
+//================ INPUT TRACE ================
+// Inputs a replay needs that don't arrive through a hook of their own are
+// compared against what was last recorded once per pass, before the decision
+void captureInputSettings(InputTraceSettings &s) {
+    DecisionParams p = currentDecisionParams();
+    s.sunriseTime = p.sunriseTime;
+    s.sunsetTime = p.sunsetTime;
+    s.monitoringWindow = p.monitoringWindow;
+    s.cloudThreshold = p.cloudThreshold;
+    s.cloudHysteresis = p.cloudHysteresis;
+    s.maxRetries = p.maxRetries;
+    s.overrideDuration = manualOverrideDuration;
+    s.utcOffset = timezoneOffsetSec + daylightOffsetSec;
+    s.latitude = locationLatitude;
+    s.longitude = locationLongitude;
+    s.shareRole = forecastShare.getRole();
+}
+
+// Our own fetches and forecasts from the site's leader alike
+void traceForecast() {
+    if (forecastCache.fetchedAt == tracedForecastAt) return;
+    inputTrace.recordForecast(millis(), forecastCache);
+    tracedForecastAt = forecastCache.fetchedAt;
+}
+
+void traceToggle(uint8_t zone, uint8_t action) {
+    InputTraceToggle toggle = { zone, action };
+    inputTrace.record(IT_TOGGLE, millis(), &toggle, sizeof(toggle));
+}
+
+void recordInputs() {
+    uint32_t nowMs = millis();
+    if (lastInputCheckpointMs == 0 || nowMs - lastInputCheckpointMs >= INPUT_TRACE_CHECKPOINT_MS) {
+        uint32_t epoch = timeClient.getEpochTime();
+        inputTrace.record(IT_CHECKPOINT, nowMs, &epoch, sizeof(epoch));
+        lastInputCheckpointMs = nowMs;
     }
     
-    bool isLightOn = (digitalRead(RELAY_PIN) == relayOn);
-    String stateStr = getSystemStateString();
+    int8_t wifi = WiFi.status() == WL_CONNECTED;
+    if (wifi != tracedWifi) {
+        inputTrace.record(IT_WIFI, nowMs, &wifi, sizeof(wifi));
+        tracedWifi = wifi;
+    }
     
-    DynamicJsonDocument doc(512);
-    doc["success"] = true;
-    doc["lightOn"] = isLightOn;
-    doc["systemState"] = stateStr;
-    doc["cloudCoverage"] = currentCloudCoverage;
-    doc["cloudStatus"] = cloudStatus;
-    doc["isMonitoring"] = isMonitoring;
-    doc["sunriseTime"] = String(sunriseHour) + ":" + (sunriseMinute < 10 ? "0" : "") + String(sunriseMinute);
-    doc["sunsetTime"] = String(sunsetHour) + ":" + (sunsetMinute < 10 ? "0" : "") + String(sunsetMinute);
-    doc["time"] = timeClient.getFormattedTime();
+    InputTraceSettings settings;
+    captureInputSettings(settings);
+    if (memcmp(&settings, &tracedSettings, sizeof(settings)) != 0) {
+        inputTrace.record(IT_SETTINGS, nowMs, &settings, sizeof(settings));
+        tracedSettings = settings;
+    }
     
-    String jsonResponse;
-    serializeJson(doc, jsonResponse);
-    server.send(200, "application/json", jsonResponse);
+    traceForecast();
 }
 
-void handleSaveConfig() {
+
+//================ MQTT TELEMETRY ================
+// Every log entry (state changes, relay switches, cloud samples) is also
+// queued for the broker
+void forwardLogEntry(const LogEntry &entry) {
+    MqttEvent e = { entry.timestamp, entry.type, entry.value, entry.extraData };
+    mqttPublisher.enqueue(e);
+}
+
+// Snapshot sent with every batch
+size_t writeMqttState(char *out, size_t size) {
+    int n = snprintf_P(out, size, PSTR("{\"lightOn\":%s,\"state\":%d,\"cloudCoverage\":%.1f,\"freeHeap\":%u,"
+                       "\"uptime\":%lu,\"relaySwitches\":%u,\"rssi\":%d}"),
+                       digitalRead(RELAY_PIN) == relayOn ? "true" : "false", currentState, currentCloudCoverage,
+                       ESP.getFreeHeap(), millis() / 1000, metrics.getCounter(MC_RELAY_SWITCHES), WiFi.RSSI());
+    return n < 0 ? 0 : n;
+}
+
+
+//================ WEB SERVER HANDLERS ================
+void sendScratch(int code, const char *contentType, ScratchWriter &out) {
+    out.finish();
+    if (out.overflowed()) {
+        server.send_P(500, "application/json", PSTR("{\"success\":false,\"error\":\"response too large\"}"));
+        return;
+    }
+    server.send(code, contentType, out.c_str(), out.length());
+}
+
+// Placeholders in INDEX_HTML, e.g. [LIGHT_STATE]; anything else in
+// brackets is left as it is
+#define ROOT_PAGE_FIELDS(X) \
+    X(COLOR_STATUS) X(LIGHT_STATE) X(CURRENT_TIME) X(BUTTON_TEXT) X(BUTTON_ICON) X(CLOUD_COVERAGE) \
+    X(CLOUD_STATUS) X(CLOUD_THRESHOLD) X(CLOUD_HYSTERESIS) X(MONITORING_WINDOW) X(OVERRIDE_DURATION) \
+    X(SUNRISE_HOUR) X(SUNRISE_MINUTE) X(SUNSET_HOUR) X(SUNSET_MINUTE) X(ADMIN_USERNAME) X(MAX_RETRIES) \
+    X(TIMEZONE_OFFSET) X(DAYLIGHT_OFFSET) X(SUNRISE_OFFSET) X(SUNSET_OFFSET) X(LATITUDE) X(LONGITUDE) \
+    X(DEVICE_NAME) X(RELAY_LOW_SELECTED) X(RELAY_HIGH_SELECTED)
+
+enum RootPageField {
+#define X(name) RF_##name,
+    ROOT_PAGE_FIELDS(X)
+#undef X
+    RF_COUNT
+};
+
+#define ROOT_PAGE_VALUE_SIZE 64
+#define ROOT_PAGE_NAME_MAX 24
+
+static const char rootPageFieldNames[RF_COUNT][ROOT_PAGE_NAME_MAX] PROGMEM = {
+#define X(name) #name,
+    ROOT_PAGE_FIELDS(X)
+#undef X
+};
+
+// The root page is streamed from flash with its values filled in as it
+// goes, instead of being copied into a String and rewritten per field
+struct RootPageStream {
+    size_t pos;             // Offset into INDEX_HTML
+    const char *pending;    // Rest of a value being copied out
+    char values[RF_COUNT][ROOT_PAGE_VALUE_SIZE];
+};
+
+void setRootField(RootPageStream *s, RootPageField field, PGM_P format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf_P(s->values[field], ROOT_PAGE_VALUE_SIZE, format, args);
+    va_end(args);
+}
+
+// Snapshots the page's values; NULL if the heap can't hold them
+RootPageStream *beginRootPage() {
+    RootPageStream *s = (RootPageStream *)malloc(sizeof(RootPageStream));
+    if (s == NULL) return NULL;
+    s->pos = 0;
+    s->pending = NULL;
+    
+    bool isLightOn = (digitalRead(RELAY_PIN) == relayOn);
+    char statusText[64];
+    if (isMonitoring) {
+        formatSystemState(statusText, sizeof(statusText));
+    } else {
+        formatCloudStatus(statusText, sizeof(statusText));
+    }
+    
+    setRootField(s, RF_COLOR_STATUS, PSTR("%s"), isLightOn ? "#4CAF50" : "#ff4444");
+    setRootField(s, RF_LIGHT_STATE, PSTR("%s"), isLightOn ? "ON" : "OFF");
+    setRootField(s, RF_CURRENT_TIME, PSTR("%s"), timeClient.getFormattedTime().c_str());
+    setRootField(s, RF_BUTTON_TEXT, PSTR("%s"), isLightOn ? "Turn Off" : "Turn On");
+    setRootField(s, RF_BUTTON_ICON, PSTR("%s"), isLightOn ? "&#127769;" : "&#9728;");
+    if (currentCloudCoverage < 0) {
+        setRootField(s, RF_CLOUD_COVERAGE, PSTR("Unknown"));
+    } else {
+        setRootField(s, RF_CLOUD_COVERAGE, PSTR("%.1f"), currentCloudCoverage);
+    }
+    setRootField(s, RF_CLOUD_STATUS, PSTR("%s"), statusText);
+    setRootField(s, RF_CLOUD_THRESHOLD, PSTR("%d"), cloudThreshold);
+    setRootField(s, RF_CLOUD_HYSTERESIS, PSTR("%d"), cloudHysteresis);
+    setRootField(s, RF_MONITORING_WINDOW, PSTR("%d"), monitoringWindow);
+    setRootField(s, RF_OVERRIDE_DURATION, PSTR("%d"), manualOverrideDuration);
+    setRootField(s, RF_SUNRISE_HOUR, PSTR("%d"), sunriseHour);
+    setRootField(s, RF_SUNRISE_MINUTE, PSTR("%02d"), sunriseMinute);
+    setRootField(s, RF_SUNSET_HOUR, PSTR("%d"), sunsetHour);
+    setRootField(s, RF_SUNSET_MINUTE, PSTR("%02d"), sunsetMinute);
+    setRootField(s, RF_ADMIN_USERNAME, PSTR("%s"), adminUsername);
+    setRootField(s, RF_MAX_RETRIES, PSTR("%d"), maxRetries);
+    setRootField(s, RF_TIMEZONE_OFFSET, PSTR("%d"), timezoneOffsetSec);
+    setRootField(s, RF_DAYLIGHT_OFFSET, PSTR("%d"), daylightOffsetSec);
+    setRootField(s, RF_SUNRISE_OFFSET, PSTR("%d"), sunriseOffset);
+    setRootField(s, RF_SUNSET_OFFSET, PSTR("%d"), sunsetOffset);
+    setRootField(s, RF_LATITUDE, PSTR("%.6f"), locationLatitude);
+    setRootField(s, RF_LONGITUDE, PSTR("%.6f"), locationLongitude);
+    setRootField(s, RF_DEVICE_NAME, PSTR("%s"), deviceName);
+    setRootField(s, RF_RELAY_LOW_SELECTED, PSTR("%s"), relayOn == LOW ? "selected" : "");
+    setRootField(s, RF_RELAY_HIGH_SELECTED, PSTR("%s"), relayOn == HIGH ? "selected" : "");
+    return s;
+}
+
+// Returns the value for a placeholder starting at INDEX_HTML[pos], or NULL,
+// with `length` set to the placeholder's length
+const char *rootPlaceholder(RootPageStream *s, size_t pos, size_t &length) {
+    char name[ROOT_PAGE_NAME_MAX];
+    size_t len = 0;
+    char c;
+    while ((c = pgm_read_byte(INDEX_HTML + pos + 1 + len)) != ']') {
+        if (c == 0 || len == sizeof(name) - 1) return NULL;
+        name[len++] = c;
+    }
+    name[len] = 0;
+    for (int i = 0; i < RF_COUNT; i++) {
+        if (strcmp_P(name, rootPageFieldNames[i]) == 0) {
+            length = len + 2;
+            return s->values[i];
+        }
+    }
+    return NULL;
+}
+
+// HttpChunkProducer for the root page
+size_t produceRootPage(void *ctx, char *out, size_t size) {
+    RootPageStream *s = (RootPageStream *)ctx;
+    size_t n = 0;
+    while (n < size) {
+        if (s->pending) {
+            while (n < size && *s->pending) out[n++] = *s->pending++;
+            if (*s->pending == 0) s->pending = NULL;
+            continue;
+        }
+        char c = pgm_read_byte(INDEX_HTML + s->pos);
+        if (c == 0) break;
+        size_t length;
+        if (c == '[' && (s->pending = rootPlaceholder(s, s->pos, length)) != NULL) {
+            s->pos += length;
+            continue;
+        }
+        out[n++] = c;
+        s->pos++;
+    }
+    return n;
+}
+
+void releaseRootPage(void *ctx) {
+    free(ctx);
+}
+
+void handleRoot() {
+    MetricTimer timer(MH_HTTP_ROOT);
+    TRACE_DEBUG_S(TR_AUTH_HEADER, server.header(PSTR("Authorization")).c_str());
+    
+    if (!server.authenticate(http_username, http_password)) {
+        TRACE_WARN(TR_AUTH_FAILED, server.headers());
+        server.sendHeader(PSTR("Location"), "/login");
+        server.send(303);
+        return;
+    }
+    
+    RootPageStream *page = beginRootPage();
+    if (page == NULL) {
+        server.send_P(500, "text/plain", PSTR("Out of memory"));
+        return;
+    }
+    TRACE_DEBUG(TR_ROOT_SENT);
+    server.sendStream(200, "text/html", produceRootPage, page, releaseRootPage);
+    ESP.wdtFeed();
+}
+
+//================ SESSIONS ================
+bool checkSessionCookie(const char *cookies) {
+    return sessionCookieValid(cookies, millis() / 1000);
+}
+
+// Same length and bytes, without stopping at the first mismatch
+bool credentialMatches(const char *given, const char *expected) {
+    size_t len = strlen(given);
+    return len == strlen(expected) && digestEqual((const uint8_t *)given, (const uint8_t *)expected, len);
+}
+
+void handleLoginPage() {
+    ScratchWriter out(scratch);
+    out.printf_P(PSTR("<html><head><meta name='viewport' content='width=device-width, initial-scale=1'>"
+                      "<title>Light Controller</title></head><body><h1>Light Controller</h1>%s"
+                      "<form method='POST' action='/login'><input name='username' placeholder='Username'> "
+                      "<input name='password' type='password' placeholder='Password'> <button>Log in</button></form>"
+                      "</body></html>"),
+                 server.hasArg(PSTR("failed")) ? "<p>Wrong username or password.</p>" : "");
+    sendScratch(200, "text/html", out);
+}
+
+// Issues a session cookie for the admin credentials; API clients can keep
+// sending Basic credentials instead
+void handleLogin() {
+    bool userOk = credentialMatches(server.arg(PSTR("username")).c_str(), http_username);
+    bool passOk = credentialMatches(server.arg(PSTR("password")).c_str(), http_password);
+    if (!userOk || !passOk) {
+        metrics.inc(MC_HTTP_LOGIN_FAILED);
+        TRACE_WARN(TR_LOGIN_FAILED);
+        server.sendHeader(PSTR("Location"), "/login?failed=1");
+        server.send(303);
+        return;
+    }
+    
+    char token[SESSION_TOKEN_LEN + 1];
+    char cookie[128];
+    sessionIssue(millis() / 1000, token);
+    snprintf_P(cookie, sizeof(cookie), PSTR(SESSION_COOKIE_NAME "=%s; Max-Age=%lu; Path=/; HttpOnly; SameSite=Strict"), token,
+               SESSION_LIFETIME_S);
+    server.sendHeader(PSTR("Set-Cookie"), cookie);
+    server.sendHeader(PSTR("Location"), "/");
+    server.send(303);
+}
+
+void handleLogout() {
+    server.sendHeader(PSTR("Set-Cookie"), SESSION_COOKIE_NAME "=; Max-Age=0; Path=/; HttpOnly; SameSite=Strict");
+    server.sendHeader(PSTR("Location"), "/login");
+    server.send(303);
+}
+
+void handleSetTime() {
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+
+    bool changed = false;
+
+    if (server.hasArg(PSTR("sunriseHour"))) {
+        int newHour = constrain(server.arg(PSTR("sunriseHour")).toInt(), 0, 23);
+        if (sunriseHour != newHour) {
+            sunriseHour = newHour;
+            changed = true;
+        }
+    }
+    
+    if (server.hasArg(PSTR("sunriseMinute"))) {
+        int newMinute = constrain(server.arg(PSTR("sunriseMinute")).toInt(), 0, 59);
+        if (sunriseMinute != newMinute) {
+            sunriseMinute = newMinute;
+            changed = true;
+        }
+    }
+    
+    if (server.hasArg(PSTR("sunsetHour"))) {
+        int newHour = constrain(server.arg(PSTR("sunsetHour")).toInt(), 0, 23);
+        if (sunsetHour != newHour) {
+            sunsetHour = newHour;
+            changed = true;
+        }
+    }
+    
+    if (server.hasArg(PSTR("sunsetMinute"))) {
+        int newMinute = constrain(server.arg(PSTR("sunsetMinute")).toInt(), 0, 59);
+        if (sunsetMinute != newMinute) {
+            sunsetMinute = newMinute;
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        TRACE_INFO(TR_SAVE_TIMES, sunriseHour, sunriseMinute, sunsetHour, sunsetMinute);
+        saveSettings();
+        monitoring_sunrise = true;
+        monitoring_sunset = true;
+    }
+    
+    server.sendHeader(PSTR("Location"), "/");
+    server.send(303);
+}
+
+void handleToggle() {
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+    
+    manualOverride = true;
+    manualOverrideStartTime = millis();
+    manualLightState = !(digitalRead(RELAY_PIN) == relayOn);
+    traceToggle(0, manualLightState ? INPUT_TOGGLE_ON : INPUT_TOGGLE_OFF);
+    
+    toggleLights(manualLightState);
+    
+    currentState = MANUAL;
+    
+    TRACE_INFO_S(TR_MANUAL_TOGGLE, manualLightState ? "ON" : "OFF");
+    
+    if (server.hasArg(PSTR("api"))) {
+        ScratchWriter out(scratch);
+        out.printf_P(PSTR("{\"success\":true,\"state\":\"%s\"}"), manualLightState ? "on" : "off");
+        sendScratch(200, "application/json", out);
+    } else {
+        server.sendHeader(PSTR("Location"), "/");
+        server.send(303);
+    }
+}
+
+// Clicks and dashboards polling /cloudcheck at once cost one forecast
+// lookup (and at most one fetch) between them
+#define CLOUDCHECK_COALESCE_MS 30000
+
+// True when coalescedCloudCoverage() would have to fetch the forecast
+bool cloudCheckWillFetch() {
+    if (lastCloudCheckMs != 0 && millis() - lastCloudCheckMs < CLOUDCHECK_COALESCE_MS) return false;
+    uint32_t utc = utcNow();
+    float cloudCover;
+    if (forecastCache.isFresh(utc) && lookupCloudCoverage(utc, cloudCover)) return false;
+    return forecastShare.getRole() != SHARE_FOLLOWER;
+}
+
+float coalescedCloudCoverage() {
+    if (lastCloudCheckMs != 0 && millis() - lastCloudCheckMs < CLOUDCHECK_COALESCE_MS) {
+        metrics.inc(MC_CLOUDCHECK_COALESCED);
+        return lastCloudCheckValue;
+    }
+    lastCloudCheckValue = getCloudCoverage();
+    lastCloudCheckMs = millis();
+    return lastCloudCheckValue;
+}
+
+void handleCloudMonitoring() {
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+    if (cloudCheckWillFetch() && !admitBlocking()) return;
+
+    float newCloudCoverage = coalescedCloudCoverage();
+    bool success = (newCloudCoverage >= 0);
+    
+    if (success) { 
+        currentCloudCoverage = newCloudCoverage;
+        
+        if (isWithinMonitoringWindow(hour(), minute())) {
+            if (currentCloudCoverage > CLOUD_COVERAGE_THRESHOLD) {
+                cloudTriggeredActivation = true;
+                currentState = ACTIVE;
+                writeRelay(true);
+            }
+        }
+    }
+    if (server.hasArg(PSTR("api"))) {
+        char statusText[64];
+        formatCloudStatus(statusText, sizeof(statusText));
+        
+        ScratchWriter out(scratch);
+        out.printf_P(PSTR("{\"success\":%s,\"cloudCoverage\":%.2f,\"isMonitoring\":%s,\"status\":\"%s\"}"),
+                     success ? "true" : "false", currentCloudCoverage,
+                     isMonitoring ? "true" : "false", statusText);
+        sendScratch(200, "application/json", out);
+    } else {
+        server.sendHeader(PSTR("Location"), "/");
+        server.send(303);
+    }
+}
+
+void handleSystemStatus() {
+    MetricTimer timer(MH_HTTP_API);
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+    
+    bool isLightOn = (digitalRead(RELAY_PIN) == relayOn);
+    char stateText[64];
+    char statusText[64];
+    formatSystemState(stateText, sizeof(stateText));
+    formatCloudStatus(statusText, sizeof(statusText));
+    
+    ScratchWriter out(scratch);
+    out.printf_P(PSTR("{\"success\":true,\"lightOn\":%s,\"systemState\":\"%s\",\"cloudCoverage\":%.2f,"
+                      "\"cloudStatus\":\"%s\",\"isMonitoring\":%s,\"sunriseTime\":\"%d:%02d\",\"sunsetTime\":\"%d:%02d\","
+                      "\"time\":\"%02d:%02d:%02d\""),
+                 isLightOn ? "true" : "false", stateText, currentCloudCoverage,
+                 statusText, isMonitoring ? "true" : "false",
+                 sunriseHour, sunriseMinute, sunsetHour, sunsetMinute,
+                 timeClient.getHours(), timeClient.getMinutes(), timeClient.getSeconds());
+    out.printf_P(PSTR(",\"freeHeap\":%u,\"minFreeHeap\":%u,\"heapFragmentation\":%u,\"maxFreeBlock\":%u"),
+                 ESP.getFreeHeap(), minFreeHeap, ESP.getHeapFragmentation(), ESP.getMaxFreeBlockSize());
+    out.printf_P(PSTR(",\"scratchHighWater\":%u,\"scratchCapacity\":%u,\"scratchOverflows\":%u"),
+                 scratch.getHighWater(), scratch.getCapacity(), scratch.getOverflowCount());
+    out.printf_P(PSTR(",\"admission\":{\"rejected\":%u,\"rejectedExpensive\":%u,\"deferredPasses\":%u,\"coalesced\":%u,\"debtUs\":%u}"),
+                 metrics.getCounter(MC_HTTP_REJECTED_RATE), metrics.getCounter(MC_HTTP_REJECTED_EXPENSIVE),
+                 metrics.getCounter(MC_HTTP_DEFERRED), metrics.getCounter(MC_CLOUDCHECK_COALESCED), admission.getDebtUs());
+    uint32_t gzipIn = metrics.getCounter(MC_HTTP_GZIP_BYTES_IN);
+    uint32_t gzipOut = metrics.getCounter(MC_HTTP_GZIP_BYTES_OUT);
+    uint32_t gzipSaved = gzipIn > gzipOut ? gzipIn - gzipOut : 0;
+    out.printf_P(PSTR(",\"gzip\":{\"responses\":%u,\"bytesIn\":%u,\"bytesOut\":%u,\"usPerKBSaved\":%.1f}"),
+                 metrics.getCounter(MC_HTTP_GZIP_RESPONSES), gzipIn, gzipOut,
+                 gzipSaved > 0 ? metrics.getCounter(MC_HTTP_GZIP_MICROS) * 1024.0f / gzipSaved : 0.0f);
+    ForecastHour hour;
+    uint32_t utc = utcNow();
+    if (forecastCache.lookup(utc, hour)) {
+        float elevation = solarElevation(utc, locationLatitude, locationLongitude);
+        out.printf_P(PSTR(",\"sky\":{\"cloudCover\":%.0f,\"cloudLow\":%.0f,\"cloudMid\":%.0f,\"cloudHigh\":%.0f,"
+                          "\"precipitation\":%.1f,\"radiation\":%.1f,\"sunElevation\":%.1f,\"effectiveCover\":%.1f,"
+                          "\"illuminanceLux\":%.0f}"),
+                     hour.cloudCover, hour.cloudLow, hour.cloudMid, hour.cloudHigh, hour.precipitation, hour.radiation,
+                     elevation, effectiveCloudCover(hour, elevation), estimateIlluminance(hour, elevation));
+    }
+    if (clockIsSet(utc)) {
+        uint32_t localNow = timeClient.getEpochTime();
+        float kWh[PERIOD_COUNT] = { 0, 0, 0 };
+        for (int c = 0; c < ENERGY_CIRCUITS; c++) {
+            for (int period = 0; period < PERIOD_COUNT; period++) {
+                kWh[period] += energyKWh(energyMeter.getTotalSeconds(c, (EnergyPeriod)period, localNow), circuitLoadWatts(c));
+            }
+        }
+        out.printf_P(PSTR(",\"energy\":{\"main\":"));
+        writeEnergyCircuit(out, 0, localNow);
+        out.printf_P(PSTR(",\"allCircuitsKWh\":{\"today\":%.3f,\"week\":%.3f,\"lifetime\":%.3f}}"),
+                     kWh[PERIOD_TODAY], kWh[PERIOD_WEEK], kWh[PERIOD_LIFETIME]);
+    }
+    out.printf_P(PSTR(",\"forecastAge\":%d,\"forecastShare\":{\"role\":\"%s\",\"self\":\"%08x\",\"leader\":\"%08x\"}"),
+                 forecastCache.fetchedAt != 0 ? (int)(utcNow() - forecastCache.fetchedAt) : -1,
+                 ForecastShare::roleName(forecastShare.getRole()).c_str(), forecastShare.getSelfId(), forecastShare.getLeaderId());
+    out.printf_P(PSTR(",\"forecastProviders\":["));
+    const ForecastHedge &hedge = forecastClient.getHedge();
+    for (uint8_t i = 0; i < forecastClient.getCount(); i++) {
+        const ForecastProvider &provider = forecastClient.getProvider(i);
+        const ForecastProviderStats &stats = hedge.getStats(i);
+        out.printf_P(PSTR("%s{\"host\":"), i == 0 ? "" : ",");
+        out.jsonString(provider.host);
+        out.printf_P(PSTR(",\"port\":%u,\"requests\":%u,\"successes\":%u,\"failures\":%u,\"wins\":%u,\"hedged\":%u,"
+                          "\"cancelled\":%u,\"p50Ms\":%u,\"p90Ms\":%u,\"lastMs\":%u,\"hedgeDelayMs\":%u}"),
+                     provider.port, stats.requests, stats.successes, stats.failures, stats.wins, stats.hedged,
+                     stats.cancelled, stats.percentile(50), stats.percentile(90), stats.lastLatencyMs,
+                     hedge.hedgeDelayMs(i));
+    }
+    out.printf_P(PSTR("]}"));
+    sendScratch(200, "application/json", out);
+}
+
+void handleGetPlan() {
+    MetricTimer timer(MH_HTTP_API);
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+    
+    time_t now = timeClient.getEpochTime();
+    const PlanEntry *current = currentPlanEntry(now);
+    if (!dayPlan.valid) {
+        server.send_P(503, "application/json", PSTR("{\"success\":false,\"error\":\"clock not set\"}"));
+        return;
+    }
+    
+    const DecisionParams &p = dayPlan.params;
+    ScratchWriter out(scratch);
+    out.printf_P(PSTR("{\"date\":\"%04d-%02d-%02d\",\"sunrise\":\"%02d:%02d\",\"sunset\":\"%02d:%02d\","
+                      "\"monitoringWindow\":%d,\"cloudThreshold\":%d,\"cloudHysteresis\":%d,\"forecastAge\":%d,"
+                      "\"truncated\":%s,\"current\":%d,\"entries\":["),
+                 year(now), month(now), day(now), p.sunriseTime / 60, p.sunriseTime % 60, p.sunsetTime / 60,
+                 p.sunsetTime % 60, p.monitoringWindow, p.cloudThreshold, p.cloudHysteresis,
+                 dayPlan.forecastFetchedAt != 0 ? (int)(utcNow() - dayPlan.forecastFetchedAt) : -1,
+                 dayPlan.truncated ? "true" : "false", current != NULL ? (int)(current - dayPlan.entries) : -1);
+    for (uint8_t i = 0; i < dayPlan.count; i++) {
+        const PlanEntry &e = dayPlan.entries[i];
+        out.printf_P(PSTR("%s{\"time\":\"%02d:%02d\",\"on\":%s,\"reason\":\"%s\",\"state\":\"%s\","
+                          "\"cloudStatus\":\"%s\",\"cloudCoverage\":%.1f}"),
+                     i == 0 ? "" : ",", e.minute / 60, e.minute % 60, e.lightOn ? "true" : "false",
+                     planReasonName(e.reason).c_str(), systemStateName((SystemState)e.state).c_str(),
+                     cloudStatusName((CloudStatus)e.cloudStatus).c_str(), e.cloudCoverage);
+    }
+    out.printf_P(PSTR("]}"));
+    sendScratch(200, "application/json", out);
+}
+
+// The main circuit, then every zone with a pin or recorded on-time
+void handleGetEnergy() {
+    MetricTimer timer(MH_HTTP_API);
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+    if (!clockIsSet(utcNow())) {
+        server.send_P(503, "application/json", PSTR("{\"success\":false,\"error\":\"clock not set\"}"));
+        return;
+    }
+    
+    uint32_t now = timeClient.getEpochTime();
+    ScratchWriter out(scratch);
+    out.printf_P(PSTR("{\"checkpointAgeSec\":%u,\"circuits\":["), (unsigned)((millis() - lastEnergyCheckpointMs) / 1000));
+    for (int c = 0; c < ENERGY_CIRCUITS; c++) {
+        if (c > 0 && zones[c - 1].pin == ZONE_NO_PIN && energyMeter.getTotalSeconds(c, PERIOD_LIFETIME, now) == 0) {
+            continue;
+        }
+        if (c > 0) out.printf_P(PSTR(","));
+        writeEnergyCircuit(out, c, now);
+    }
+    out.printf_P(PSTR("]}"));
+    sendScratch(200, "application/json", out);
+}
+
+void handleGetMqtt() {
+    MetricTimer timer(MH_HTTP_API);
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+    
+    ScratchWriter out(scratch);
+    out.printf_P(PSTR("{\"state\":\"%s\",\"topic\":"), MqttPublisher::stateName(mqttPublisher.getState()).c_str());
+    out.jsonString(mqttPublisher.getEventsTopic());
+    out.printf_P(PSTR(",\"messagesPerSec\":%.2f,\"eventsPerSec\":%.2f,\"sequence\":%u,\"queued\":%u,"
+                      "\"queueCapacity\":%u,\"dropped\":%u,\"queueBytes\":%u,\"bufferBytes\":%u}"),
+                 mqttPublisher.getMessagesPerSec(), mqttPublisher.getEventsPerSec(), mqttPublisher.getSequence(),
+                 mqttPublisher.getQueueDepth(), MqttEventQueue::capacity(), mqttPublisher.getDropped(),
+                 MqttPublisher::queueBytes(), MqttPublisher::bufferBytes());
+    sendScratch(200, "application/json", out);
+}
+
+void handleSaveConfig() {
     if (!server.authenticate(http_username, http_password)) {
         return server.requestAuthentication();
     }
     
     bool changed = false;
     
-    if (server.hasArg("cloudThreshold")) {
-        int newThreshold = constrain(server.arg("cloudThreshold").toInt(), 0, 100);
+    if (server.hasArg(PSTR("cloudThreshold"))) {
+        int newThreshold = constrain(server.arg(PSTR("cloudThreshold")).toInt(), 0, 100);
         if (cloudThreshold != newThreshold) {
             cloudThreshold = newThreshold;
             changed = true;
         }
     }
     
-    if (server.hasArg("cloudHysteresis")) {
-        int newHysteresis = constrain(server.arg("cloudHysteresis").toInt(), 0, 20);
+    if (server.hasArg(PSTR("cloudHysteresis"))) {
+        int newHysteresis = constrain(server.arg(PSTR("cloudHysteresis")).toInt(), 0, 20);
         if (cloudHysteresis != newHysteresis) {
             cloudHysteresis = newHysteresis;
             changed = true;
         }
     }
     
-    if (server.hasArg("monitoringWindow")) {
-        int newWindow = constrain(server.arg("monitoringWindow").toInt(), 5, 120);
+    if (server.hasArg(PSTR("monitoringWindow"))) {
+        int newWindow = constrain(server.arg(PSTR("monitoringWindow")).toInt(), 5, 120);
         if (monitoringWindow != newWindow) {
             monitoringWindow = newWindow;
             changed = true;
         }
     }
     
-    if (server.hasArg("overrideDuration")) {
-        int newDuration = constrain(server.arg("overrideDuration").toInt(), 5, 1440);
+    if (server.hasArg(PSTR("overrideDuration"))) {
+        int newDuration = constrain(server.arg(PSTR("overrideDuration")).toInt(), 5, 1440);
         if (manualOverrideDuration != newDuration) {
             manualOverrideDuration = newDuration;
             changed = true;
@@ -816,11 +1569,11 @@ void handleSaveConfig() {
     }
     
     if (changed) {
-        Serial.println("Saving configuration changes");
+        TRACE_INFO_S(TR_SAVE_CONFIG, "basic");
         saveSettings();
     }
     
-    server.sendHeader("Location", "/");
+    server.sendHeader(PSTR("Location"), "/");
     server.send(303);
 }
 
@@ -833,8 +1586,8 @@ void handleSaveAdvanced() {
     bool requiresReconnect = false;
     bool sunTimeChanged = false;
     
-    if (server.hasArg("sunriseOffset")) {
-        int newOffset = constrain(server.arg("sunriseOffset").toInt(), -120, 120);
+    if (server.hasArg(PSTR("sunriseOffset"))) {
+        int newOffset = constrain(server.arg(PSTR("sunriseOffset")).toInt(), -120, 120);
         if (sunriseOffset != newOffset) {
             sunriseOffset = newOffset;
             changed = true;
@@ -842,8 +1595,8 @@ void handleSaveAdvanced() {
         }
     }
     
-    if (server.hasArg("sunsetOffset")) {
-        int newOffset = constrain(server.arg("sunsetOffset").toInt(), -120, 120);
+    if (server.hasArg(PSTR("sunsetOffset"))) {
+        int newOffset = constrain(server.arg(PSTR("sunsetOffset")).toInt(), -120, 120);
         if (sunsetOffset != newOffset) {
             sunsetOffset = newOffset;
             changed = true;
@@ -851,16 +1604,16 @@ void handleSaveAdvanced() {
         }
     }
     
-    if (server.hasArg("maxRetries")) {
-        int newRetries = constrain(server.arg("maxRetries").toInt(), 1, 10);
+    if (server.hasArg(PSTR("maxRetries"))) {
+        int newRetries = constrain(server.arg(PSTR("maxRetries")).toInt(), 1, 10);
         if (maxRetries != newRetries) {
             maxRetries = newRetries;
             changed = true;
         }
     }
     
-    if (server.hasArg("timezoneOffset")) {
-        int newOffset = server.arg("timezoneOffset").toInt();
+    if (server.hasArg(PSTR("timezoneOffset"))) {
+        int newOffset = server.arg(PSTR("timezoneOffset")).toInt();
         if (timezoneOffsetSec != newOffset) {
             timezoneOffsetSec = newOffset;
             changed = true;
@@ -869,8 +1622,8 @@ void handleSaveAdvanced() {
         }
     }
     
-    if (server.hasArg("daylightOffset")) {
-        int newOffset = server.arg("daylightOffset").toInt();
+    if (server.hasArg(PSTR("daylightOffset"))) {
+        int newOffset = server.arg(PSTR("daylightOffset")).toInt();
         if (daylightOffsetSec != newOffset) {
             daylightOffsetSec = newOffset;
             changed = true;
@@ -880,8 +1633,7 @@ void handleSaveAdvanced() {
     }
     
     if (changed) {
-        Serial.println("Saving advanced configuration changes");
-        saveSettings();
+        TRACE_INFO_S(TR_SAVE_CONFIG, "advanced");
         
         if (requiresReconnect) {
             timeClient.setTimeOffset(timezoneOffsetSec + daylightOffsetSec);
@@ -889,11 +1641,13 @@ void handleSaveAdvanced() {
         }
         
         if (sunTimeChanged) {
-            updateSunriseSunsetTime();
+            recomputeSunTimes();
         }
+        
+        saveSettings();
     }
     
-    server.sendHeader("Location", "/");
+    server.sendHeader(PSTR("Location"), "/");
     server.send(303);
 }
 
@@ -905,10 +1659,10 @@ void handleSaveSystem() {
     bool changed = false;
     bool credentialsChanged = false;
     
-    if (server.hasArg("username") && server.arg("username").length() > 0 && 
-        server.arg("username").length() < 32) {
-        if (strcmp(adminUsername, server.arg("username").c_str()) != 0) {
-            strncpy(adminUsername, server.arg("username").c_str(), 31);
+    if (server.hasArg(PSTR("username")) && server.arg(PSTR("username")).length() > 0 && 
+        server.arg(PSTR("username")).length() < 32) {
+        if (strcmp(adminUsername, server.arg(PSTR("username")).c_str()) != 0) {
+            strncpy(adminUsername, server.arg(PSTR("username")).c_str(), 31);
             adminUsername[31] = 0; 
             strcpy(http_username, adminUsername); 
             changed = true;
@@ -916,10 +1670,10 @@ void handleSaveSystem() {
         }
     }
     
-    if (server.hasArg("password") && server.arg("password").length() > 0 && 
-        server.arg("password").length() < 32) {
-        if (strcmp(adminPassword, server.arg("password").c_str()) != 0) {
-            strncpy(adminPassword, server.arg("password").c_str(), 31);
+    if (server.hasArg(PSTR("password")) && server.arg(PSTR("password")).length() > 0 && 
+        server.arg(PSTR("password")).length() < 32) {
+        if (strcmp(adminPassword, server.arg(PSTR("password")).c_str()) != 0) {
+            strncpy(adminPassword, server.arg(PSTR("password")).c_str(), 31);
             adminPassword[31] = 0; 
             strcpy(http_password, adminPassword); 
             changed = true;
@@ -927,17 +1681,17 @@ void handleSaveSystem() {
         }
     }
     
-    if (server.hasArg("deviceName") && server.arg("deviceName").length() > 0 && 
-        server.arg("deviceName").length() < 32) {
-        if (strcmp(deviceName, server.arg("deviceName").c_str()) != 0) {
-            strncpy(deviceName, server.arg("deviceName").c_str(), 31);
+    if (server.hasArg(PSTR("deviceName")) && server.arg(PSTR("deviceName")).length() > 0 && 
+        server.arg(PSTR("deviceName")).length() < 32) {
+        if (strcmp(deviceName, server.arg(PSTR("deviceName")).c_str()) != 0) {
+            strncpy(deviceName, server.arg(PSTR("deviceName")).c_str(), 31);
             deviceName[31] = 0; 
             changed = true;
         }
     }
     
-    if (server.hasArg("relayLogic")) {
-        String relayLogic = server.arg("relayLogic");
+    if (server.hasArg(PSTR("relayLogic"))) {
+        String relayLogic = server.arg(PSTR("relayLogic"));
         bool newRelayOn = (relayLogic == "active_high") ? HIGH : LOW;
         bool newRelayOff = (relayLogic == "active_high") ? LOW : HIGH;
         
@@ -953,15 +1707,15 @@ void handleSaveSystem() {
     }
     
     if (changed) {
-        Serial.println("Saving system configuration changes");
+        TRACE_INFO_S(TR_SAVE_CONFIG, "system");
         saveSettings();
         
         if (credentialsChanged) {
-            Serial.println("Credentials changed - new auth will be required");
+            TRACE_INFO(TR_CREDENTIALS_CHANGED);
         }
     }
     
-    server.sendHeader("Location", "/");
+    server.sendHeader(PSTR("Location"), "/");
     server.send(303);
 }
 
@@ -972,16 +1726,16 @@ void handleSaveLocation() {
     
     bool changed = false;
     
-    if (server.hasArg("latitude")) {
-        float newLat = server.arg("latitude").toFloat();
+    if (server.hasArg(PSTR("latitude"))) {
+        float newLat = server.arg(PSTR("latitude")).toFloat();
         if (abs(locationLatitude - newLat) > 0.00001 && newLat >= -90 && newLat <= 90) {
             locationLatitude = newLat;
             changed = true;
         }
     }
     
-    if (server.hasArg("longitude")) {
-        float newLong = server.arg("longitude").toFloat();
+    if (server.hasArg(PSTR("longitude"))) {
+        float newLong = server.arg(PSTR("longitude")).toFloat();
         if (abs(locationLongitude - newLong) > 0.00001 && newLong >= -180 && newLong <= 180) {
             locationLongitude = newLong;
             changed = true;
@@ -989,17 +1743,16 @@ void handleSaveLocation() {
     }
     
     if (changed) {
-        Serial.printf("Location updated to: %f, %f\n", locationLatitude, locationLongitude);
-        saveSettings();
-        
-        sun.setPosition(locationLatitude, locationLongitude, (timezoneOffsetSec + daylightOffsetSec) / 3600.0);
+        TRACE_INFO_F(TR_LOCATION_UPDATED, locationLatitude, locationLongitude);
         
-        updateSunriseSunsetTime();
+        forecastCache.clear();
+        recomputeSunTimes();
+        saveSettings();
         
         lastTimeSync = 0;
     }
     
-    server.sendHeader("Location", "/");
+    server.sendHeader(PSTR("Location"), "/");
     server.send(303);
 }
 
@@ -1008,29 +1761,422 @@ void handleReboot() {
         return server.requestAuthentication();
     }
     
-    server.send(200, "text/html", "<html><body><h1>Rebooting...</h1><p>The device is rebooting. Please wait 10 seconds before reconnecting.</p><script>setTimeout(function(){location.href='/'},30000);</script></body></html>");
-    delay(500);
-    ESP.restart();
+    server.send_P(200, "text/html", PSTR("<html><body><h1>Rebooting...</h1><p>The device is rebooting. Please wait 10 seconds before reconnecting.</p><script>setTimeout(function(){location.href='/'},30000);</script></body></html>"));
+    rebootAtMs = millis() + 500; // The loop restarts once the response has had time to go out
 }
 
 void handleNotFound() {
     if (server.method() == HTTP_OPTIONS) {
-        server.sendHeader("Access-Control-Allow-Origin", "*");
-        server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-        server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
+        server.sendHeader(PSTR("Access-Control-Allow-Origin"), "*");
+        server.sendHeader(PSTR("Access-Control-Allow-Methods"), "GET, POST, OPTIONS");
+        server.sendHeader(PSTR("Access-Control-Allow-Headers"), "Content-Type");
         server.send(200);
         return;
     }
     
-    String message = "File Not Found\n\n";
-    message += "URI: " + server.uri() + "\n";
-    message += "Method: " + String((server.method() == HTTP_GET) ? "GET" : "POST") + "\n";
-    server.send(404, "text/plain", message);
+    ScratchWriter out(scratch);
+    out.printf_P(PSTR("File Not Found\n\nURI: %s\nMethod: %s\n"),
+                 server.uri().c_str(), (server.method() == HTTP_GET) ? "GET" : "POST");
+    sendScratch(404, "text/plain", out);
+}
+
+//================ BULK CONFIGURATION API ================
+void captureConfig(ControllerConfig &cfg) {
+    cfg.sunriseHour = sunriseHour;
+    cfg.sunriseMinute = sunriseMinute;
+    cfg.sunsetHour = sunsetHour;
+    cfg.sunsetMinute = sunsetMinute;
+    cfg.cloudThreshold = cloudThreshold;
+    cfg.cloudHysteresis = cloudHysteresis;
+    cfg.monitoringWindow = monitoringWindow;
+    cfg.overrideDuration = manualOverrideDuration;
+    cfg.sunriseOffset = sunriseOffset;
+    cfg.sunsetOffset = sunsetOffset;
+    cfg.maxRetries = maxRetries;
+    cfg.timezoneOffset = timezoneOffsetSec;
+    cfg.daylightOffset = daylightOffsetSec;
+    cfg.latitude = locationLatitude;
+    cfg.longitude = locationLongitude;
+    cfg.relayActiveHigh = (relayOn == HIGH);
+    strcpy(cfg.username, adminUsername);
+    strcpy(cfg.password, adminPassword);
+    strcpy(cfg.deviceName, deviceName);
+}
+
+// Reads an optional integer field; a present but invalid value rejects the document
+bool readConfigInt(JsonObject obj, const char *key, int minVal, int maxVal, int &out) {
+    if (!obj.containsKey(key)) return true;
+    if (!obj[key].is<int>()) return false;
+    int value = obj[key].as<int>();
+    if (value < minVal || value > maxVal) return false;
+    out = value;
+    return true;
+}
+
+bool readConfigFloat(JsonObject obj, const char *key, float minVal, float maxVal, float &out) {
+    if (!obj.containsKey(key)) return true;
+    if (!obj[key].is<float>()) return false;
+    float value = obj[key].as<float>();
+    if (isnan(value) || value < minVal || value > maxVal) return false;
+    out = value;
+    return true;
+}
+
+bool readConfigBool(JsonObject obj, const char *key, bool &out) {
+    if (!obj.containsKey(key)) return true;
+    if (!obj[key].is<bool>()) return false;
+    out = obj[key].as<bool>();
+    return true;
+}
+
+bool readConfigString(JsonObject obj, const char *key, char *out, size_t size = 32) {
+    if (!obj.containsKey(key)) return true;
+    if (!obj[key].is<const char*>()) return false;
+    const char *value = obj[key].as<const char*>();
+    size_t len = strlen(value);
+    if (len == 0 || len > size - 1) return false;
+    for (size_t i = 0; i < len; i++) {
+        if (value[i] < 32 || value[i] > 126) return false;
+    }
+    strcpy(out, value);
+    return true;
+}
+
+// Validates the whole document into a staged copy; returns the first bad field or NULL
+const char *parseConfigDocument(JsonObject obj, ControllerConfig &cfg) {
+    if (!readConfigInt(obj, "sunriseHour", 0, 23, cfg.sunriseHour)) return "sunriseHour";
+    if (!readConfigInt(obj, "sunriseMinute", 0, 59, cfg.sunriseMinute)) return "sunriseMinute";
+    if (!readConfigInt(obj, "sunsetHour", 0, 23, cfg.sunsetHour)) return "sunsetHour";
+    if (!readConfigInt(obj, "sunsetMinute", 0, 59, cfg.sunsetMinute)) return "sunsetMinute";
+    if (!readConfigInt(obj, "cloudThreshold", 0, 100, cfg.cloudThreshold)) return "cloudThreshold";
+    if (!readConfigInt(obj, "cloudHysteresis", 0, 20, cfg.cloudHysteresis)) return "cloudHysteresis";
+    if (!readConfigInt(obj, "monitoringWindow", 5, 120, cfg.monitoringWindow)) return "monitoringWindow";
+    if (!readConfigInt(obj, "overrideDuration", 5, 1440, cfg.overrideDuration)) return "overrideDuration";
+    if (!readConfigInt(obj, "sunriseOffset", -120, 120, cfg.sunriseOffset)) return "sunriseOffset";
+    if (!readConfigInt(obj, "sunsetOffset", -120, 120, cfg.sunsetOffset)) return "sunsetOffset";
+    if (!readConfigInt(obj, "maxRetries", 1, 10, cfg.maxRetries)) return "maxRetries";
+    if (!readConfigInt(obj, "timezoneOffset", -43200, 50400, cfg.timezoneOffset)) return "timezoneOffset";
+    if (!readConfigInt(obj, "daylightOffset", -7200, 7200, cfg.daylightOffset)) return "daylightOffset";
+    if (!readConfigFloat(obj, "latitude", -90, 90, cfg.latitude)) return "latitude";
+    if (!readConfigFloat(obj, "longitude", -180, 180, cfg.longitude)) return "longitude";
+    if (!readConfigString(obj, "username", cfg.username)) return "username";
+    if (!readConfigString(obj, "password", cfg.password)) return "password";
+    if (!readConfigString(obj, "deviceName", cfg.deviceName)) return "deviceName";
+
+    if (obj.containsKey("relayLogic")) {
+        const char *relayLogic = obj["relayLogic"] | "";
+        if (strcmp(relayLogic, "active_high") == 0) {
+            cfg.relayActiveHigh = true;
+        } else if (strcmp(relayLogic, "active_low") == 0) {
+            cfg.relayActiveHigh = false;
+        } else {
+            return "relayLogic";
+        }
+    }
+    return NULL;
+}
+
+// Swaps the staged config in, then runs dependent work once and commits once
+void applyConfig(const ControllerConfig &cfg) {
+    bool timeOffsetChanged = (cfg.timezoneOffset != timezoneOffsetSec) ||
+                             (cfg.daylightOffset != daylightOffsetSec);
+    bool locationChanged = abs(cfg.latitude - locationLatitude) > 0.00001 ||
+                           abs(cfg.longitude - locationLongitude) > 0.00001;
+    bool sunTimeChanged = timeOffsetChanged || locationChanged ||
+                          cfg.sunriseOffset != sunriseOffset ||
+                          cfg.sunsetOffset != sunsetOffset;
+    bool scheduleChanged = cfg.sunriseHour != sunriseHour || cfg.sunriseMinute != sunriseMinute ||
+                           cfg.sunsetHour != sunsetHour || cfg.sunsetMinute != sunsetMinute;
+    bool relayChanged = cfg.relayActiveHigh != (relayOn == HIGH);
+    bool wasLightOn = (digitalRead(RELAY_PIN) == relayOn);
+
+    sunriseHour = cfg.sunriseHour;
+    sunriseMinute = cfg.sunriseMinute;
+    sunsetHour = cfg.sunsetHour;
+    sunsetMinute = cfg.sunsetMinute;
+    cloudThreshold = cfg.cloudThreshold;
+    cloudHysteresis = cfg.cloudHysteresis;
+    monitoringWindow = cfg.monitoringWindow;
+    manualOverrideDuration = cfg.overrideDuration;
+    sunriseOffset = cfg.sunriseOffset;
+    sunsetOffset = cfg.sunsetOffset;
+    maxRetries = cfg.maxRetries;
+    timezoneOffsetSec = cfg.timezoneOffset;
+    daylightOffsetSec = cfg.daylightOffset;
+    locationLatitude = cfg.latitude;
+    locationLongitude = cfg.longitude;
+    relayOn = cfg.relayActiveHigh ? HIGH : LOW;
+    relayOff = cfg.relayActiveHigh ? LOW : HIGH;
+    strcpy(adminUsername, cfg.username);
+    strcpy(adminPassword, cfg.password);
+    strcpy(http_username, adminUsername);
+    strcpy(http_password, adminPassword);
+    strcpy(deviceName, cfg.deviceName);
+
+    if (relayChanged) {
+        digitalWrite(RELAY_PIN, wasLightOn ? relayOn : relayOff);
+    }
+
+    if (timeOffsetChanged) {
+        timeClient.setTimeOffset(timezoneOffsetSec + daylightOffsetSec);
+        lastTimeSync = 0;
+    }
+
+    if (locationChanged) {
+        forecastCache.clear();
+    }
+
+    if (sunTimeChanged) {
+        recomputeSunTimes();
+    }
+
+    if (sunTimeChanged || scheduleChanged) {
+        monitoring_sunrise = true;
+        monitoring_sunset = true;
+    }
+
+    saveSettings();
+}
+
+void sendConfigJson() {
+    ScratchWriter out(scratch);
+    out.printf_P(PSTR("{\"sunriseHour\":%d,\"sunriseMinute\":%d,\"sunsetHour\":%d,\"sunsetMinute\":%d,"
+                      "\"cloudThreshold\":%d,\"cloudHysteresis\":%d,\"monitoringWindow\":%d,\"overrideDuration\":%d,"
+                      "\"sunriseOffset\":%d,\"sunsetOffset\":%d,\"maxRetries\":%d,"
+                      "\"timezoneOffset\":%d,\"daylightOffset\":%d,\"latitude\":%.6f,\"longitude\":%.6f,"
+                      "\"relayLogic\":\"%s\",\"username\":"),
+                 sunriseHour, sunriseMinute, sunsetHour, sunsetMinute,
+                 cloudThreshold, cloudHysteresis, monitoringWindow, manualOverrideDuration,
+                 sunriseOffset, sunsetOffset, maxRetries,
+                 timezoneOffsetSec, daylightOffsetSec, locationLatitude, locationLongitude,
+                 relayOn == HIGH ? "active_high" : "active_low");
+    out.jsonString(adminUsername);
+    out.printf_P(PSTR(",\"deviceName\":"));
+    out.jsonString(deviceName);
+    out.printf_P(PSTR("}"));
+    sendScratch(200, "application/json", out);
+}
+
+void handleGetConfig() {
+    MetricTimer timer(MH_HTTP_API);
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+    sendConfigJson();
+}
+
+void handlePutConfig() {
+    MetricTimer timer(MH_HTTP_API);
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+
+    DynamicJsonDocument doc(1024);
+    DeserializationError error = deserializeJson(doc, server.arg(PSTR("plain")));
+    if (error || !doc.is<JsonObject>()) {
+        server.send_P(400, "application/json", PSTR("{\"success\":false,\"error\":\"invalid JSON\"}"));
+        return;
+    }
+
+    ControllerConfig staged;
+    captureConfig(staged);
+    const char *badField = parseConfigDocument(doc.as<JsonObject>(), staged);
+    if (badField != NULL) {
+        ScratchWriter out(scratch);
+        out.printf_P(PSTR("{\"success\":false,\"error\":\"invalid value\",\"field\":\"%s\"}"), badField);
+        sendScratch(400, "application/json", out);
+        return;
+    }
+
+    TRACE_INFO_S(TR_SAVE_CONFIG, "bulk");
+    applyConfig(staged);
+    sendConfigJson();
+}
+
+//================ ZONES API ================
+void sendZonesJson() {
+    ScratchWriter out(scratch);
+    out.printf_P(PSTR("{\"maxZones\":%d,\"pins\":["), MAX_ZONES);
+    for (size_t i = 0; i < sizeof(ZONE_PINS); i++) {
+        out.printf_P(PSTR("%s%d"), i == 0 ? "" : ",", ZONE_PINS[i]);
+    }
+    out.printf_P(PSTR("],\"zones\":["));
+    for (int i = 0; i < MAX_ZONES; i++) {
+        const ZoneConfig &z = zones[i];
+        const ZoneRuntime &rt = zoneRuntime[i];
+        out.printf_P(PSTR("%s{\"id\":%d,\"name\":"), i == 0 ? "" : ",", i + 1);
+        out.jsonString(z.name);
+        out.printf_P(PSTR(",\"enabled\":%s,\"pin\":%d,\"relayLogic\":\"%s\",\"sunriseOffset\":%d,\"sunsetOffset\":%d,"
+                          "\"cloudThreshold\":%u,\"cloudHysteresis\":%u,\"monitoringWindow\":%u,\"loadWatts\":%u,"
+                          "\"lightOn\":%s,\"override\":%s,\"state\":\"%s\"}"),
+                     (z.flags & ZONE_ENABLED) ? "true" : "false", z.pin,
+                     (z.flags & ZONE_ACTIVE_HIGH) ? "active_high" : "active_low",
+                     z.sunriseOffset, z.sunsetOffset, z.cloudThreshold, z.cloudHysteresis, z.monitoringWindow,
+                     z.loadTensW * 10, rt.lightOn ? "true" : "false", rt.override ? "true" : "false",
+                     LogManager::getStateName(rt.decision.state).c_str());
+    }
+    out.printf_P(PSTR("]}"));
+    sendScratch(200, "application/json", out);
+}
+
+// Validates one zone object into the staged table; returns the bad key or NULL
+const char *parseZoneObject(JsonObject obj, ZoneConfig *staged, int &index) {
+    int id = 0;
+    index = -1;
+    if (!obj.containsKey("id") || !readConfigInt(obj, "id", 1, MAX_ZONES, id)) return "id";
+    index = id - 1;
+    ZoneConfig &z = staged[index];
+    
+    int pin = z.pin, sunriseOff = z.sunriseOffset, sunsetOff = z.sunsetOffset;
+    int threshold = z.cloudThreshold, hysteresis = z.cloudHysteresis, window = z.monitoringWindow;
+    int loadWatts = z.loadTensW * 10;
+    bool enabled = z.flags & ZONE_ENABLED;
+    if (!readConfigString(obj, "name", z.name, sizeof(z.name))) return "name";
+    if (!readConfigBool(obj, "enabled", enabled)) return "enabled";
+    if (!readConfigInt(obj, "pin", ZONE_NO_PIN, 16, pin)) return "pin";
+    if (!readConfigInt(obj, "sunriseOffset", -120, 120, sunriseOff)) return "sunriseOffset";
+    if (!readConfigInt(obj, "sunsetOffset", -120, 120, sunsetOff)) return "sunsetOffset";
+    if (!readConfigInt(obj, "cloudThreshold", 0, 100, threshold)) return "cloudThreshold";
+    if (!readConfigInt(obj, "cloudHysteresis", 0, 20, hysteresis)) return "cloudHysteresis";
+    if (!readConfigInt(obj, "monitoringWindow", 5, 120, window)) return "monitoringWindow";
+    if (!readConfigInt(obj, "loadWatts", 0, 2550, loadWatts)) return "loadWatts";
+    
+    uint8_t flags = z.flags;
+    if (obj.containsKey("relayLogic")) {
+        const char *relayLogic = obj["relayLogic"] | "";
+        if (strcmp(relayLogic, "active_high") == 0) {
+            flags |= ZONE_ACTIVE_HIGH;
+        } else if (strcmp(relayLogic, "active_low") == 0) {
+            flags &= ~ZONE_ACTIVE_HIGH;
+        } else {
+            return "relayLogic";
+        }
+    }
+    flags = enabled ? (flags | ZONE_ENABLED) : (flags & ~ZONE_ENABLED);
+    
+    z.pin = pin;
+    z.flags = flags;
+    z.sunriseOffset = sunriseOff;
+    z.sunsetOffset = sunsetOff;
+    z.cloudThreshold = threshold;
+    z.cloudHysteresis = hysteresis;
+    z.monitoringWindow = window;
+    z.loadTensW = (loadWatts + 5) / 10;
+    return NULL;
+}
+
+// Swaps the staged table in. Pins a zone gave up are switched off and
+// released; zones whose settings changed start their decision afresh.
+void applyZones(const ZoneConfig *staged) {
+    for (int i = 0; i < MAX_ZONES; i++) {
+        if (memcmp(&zones[i], &staged[i], sizeof(ZoneConfig)) == 0) continue;
+        
+        if (zones[i].pin != ZONE_NO_PIN && zones[i].pin != staged[i].pin) {
+            writeZoneRelay(i, false);
+            pinMode(zones[i].pin, INPUT);
+        }
+        bool wasOn = zoneRuntime[i].lightOn;
+        zones[i] = staged[i];
+        initZoneRuntime(zoneRuntime[i]);
+        zoneRuntime[i].lightOn = wasOn && zoneUsable(zones[i]);
+    }
+    setupZonePins();
+    saveZones();
+}
+
+void handleGetZones() {
+    MetricTimer timer(MH_HTTP_API);
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+    sendZonesJson();
+}
+
+// Accepts {"zones":[{"id":N, ...}, ...]} with any subset of fields per zone;
+// one bad field rejects the whole document
+void handlePutZones() {
+    MetricTimer timer(MH_HTTP_API);
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+    
+    DynamicJsonDocument doc(4096);
+    DeserializationError error = deserializeJson(doc, server.arg(PSTR("plain")));
+    JsonArray list = doc["zones"];
+    if (error || list.isNull()) {
+        server.send_P(400, "application/json", PSTR("{\"success\":false,\"error\":\"invalid JSON\"}"));
+        return;
+    }
+    
+    ZoneConfig staged[MAX_ZONES];
+    memcpy(staged, zones, sizeof(staged));
+    int badZone = -1;
+    const char *badField = NULL;
+    for (JsonObject obj : list) {
+        badField = parseZoneObject(obj, staged, badZone);
+        if (badField != NULL) break;
+    }
+    
+    // Pins are checked once every zone is staged, so two zones can swap pins
+    for (int i = 0; badField == NULL && i < MAX_ZONES; i++) {
+        if (!zonePinAllowed(staged, i, staged[i].pin)) {
+            badZone = i;
+            badField = "pin";
+        }
+    }
+    
+    if (badField != NULL) {
+        ScratchWriter out(scratch);
+        out.printf_P(PSTR("{\"success\":false,\"error\":\"invalid value\",\"zone\":%d,\"field\":\"%s\"}"),
+                     badZone + 1, badField);
+        sendScratch(400, "application/json", out);
+        return;
+    }
+    
+    TRACE_INFO_S(TR_SAVE_CONFIG, "zone");
+    applyZones(staged);
+    sendZonesJson();
+}
+
+// Toggles a zone's manual override, or returns it to automatic with auto=1
+void handleZoneToggle() {
+    MetricTimer timer(MH_HTTP_API);
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+    
+    int index = server.arg(PSTR("id")).toInt() - 1;
+    if (index < 0 || index >= MAX_ZONES || !zoneUsable(zones[index])) {
+        server.send_P(400, "application/json", PSTR("{\"success\":false,\"error\":\"unknown or disabled zone\"}"));
+        return;
+    }
+    
+    ZoneRuntime &rt = zoneRuntime[index];
+    if (server.hasArg(PSTR("auto"))) {
+        traceToggle(index + 1, INPUT_TOGGLE_AUTO);
+        rt.override = false;
+        rt.decision.state = NORMAL;
+    } else {
+        traceToggle(index + 1, rt.lightOn ? INPUT_TOGGLE_OFF : INPUT_TOGGLE_ON);
+        rt.override = true;
+        rt.overrideStart = millis();
+        rt.overrideOn = !rt.lightOn;
+        rt.decision.state = MANUAL;
+        setZoneLight(index, rt.overrideOn);
+    }
+    
+    ScratchWriter out(scratch);
+    out.printf_P(PSTR("{\"success\":true,\"id\":%d,\"state\":\"%s\",\"override\":%s}"), index + 1,
+                 rt.lightOn ? "on" : "off", rt.override ? "true" : "false");
+    sendScratch(200, "application/json", out);
 }
 
 //================ SETUP & LOOP ================
 void setup() {
   Serial.begin(115200);
+  profiler.begin();
+  inputTrace.begin(INPUT_TRACE_ENABLED ? inputTraceRing : NULL, sizeof(inputTraceRing));
+  inputTrace.record(IT_BOOT, millis());
   pinMode(RELAY_PIN, OUTPUT);
   pinMode(ERROR_LED_PIN, OUTPUT);
   pinMode(STATUS_LED_PIN, OUTPUT);
@@ -1043,15 +2189,19 @@ void setup() {
   lastTimeSync = millis();
   wifiEnabled = true;
   
+  sessionBegin();
   loadSettings();
+  loadZones();
+  setupZonePins();
+  loadEnergy();
   
   logManager.begin();
-  
-  Serial.println("\n*** AUTHENTICATION DEBUG ***");
-  Serial.printf("HTTP username: [%s]\n", http_username);
-  Serial.printf("HTTP password: [%s]\n", http_password);
-  Serial.printf("Admin username: [%s]\n", adminUsername);
-  Serial.printf("Admin password: [%s]\n", adminPassword);
+  forecastClient.begin(FORECAST_PROVIDERS, sizeof(FORECAST_PROVIDERS) / sizeof(FORECAST_PROVIDERS[0]),
+                       FORECAST_HEDGE_ENABLED);
+  forecastShare.begin(FORECAST_SHARE_ENABLED, FORECAST_SHARE_KEY, FORECAST_SHARE_GROUP, FORECAST_SHARE_PORT);
+  mqttPublisher.begin(MQTT_ENABLED, MQTT_HOST, MQTT_PORT, MQTT_USER, MQTT_PASSWORD, MQTT_TOPIC_PREFIX,
+                      MQTT_BATCH_INTERVAL_MS, writeMqttState);
+  logManager.setListener(forwardLogEntry);
   
   if (strlen(adminUsername) == 0 || strlen(adminPassword) == 0) {
     strcpy(adminUsername, "admin");
@@ -1060,35 +2210,34 @@ void setup() {
     strcpy(http_password, "admin");
     
     saveSettings();
-    Serial.println("Set and saved default credentials: admin/admin");
+    TRACE_WARN(TR_CREDENTIALS_DEFAULT);
   }
   
   bool hasBadChars = false;
   for (int i = 0; i < strlen(http_username); i++) {
     if (http_username[i] < 32 || http_username[i] > 126) {
       hasBadChars = true;
-      Serial.printf("Bad character in username at position %d: %d\n", i, http_username[i]);
+      TRACE_WARN_S(TR_CREDENTIAL_BAD_CHAR, "username", i, http_username[i]);
     }
   }
   
   for (int i = 0; i < strlen(http_password); i++) {
     if (http_password[i] < 32 || http_password[i] > 126) {
       hasBadChars = true;
-      Serial.printf("Bad character in password at position %d: %d\n", i, http_password[i]);
+      TRACE_WARN_S(TR_CREDENTIAL_BAD_CHAR, "password", i, http_password[i]);
     }
   }
   
   if (hasBadChars) {
-    Serial.println("WARNING: Non-printable characters detected in credentials!");
     strcpy(http_username, "admin");
     strcpy(http_password, "admin");
     strcpy(adminUsername, "admin");
     strcpy(adminPassword, "admin");
     saveSettings();
-    Serial.println("Credentials reset to admin/admin due to corruption");
+    TRACE_WARN(TR_CREDENTIALS_RESET);
   }
   
-  Serial.printf("Using credentials: %s / %s\n", http_username, http_password);
+  TRACE_INFO_S(TR_USING_CREDENTIALS, http_username);
   
   connectToWiFi();
   
@@ -1107,31 +2256,84 @@ void setup() {
   
   logManager.logSystemState(NORMAL);
   
-  Serial.println("Setup complete");
+  TRACE_INFO(TR_SETUP_COMPLETE);
 }
 
 void loop() {
+    uint32_t loopStart = micros();
+    uint32_t stageStart;
+    profiler.beginLoop();
     ESP.wdtFeed();
+    trackHeapUsage();
     
     static SystemState previousState = NORMAL;
+    tickCloudSampled = false;
+    
+    if (rebootAtMs != 0 && (int32_t)(millis() - rebootAtMs) >= 0) {
+        if (energyMeter.needsCheckpoint()) commitEeprom();
+        ESP.restart();
+    }
     
     if (WiFi.status() == WL_CONNECTED) {
+        stageStart = profiler.beginStage(PROF_OTA);
         ArduinoOTA.handle();
-        server.handleClient();
+        profiler.endStage(PROF_OTA, stageStart);
+        
+        // Passes after an overrun leave connections waiting so relay control keeps its pace
+        if (admission.webTurn()) {
+            stageStart = profiler.beginStage(PROF_HANDLE_CLIENT);
+            // Requests arrive on all connections in the background; complete
+            // ones are handled here, oldest first, while the budget lasts
+            uint32_t webStart = micros();
+            do {
+                scratch.reset();
+            } while (server.handleClient() && micros() - webStart < WEB_TICK_BUDGET_US);
+            admission.webSpent(micros() - webStart);
+            profiler.endStage(PROF_HANDLE_CLIENT, stageStart);
+        } else {
+            metrics.inc(MC_HTTP_DEFERRED);
+        }
+        
         if ((millis() - lastTimeSync) > SYNC_INTERVAL) {
+            stageStart = profiler.beginStage(PROF_NTP_SYNC);
             updateLocalTime();
             updateSunriseSunsetTime();
             lastTimeSync = millis();
+            profiler.endStage(PROF_NTP_SYNC, stageStart);
         }
     } else if (wifiEnabled) {
+        metrics.inc(MC_WIFI_RECONNECTS);
+        stageStart = profiler.beginStage(PROF_WIFI_CONNECT);
         connectToWiFi();
+        profiler.endStage(PROF_WIFI_CONNECT, stageStart);
+    }
+    
+    if (FORECAST_SHARE_ENABLED) {
+        stageStart = profiler.beginStage(PROF_FORECAST_SHARE);
+        forecastShare.poll(forecastCache, utcNow(), locationLatitude, locationLongitude);
+        if (forecastShare.wantsRefresh(forecastCache, utcNow())) {
+            fetchForecast(utcNow());
+        }
+        profiler.endStage(PROF_FORECAST_SHARE, stageStart);
+    }
+    
+    if (MQTT_ENABLED) {
+        stageStart = profiler.beginStage(PROF_MQTT);
+        mqttPublisher.poll(millis());
+        profiler.endStage(PROF_MQTT, stageStart);
     }
     
     if (currentState != previousState) {
+        stageStart = profiler.beginStage(PROF_STATE_LOG);
         logManager.logSystemState(currentState);
         previousState = currentState;
+        profiler.endStage(PROF_STATE_LOG, stageStart);
     }
     
+    stageStart = profiler.beginStage(PROF_INPUT_TRACE);
+    recordInputs();
+    profiler.endStage(PROF_INPUT_TRACE, stageStart);
+    
     if (manualOverride) {
         unsigned long overrideElapsedMinutes = (millis() - manualOverrideStartTime) / 60000;
         
@@ -1139,19 +2341,33 @@ void loop() {
             manualOverride = false;
             currentState = NORMAL;
             cloudTriggeredActivation = false;
-            Serial.println("Manual override expired, returning to automatic control");
-        } else {
+            TRACE_INFO(TR_OVERRIDE_EXPIRED);
+        } else if ((digitalRead(RELAY_PIN) == relayOn) != manualLightState) {
+            // Only when the relay disagrees, so an override isn't logged every pass
+            stageStart = profiler.beginStage(PROF_RELAY_UPDATE);
             toggleLights(manualLightState);
+            profiler.endStage(PROF_RELAY_UPDATE, stageStart);
         }
     } else {
+        stageStart = profiler.beginStage(PROF_DECISION);
         time_t now = timeClient.getEpochTime();
         int currentHour = hour(now);
         int currentMinute = minute(now);
         
         isWithinMonitoringWindow(currentHour, currentMinute);
         
-        bool shouldBeOn = shouldActivateLights(currentHour, currentMinute);
+        bool shouldBeOn;
+        const PlanEntry *entry = currentPlanEntry(now);
+        if (entry != NULL) {
+            refreshPlanForecast(currentHour * 60 + currentMinute);
+            shouldBeOn = applyPlanEntry(*entry);
+        } else {
+            // Before the clock is set, or past the end of a truncated plan
+            shouldBeOn = shouldActivateLights(currentHour, currentMinute);
+        }
+        profiler.endStage(PROF_DECISION, stageStart);
         
+        stageStart = profiler.beginStage(PROF_RELAY_UPDATE);
         static bool previousLightState = false;
         if (shouldBeOn != previousLightState) {
             toggleLights(shouldBeOn);
@@ -1159,12 +2375,12 @@ void loop() {
             
             if (shouldBeOn) {
                 if (cloudTriggeredActivation) {
-                    Serial.println("Lights ON: Cloud coverage triggered early activation");
+                    TRACE_INFO(TR_LIGHTS_ON_CLOUD);
                 } else {
-                    Serial.println("Lights ON: Regular schedule");
+                    TRACE_INFO(TR_LIGHTS_ON_SCHEDULE);
                 }
             } else {
-                Serial.println("Lights OFF: Regular schedule");
+                TRACE_INFO(TR_LIGHTS_OFF);
             }
         }
         
@@ -1174,77 +2390,159 @@ void loop() {
         } else {
             digitalWrite(STATUS_LED_PIN, shouldBeOn);
         }
+        profiler.endStage(PROF_RELAY_UPDATE, stageStart);
     }
     
+    stageStart = profiler.beginStage(PROF_ZONES);
+    updateZones();
+    trackEnergy();
+    profiler.endStage(PROF_ZONES, stageStart);
+    
+    traceLog.drain(TRACE_DRAIN_PER_TICK);
+    metrics.observe(MH_LOOP, micros() - loopStart);
+    profiler.endLoop();
+    
     delay(100);
     yield();
 }
 
 //================ HELPER FUNCTIONS ================
+void sendRejected(AdmissionResult result, uint32_t retryAfter) {
+    metrics.inc(result == REJECT_RATE ? MC_HTTP_REJECTED_RATE : MC_HTTP_REJECTED_EXPENSIVE);
+    server.sendHeader(PSTR("Retry-After"), String(retryAfter));
+    server.send_P(429, "application/json", result == REJECT_RATE ? PSTR("{\"success\":false,\"error\":\"rate limited\"}")
+                                                                 : PSTR("{\"success\":false,\"error\":\"busy, try again later\"}"));
+}
+
+// Runs before a request reaches its handler; rejected requests get a 429
+// without reaching authentication
+bool admitRequest(uint32_t remoteIp, const char *url) {
+    uint32_t retryAfter = 0;
+    AdmissionResult result = admission.admit(remoteIp, millis(), retryAfter);
+    if (result == ADMIT) return true;
+    sendRejected(result, retryAfter);
+    return false;
+}
+
+// For authenticated handlers about to block the loop for a forecast fetch,
+// a Wi-Fi reconnect, an NTP sync or benchmarks; all clients together get
+// ADMISSION_EXPENSIVE_BURST of them. False once a 429 has been sent.
+bool admitBlocking() {
+    uint32_t retryAfter = 0;
+    AdmissionResult result = admission.admitBlocking(millis(), retryAfter);
+    if (result == ADMIT) return true;
+    sendRejected(result, retryAfter);
+    return false;
+}
+
 void setupWebServer() {
-    server.on("/", HTTP_GET, handleRoot);
-    server.on("/settime", HTTP_POST, handleSetTime);
-    server.on("/toggle", HTTP_GET, handleToggle);
-    server.on("/cloudcheck", HTTP_GET, handleCloudMonitoring);
-    server.on("/saveconfig", HTTP_POST, handleSaveConfig);
-    server.on("/saveadvanced", HTTP_POST, handleSaveAdvanced);
-    server.on("/savelocation", HTTP_POST, handleSaveLocation);
-    server.on("/savesystem", HTTP_POST, handleSaveSystem);
-    server.on("/reboot", HTTP_GET, handleReboot);
-    
-    server.on("/api/status", HTTP_GET, handleSystemStatus);
-    server.on("/api/logs", HTTP_GET, handleGetLogs); 
-    
-    server.on("/reset", HTTP_GET, []() {
+    server.setAdmitHook(admitRequest);
+    server.setSessionCheck(checkSessionCookie);
+    server.on(PSTR("/login"), HTTP_GET, handleLoginPage);
+    server.on(PSTR("/login"), HTTP_POST, handleLogin);
+    server.on(PSTR("/logout"), HTTP_GET, handleLogout);
+    server.on(PSTR("/"), HTTP_GET, handleRoot);
+    server.on(PSTR("/settime"), HTTP_POST, handleSetTime);
+    server.on(PSTR("/toggle"), HTTP_GET, handleToggle);
+    server.on(PSTR("/cloudcheck"), HTTP_GET, handleCloudMonitoring);
+    server.on(PSTR("/saveconfig"), HTTP_POST, handleSaveConfig);
+    server.on(PSTR("/saveadvanced"), HTTP_POST, handleSaveAdvanced);
+    server.on(PSTR("/savelocation"), HTTP_POST, handleSaveLocation);
+    server.on(PSTR("/savesystem"), HTTP_POST, handleSaveSystem);
+    server.on(PSTR("/reboot"), HTTP_GET, handleReboot);
+    
+    server.on(PSTR("/api/status"), HTTP_GET, handleSystemStatus);
+    server.on(PSTR("/api/logs"), HTTP_GET, handleGetLogs);
+    server.on(PSTR("/api/config"), HTTP_GET, handleGetConfig);
+    server.on(PSTR("/api/config"), HTTP_PUT, handlePutConfig);
+    server.on(PSTR("/api/trace"), HTTP_GET, handleGetTrace);
+    server.on(PSTR("/api/inputtrace"), HTTP_GET, handleGetInputTrace);
+    server.on(PSTR("/metrics"), HTTP_GET, handleMetrics);
+    server.on(PSTR("/api/profile"), HTTP_GET, handleGetProfile);
+    server.on(PSTR("/api/bench"), HTTP_GET, handleBench);
+    server.on(PSTR("/api/zones"), HTTP_GET, handleGetZones);
+    server.on(PSTR("/api/zones"), HTTP_PUT, handlePutZones);
+    server.on(PSTR("/api/zones/toggle"), HTTP_GET, handleZoneToggle);
+    server.on(PSTR("/api/mqtt"), HTTP_GET, handleGetMqtt);
+    server.on(PSTR("/api/plan"), HTTP_GET, handleGetPlan);
+    server.on(PSTR("/api/energy"), HTTP_GET, handleGetEnergy);
+    
+    server.on(PSTR("/reset"), HTTP_GET, []() {
         loadSettings();
-        server.sendHeader("Location", "/");
+        loadZones();
+        setupZonePins();
+        server.sendHeader(PSTR("Location"), "/");
         server.send(303);
     });
     
-    server.on("/updateonline", HTTP_GET, []() {
+    server.on(PSTR("/updateonline"), HTTP_GET, []() {
+        if (!server.authenticate(http_username, http_password)) {
+            return server.requestAuthentication();
+        }
+        if (!admitBlocking()) return;
         updateSunriseSunsetTime();
-        server.sendHeader("Location", "/");
+        server.sendHeader(PSTR("Location"), "/");
         server.send(303);
     });
-    server.on("/reconnect", HTTP_GET, []() {
+    server.on(PSTR("/reconnect"), HTTP_GET, []() {
+        if (!server.authenticate(http_username, http_password)) {
+            return server.requestAuthentication();
+        }
+        if (!admitBlocking()) return;
+        metrics.inc(MC_WIFI_RECONNECTS);
         enableWiFi();
         connectToWiFi();
-        server.sendHeader("Location", "/");
+        server.sendHeader(PSTR("Location"), "/");
         server.send(303);
     });
-    server.on("/factory_reset", HTTP_GET, []() {
-        Serial.println("FACTORY RESET requested - resetting credentials to admin/admin");
+    server.on(PSTR("/factory_reset"), HTTP_GET, []() {
+        TRACE_WARN(TR_FACTORY_RESET);
         strcpy(adminUsername, "admin");
         strcpy(adminPassword, "admin");
         strcpy(http_username, "admin");
         strcpy(http_password, "admin");
         saveSettings();
         
-        server.send(200, "text/html", "<html><body><h1>Credentials Reset</h1>"
-                   "<p>Username and password have been reset to: admin/admin</p>"
-                   "<p><a href='/'>Go to login page</a></p></body></html>");
+        server.send_P(200, "text/html", PSTR("<html><body><h1>Credentials Reset</h1>"
+                                             "<p>Username and password have been reset to: admin/admin</p>"
+                                             "<p><a href='/'>Go to login page</a></p></body></html>"));
     });
     
-    server.on("/debug_auth", HTTP_GET, []() {
-        String debug = "<html><body><h1>Auth Debug</h1>";
-        debug += "<p>Current credentials: " + String(http_username) + " / " + String(http_password) + "</p>";
-        debug += "<p>EEPROM credentials: " + String(adminUsername) + " / " + String(adminPassword) + "</p>";
-        debug += "</body></html>";
-        
-        server.send(200, "text/html", debug);
+    server.on(PSTR("/debug_auth"), HTTP_GET, []() {
+        ScratchWriter out(scratch);
+        out.printf_P(PSTR("<html><body><h1>Auth Debug</h1>"
+                          "<p>Current credentials: %s / %s</p>"
+                          "<p>EEPROM credentials: %s / %s</p>"
+                          "</body></html>"),
+                     http_username, http_password, adminUsername, adminPassword);
+        sendScratch(200, "text/html", out);
     });
     server.onNotFound(handleNotFound);
     server.enableCORS(true);
-    Serial.println("Web server routes configured");
+    server.enableCompression(HTTP_GZIP_MIN_BYTES);
+    TRACE_INFO(TR_ROUTES_CONFIGURED);
 }
 
 //================ NEW API ENDPOINT FOR LOGS ================
 void handleGetLogs() {
+    MetricTimer timer(MH_HTTP_API);
     if (!server.authenticate(http_username, http_password)) {
         return server.requestAuthentication();
     }
     
-    String type = server.hasArg("type") ? server.arg("type") : "cloud";
+    // Incremental form used by the fleet collector: every type, resumable cursor
+    if (server.hasArg(PSTR("since"))) {
+        uint32_t since = strtoul(server.arg(PSTR("since")).c_str(), NULL, 10);
+        uint16_t skip = server.hasArg(PSTR("skip")) ? server.arg(PSTR("skip")).toInt() : 0;
+        size_t available;
+        char *out = scratch.tail(available);
+        size_t len = logManager.getLogsSinceJson(since, skip, out, available);
+        scratch.commitTail(len + 1);
+        server.send(200, "application/json", out, len);
+        return;
+    }
+    
+    String type = server.hasArg(PSTR("type")) ? server.arg(PSTR("type")) : "cloud";
     LogEntryType logType = LOG_CLOUD_COVERAGE;
     
     if (type == "light") {
@@ -1255,6 +2553,510 @@ void handleGetLogs() {
         logType = LOG_ERROR;
     }
     
-    String jsonResponse = logManager.getLogsAsJson(logType);
-    server.send(200, "application/json", jsonResponse);
-}
\ No newline at end of file
+    // Charts ask for a bounded number of points however long the history is
+    if (server.hasArg(PSTR("points"))) {
+        int points = constrain(server.arg(PSTR("points")).toInt(), 2, LOG_CHART_MAX_POINTS);
+        uint16_t zone = server.hasArg(PSTR("zone")) ? constrain(server.arg(PSTR("zone")).toInt(), 0, MAX_ZONES) : 0;
+        LogBucket *buckets = (LogBucket *)scratch.alloc(sizeof(LogBucket) * points);
+        if (buckets == NULL) {
+            server.send_P(500, "application/json", PSTR("{\"success\":false,\"error\":\"out of scratch memory\"}"));
+            return;
+        }
+        size_t available;
+        char *out = scratch.tail(available);
+        size_t len = logManager.getDecimatedLogsAsJson(logType, points, zone, buckets, out, available);
+        scratch.commitTail(len + 1);
+        server.send(200, "application/json", out, len);
+        return;
+    }
+    
+    size_t available;
+    char *out = scratch.tail(available);
+    size_t len = logManager.getLogsAsJson(logType, out, available);
+    scratch.commitTail(len + 1);
+    server.send(200, "application/json", out, len);
+}
+
+//================ TRACE API ENDPOINT ================
+void handleGetTrace() {
+    MetricTimer timer(MH_HTTP_API);
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+    
+    uint32_t since = server.hasArg(PSTR("since")) ? server.arg(PSTR("since")).toInt() : 0;
+    if (since < traceLog.getOldestSeq()) since = traceLog.getOldestSeq();
+    
+    ScratchWriter out(scratch);
+    out.printf_P(PSTR("{\"next\":%u,\"dropped\":%u,\"records\":["), traceLog.getNextSeq(), traceLog.getDroppedCount());
+    
+    char line[TRACE_LINE_SIZE];
+    bool first = true;
+    for (uint32_t seq = since; seq < traceLog.getNextSeq(); seq++) {
+        const TraceRecord *rec = traceLog.get(seq);
+        if (rec == NULL) continue;
+        traceLog.format(*rec, line, sizeof(line));
+        out.printf_P(PSTR("%s{\"seq\":%u,\"ms\":%u,\"level\":\"%s\",\"msg\":"), 
+                     first ? "" : ",", rec->seq, rec->timestamp, TraceBuffer::levelName(rec->level).c_str());
+        out.jsonString(line);
+        out.printf_P(PSTR("}"));
+        first = false;
+    }
+    out.printf_P(PSTR("]}"));
+    sendScratch(200, "application/json", out);
+}
+
+//================ INPUT TRACE ENDPOINT ================
+// The raw recorder ring for tools/trace_replay.cpp; clear=1 empties it once
+// copied, so consecutive downloads neither overlap nor miss a record
+void handleGetInputTrace() {
+    MetricTimer timer(MH_HTTP_API);
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+    
+    size_t size = inputTrace.downloadSize();
+    uint8_t *out = (uint8_t *)scratch.alloc(size);
+    if (out == NULL) {
+        server.send_P(500, "application/json", PSTR("{\"success\":false,\"error\":\"out of scratch memory\"}"));
+        return;
+    }
+    size_t len = inputTrace.copyTo(out, size);
+    if (server.hasArg(PSTR("clear"))) inputTrace.clear();
+    
+    server.sendHeader(PSTR("Content-Disposition"), "attachment; filename=\"inputtrace.bin\"");
+    server.send(200, "application/octet-stream", (const char *)out, len);
+}
+
+//================ METRICS ENDPOINT ================
+// Exposition text is batched in a scratch buffer and sent as chunks
+char *metricsChunk = NULL;
+size_t metricsChunkSize = 0;
+size_t metricsChunkLen = 0;
+
+void flushMetricsChunk() {
+    if (metricsChunkLen > 0) {
+        server.sendContent(metricsChunk, metricsChunkLen);
+        metricsChunkLen = 0;
+    }
+}
+
+void appendMetricsText(const char *text, size_t len) {
+    if (metricsChunkLen + len > metricsChunkSize) flushMetricsChunk();
+    if (len > metricsChunkSize) {
+        server.sendContent(text, len);
+        return;
+    }
+    memcpy(metricsChunk + metricsChunkLen, text, len);
+    metricsChunkLen += len;
+}
+
+void handleMetrics() {
+    MetricTimer timer(MH_HTTP_API);
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+    
+    metrics.set(MG_FREE_HEAP, ESP.getFreeHeap());
+    metrics.set(MG_MIN_FREE_HEAP, minFreeHeap);
+    metrics.set(MG_HEAP_FRAGMENTATION, ESP.getHeapFragmentation());
+    metrics.set(MG_MAX_FREE_BLOCK, ESP.getMaxFreeBlockSize());
+    metrics.set(MG_UPTIME, millis() / 1000);
+    metrics.set(MG_MQTT_QUEUE_DEPTH, mqttPublisher.getQueueDepth());
+    metrics.set(MG_HTTP_CONNECTIONS, server.getActiveConnections());
+    metrics.set(MG_HTTP_BUFFERED, server.getBufferedBytes());
+    
+    metricsChunkSize = 1024;
+    metricsChunk = (char *)scratch.alloc(metricsChunkSize);
+    if (metricsChunk == NULL) {
+        server.send_P(500, "text/plain", PSTR("Out of scratch memory"));
+        return;
+    }
+    metricsChunkLen = 0;
+    
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send_P(200, "text/plain; version=0.0.4", PSTR(""));
+    metrics.render(appendMetricsText);
+    flushMetricsChunk();
+    server.sendContent("");
+}
+
+//================ LOOP PROFILER ENDPOINT ================
+void handleGetProfile() {
+    MetricTimer timer(MH_HTTP_API);
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+    
+    ScratchWriter out(scratch);
+    out.printf_P(PSTR("{\"cpuMHz\":%u,\"loops\":%u,\"stalls\":%u,\"stallThresholdMs\":%u,\"stages\":["),
+                 ESP.getCpuFreqMHz(), profiler.getLoopCount(), profiler.getStallCount(), PROFILER_STALL_MS);
+    
+    for (uint8_t i = 0; i < PROF_STAGE_COUNT; i++) {
+        uint32_t count, minUs, avgUs, maxUs, p99Us;
+        profiler.getStageSummary((ProfileStage)i, count, minUs, avgUs, maxUs, p99Us);
+        out.printf_P(PSTR("%s{\"name\":\"%s\",\"count\":%u,\"minUs\":%u,\"avgUs\":%u,\"maxUs\":%u,\"p99Us\":%u}"),
+                     i == 0 ? "" : ",", LoopProfiler::stageName(i).c_str(), count, minUs, avgUs, maxUs, p99Us);
+    }
+    out.printf_P(PSTR("],\"lastStall\":"));
+    
+    StallReport stall;
+    if (profiler.getLastStall(stall)) {
+        out.printf_P(PSTR("{\"loop\":%u,\"uptimeMs\":%u,\"loopUs\":%u,\"watchdog\":%s,\"resetReason\":%u,\"activeStage\":\"%s\",\"stageUs\":{"),
+                     stall.sequence, stall.uptimeMs, stall.loopMicros, stall.watchdog ? "true" : "false",
+                     stall.resetReason, LoopProfiler::stageName(stall.activeStage).c_str());
+        for (uint8_t i = 0; i < PROF_STAGE_COUNT; i++) {
+            out.printf_P(PSTR("%s\"%s\":%u"), i == 0 ? "" : ",", LoopProfiler::stageName(i).c_str(), stall.stageMicros[i]);
+        }
+        out.printf_P(PSTR("}}"));
+    } else {
+        out.printf_P(PSTR("null"));
+    }
+    out.printf_P(PSTR("}"));
+    
+    if (server.hasArg(PSTR("reset"))) {
+        profiler.reset();
+    }
+    sendScratch(200, "application/json", out);
+}
+
+//================ BENCHMARK ENDPOINT ================
+// Hot-path timings for comparing firmware builds. The decision cases run on
+// a private copy of the state and log writes stay in the EEPROM RAM copy.
+#define BENCH_LOG_JSON_SIZE 3200
+
+struct ForecastBench {
+    char *pristine;
+    char *work;
+    size_t length;
+    ForecastCache cache;
+};
+
+struct LogJsonBench {
+    char *out;
+    size_t size;
+};
+
+struct GzipBench {
+    GzipEncoder encoder;
+    uint8_t dest[GZIP_BOUND(GZIP_MAX_INPUT)];
+    const char *json;
+    size_t length;
+    size_t compressed;
+};
+
+DecisionState benchDecision;
+DecisionParams benchParams;
+
+float benchCloudSource() {
+    return 85;
+}
+
+void benchDecisionSetup(void *ctx) {
+    initDecisionState(benchDecision);
+}
+
+void benchDecisionRun(void *ctx) {
+    shouldActivateLights(benchDecision, benchParams, *(int *)ctx, benchCloudSource);
+}
+
+float benchPlanCloud(void *ctx, int minute) {
+    return 85;
+}
+
+void benchPlanBuildRun(void *ctx) {
+    buildDayPlan(*(DayPlan *)ctx, benchParams, 0, 0, benchPlanCloud, NULL);
+}
+
+void benchPlanLookupRun(void *ctx) {
+    planEntryAt(*(DayPlan *)ctx, benchParams.sunsetTime - 1);
+}
+
+struct ZoneBench {
+    ZoneConfig configs[MAX_ZONES];
+    ZoneRuntime runtime[MAX_ZONES];
+    ZoneTick tick;
+};
+
+void benchZonesSetup(void *ctx) {
+    ZoneBench *b = (ZoneBench *)ctx;
+    for (int i = 0; i < MAX_ZONES; i++) initZoneRuntime(b->runtime[i]);
+}
+
+void benchZonesRun(void *ctx) {
+    ZoneBench *b = (ZoneBench *)ctx;
+    evaluateZones(b->configs, b->runtime, MAX_ZONES, b->tick);
+}
+
+void benchSunTimesRun(void *ctx) {
+    int sunriseTime, sunsetTime;
+    computeSunTimes(sunriseTime, sunsetTime);
+}
+
+void benchForecastSetup(void *ctx) {
+    ForecastBench *b = (ForecastBench *)ctx;
+    memcpy(b->work, b->pristine, b->length + 1);
+}
+
+void benchForecastRun(void *ctx) {
+    ForecastBench *b = (ForecastBench *)ctx;
+    parseForecast(b->work, b->cache);
+}
+
+void benchRootRenderRun(void *ctx) {
+    RootPageStream *page = beginRootPage();
+    if (page == NULL) return;
+    char chunk[HTTP_STREAM_CHUNK];
+    while (produceRootPage(page, chunk, sizeof(chunk)) > 0) {
+    }
+    releaseRootPage(page);
+}
+
+// One request's credentials, both ways
+struct AuthBench {
+    char authorization[96];
+    char cookie[64];
+};
+
+void benchAuthBasicRun(void *ctx) {
+    AsyncHttpServer::basicAuthMatches(((AuthBench *)ctx)->authorization, http_username, http_password);
+}
+
+void benchAuthSessionRun(void *ctx) {
+    checkSessionCookie(((AuthBench *)ctx)->cookie);
+}
+
+// A full ring, so every record also drops the oldest one
+#define BENCH_INPUT_TRACE_SIZE 1024
+
+struct InputTraceBench {
+    InputTrace trace;
+    uint8_t ring[BENCH_INPUT_TRACE_SIZE];
+    InputTraceSettings settings;
+};
+
+void benchInputPollRun(void *ctx) {
+    InputTraceBench *b = (InputTraceBench *)ctx;
+    InputTraceSettings settings;
+    captureInputSettings(settings);
+    if (memcmp(&settings, &b->settings, sizeof(settings)) != 0) b->settings = settings;
+}
+
+void benchInputCheckpointRun(void *ctx) {
+    uint32_t epoch = timeClient.getEpochTime();
+    ((InputTraceBench *)ctx)->trace.record(IT_CHECKPOINT, millis(), &epoch, sizeof(epoch));
+}
+
+void benchInputForecastRun(void *ctx) {
+    ((InputTraceBench *)ctx)->trace.recordForecast(millis(), forecastCache);
+}
+
+void benchLogAddRun(void *ctx) {
+    logManager.addLog(LOG_LIGHT_STATE, 1);
+}
+
+void benchLogJsonRun(void *ctx) {
+    LogJsonBench *b = (LogJsonBench *)ctx;
+    logManager.getLogsAsJson(LOG_LIGHT_STATE, b->out, b->size);
+}
+
+void benchGzipRun(void *ctx) {
+    GzipBench *b = (GzipBench *)ctx;
+    b->encoder.begin();
+    b->compressed = 0;
+    b->encoder.write((const uint8_t *)b->json, b->length, b->dest, [b](const uint8_t *, size_t n) {
+        b->compressed += n;
+    });
+    b->compressed += b->encoder.finish(b->dest);
+}
+
+// Builds an Open-Meteo style hourly payload. Returns false if the heap can't hold it.
+bool buildForecastPayload(ForecastBench &b, int days) {
+    int hours = days * 24;
+    size_t capacity = 480 + hours * (24 + FC_COUNT * 6);
+    b.pristine = (char *)malloc(capacity);
+    b.work = (char *)malloc(capacity);
+    if (b.pristine == NULL || b.work == NULL) {
+        free(b.pristine);
+        free(b.work);
+        return false;
+    }
+    
+    size_t len = snprintf_P(b.pristine, capacity,
+        PSTR("{\"latitude\":%.4f,\"longitude\":%.4f,\"generationtime_ms\":0.05,\"utc_offset_seconds\":0,"
+        "\"timezone\":\"GMT\",\"timezone_abbreviation\":\"GMT\",\"elevation\":10.0,"
+        "\"hourly_units\":{\"time\":\"iso8601\"},\"hourly\":{\"time\":["),
+        locationLatitude, locationLongitude);
+    for (int h = 0; h < hours; h++) {
+        len += snprintf_P(b.pristine + len, capacity - len, PSTR("%s\"2025-01-%02dT%02d:00\""),
+                          h == 0 ? "" : ",", 1 + h / 24, h % 24);
+    }
+    len += snprintf_P(b.pristine + len, capacity - len, PSTR("]"));
+    for (uint8_t c = 0; c < FC_COUNT; c++) {
+        len += snprintf_P(b.pristine + len, capacity - len, PSTR(",\"%s\":["), forecastColumnName(c).c_str());
+        for (int h = 0; h < hours; h++) {
+            len += snprintf_P(b.pristine + len, capacity - len, PSTR("%s%d.%d"), h == 0 ? "" : ",", (h * 37 + c * 11) % 101,
+                              h % 10);
+        }
+        len += snprintf_P(b.pristine + len, capacity - len, PSTR("]"));
+    }
+    len += snprintf_P(b.pristine + len, capacity - len, PSTR("}}"));
+    
+    b.length = len;
+    return true;
+}
+
+void fillBenchLogs(uint16_t count) {
+    logManager.resetLogs(now());
+    for (uint16_t i = 0; i < count; i++) {
+        logManager.addLog(LOG_LIGHT_STATE, i & 1);
+    }
+}
+
+void writeBenchResult(ScratchWriter &out, bool &first, const char *name, const BenchResult &r) {
+    uint32_t avgCycles = r.iterations > 0 ? (uint32_t)(r.totalCycles / r.iterations) : 0;
+    out.printf_P(PSTR("%s{\"name\":\"%s\",\"iterations\":%u,\"minCycles\":%u,\"avgCycles\":%u,\"maxCycles\":%u,\"avgUs\":%u}"),
+                 first ? "" : ",", name, r.iterations, r.minCycles, avgCycles, r.maxCycles,
+                 avgCycles / ESP.getCpuFreqMHz());
+    first = false;
+}
+
+void handleBench() {
+    MetricTimer timer(MH_HTTP_API);
+    if (!server.authenticate(http_username, http_password)) {
+        return server.requestAuthentication();
+    }
+    if (!admitBlocking()) return;
+    
+    char *logJson = (char *)scratch.alloc(BENCH_LOG_JSON_SIZE);
+    if (logJson == NULL) {
+        server.send_P(500, "application/json", PSTR("{\"success\":false,\"error\":\"out of scratch memory\"}"));
+        return;
+    }
+    
+    ScratchWriter out(scratch);
+    out.printf_P(PSTR("{\"cpuMHz\":%u,\"freeHeap\":%u,\"results\":["), ESP.getCpuFreqMHz(), ESP.getFreeHeap());
+    bool first = true;
+    BenchResult result;
+    char name[24];
+    
+    // Decision evaluation inside a monitoring window (samples clouds) and at midday
+    benchParams = currentDecisionParams();
+    int windowTime = benchParams.sunsetTime - 1;
+    int middayTime = (benchParams.sunriseTime + benchParams.sunsetTime) / 2;
+    runBench(benchDecisionRun, benchDecisionSetup, &windowTime, 1000, result);
+    writeBenchResult(out, first, "decision_window", result);
+    runBench(benchDecisionRun, benchDecisionSetup, &middayTime, 1000, result);
+    writeBenchResult(out, first, "decision_midday", result);
+    
+    // What the loop does instead once the day's plan exists
+    DayPlan *plan = (DayPlan *)malloc(sizeof(DayPlan));
+    if (plan != NULL) {
+        runBench(benchPlanBuildRun, NULL, plan, 3, result);
+        writeBenchResult(out, first, "plan_build", result);
+        runBench(benchPlanLookupRun, NULL, plan, 1000, result);
+        writeBenchResult(out, first, "plan_lookup", result);
+        free(plan);
+    }
+    
+    // Full zone table, with staggered offsets so some zones sit in a window
+    ZoneBench *zoneBench = (ZoneBench *)malloc(sizeof(ZoneBench));
+    if (zoneBench != NULL) {
+        for (int i = 0; i < MAX_ZONES; i++) {
+            initZoneConfig(zoneBench->configs[i], i, cloudThreshold, cloudHysteresis, monitoringWindow);
+            zoneBench->configs[i].flags = ZONE_ENABLED;
+            zoneBench->configs[i].pin = i;
+            zoneBench->configs[i].sunsetOffset = i * 5;
+        }
+        zoneBench->tick = { windowTime, benchParams.sunriseTime, benchParams.sunsetTime, maxRetries, 0, 60000,
+                            benchCloudSource };
+        runBench(benchZonesRun, benchZonesSetup, zoneBench, 1000, result);
+        writeBenchResult(out, first, "zones_16", result);
+        free(zoneBench);
+    } else {
+        out.printf_P(PSTR("%s{\"name\":\"zones_16\",\"error\":\"out of memory\"}"), first ? "" : ",");
+        first = false;
+    }
+    
+    runBench(benchSunTimesRun, NULL, NULL, 100, result);
+    writeBenchResult(out, first, "sun_times", result);
+    
+    AuthBench authBench;
+    char token[SESSION_TOKEN_LEN + 1];
+    sessionIssue(millis() / 1000, token);
+    snprintf_P(authBench.authorization, sizeof(authBench.authorization), PSTR("Basic %s"),
+               base64::encode(String(http_username) + ":" + http_password, false).c_str());
+    snprintf_P(authBench.cookie, sizeof(authBench.cookie), PSTR("theme=dark; " SESSION_COOKIE_NAME "=%s"), token);
+    runBench(benchAuthBasicRun, NULL, &authBench, 1000, result);
+    writeBenchResult(out, first, "auth_basic", result);
+    runBench(benchAuthSessionRun, NULL, &authBench, 1000, result);
+    writeBenchResult(out, first, "auth_session", result);
+    
+    static const uint8_t forecastDays[] = { 1, 7, 16 };
+    for (uint8_t i = 0; i < sizeof(forecastDays); i++) {
+        snprintf_P(name, sizeof(name), PSTR("forecast_parse_%ud"), forecastDays[i]);
+        ForecastBench forecast;
+        if (!buildForecastPayload(forecast, forecastDays[i])) {
+            out.printf_P(PSTR("%s{\"name\":\"%s\",\"error\":\"out of memory\"}"), first ? "" : ",", name);
+            first = false;
+            continue;
+        }
+        runBench(benchForecastRun, benchForecastSetup, &forecast, 10, result);
+        writeBenchResult(out, first, name, result);
+        free(forecast.pristine);
+        free(forecast.work);
+    }
+    
+    // Recorder cost: the per-pass settings check and the two record sizes
+    InputTraceBench *inputBench = (InputTraceBench *)malloc(sizeof(InputTraceBench));
+    if (inputBench != NULL) {
+        inputBench->trace.begin(inputBench->ring, sizeof(inputBench->ring));
+        captureInputSettings(inputBench->settings);
+        runBench(benchInputPollRun, NULL, inputBench, 1000, result);
+        writeBenchResult(out, first, "input_trace_poll", result);
+        runBench(benchInputCheckpointRun, NULL, inputBench, 1000, result);
+        writeBenchResult(out, first, "input_trace_checkpoint", result);
+        runBench(benchInputForecastRun, NULL, inputBench, 100, result);
+        writeBenchResult(out, first, "input_trace_forecast", result);
+        free(inputBench);
+    } else {
+        out.printf_P(PSTR("%s{\"name\":\"input_trace\",\"error\":\"out of memory\"}"), first ? "" : ",");
+        first = false;
+    }
+    
+    runBench(benchRootRenderRun, NULL, NULL, 3, result);
+    writeBenchResult(out, first, "root_render", result);
+    
+    // Log cases measure the RAM-side cost; commit latency is in /metrics
+    logManager.setCommitsSuspended(true);
+    fillBenchLogs(0);
+    runBench(benchLogAddRun, NULL, NULL, MAX_LOG_ENTRIES, result);
+    writeBenchResult(out, first, "log_add", result);
+    
+    static const uint8_t logFill[] = { 0, 25, 50, 100 };
+    LogJsonBench logBench = { logJson, BENCH_LOG_JSON_SIZE };
+    for (uint8_t i = 0; i < sizeof(logFill); i++) {
+        fillBenchLogs(logFill[i]);
+        snprintf_P(name, sizeof(name), PSTR("log_json_%u"), logFill[i]);
+        runBench(benchLogJsonRun, NULL, &logBench, 20, result);
+        writeBenchResult(out, first, name, result);
+    }
+    
+    // Compressing the full log JSON, the largest body the server sends
+    GzipBench *gzipBench = (GzipBench *)malloc(sizeof(GzipBench));
+    if (gzipBench != NULL) {
+        gzipBench->json = logJson;
+        gzipBench->length = logManager.getLogsAsJson(LOG_LIGHT_STATE, logJson, BENCH_LOG_JSON_SIZE);
+        runBench(benchGzipRun, NULL, gzipBench, 10, result);
+        writeBenchResult(out, first, "gzip_log_json", result);
+        free(gzipBench);
+    } else {
+        out.printf_P(PSTR("%s{\"name\":\"gzip_log_json\",\"error\":\"out of memory\"}"), first ? "" : ",");
+        first = false;
+    }
+    logManager.setCommitsSuspended(false);
+    logManager.reload();
+    
+    out.printf_P(PSTR("]}"));
+    sendScratch(200, "application/json", out);
+}
@@ -0,0 +1,135 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+// Admission control for the web server, which shares the loop with relay
+// control. Each client gets a token bucket, requests that are about to block
+// the loop share one more, and time spent serving requests beyond the
+// per-pass budget is paid back by skipping later passes.
+
+#include <stdint.h>
+#include <string.h>
+
+#define ADMISSION_CLIENTS 8                 // Clients tracked; the least recently seen is replaced
+#define ADMISSION_BURST 20                  // Requests a client may make back to back (a dashboard load is ~8)
+#define ADMISSION_REFILL_MS 250             // One request token per period
+#define ADMISSION_EXPENSIVE_BURST 2         // Blocking requests, shared by all clients
+#define ADMISSION_EXPENSIVE_REFILL_MS 30000
+#define WEB_TICK_BUDGET_US 40000            // Average handleClient() time allowed per loop pass
+#define WEB_DEBT_MAX_US 2000000             // Caps how long one slow request defers the server (~5 s)
+
+enum AdmissionResult {
+  ADMIT,
+  REJECT_RATE,        // The client exceeded its own rate
+  REJECT_EXPENSIVE    // Too many blocking requests across all clients
+};
+
+struct TokenBucket {
+  uint16_t tokens;
+  uint32_t lastMs;    // Time the last whole token was credited
+
+  void reset(uint16_t burst, uint32_t nowMs) {
+    tokens = burst;
+    lastMs = nowMs;
+  }
+
+  bool take(uint16_t burst, uint32_t refillMs, uint32_t nowMs) {
+    uint32_t added = (nowMs - lastMs) / refillMs;
+    if (added > 0) {
+      if (tokens + added >= burst) {
+        tokens = burst;
+        lastMs = nowMs;
+      } else {
+        tokens += added;
+        lastMs += added * refillMs;
+      }
+    }
+    if (tokens == 0) return false;
+    tokens--;
+    return true;
+  }
+
+  // Seconds until the next token, rounded up for Retry-After
+  uint32_t retryAfterSec(uint32_t refillMs, uint32_t nowMs) const {
+    uint32_t elapsed = nowMs - lastMs;
+    uint32_t waitMs = elapsed < refillMs ? refillMs - elapsed : 0;
+    return (waitMs + 999) / 1000;
+  }
+};
+
+class AdmissionControl {
+private:
+  struct ClientSlot {
+    uint32_t key;       // IPv4 address
+    uint32_t lastSeenMs;
+    TokenBucket bucket;
+    bool used;
+  };
+
+  ClientSlot clients[ADMISSION_CLIENTS];
+  TokenBucket expensive;
+  uint32_t debtUs;
+
+  ClientSlot &slotFor(uint32_t key, uint32_t nowMs) {
+    ClientSlot *oldest = &clients[0];
+    for (int i = 0; i < ADMISSION_CLIENTS; i++) {
+      ClientSlot &s = clients[i];
+      if (s.used && s.key == key) return s;
+      if (!s.used) {
+        oldest = &s;
+      } else if (oldest->used && nowMs - s.lastSeenMs > nowMs - oldest->lastSeenMs) {
+        oldest = &s;
+      }
+    }
+    oldest->used = true;
+    oldest->key = key;
+    oldest->bucket.reset(ADMISSION_BURST, nowMs);
+    return *oldest;
+  }
+
+public:
+  AdmissionControl() : debtUs(0) {
+    memset(clients, 0, sizeof(clients));
+    expensive.reset(ADMISSION_EXPENSIVE_BURST, 0);
+  }
+
+  // Called from the server's admit hook for each complete request, before
+  // its handler runs. `retryAfterSec` is set for rejections.
+  AdmissionResult admit(uint32_t clientKey, uint32_t nowMs, uint32_t &retryAfterSec) {
+    ClientSlot &s = slotFor(clientKey, nowMs);
+    s.lastSeenMs = nowMs;
+    if (!s.bucket.take(ADMISSION_BURST, ADMISSION_REFILL_MS, nowMs)) {
+      retryAfterSec = s.bucket.retryAfterSec(ADMISSION_REFILL_MS, nowMs);
+      return REJECT_RATE;
+    }
+    return ADMIT;
+  }
+
+  // Called by an authenticated handler just before it blocks the loop, so
+  // answers that need no fetch or reconnect, and requests that fail
+  // authentication, never use up the shared budget
+  AdmissionResult admitBlocking(uint32_t nowMs, uint32_t &retryAfterSec) {
+    if (!expensive.take(ADMISSION_EXPENSIVE_BURST, ADMISSION_EXPENSIVE_REFILL_MS, nowMs)) {
+      retryAfterSec = expensive.retryAfterSec(ADMISSION_EXPENSIVE_REFILL_MS, nowMs);
+      return REJECT_EXPENSIVE;
+    }
+    return ADMIT;
+  }
+
+  // False while earlier passes overran the budget; each skipped pass pays
+  // one budget's worth back. Complete requests wait in the server meanwhile.
+  bool webTurn() {
+    if (debtUs == 0) return true;
+    debtUs = debtUs > WEB_TICK_BUDGET_US ? debtUs - WEB_TICK_BUDGET_US : 0;
+    return false;
+  }
+
+  void webSpent(uint32_t spentUs) {
+    if (spentUs <= WEB_TICK_BUDGET_US) return;
+    debtUs += spentUs - WEB_TICK_BUDGET_US;
+    if (debtUs > WEB_DEBT_MAX_US) debtUs = WEB_DEBT_MAX_US;
+  }
+
+  uint32_t getDebtUs() const { return debtUs; }
+};
+
+#endif
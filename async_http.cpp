@@ -0,0 +1,655 @@
+#include "async_http.h"
+#include <lwip/tcp.h>
+#include <new>
+#include "gzip_stream.h"
+#include "hmac.h"
+#include "metrics.h"
+
+#define HTTP_POLL_INTERVAL 2        // TCP coarse timer ticks (500 ms each)
+
+// A compressed stream chunk must fit the stage it is sent from
+static_assert(GZIP_BOUND(GZIP_MAX_INPUT) <= HTTP_STREAM_CHUNK, "stream chunk too small for gzip output");
+
+// The lwIP callbacks. All of them run from the TCP stack between loop
+// passes (or while the loop yields), never in the middle of loop code.
+struct HttpCallbacks {
+  static err_t accept(void *arg, tcp_pcb *pcb, err_t err);
+  static err_t receive(void *arg, tcp_pcb *pcb, pbuf *p, err_t err);
+  static err_t sent(void *arg, tcp_pcb *pcb, u16_t len);
+  static err_t poll(void *arg, tcp_pcb *pcb);
+  static void error(void *arg, err_t err);
+};
+
+AsyncHttpServer::AsyncHttpServer(uint16_t listenPort)
+    : port(listenPort), listener(NULL), routeCount(0), notFound(NULL), admitHook(NULL), sessionCheck(NULL),
+      cors(false), gzipMinBytes(0), nextReadySeq(0), bufferedBytes(0), current(NULL), currentMethod(HTTP_ANY), lengthUnknown(false) {
+  memset(conns, 0, sizeof(conns));
+  memset(&request, 0, sizeof(request));
+}
+
+void AsyncHttpServer::begin() {
+  tcp_pcb *pcb = tcp_new();
+  if (pcb == NULL) return;
+  if (tcp_bind(pcb, IP_ADDR_ANY, port) != ERR_OK) {
+    tcp_close(pcb);
+    return;
+  }
+  listener = tcp_listen_with_backlog(pcb, HTTP_MAX_CONNECTIONS);
+  if (listener == NULL) {
+    tcp_close(pcb);
+    return;
+  }
+  tcp_arg(listener, this);
+  tcp_accept(listener, HttpCallbacks::accept);
+}
+
+void AsyncHttpServer::on(PGM_P uri, HTTPMethod method, HttpHandler handler) {
+  if (routeCount >= HTTP_MAX_ROUTES) return;
+  routes[routeCount].uri = uri;
+  routes[routeCount].method = method;
+  routes[routeCount].handler = handler;
+  routeCount++;
+}
+
+uint8_t AsyncHttpServer::getActiveConnections() {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+    if (conns[i].state != CONN_FREE) n++;
+  }
+  return n;
+}
+
+//================ CONNECTIONS ================
+err_t HttpCallbacks::accept(void *arg, tcp_pcb *pcb, err_t err) {
+  AsyncHttpServer *server = (AsyncHttpServer *)arg;
+  if (err != ERR_OK || pcb == NULL) return ERR_VAL;
+
+  HttpConnection *c = NULL;
+  for (uint8_t i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+    if (server->conns[i].state == CONN_FREE) {
+      c = &server->conns[i];
+      break;
+    }
+  }
+  if (c == NULL) {
+    metrics.inc(MC_HTTP_REFUSED);
+    tcp_abort(pcb);
+    return ERR_ABRT;
+  }
+
+  memset(c, 0, sizeof(*c));
+  c->owner = server;
+  c->pcb = pcb;
+  c->state = CONN_READING;
+  c->remoteIp = ip_2_ip4(&pcb->remote_ip)->addr;
+  c->lastActivityMs = millis();
+
+  tcp_arg(pcb, c);
+  tcp_recv(pcb, receive);
+  tcp_sent(pcb, sent);
+  tcp_err(pcb, error);
+  tcp_poll(pcb, poll, HTTP_POLL_INTERVAL);
+  tcp_nagle_disable(pcb);
+  return ERR_OK;
+}
+
+err_t HttpCallbacks::receive(void *arg, tcp_pcb *pcb, pbuf *p, err_t err) {
+  HttpConnection &c = *(HttpConnection *)arg;
+  AsyncHttpServer &server = *c.owner;
+
+  if (p == NULL) {
+    // The client is done sending; a response in progress still goes out
+    if (c.state == CONN_READING) return server.close(c) ? ERR_ABRT : ERR_OK;
+    return ERR_OK;
+  }
+
+  size_t len = p->tot_len;
+  c.lastActivityMs = millis();
+  if (c.state != CONN_READING) {
+    tcp_recved(pcb, len);
+    pbuf_free(p);
+    return ERR_OK;
+  }
+
+  if (c.rxLen + len > HTTP_REQUEST_MAX) {
+    tcp_recved(pcb, len);
+    pbuf_free(p);
+    return server.sendError(c, 413) ? ERR_ABRT : ERR_OK;
+  }
+  if (!server.grow(c.rx, c.rxCap, c.rxLen + len + 1)) {
+    tcp_recved(pcb, len);
+    pbuf_free(p);
+    return server.sendError(c, 503) ? ERR_ABRT : ERR_OK;
+  }
+  pbuf_copy_partial(p, c.rx + c.rxLen, len, 0);
+  c.rxLen += len;
+  c.rx[c.rxLen] = 0;
+  tcp_recved(pcb, len);
+  pbuf_free(p);
+
+  switch (httpRequestComplete(c.rx, c.rxLen, HTTP_REQUEST_MAX, c.headLen, c.bodyLen)) {
+    case HTTP_PARSE_DONE:
+      c.state = CONN_READY;
+      c.readySeq = server.nextReadySeq++;
+      return ERR_OK;
+    case HTTP_PARSE_BAD:
+      return server.sendError(c, 400) ? ERR_ABRT : ERR_OK;
+    case HTTP_PARSE_TOO_LARGE:
+      return server.sendError(c, 413) ? ERR_ABRT : ERR_OK;
+    default:
+      return ERR_OK;
+  }
+}
+
+err_t HttpCallbacks::sent(void *arg, tcp_pcb *pcb, u16_t len) {
+  HttpConnection &c = *(HttpConnection *)arg;
+  c.lastActivityMs = millis();
+  return c.owner->pump(c) ? ERR_ABRT : ERR_OK;
+}
+
+err_t HttpCallbacks::poll(void *arg, tcp_pcb *pcb) {
+  HttpConnection &c = *(HttpConnection *)arg;
+  // A complete request waits for the loop however long that takes
+  bool waiting = c.state == CONN_READING || c.state == CONN_SENDING;
+  if (waiting && millis() - c.lastActivityMs >= HTTP_IDLE_TIMEOUT_MS) {
+    metrics.inc(MC_HTTP_TIMEOUTS);
+    tcp_arg(pcb, NULL);
+    tcp_abort(pcb);
+    c.pcb = NULL;
+    c.owner->release(c);
+    return ERR_ABRT;
+  }
+  // Writes refused for lack of memory are retried here
+  if (c.state == CONN_SENDING) return c.owner->pump(c) ? ERR_ABRT : ERR_OK;
+  return ERR_OK;
+}
+
+void HttpCallbacks::error(void *arg, err_t err) {
+  if (arg == NULL) return;
+  HttpConnection &c = *(HttpConnection *)arg;
+  // lwIP has already freed the pcb
+  c.pcb = NULL;
+  if (c.owner->current == &c) {
+    c.state = CONN_ABORTED;
+  } else {
+    c.owner->release(c);
+  }
+}
+
+bool AsyncHttpServer::grow(char *&buf, size_t &cap, size_t need) {
+  if (need <= cap) return true;
+  size_t newCap = cap == 0 ? HTTP_RX_INITIAL : cap;
+  while (newCap < need) newCap *= 2;
+  if (bufferedBytes - cap + newCap > HTTP_BUFFER_BUDGET) return false;
+  char *grown = (char *)realloc(buf, newCap);
+  if (grown == NULL) return false;
+  bufferedBytes = bufferedBytes - cap + newCap;
+  buf = grown;
+  cap = newCap;
+  return true;
+}
+
+void AsyncHttpServer::release(HttpConnection &c) {
+  if (c.producer && c.producerRelease) c.producerRelease(c.producerCtx);
+  dropGzip(c);
+  free(c.rx);
+  free(c.tx);
+  free(c.stage);
+  bufferedBytes -= c.rxCap + c.txCap + (c.stage ? HTTP_STREAM_CHUNK : 0);
+  memset(&c, 0, sizeof(c));
+  c.state = CONN_FREE;
+}
+
+bool AsyncHttpServer::close(HttpConnection &c) {
+  tcp_pcb *pcb = c.pcb;
+  bool aborted = false;
+  if (pcb) {
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_err(pcb, NULL);
+    tcp_poll(pcb, NULL, 0);
+    // Unsent data still goes out before the FIN
+    if (tcp_close(pcb) != ERR_OK) {
+      tcp_abort(pcb);
+      aborted = true;
+    }
+  }
+  c.pcb = NULL;
+  release(c);
+  return aborted;
+}
+
+static size_t sendable(tcp_pcb *pcb, size_t len) {
+  size_t room = tcp_sndbuf(pcb);
+  return len < room ? len : room;
+}
+
+// Writes what the send buffer takes right now and keeps the rest
+void AsyncHttpServer::queue(HttpConnection &c, const char *data, size_t len) {
+  if (c.pcb == NULL || len == 0) return;
+
+  if (c.txSent == c.txLen) {
+    size_t n = sendable(c.pcb, len);
+    if (n > 0 && tcp_write(c.pcb, data, n, TCP_WRITE_FLAG_COPY) == ERR_OK) {
+      data += n;
+      len -= n;
+    }
+    if (len == 0) return;
+  }
+
+  if (c.txSent > 0) {
+    memmove(c.tx, c.tx + c.txSent, c.txLen - c.txSent);
+    c.txLen -= c.txSent;
+    c.txSent = 0;
+  }
+  if (!grow(c.tx, c.txCap, c.txLen + len)) {
+    c.truncated = true;
+    return;
+  }
+  memcpy(c.tx + c.txLen, data, len);
+  c.txLen += len;
+}
+
+bool AsyncHttpServer::pump(HttpConnection &c) {
+  if (c.pcb == NULL) return false;
+
+  while (c.txSent < c.txLen) {
+    size_t n = sendable(c.pcb, c.txLen - c.txSent);
+    if (n == 0 || tcp_write(c.pcb, c.tx + c.txSent, n, TCP_WRITE_FLAG_COPY) != ERR_OK) break;
+    c.txSent += n;
+  }
+  if (c.txSent == c.txLen && c.tx != NULL) {
+    // Drained: give the buffer back right away
+    free(c.tx);
+    bufferedBytes -= c.txCap;
+    c.tx = NULL;
+    c.txLen = c.txSent = c.txCap = 0;
+  }
+
+  while (c.tx == NULL) {
+    if (c.stageSent == c.stageLen && !refill(c)) break;
+    size_t n = sendable(c.pcb, c.stageLen - c.stageSent);
+    if (n == 0 || tcp_write(c.pcb, c.stage + c.stageSent, n, TCP_WRITE_FLAG_COPY) != ERR_OK) break;
+    c.stageSent += n;
+  }
+  tcp_output(c.pcb);
+
+  if (c.state == CONN_SENDING && c.tx == NULL && c.producer == NULL && c.stageSent == c.stageLen) return close(c);
+  return false;
+}
+
+void AsyncHttpServer::endStream(HttpConnection &c) {
+  if (c.producerRelease) c.producerRelease(c.producerCtx);
+  c.producer = NULL;
+}
+
+// Puts the next part of a streamed body in the stage; false once there is
+// nothing left. A compressed stream has its producer write straight into
+// the encoder's window, and the trailer goes out after its last part.
+bool AsyncHttpServer::refill(HttpConnection &c) {
+  c.stageLen = c.stageSent = 0;
+  while (c.stageLen == 0 && c.producer) {
+    if (c.gzip == NULL) {
+      c.stageLen = c.producer(c.producerCtx, c.stage, HTTP_STREAM_CHUNK);
+      if (c.stageLen == 0) endStream(c);
+      continue;
+    }
+    size_t room;
+    uint8_t *in = c.gzip->input(room);
+    size_t n = c.producer(c.producerCtx, (char *)in, room);
+    uint32_t start = micros();
+    if (n > 0) {
+      c.stageLen = c.gzip->compress(n, (uint8_t *)c.stage);
+      metrics.inc(MC_HTTP_GZIP_BYTES_IN, n);
+      metrics.inc(MC_HTTP_GZIP_BYTES_OUT, c.stageLen);
+    } else {
+      c.stageLen = c.gzip->finish((uint8_t *)c.stage);
+      metrics.inc(MC_HTTP_GZIP_BYTES_OUT, c.stageLen);
+      metrics.inc(MC_HTTP_GZIP_RESPONSES);
+      dropGzip(c);
+      endStream(c);
+    }
+    metrics.inc(MC_HTTP_GZIP_MICROS, micros() - start);
+  }
+  return c.stageLen > 0;
+}
+
+FlashName AsyncHttpServer::statusText(int code) {
+  switch (code) {
+    case 200: return FlashName(PSTR("OK"));
+    case 204: return FlashName(PSTR("No Content"));
+    case 303: return FlashName(PSTR("See Other"));
+    case 400: return FlashName(PSTR("Bad Request"));
+    case 401: return FlashName(PSTR("Unauthorized"));
+    case 404: return FlashName(PSTR("Not Found"));
+    case 413: return FlashName(PSTR("Payload Too Large"));
+    case 429: return FlashName(PSTR("Too Many Requests"));
+    case 503: return FlashName(PSTR("Service Unavailable"));
+    default: return FlashName(code < 400 ? PSTR("OK") : PSTR("Error"));
+  }
+}
+
+// Answers a request that never reaches a handler
+bool AsyncHttpServer::sendError(HttpConnection &c, int code) {
+  char response[96];
+  int n = snprintf_P(response, sizeof(response),
+                     PSTR("HTTP/1.1 %d %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"), code,
+                     statusText(code).c_str());
+  c.state = CONN_SENDING;
+  queue(c, response, n);
+  return pump(c);
+}
+
+//================ DISPATCH ================
+HTTPMethod AsyncHttpServer::parseMethod(const char *method) {
+  if (strcmp(method, "GET") == 0) return HTTP_GET;
+  if (strcmp(method, "POST") == 0) return HTTP_POST;
+  if (strcmp(method, "PUT") == 0) return HTTP_PUT;
+  if (strcmp(method, "OPTIONS") == 0) return HTTP_OPTIONS;
+  if (strcmp(method, "HEAD") == 0) return HTTP_HEAD;
+  if (strcmp(method, "PATCH") == 0) return HTTP_PATCH;
+  if (strcmp(method, "DELETE") == 0) return HTTP_DELETE;
+  return HTTP_ANY;
+}
+
+HttpConnection *AsyncHttpServer::nextReady() {
+  HttpConnection *oldest = NULL;
+  for (uint8_t i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+    HttpConnection &c = conns[i];
+    if (c.state == CONN_READY && (oldest == NULL || (int32_t)(c.readySeq - oldest->readySeq) < 0)) {
+      oldest = &c;
+    }
+  }
+  return oldest;
+}
+
+bool AsyncHttpServer::handleClient() {
+  HttpConnection *c = nextReady();
+  if (c == NULL) return false;
+
+  current = c;
+  c->headersLen = 0;
+  c->responded = false;
+  lengthUnknown = false;
+
+  if (!httpParseRequest(c->rx, c->headLen, c->bodyLen, request)) {
+    memset(&request, 0, sizeof(request));
+    request.path = "";
+    send(400);
+  } else {
+    currentMethod = parseMethod(request.method);
+    if (admitHook == NULL || admitHook(c->remoteIp, request.path)) {
+      HttpHandler handler = notFound;
+      for (uint8_t i = 0; i < routeCount; i++) {
+        const HttpRoute &r = routes[i];
+        if (strcmp_P(request.path, r.uri) == 0 && (r.method == HTTP_ANY || r.method == currentMethod)) {
+          handler = r.handler;
+          break;
+        }
+      }
+      if (handler) {
+        handler();
+      } else {
+        send(404, "text/plain", "Not found");
+      }
+    }
+  }
+  if (c->state != CONN_ABORTED && !c->responded) send(500);
+  if (c->state != CONN_ABORTED && c->gzip && c->producer == NULL) finishGzip(*c);
+  current = NULL;
+
+  // The parsed request points into rx, so it goes only now
+  free(c->rx);
+  bufferedBytes -= c->rxCap;
+  c->rx = NULL;
+  c->rxCap = 0;
+  memset(&request, 0, sizeof(request));
+
+  if (c->state == CONN_ABORTED) {
+    release(*c);
+  } else if (c->truncated) {
+    close(*c);
+  } else {
+    c->state = CONN_SENDING;
+    pump(*c);
+  }
+  return true;
+}
+
+//================ REQUEST ================
+String AsyncHttpServer::arg(PGM_P name) {
+  const char *value = httpArg(request, FlashName(name).c_str());
+  return String(value ? value : "");
+}
+
+bool AsyncHttpServer::hasArg(PGM_P name) {
+  return httpArg(request, FlashName(name).c_str()) != NULL;
+}
+
+// Only the headers the parser keeps are available
+String AsyncHttpServer::header(PGM_P name) {
+  FlashName wanted(name);
+  const char *value = NULL;
+  if (strcasecmp_P(wanted.c_str(), PSTR("Authorization")) == 0) {
+    value = request.authorization;
+  } else if (strcasecmp_P(wanted.c_str(), PSTR("Content-Type")) == 0) {
+    value = request.contentType;
+  } else if (strcasecmp_P(wanted.c_str(), PSTR("Cookie")) == 0) {
+    value = request.cookie;
+  }
+  return String(value ? value : "");
+}
+
+uint32_t AsyncHttpServer::remoteIp() {
+  return current ? current->remoteIp : 0;
+}
+
+// A valid session cookie is enough; Basic credentials are only decoded
+// for clients without one
+bool AsyncHttpServer::authenticate(const char *username, const char *password) {
+  if (sessionCheck != NULL && request.cookie != NULL && sessionCheck(request.cookie)) {
+    metrics.inc(MC_HTTP_AUTH_SESSION);
+    return true;
+  }
+  bool ok = basicAuthMatches(request.authorization, username, password);
+  metrics.inc(ok ? MC_HTTP_AUTH_BASIC : MC_HTTP_AUTH_FAILED);
+  return ok;
+}
+
+bool AsyncHttpServer::basicAuthMatches(const char *auth, const char *username, const char *password) {
+  if (auth == NULL || strncasecmp(auth, "Basic ", 6) != 0) return false;
+
+  uint8_t decoded[72];
+  int len = httpBase64Decode(auth + 6, decoded, sizeof(decoded));
+  size_t userLen = strlen(username);
+  size_t passLen = strlen(password);
+  if (len < 0 || (size_t)len != userLen + 1 + passLen || (size_t)len > sizeof(decoded)) return false;
+
+  uint8_t expected[72];
+  memcpy(expected, username, userLen);
+  expected[userLen] = ':';
+  memcpy(expected + userLen + 1, password, passLen);
+  return digestEqual(decoded, expected, len);
+}
+
+void AsyncHttpServer::requestAuthentication(HTTPAuthMethod mode, const char *realm, const String &authFailMsg) {
+  char challenge[64];
+  snprintf_P(challenge, sizeof(challenge), PSTR("Basic realm=\"%s\""), realm ? realm : "Login Required");
+  sendHeader(PSTR("WWW-Authenticate"), challenge);
+  send(401, "text/html", authFailMsg);
+}
+
+//================ RESPONSE ================
+void AsyncHttpServer::sendHeader(PGM_P name, const String &value, bool first) {
+  if (current == NULL) return;
+  HttpConnection &c = *current;
+  char line[HTTP_HEADER_SIZE];
+  size_t nameLen = strlen_P(name);
+  if (nameLen >= sizeof(line)) return;
+  memcpy_P(line, name, nameLen);
+  int n = snprintf_P(line + nameLen, sizeof(line) - nameLen, PSTR(": %s\r\n"), value.c_str());
+  if (n < 0 || nameLen + n >= sizeof(line)) return;
+  n += nameLen;
+  if (c.headersLen + n > sizeof(c.headers)) return;
+  if (first) {
+    memmove(c.headers + n, c.headers, c.headersLen);
+    memcpy(c.headers, line, n);
+  } else {
+    memcpy(c.headers + c.headersLen, line, n);
+  }
+  c.headersLen += n;
+}
+
+void AsyncHttpServer::setContentLength(size_t length) {
+  lengthUnknown = length == CONTENT_LENGTH_UNKNOWN;
+}
+
+void AsyncHttpServer::sendHead(int code, const char *contentType, size_t contentLength) {
+  HttpConnection &c = *current;
+  char head[192];
+  int n = snprintf_P(head, sizeof(head), PSTR("HTTP/1.1 %d %s\r\n"), code, statusText(code).c_str());
+  if (contentType && *contentType) {
+    n += snprintf_P(head + n, sizeof(head) - n, PSTR("Content-Type: %s\r\n"), contentType);
+  }
+  if (contentLength != CONTENT_LENGTH_UNKNOWN) {
+    n += snprintf_P(head + n, sizeof(head) - n, PSTR("Content-Length: %u\r\n"), (unsigned)contentLength);
+  }
+  if (cors) {
+    n += snprintf_P(head + n, sizeof(head) - n, PSTR("Access-Control-Allow-Origin: *\r\n"));
+  }
+  // One request per connection; a body of unknown length ends with it
+  n += snprintf_P(head + n, sizeof(head) - n, PSTR("Connection: close\r\n"));
+  queue(c, head, n);
+  queue(c, c.headers, c.headersLen);
+  queue(c, "\r\n", 2);
+  c.responded = true;
+}
+
+void AsyncHttpServer::send(int code) {
+  send(code, NULL, "", 0);
+}
+
+void AsyncHttpServer::send(int code, const char *contentType, const char *content) {
+  send(code, contentType, content, strlen(content));
+}
+
+void AsyncHttpServer::send_P(int code, const char *contentType, PGM_P content) {
+  if (current == NULL || current->responded) return;
+  size_t length = strlen_P(content);
+  bool gzip = startGzip(contentType, length);
+  sendHead(code, contentType, gzip ? CONTENT_LENGTH_UNKNOWN : length);
+  // Flash is read in words, so the body goes through a RAM bounce buffer
+  char piece[128];
+  for (size_t sent = 0; sent < length;) {
+    size_t n = length - sent < sizeof(piece) ? length - sent : sizeof(piece);
+    memcpy_P(piece, content + sent, n);
+    if (gzip) {
+      queueGzip(*current, piece, n);
+    } else {
+      queue(*current, piece, n);
+    }
+    sent += n;
+  }
+  if (gzip) finishGzip(*current);
+}
+
+void AsyncHttpServer::send(int code, const char *contentType, const String &content) {
+  send(code, contentType, content.c_str(), content.length());
+}
+
+void AsyncHttpServer::send(int code, const char *contentType, const char *content, size_t length) {
+  if (current == NULL || current->responded) return;
+  if (startGzip(contentType, lengthUnknown ? CONTENT_LENGTH_UNKNOWN : length)) {
+    sendHead(code, contentType, CONTENT_LENGTH_UNKNOWN);
+    queueGzip(*current, content, length);
+    // A body of unknown length is finished once its handler returns
+    if (!lengthUnknown) finishGzip(*current);
+    return;
+  }
+  sendHead(code, contentType, lengthUnknown ? CONTENT_LENGTH_UNKNOWN : length);
+  queue(*current, content, length);
+}
+
+void AsyncHttpServer::sendContent(const char *content, size_t length) {
+  if (current == NULL || !current->responded) return;
+  if (current->gzip) {
+    queueGzip(*current, content, length);
+  } else {
+    queue(*current, content, length);
+  }
+}
+
+//================ COMPRESSION ================
+static bool compressible(const char *contentType) {
+  return contentType != NULL && (strncmp(contentType, "text/", 5) == 0 ||
+                                 strncmp(contentType, "application/json", 16) == 0 ||
+                                 strncmp(contentType, "application/javascript", 22) == 0);
+}
+
+// Sets up an encoder for the current response when the client accepts gzip
+// and the body is worth it; the encoder counts against the buffer budget
+bool AsyncHttpServer::startGzip(const char *contentType, size_t contentLength) {
+  HttpConnection &c = *current;
+  if (gzipMinBytes == 0 || !compressible(contentType) || !httpAcceptsGzip(request.acceptEncoding)) return false;
+  if (contentLength != CONTENT_LENGTH_UNKNOWN && contentLength < gzipMinBytes) return false;
+  if (bufferedBytes + sizeof(GzipEncoder) > HTTP_BUFFER_BUDGET) return false;
+  void *memory = malloc(sizeof(GzipEncoder));
+  if (memory == NULL) return false;
+  c.gzip = new (memory) GzipEncoder();
+  bufferedBytes += sizeof(GzipEncoder);
+  sendHeader(PSTR("Content-Encoding"), "gzip");
+  sendHeader(PSTR("Vary"), "Accept-Encoding");
+  return true;
+}
+
+void AsyncHttpServer::queueGzip(HttpConnection &c, const char *data, size_t len) {
+  uint8_t out[GZIP_BOUND(GZIP_MAX_INPUT)];
+  size_t produced = 0;
+  uint32_t start = micros();
+  c.gzip->write((const uint8_t *)data, len, out, [&](const uint8_t *piece, size_t n) {
+    queue(c, (const char *)piece, n);
+    produced += n;
+  });
+  metrics.inc(MC_HTTP_GZIP_MICROS, micros() - start);
+  metrics.inc(MC_HTTP_GZIP_BYTES_IN, len);
+  metrics.inc(MC_HTTP_GZIP_BYTES_OUT, produced);
+}
+
+void AsyncHttpServer::finishGzip(HttpConnection &c) {
+  uint8_t out[GZIP_BOUND(0)];
+  size_t n = c.gzip->finish(out);
+  queue(c, (const char *)out, n);
+  metrics.inc(MC_HTTP_GZIP_BYTES_OUT, n);
+  metrics.inc(MC_HTTP_GZIP_RESPONSES);
+  dropGzip(c);
+}
+
+void AsyncHttpServer::dropGzip(HttpConnection &c) {
+  if (c.gzip == NULL) return;
+  c.gzip->~GzipEncoder();
+  free(c.gzip);
+  c.gzip = NULL;
+  bufferedBytes -= sizeof(GzipEncoder);
+}
+
+void AsyncHttpServer::sendStream(int code, const char *contentType, HttpChunkProducer producer, void *ctx,
+                                 HttpReleaseFn release) {
+  if (current == NULL || current->responded) {
+    if (release) release(ctx);
+    return;
+  }
+  HttpConnection &c = *current;
+  if (bufferedBytes + HTTP_STREAM_CHUNK > HTTP_BUFFER_BUDGET || (c.stage = (char *)malloc(HTTP_STREAM_CHUNK)) == NULL) {
+    if (release) release(ctx);
+    send(503);
+    return;
+  }
+  bufferedBytes += HTTP_STREAM_CHUNK;
+  startGzip(contentType, CONTENT_LENGTH_UNKNOWN);
+  sendHead(code, contentType, CONTENT_LENGTH_UNKNOWN);
+  c.producer = producer;
+  c.producerCtx = ctx;
+  c.producerRelease = release;
+  c.stageLen = c.stageSent = 0;
+}
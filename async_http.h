@@ -0,0 +1,195 @@
+#ifndef ASYNC_HTTP_H
+#define ASYNC_HTTP_H
+
+#include <Arduino.h>
+#include "flash_string.h"
+#include "http_request.h"
+
+struct tcp_pcb;
+struct pbuf;
+class GzipEncoder;
+
+#define HTTP_MAX_CONNECTIONS 6      // Further connections are refused until one closes
+#define HTTP_MAX_ROUTES 40
+#define HTTP_REQUEST_MAX 4096       // Head and body of one request
+#define HTTP_RX_INITIAL 512         // First receive buffer; grown as a request needs it
+#define HTTP_IDLE_TIMEOUT_MS 5000   // A request must arrive, and a response drain, within this
+#define HTTP_HEADER_SIZE 192        // Extra response headers per request
+#define HTTP_STREAM_CHUNK 512       // Bytes a chunk producer is asked for at a time
+#define HTTP_BUFFER_BUDGET 16384    // Request and response bytes held for all connections together
+#define HTTP_GZIP_MIN_BYTES 1024    // Smaller bodies fit a TCP segment or two; gzip wouldn't save a round trip
+
+// The subset of ESP8266WebServer's vocabulary the handlers use
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+enum HTTPAuthMethod { BASIC_AUTH };
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+
+typedef void (*HttpHandler)();
+
+// Fills `out` with the next part of a streamed body; returns 0 at the end.
+// Runs from the TCP stack's callbacks, so it must not block or yield.
+typedef size_t (*HttpChunkProducer)(void *ctx, char *out, size_t size);
+typedef void (*HttpReleaseFn)(void *ctx);
+
+// Runs before a request reaches its handler; returns false after sending
+// a response of its own
+typedef bool (*HttpAdmitHook)(uint32_t remoteIp, const char *uri);
+
+// Checks a request's Cookie header before authenticate() falls back to Basic
+typedef bool (*HttpSessionCheck)(const char *cookies);
+
+enum HttpConnState {
+  CONN_FREE,
+  CONN_READING,    // Receiving the request, in TCP callbacks
+  CONN_READY,      // Complete, waiting for the loop to run its handler
+  CONN_SENDING,    // Response queued, drained from sent callbacks
+  CONN_ABORTED     // The stack dropped the connection while its handler ran
+};
+
+class AsyncHttpServer;
+
+struct HttpConnection {
+  AsyncHttpServer *owner;
+  tcp_pcb *pcb;
+  HttpConnState state;
+  uint32_t remoteIp;
+  uint32_t lastActivityMs;
+  uint32_t readySeq;         // Dispatch order
+
+  char *rx;                  // Request, NUL-terminated; freed once handled
+  size_t rxLen;
+  size_t rxCap;
+  size_t headLen;
+  size_t bodyLen;
+
+  char *tx;                  // Response bytes the send buffer couldn't take yet
+  size_t txLen;
+  size_t txSent;
+  size_t txCap;
+  char headers[HTTP_HEADER_SIZE];
+  size_t headersLen;
+  bool responded;
+  bool truncated;            // Part of the response didn't fit the buffer budget
+
+  HttpChunkProducer producer;
+  void *producerCtx;
+  HttpReleaseFn producerRelease;
+  char *stage;               // HTTP_STREAM_CHUNK bytes while streaming
+  size_t stageLen;
+  size_t stageSent;
+  GzipEncoder *gzip;         // While the body is being compressed
+};
+
+struct HttpRoute {
+  const char *uri;
+  HTTPMethod method;
+  HttpHandler handler;
+};
+
+// Callback-driven server on the raw lwIP TCP API. Requests are received
+// for all connections at once in the stack's callbacks; handlers still run
+// from the loop, one complete request at a time, and their responses drain
+// in sent callbacks so a slow reader holds up nobody. Handlers use the same
+// calls as with ESP8266WebServer (arg, authenticate, send, sendHeader, ...)
+// against the request being dispatched.
+class AsyncHttpServer {
+private:
+  uint16_t port;
+  tcp_pcb *listener;
+  HttpConnection conns[HTTP_MAX_CONNECTIONS];
+  HttpRoute routes[HTTP_MAX_ROUTES];
+  uint8_t routeCount;
+  HttpHandler notFound;
+  HttpAdmitHook admitHook;
+  HttpSessionCheck sessionCheck;
+  bool cors;
+  size_t gzipMinBytes;       // 0 leaves compression off
+  uint32_t nextReadySeq;
+  size_t bufferedBytes;
+
+  HttpConnection *current;   // Request being dispatched; argument and header names are PSTRs
+  HttpRequest request;
+  HTTPMethod currentMethod;
+  bool lengthUnknown;        // setContentLength(CONTENT_LENGTH_UNKNOWN) was called
+
+  // The lwIP callbacks, kept out of this header with the lwIP types
+  friend struct HttpCallbacks;
+
+  // These return true when the connection had to be aborted, which a TCP
+  // callback must report as ERR_ABRT
+  bool pump(HttpConnection &c);
+  bool close(HttpConnection &c);
+  bool sendError(HttpConnection &c, int code);
+
+  void release(HttpConnection &c);
+  bool grow(char *&buf, size_t &cap, size_t need);
+  void queue(HttpConnection &c, const char *data, size_t len);
+  void sendHead(int code, const char *contentType, size_t contentLength);
+  HttpConnection *nextReady();
+
+  bool startGzip(const char *contentType, size_t contentLength);
+  void queueGzip(HttpConnection &c, const char *data, size_t len);
+  void finishGzip(HttpConnection &c);
+  void dropGzip(HttpConnection &c);
+  bool refill(HttpConnection &c);
+  void endStream(HttpConnection &c);
+
+  static HTTPMethod parseMethod(const char *method);
+  static FlashName statusText(int code);
+
+public:
+  AsyncHttpServer(uint16_t listenPort);
+
+  void begin();
+
+  // `uri` is a PSTR, like every route in the sketch
+  void on(PGM_P uri, HTTPMethod method, HttpHandler handler);
+  void onNotFound(HttpHandler handler) { notFound = handler; }
+  void enableCORS(bool enable) { cors = enable; }
+  // Text and JSON bodies of at least `minBytes` (or of unknown length) go
+  // out gzipped to clients that accept it; 0 turns compression off
+  void enableCompression(size_t minBytes) { gzipMinBytes = minBytes; }
+  void setAdmitHook(HttpAdmitHook hook) { admitHook = hook; }
+  void setSessionCheck(HttpSessionCheck check) { sessionCheck = check; }
+
+  // Runs the handler of the longest-waiting complete request, if any;
+  // returns false when none was waiting
+  bool handleClient();
+
+  // Request being dispatched; argument and header names are PSTRs
+  String arg(PGM_P name);
+  bool hasArg(PGM_P name);
+  String header(PGM_P name);
+  int headers() { return request.headerCount; }
+  String uri() { return String(request.path); }
+  HTTPMethod method() { return currentMethod; }
+  uint32_t remoteIp();
+  bool authenticate(const char *username, const char *password);
+  static bool basicAuthMatches(const char *authorization, const char *username, const char *password);
+  void requestAuthentication(HTTPAuthMethod mode = BASIC_AUTH, const char *realm = NULL,
+                             const String &authFailMsg = String(""));
+
+  // Response. With setContentLength(CONTENT_LENGTH_UNKNOWN) the body is
+  // whatever sendContent() adds until the handler returns. Header names are
+  // PSTRs.
+  void sendHeader(PGM_P name, const String &value, bool first = false);
+  void setContentLength(size_t length);
+  void send(int code);
+  void send(int code, const char *contentType, const char *content);
+  void send(int code, const char *contentType, const char *content, size_t length);
+  void send(int code, const char *contentType, const String &content);
+  // A constant body that stays in flash
+  void send_P(int code, const char *contentType, PGM_P content);
+  void sendContent(const char *content, size_t length);
+  void sendContent(const char *content) { sendContent(content, strlen(content)); }
+
+  // Streams a body from `producer` as the connection drains, e.g. from
+  // PROGMEM; `release` frees ctx once the connection is done with it
+  void sendStream(int code, const char *contentType, HttpChunkProducer producer, void *ctx,
+                  HttpReleaseFn release);
+
+  uint8_t getActiveConnections();
+  size_t getBufferedBytes() { return bufferedBytes; }
+};
+
+#endif
@@ -0,0 +1,23 @@
+#include "bench.h"
+
+void runBench(BenchFn fn, BenchFn setup, void *ctx, uint32_t iterations, BenchResult &result) {
+  result.iterations = iterations;
+  result.minCycles = 0xFFFFFFFF;
+  result.maxCycles = 0;
+  result.totalCycles = 0;
+
+  for (uint32_t i = 0; i < iterations; i++) {
+    if (setup != NULL) setup(ctx);
+
+    uint32_t start = ESP.getCycleCount();
+    fn(ctx);
+    uint32_t cycles = ESP.getCycleCount() - start;
+
+    if (cycles < result.minCycles) result.minCycles = cycles;
+    if (cycles > result.maxCycles) result.maxCycles = cycles;
+    result.totalCycles += cycles;
+    yield();
+  }
+
+  if (iterations == 0) result.minCycles = 0;
+}
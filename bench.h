@@ -0,0 +1,21 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <Arduino.h>
+
+// Cycle-counted timings of one benchmark case
+struct BenchResult {
+  uint32_t iterations;
+  uint32_t minCycles;
+  uint32_t maxCycles;
+  uint64_t totalCycles;
+};
+
+typedef void (*BenchFn)(void *ctx);
+
+// Runs `fn` the given number of times. `setup`, if not NULL, runs before every
+// iteration outside the timed region. Yields between iterations so long cases
+// don't trip the watchdog.
+void runBench(BenchFn fn, BenchFn setup, void *ctx, uint32_t iterations, BenchResult &result);
+
+#endif
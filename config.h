@@ -11,17 +11,66 @@ const char *NTP_SERVER = "time.google.com"; // Using more reliable NTP server Th
 const int CLOUD_COVERAGE_THRESHOLD = 78;
 const int CLOUD_COVERAGE_HYSTERESIS = 5;
 
-const char* API_HOST = "api.open-meteo.com";
-const int HTTP_PORT = 80;
+// Open-Meteo compatible endpoints as "host:port", in order of preference (at
+// most 4). When the first is slower than its usual p90 the next is asked as
+// well and the first answer wins; the rest are fallbacks when one fails.
+const char *FORECAST_PROVIDERS[] = {
+  "api.open-meteo.com:80",                    // Or the machine running tools/forecast_server
+  // "192.168.1.20:8080",
+};
+const bool FORECAST_HEDGE_ENABLED = true;     // false only falls back on errors
+const int FORECAST_DAYS = 1;                  // Only the current hour is used
+const unsigned long FORECAST_TIMEOUT_MS = 5000; // Whole fetch, hedges and fallbacks included
 const int EEPROM_SIZE = 512;
 const unsigned long WIFI_TIMEOUT = 10000;
 const int BUFFER_SIZE = 6144;
 
+//================ FORECAST SHARING ================
+// Units at one site elect the one with the lowest chip ID to fetch the
+// forecast and multicast it; the rest only fetch if its frames stop.
+const bool FORECAST_SHARE_ENABLED = false;
+const char *FORECAST_SHARE_KEY = "change-me";      // Same on every unit; frames are signed with it
+const char *FORECAST_SHARE_GROUP = "239.255.76.67";
+const int FORECAST_SHARE_PORT = 47647;
+
+//================ MQTT TELEMETRY ================
+// Log events and a state snapshot are batched into one publish per interval
+// on <prefix>/<chip id>/events; <prefix>/<chip id>/status holds online/offline.
+// Use an IP address for the host, a name lookup blocks the loop.
+const bool MQTT_ENABLED = false;
+const char *MQTT_HOST = "192.168.1.10";
+const int MQTT_PORT = 1883;
+const char *MQTT_USER = "";                      // Empty for brokers without authentication
+const char *MQTT_PASSWORD = "";
+const char *MQTT_TOPIC_PREFIX = "lightctl";
+const unsigned long MQTT_BATCH_INTERVAL_MS = 5000;
+
 //================ PIN DEFINITIONS ================
 const int RELAY_PIN = 12;        // D6 - Main light relay
 const int ERROR_LED_PIN = 14;   // D5 - Error indicator
 const int STATUS_LED_PIN = 13;  // D7 - Status indicator
 
+//================ ZONES ================
+// GPIOs a zone relay may use (D2, D1, D0, D3, D4, D8). D3, D4 and D8 are boot
+// strapping pins, so only use them with relay boards that leave them alone
+// at power-up.
+const int8_t ZONE_PINS[] = { 4, 5, 16, 0, 2, 15 };
+
+//================ ENERGY ================
+// Estimated kWh is on-time times the connected load; zones set theirs with
+// loadWatts in /api/zones. Counters are written to flash with any other
+// EEPROM commit, and on their own at most this often.
+const float MAIN_LOAD_WATTS = 60;
+const unsigned long ENERGY_CHECKPOINT_MS = 2UL * 60 * 60 * 1000;
+
+//================ INPUT TRACE ================
+// External inputs are recorded into a RAM ring for /api/inputtrace and
+// tools/trace_replay.cpp. A checkpoint is a few bytes; a 48-hour forecast
+// is about 350, so the ring covers roughly a day of normal operation.
+const bool INPUT_TRACE_ENABLED = true;
+const size_t INPUT_TRACE_SIZE = 4096;
+const unsigned long INPUT_TRACE_CHECKPOINT_MS = 5UL * 60 * 1000;
+
 //================ TIME CONFIGURATION ================
 const int TIME_RISE_OFFSET_MINUTES = 0;
 const int TIME_SET_OFFSET_MINUTES = 0;
@@ -40,4 +89,8 @@ const float LONGITUDE = 0; // Update with your actual longitude
 //================ TIMING INTERVALS ================
 const unsigned long SYNC_INTERVAL = 1 * 60 * 60 * 1000; // 1 hour in milliseconds
 
+//================ TRACE CONFIGURATION ================
+#define TRACE_LEVEL 3           // 0=off, 1=error, 2=warn, 3=info, 4=debug; lower levels are compiled out
+#define TRACE_SHOW_SENSITIVE 0  // 1 keeps credentials and auth headers in trace records
+
 #endif
\ No newline at end of file
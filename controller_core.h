@@ -0,0 +1,211 @@
+#ifndef CONTROLLER_CORE_H
+#define CONTROLLER_CORE_H
+
+// Light decision logic, shared by the ESP8266 and the host-side tools under
+// tools/. This header and every other one the tools include must not depend
+// on the Arduino core; flash-resident strings go through flash_string.h,
+// which also builds on a host.
+
+#include <stdint.h>
+#include "flash_string.h"
+
+#define MINUTES_PER_DAY (24 * 60)
+#define CLOCK_SET_MIN_EPOCH 1600000000   // Earlier UTC times mean NTP hasn't synced yet
+
+// Plans, energy accounting and forecast sharing all wait for a real clock
+inline bool clockIsSet(uint32_t utc) {
+  return utc >= CLOCK_SET_MIN_EPOCH;
+}
+
+//================ SYSTEM STATE ENUM ================
+enum SystemState {
+  NORMAL,
+  MONITORING,
+  ACTIVE,
+  SCHEDULED,
+  MANUAL     // New state for manual override
+};
+
+// Cloud status is kept as a code and only formatted when a page or API renders it
+enum CloudStatus {
+  CLOUD_NOT_MONITORING,
+  CLOUD_WIFI_DISCONNECTED,
+  CLOUD_FETCH_ERROR,
+  CLOUD_MAX_RETRIES,
+  CLOUD_COVERAGE_READ,
+  CLOUD_ACTIVATING,
+  CLOUD_NORMAL,
+  CLOUD_SCHEDULED
+};
+
+// Inputs that stay fixed for a decision; sun times already include offsets
+struct DecisionParams {
+  int sunriseTime;       // Minutes from midnight
+  int sunsetTime;
+  int monitoringWindow;  // Minutes before sunrise/sunset to check clouds
+  int cloudThreshold;    // Percent
+  int cloudHysteresis;   // Percent
+  int maxRetries;
+};
+
+// State carried from one loop pass to the next
+struct DecisionState {
+  bool monitoringSunrise;
+  bool monitoringSunset;
+  int retryCount;
+  bool cloudTriggered;
+  bool isMonitoring;
+  float cloudCoverage;   // Last sample, -1 when unknown
+  SystemState state;
+  CloudStatus cloudStatus;
+};
+
+// Returns cloud coverage in percent, or a negative value if it couldn't be read
+typedef float (*CloudCoverageSource)();
+
+inline void initDecisionState(DecisionState &st) {
+  st.monitoringSunrise = true;
+  st.monitoringSunset = true;
+  st.retryCount = 0;
+  st.cloudTriggered = false;
+  st.isMonitoring = false;
+  st.cloudCoverage = -1;
+  st.state = NORMAL;
+  st.cloudStatus = CLOUD_NOT_MONITORING;
+}
+
+inline bool isBeforeSunrise(const DecisionParams &p, int currentTime) {
+  return currentTime >= (p.sunriseTime - p.monitoringWindow) && currentTime < p.sunriseTime;
+}
+
+inline bool isBeforeSunset(const DecisionParams &p, int currentTime) {
+  return currentTime >= (p.sunsetTime - p.monitoringWindow) && currentTime < p.sunsetTime;
+}
+
+inline bool updateMonitoringWindow(DecisionState &st, const DecisionParams &p, int currentTime) {
+  st.isMonitoring = isBeforeSunrise(p, currentTime) || isBeforeSunset(p, currentTime);
+  return st.isMonitoring;
+}
+
+// Applies threshold and hysteresis to one sample and updates the monitoring flags
+inline bool applyCloudSample(DecisionState &st, const DecisionParams &p, bool isSunrise, float cloudCoverage) {
+  st.retryCount = 0;
+  st.cloudStatus = CLOUD_COVERAGE_READ;
+
+  bool shouldActivate = false;
+
+  if (cloudCoverage > p.cloudThreshold) {
+    shouldActivate = true;
+    st.cloudStatus = CLOUD_ACTIVATING;
+    st.cloudTriggered = true;
+    st.state = ACTIVE;
+  } else if (cloudCoverage < (p.cloudThreshold - p.cloudHysteresis)) {
+    shouldActivate = false;
+    st.cloudStatus = CLOUD_NORMAL;
+  } else {
+    shouldActivate = st.cloudTriggered;
+  }
+
+  if (isSunrise) {
+    st.monitoringSunrise = !shouldActivate;
+  } else {
+    st.monitoringSunset = !shouldActivate;
+  }
+
+  return shouldActivate;
+}
+
+inline bool monitorCloudConditions(DecisionState &st, const DecisionParams &p, bool isSunrise,
+                   CloudCoverageSource source) {
+  if (st.retryCount >= p.maxRetries) {
+    st.retryCount = 0;
+    st.cloudStatus = CLOUD_MAX_RETRIES;
+
+    if (isSunrise) {
+      st.monitoringSunrise = false;
+    } else {
+      st.monitoringSunset = false;
+    }
+
+    return false; // Don't activate lights on retry failure
+  }
+
+  float cloudCoverage = source();
+  st.cloudCoverage = cloudCoverage;
+
+  if (cloudCoverage < 0) {
+    st.cloudStatus = CLOUD_FETCH_ERROR;
+    st.retryCount++;
+    return false; // Don't activate yet, will retry later
+  }
+
+  return applyCloudSample(st, p, isSunrise, cloudCoverage);
+}
+
+inline bool shouldActivateLights(DecisionState &st, const DecisionParams &p, int currentTime,
+                 CloudCoverageSource source) {
+  bool beforeSunrise = isBeforeSunrise(p, currentTime);
+  bool beforeSunset = isBeforeSunset(p, currentTime);
+
+  // Normal light activation schedule (night time)
+  bool isNightTime = (currentTime < p.sunriseTime || currentTime >= p.sunsetTime);
+
+  // Outside both windows: re-arm monitoring for the next one
+  if (!beforeSunrise && !beforeSunset) {
+    st.monitoringSunrise = true;
+    st.monitoringSunset = true;
+    st.retryCount = 0;
+    st.cloudTriggered = false;
+  }
+
+  if (beforeSunrise && st.monitoringSunrise) {
+    if (monitorCloudConditions(st, p, true, source)) {
+      return true;
+    }
+  }
+
+  if (beforeSunset && st.monitoringSunset) {
+    if (monitorCloudConditions(st, p, false, source)) {
+      return true;
+    }
+  }
+
+  if (st.cloudTriggered && (beforeSunrise || beforeSunset)) {
+    return true;
+  }
+
+  // Normal schedule (night time) activation
+  if (isNightTime) {
+    st.state = SCHEDULED;
+    st.cloudStatus = CLOUD_SCHEDULED;
+    return true;
+  }
+
+  st.state = NORMAL;
+  return false;
+}
+
+// Names in enum order
+static const char SYSTEM_STATE_NAMES[][11] PROGMEM = { "normal", "monitoring", "active", "scheduled", "manual" };
+static const char CLOUD_STATUS_NAMES[][18] PROGMEM = {
+  "not_monitoring", "wifi_disconnected", "fetch_error", "max_retries",
+  "read", "activating", "normal", "scheduled",
+};
+
+inline FlashName systemStateName(SystemState state) {
+  return flashName(SYSTEM_STATE_NAMES, state, SYSTEM_STATE_NAMES[NORMAL]);
+}
+
+inline FlashName cloudStatusName(CloudStatus status) {
+  return flashName(CLOUD_STATUS_NAMES, status, CLOUD_STATUS_NAMES[CLOUD_NOT_MONITORING]);
+}
+
+// Sun time in minutes from midnight shifted earlier by `offset` minutes, wrapped into one day
+inline int applySunOffset(double minutesFromMidnight, int offset) {
+  int totalMinutes = int(minutesFromMidnight) - offset;
+  totalMinutes %= MINUTES_PER_DAY;
+  if (totalMinutes < 0) totalMinutes += MINUTES_PER_DAY;
+  return totalMinutes;
+}
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef DAY_PLAN_H
+#define DAY_PLAN_H
+
+// The day's light schedule, compiled ahead of time. The planner runs the
+// decision core over every minute of the day once, with cloud samples taken
+// from the forecast, and keeps only the minutes where the outcome changes.
+// The loop then looks up the current minute instead of re-running the
+// decision. The plan is rebuilt whenever its inputs (the decision
+// parameters, the day or the forecast) change.
+
+#include <string.h>
+#include "controller_core.h"
+
+#define PLAN_MAX_ENTRIES 32
+
+enum PlanReason {
+  PLAN_DAY,          // Off: daylight
+  PLAN_MONITORING,   // Off: in a window, clouds below the threshold
+  PLAN_CLOUDS,       // On: clouds over the threshold in a window
+  PLAN_NIGHT         // On: between sunset and sunrise
+};
+
+// From `minute` until the next entry
+struct PlanEntry {
+  uint16_t minute;       // Local minutes from midnight
+  bool lightOn;
+  bool cloudTriggered;
+  uint8_t reason;        // PlanReason
+  uint8_t state;         // SystemState
+  uint8_t cloudStatus;   // CloudStatus
+  float cloudCoverage;   // Sample the decision saw, -1 when none
+};
+
+struct DayPlan {
+  bool valid;
+  bool truncated;           // More changes than PLAN_MAX_ENTRIES; the rest of the day isn't covered
+  uint32_t dayStart;        // Local epoch of midnight
+  uint32_t forecastFetchedAt;
+  DecisionParams params;
+  uint8_t count;
+  PlanEntry entries[PLAN_MAX_ENTRIES];
+};
+
+// Cloud cover forecast for a local minute of the plan's day, or a negative
+// value when the forecast doesn't cover it
+typedef float (*PlanCloudLookup)(void *ctx, int minute);
+
+// The decision core takes a plain function as its cloud source
+struct PlanSampler {
+  PlanCloudLookup lookup;
+  void *ctx;
+  int minute;
+};
+
+inline PlanSampler &planSampler() {
+  static PlanSampler sampler;
+  return sampler;
+}
+
+inline float planCloudSource() {
+  PlanSampler &s = planSampler();
+  return s.lookup(s.ctx, s.minute);
+}
+
+inline bool sameDecisionParams(const DecisionParams &a, const DecisionParams &b) {
+  return a.sunriseTime == b.sunriseTime && a.sunsetTime == b.sunsetTime && a.monitoringWindow == b.monitoringWindow &&
+         a.cloudThreshold == b.cloudThreshold && a.cloudHysteresis == b.cloudHysteresis &&
+         a.maxRetries == b.maxRetries;
+}
+
+inline PlanReason planReason(const DecisionState &st, bool lightOn) {
+  if (lightOn) return st.state == SCHEDULED ? PLAN_NIGHT : PLAN_CLOUDS;
+  return st.isMonitoring ? PLAN_MONITORING : PLAN_DAY;
+}
+
+static const char PLAN_REASON_NAMES[][11] PROGMEM = { "day", "monitoring", "clouds", "night" };
+
+inline FlashName planReasonName(uint8_t reason) {
+  return flashName(PLAN_REASON_NAMES, reason, PLAN_REASON_NAMES[PLAN_DAY]);
+}
+
+// Simulates the day minute by minute. Forecast lookups only happen while the
+// decision samples clouds, i.e. inside the monitoring windows.
+inline void buildDayPlan(DayPlan &plan, const DecisionParams &p, uint32_t dayStart, uint32_t forecastFetchedAt,
+                         PlanCloudLookup lookup, void *ctx) {
+  plan.valid = true;
+  plan.truncated = false;
+  plan.dayStart = dayStart;
+  plan.forecastFetchedAt = forecastFetchedAt;
+  plan.params = p;
+  plan.count = 0;
+
+  PlanSampler &sampler = planSampler();
+  sampler.lookup = lookup;
+  sampler.ctx = ctx;
+
+  DecisionState st;
+  initDecisionState(st);
+  for (int minute = 0; minute < MINUTES_PER_DAY; minute++) {
+    sampler.minute = minute;
+    updateMonitoringWindow(st, p, minute);
+    bool lightOn = shouldActivateLights(st, p, minute, planCloudSource);
+
+    PlanEntry e;
+    e.minute = minute;
+    e.lightOn = lightOn;
+    e.cloudTriggered = st.cloudTriggered;
+    e.reason = planReason(st, lightOn);
+    e.state = st.state;
+    e.cloudStatus = st.cloudStatus;
+    e.cloudCoverage = st.cloudCoverage;
+
+    if (plan.count > 0) {
+      const PlanEntry &last = plan.entries[plan.count - 1];
+      if (last.lightOn == e.lightOn && last.cloudTriggered == e.cloudTriggered && last.reason == e.reason &&
+          last.state == e.state && last.cloudStatus == e.cloudStatus && last.cloudCoverage == e.cloudCoverage) {
+        continue;
+      }
+    }
+    if (plan.count == PLAN_MAX_ENTRIES) {
+      plan.truncated = true;
+      return;
+    }
+    plan.entries[plan.count++] = e;
+  }
+}
+
+// Entry in effect at `minute`, or NULL when the plan doesn't cover it
+inline const PlanEntry *planEntryAt(const DayPlan &plan, int minute) {
+  if (!plan.valid || plan.count == 0 || minute < 0 || minute >= MINUTES_PER_DAY) return NULL;
+  if (plan.truncated && minute >= plan.entries[plan.count - 1].minute) return NULL;
+  // Last entry starting at or before `minute`; entry 0 starts at midnight
+  int lo = 0;
+  int hi = plan.count - 1;
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+    if (plan.entries[mid].minute <= minute) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return &plan.entries[lo];
+}
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef ENERGY_H
+#define ENERGY_H
+
+// On-time per circuit for today, this week and the unit's lifetime, split by
+// why the circuit was on, so lighting energy can be billed without replaying
+// the light-state log. Counters only move when a circuit switches or the
+// reason it is on changes, and at checkpoints; reads add the open segment on
+// the fly, so a report is O(1) per circuit. Times are local epochs, weeks
+// start on Monday.
+
+#include <stdint.h>
+#include <string.h>
+#include "flash_string.h"
+#include "zones.h"
+
+#define ENERGY_CIRCUITS (1 + MAX_ZONES)  // The main relay, then the zones in order
+#define ENERGY_MAGIC 0x454E
+#define ENERGY_SECS_PER_DAY 86400UL
+
+enum EnergyCause {
+  CAUSE_SCHEDULE,   // Between sunset and sunrise
+  CAUSE_CLOUD,      // Clouds over the threshold in a monitoring window
+  CAUSE_MANUAL,     // Manual override
+  CAUSE_COUNT
+};
+
+enum EnergyPeriod {
+  PERIOD_TODAY,
+  PERIOD_WEEK,
+  PERIOD_LIFETIME,
+  PERIOD_COUNT
+};
+
+// Flash copy of one circuit, 24 bytes. Today and this week are kept to the
+// minute so every circuit fits the space after the log area.
+struct EnergySavedCircuit {
+  uint32_t lifetimeSec[CAUSE_COUNT];
+  uint16_t weekMin[CAUSE_COUNT];
+  uint16_t todayMin[CAUSE_COUNT];
+};
+
+struct EnergyRecord {
+  uint16_t magic;
+  uint16_t circuits;
+  uint32_t dayStart;        // Local epoch of the midnight `todayMin` belongs to
+  uint32_t weekStart;
+  EnergySavedCircuit saved[ENERGY_CIRCUITS];
+};
+
+static const char ENERGY_CAUSE_NAMES[][9] PROGMEM = { "schedule", "cloud", "manual" };
+
+inline FlashName energyCauseName(uint8_t cause) {
+  return flashName(ENERGY_CAUSE_NAMES, cause, ENERGY_CAUSE_NAMES[CAUSE_SCHEDULE]);
+}
+
+inline float energyKWh(uint32_t seconds, float watts) {
+  return seconds * watts / 3600000.0f;
+}
+
+class EnergyMeter {
+private:
+  struct Circuit {
+    uint32_t seconds[PERIOD_COUNT][CAUSE_COUNT];
+    bool on;
+    uint8_t cause;
+    uint32_t creditedTo;    // Local epoch the open segment has been counted up to
+  };
+
+  Circuit circuits[ENERGY_CIRCUITS];
+  uint32_t dayStart;
+  uint32_t weekStart;
+  bool dirty;
+
+  static uint32_t dayStartOf(uint32_t t) {
+    return t - t % ENERGY_SECS_PER_DAY;
+  }
+
+  // 1 January 1970 was a Thursday
+  static uint32_t weekStartOf(uint32_t t) {
+    uint32_t days = t / ENERGY_SECS_PER_DAY;
+    return (days - (days + 3) % 7) * ENERGY_SECS_PER_DAY;
+  }
+
+  // Starts new today/week buckets once `now` is past them; a clock stepping
+  // back keeps the current ones
+  void roll(uint32_t now) {
+    uint32_t day = dayStartOf(now);
+    if (day > dayStart) {
+      for (int i = 0; i < ENERGY_CIRCUITS; i++) {
+        memset(circuits[i].seconds[PERIOD_TODAY], 0, sizeof(circuits[i].seconds[PERIOD_TODAY]));
+      }
+      dayStart = day;
+      dirty = true;
+    }
+    uint32_t week = weekStartOf(now);
+    if (week > weekStart) {
+      for (int i = 0; i < ENERGY_CIRCUITS; i++) {
+        memset(circuits[i].seconds[PERIOD_WEEK], 0, sizeof(circuits[i].seconds[PERIOD_WEEK]));
+      }
+      weekStart = week;
+      dirty = true;
+    }
+  }
+
+  // Counts [from, to) of a circuit's open segment; the part before midnight
+  // or Monday only reaches the longer periods
+  void credit(Circuit &c, uint32_t from, uint32_t to) {
+    if (to <= from) return;
+    roll(to);
+    c.seconds[PERIOD_LIFETIME][c.cause] += to - from;
+    if (to > dayStart) c.seconds[PERIOD_TODAY][c.cause] += to - (from > dayStart ? from : dayStart);
+    if (to > weekStart) c.seconds[PERIOD_WEEK][c.cause] += to - (from > weekStart ? from : weekStart);
+    dirty = true;
+  }
+
+public:
+  EnergyMeter() {
+    reset();
+  }
+
+  void reset() {
+    memset(circuits, 0, sizeof(circuits));
+    dayStart = 0;
+    weekStart = 0;
+    dirty = false;
+  }
+
+  // Called every pass with each circuit's relay state; does nothing unless
+  // the circuit switched or is now on for another reason
+  bool update(int index, bool on, EnergyCause cause, uint32_t now) {
+    Circuit &c = circuits[index];
+    if (c.on == on && (!on || c.cause == cause)) return false;
+    if (c.on) credit(c, c.creditedTo, now);
+    c.on = on;
+    c.cause = cause;
+    c.creditedTo = now;
+    return true;
+  }
+
+  // Counts open segments up to `now` so a checkpoint holds them
+  void settle(uint32_t now) {
+    roll(now);
+    for (int i = 0; i < ENERGY_CIRCUITS; i++) {
+      Circuit &c = circuits[i];
+      if (!c.on || now <= c.creditedTo) continue;
+      credit(c, c.creditedTo, now);
+      c.creditedTo = now;
+    }
+  }
+
+  // Lit circuits gain time without any update() call
+  bool needsCheckpoint() const {
+    if (dirty) return true;
+    for (int i = 0; i < ENERGY_CIRCUITS; i++) {
+      if (circuits[i].on) return true;
+    }
+    return false;
+  }
+
+  void markClean() {
+    dirty = false;
+  }
+
+  bool isOn(int index) const {
+    return circuits[index].on;
+  }
+
+  uint8_t getCause(int index) const {
+    return circuits[index].cause;
+  }
+
+  uint32_t getSeconds(int index, EnergyPeriod period, EnergyCause cause, uint32_t now) const {
+    const Circuit &c = circuits[index];
+    uint32_t start = 0;
+    uint32_t total = c.seconds[period][cause];
+    if (period == PERIOD_TODAY) {
+      start = dayStartOf(now);
+      if (start != dayStart) total = 0;
+    } else if (period == PERIOD_WEEK) {
+      start = weekStartOf(now);
+      if (start != weekStart) total = 0;
+    }
+    if (c.on && c.cause == cause && now > c.creditedTo) {
+      uint32_t from = c.creditedTo > start ? c.creditedTo : start;
+      if (now > from) total += now - from;
+    }
+    return total;
+  }
+
+  uint32_t getTotalSeconds(int index, EnergyPeriod period, uint32_t now) const {
+    uint32_t total = 0;
+    for (int cause = 0; cause < CAUSE_COUNT; cause++) {
+      total += getSeconds(index, period, (EnergyCause)cause, now);
+    }
+    return total;
+  }
+
+  // Call settle() first so the open segments are included
+  void save(EnergyRecord &record) const {
+    record.magic = ENERGY_MAGIC;
+    record.circuits = ENERGY_CIRCUITS;
+    record.dayStart = dayStart;
+    record.weekStart = weekStart;
+    for (int i = 0; i < ENERGY_CIRCUITS; i++) {
+      for (int cause = 0; cause < CAUSE_COUNT; cause++) {
+        record.saved[i].lifetimeSec[cause] = circuits[i].seconds[PERIOD_LIFETIME][cause];
+        record.saved[i].weekMin[cause] = circuits[i].seconds[PERIOD_WEEK][cause] / 60;
+        record.saved[i].todayMin[cause] = circuits[i].seconds[PERIOD_TODAY][cause] / 60;
+      }
+    }
+  }
+
+  // Circuits come back switched off; the next update() reopens the lit ones
+  bool load(const EnergyRecord &record) {
+    reset();
+    if (record.magic != ENERGY_MAGIC || record.circuits != ENERGY_CIRCUITS) return false;
+    dayStart = record.dayStart;
+    weekStart = record.weekStart;
+    for (int i = 0; i < ENERGY_CIRCUITS; i++) {
+      for (int cause = 0; cause < CAUSE_COUNT; cause++) {
+        circuits[i].seconds[PERIOD_LIFETIME][cause] = record.saved[i].lifetimeSec[cause];
+        circuits[i].seconds[PERIOD_WEEK][cause] = record.saved[i].weekMin[cause] * 60UL;
+        circuits[i].seconds[PERIOD_TODAY][cause] = record.saved[i].todayMin[cause] * 60UL;
+      }
+    }
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef FLASH_STRING_H
+#define FLASH_STRING_H
+
+// Flash-resident strings. On the ESP8266 every string literal is copied into
+// RAM at boot, while PROGMEM data stays in flash and is read with the _P
+// functions. Name tables keep their names in one fixed-width PROGMEM array
+// and hand them out as a FlashName: a small RAM copy that lives until the end
+// of the full expression, so a name can go straight into a printf argument
+// list. On a host PROGMEM is a no-op, so headers shared with the tools
+// still build there.
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <pgmspace.h>
+#else
+#ifndef PROGMEM
+#define PROGMEM
+#define PSTR(s) (s)
+#define strncpy_P strncpy
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+#endif
+#ifndef PGM_P
+#define PGM_P const char *
+#endif
+#endif
+
+#define FLASH_NAME_SIZE 24   // Longest name, terminator included
+
+class FlashName {
+private:
+  char text[FLASH_NAME_SIZE];
+
+public:
+  explicit FlashName(PGM_P name) {
+    strncpy_P(text, name, sizeof(text) - 1);
+    text[sizeof(text) - 1] = 0;
+  }
+
+  const char *c_str() const { return text; }
+};
+
+// Entry `index` of a `static const char table[][width] PROGMEM`, or
+// `fallback` (a PSTR) past its end
+template <size_t N, size_t W>
+inline FlashName flashName(const char (&table)[N][W], size_t index, PGM_P fallback) {
+  static_assert(W <= FLASH_NAME_SIZE, "name table wider than FlashName");
+  return FlashName(index < N ? table[index] : fallback);
+}
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef FORECAST_CACHE_H
+#define FORECAST_CACHE_H
+
+// The last forecast as hourly fixed-point columns. tools/trace_replay.cpp
+// rebuilds it from a recorded input trace.
+
+#include <stdint.h>
+#include "flash_string.h"
+#include "sky_model.h"
+
+#define FORECAST_CACHE_HOURS 48     // Hourly values kept from one forecast
+#define FORECAST_CACHE_TTL 3600     // Seconds before a forecast is fetched again
+#define FORECAST_CACHE_MISSING 0xFF // Hour present in the forecast without a value
+#define FORECAST_CACHE_MISSING16 0xFFFF
+
+// Hourly variables kept from a forecast, stored as fixed-point columns
+enum ForecastColumn {
+  FC_CLOUD_COVER,       // Percent
+  FC_CLOUD_LOW,
+  FC_CLOUD_MID,
+  FC_CLOUD_HIGH,
+  FC_PRECIPITATION,     // Tenths of a mm
+  FC_RADIATION,         // Tenths of a W/m², the only 16-bit column
+  FC_COUNT
+};
+
+#define FORECAST_NARROW_COLUMNS FC_RADIATION
+#define FORECAST_HOUR_BYTES (FORECAST_NARROW_COLUMNS + 2)
+
+struct ForecastColumnSpec {
+  float scale;          // Stored value per unit
+  uint16_t maxStored;
+};
+
+static const ForecastColumnSpec FORECAST_COLUMNS[FC_COUNT] = {
+  { 1, 100 },
+  { 1, 100 },
+  { 1, 100 },
+  { 1, 100 },
+  { 10, 254 },
+  { 10, 20000 },
+};
+
+// Open-Meteo variables, in ForecastColumn order
+static const char FORECAST_COLUMN_NAMES[FC_COUNT][20] PROGMEM = {
+  "cloud_cover", "cloud_cover_low", "cloud_cover_mid", "cloud_cover_high", "precipitation", "shortwave_radiation"
+};
+
+inline FlashName forecastColumnName(uint8_t column) {
+  return flashName(FORECAST_COLUMN_NAMES, column, PSTR(""));
+}
+
+// Hourly forecast from the last fetch, done here or received from a peer.
+// Lookups are by UTC epoch, so no time strings are compared per sample.
+struct ForecastCache {
+  uint32_t startEpoch;   // UTC epoch of the first hour
+  uint32_t fetchedAt;    // UTC epoch of the upstream fetch, 0 when empty
+  uint8_t hours;
+  uint8_t narrow[FORECAST_NARROW_COLUMNS][FORECAST_CACHE_HOURS];
+  uint16_t radiation[FORECAST_CACHE_HOURS];
+
+  void clear() {
+    startEpoch = 0;
+    fetchedAt = 0;
+    hours = 0;
+  }
+
+  bool isFresh(uint32_t utcNow) const {
+    return fetchedAt != 0 && utcNow - fetchedAt < FORECAST_CACHE_TTL;
+  }
+
+  // Stores `value` in its column's units, or marks it missing when NaN
+  void set(ForecastColumn column, uint8_t hour, float value) {
+    const ForecastColumnSpec &spec = FORECAST_COLUMNS[column];
+    uint16_t stored;
+    if (value != value) {
+      stored = column == FC_RADIATION ? FORECAST_CACHE_MISSING16 : FORECAST_CACHE_MISSING;
+    } else {
+      float scaled = value * spec.scale;
+      stored = scaled <= 0 ? 0 : scaled >= spec.maxStored ? spec.maxStored : (uint16_t)(scaled + 0.5f);
+    }
+    if (column == FC_RADIATION) {
+      radiation[hour] = stored;
+    } else {
+      narrow[column][hour] = stored;
+    }
+  }
+
+  // The value in its variable's units, or -1 when missing
+  float get(ForecastColumn column, uint8_t hour) const {
+    if (column == FC_RADIATION) {
+      return radiation[hour] == FORECAST_CACHE_MISSING16 ? -1 : radiation[hour] / FORECAST_COLUMNS[column].scale;
+    }
+    uint8_t stored = narrow[column][hour];
+    return stored == FORECAST_CACHE_MISSING ? -1 : stored / FORECAST_COLUMNS[column].scale;
+  }
+
+  bool hourIndex(uint32_t utcNow, uint8_t &index) const {
+    if (hours == 0 || utcNow < startEpoch) return false;
+    uint32_t i = (utcNow - startEpoch) / 3600;
+    if (i >= hours) return false;
+    index = i;
+    return true;
+  }
+
+  bool lookup(uint32_t utcNow, ForecastHour &hour) const {
+    uint8_t i;
+    if (!hourIndex(utcNow, i)) return false;
+    hour.cloudCover = get(FC_CLOUD_COVER, i);
+    hour.cloudLow = get(FC_CLOUD_LOW, i);
+    hour.cloudMid = get(FC_CLOUD_MID, i);
+    hour.cloudHigh = get(FC_CLOUD_HIGH, i);
+    hour.precipitation = get(FC_PRECIPITATION, i);
+    hour.radiation = get(FC_RADIATION, i);
+    return hour.cloudCover >= 0 || (hour.cloudLow >= 0 && hour.cloudMid >= 0 && hour.cloudHigh >= 0);
+  }
+};
+
+#endif
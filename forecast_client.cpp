@@ -0,0 +1,210 @@
+#include "forecast_client.h"
+#include <lwip/dns.h>
+#include <lwip/tcp.h>
+#include "http_response.h"
+#include "metrics.h"
+
+// The lwIP callbacks. Like the web server's, they run from the TCP stack
+// while fetch() yields, never in the middle of its own code.
+struct ForecastCallbacks {
+  static void resolved(const char *name, const ip_addr_t *addr, void *arg);
+  static bool connect(ForecastRequest &r, const ip_addr_t *addr);
+  static err_t connected(void *arg, tcp_pcb *pcb, err_t err);
+  static err_t receive(void *arg, tcp_pcb *pcb, pbuf *p, err_t err);
+  static void error(void *arg, err_t err);
+};
+
+ForecastClient forecastClient;
+
+// DNS answers can arrive after their fetch has ended, so they carry the
+// provider and generation instead of a pointer into `requests`
+static void *dnsTag(uint8_t provider, uint8_t generation) {
+  return (void *)(uintptr_t)((generation << 8) | provider);
+}
+
+ForecastClient::ForecastClient() : path(NULL), generation(0), lastStatus(-1) {
+  memset(providers, 0, sizeof(providers));
+  memset(requests, 0, sizeof(requests));
+}
+
+void ForecastClient::begin(const char *const *list, uint8_t count, bool hedging) {
+  if (count > FORECAST_MAX_PROVIDERS) count = FORECAST_MAX_PROVIDERS;
+  for (uint8_t i = 0; i < count; i++) {
+    const char *colon = strrchr(list[i], ':');
+    size_t len = colon ? (size_t)(colon - list[i]) : strlen(list[i]);
+    if (len >= FORECAST_HOST_MAX) len = FORECAST_HOST_MAX - 1;
+    memcpy(providers[i].host, list[i], len);
+    providers[i].host[len] = 0;
+    providers[i].port = colon ? atoi(colon + 1) : 80;
+  }
+  hedge.begin(count, hedging);
+}
+
+//================ REQUESTS ================
+void ForecastCallbacks::resolved(const char *name, const ip_addr_t *addr, void *arg) {
+  uintptr_t tag = (uintptr_t)arg;
+  uint8_t provider = tag & 0xFF;
+  if (provider >= FORECAST_MAX_PROVIDERS) return;
+  ForecastRequest &r = forecastClient.requests[provider];
+  if (r.owner == NULL || r.generation != (tag >> 8) || r.pcb != NULL || r.failed) return;
+  if (addr == NULL || !connect(r, addr)) r.failed = true;
+}
+
+bool ForecastCallbacks::connect(ForecastRequest &r, const ip_addr_t *addr) {
+  tcp_pcb *pcb = tcp_new();
+  if (pcb == NULL) return false;
+  tcp_arg(pcb, &r);
+  tcp_recv(pcb, receive);
+  tcp_err(pcb, error);
+  if (tcp_connect(pcb, addr, r.owner->providers[r.provider].port, connected) != ERR_OK) {
+    tcp_arg(pcb, NULL);
+    tcp_abort(pcb);
+    return false;
+  }
+  r.pcb = pcb;
+  return true;
+}
+
+err_t ForecastCallbacks::connected(void *arg, tcp_pcb *pcb, err_t err) {
+  ForecastRequest &r = *(ForecastRequest *)arg;
+  char head[384];
+  int len = snprintf_P(head, sizeof(head), PSTR("GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n"),
+                       r.owner->path, r.owner->providers[r.provider].host);
+  if (err != ERR_OK || len >= (int)sizeof(head) || tcp_write(pcb, head, len, TCP_WRITE_FLAG_COPY) != ERR_OK) {
+    tcp_arg(pcb, NULL);
+    tcp_abort(pcb);
+    r.pcb = NULL;
+    r.failed = true;
+    return ERR_ABRT;
+  }
+  tcp_output(pcb);
+  return ERR_OK;
+}
+
+err_t ForecastCallbacks::receive(void *arg, tcp_pcb *pcb, pbuf *p, err_t err) {
+  ForecastRequest &r = *(ForecastRequest *)arg;
+  if (p == NULL) {
+    r.closed = true;
+    return ERR_OK;
+  }
+  size_t len = p->tot_len;
+  tcp_recved(pcb, len);
+  if (r.closed || !r.owner->grow(r, r.rxLen + len + 1)) {
+    pbuf_free(p);
+    // Too large to parse; nothing more is read from this one
+    r.closed = true;
+    r.failed = true;
+    return ERR_OK;
+  }
+  pbuf_copy_partial(p, r.rx + r.rxLen, len, 0);
+  r.rxLen += len;
+  r.rx[r.rxLen] = 0;
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+void ForecastCallbacks::error(void *arg, err_t err) {
+  if (arg == NULL) return;
+  ForecastRequest &r = *(ForecastRequest *)arg;
+  // lwIP has already freed the pcb; what arrived may still be a whole answer
+  r.pcb = NULL;
+  r.closed = true;
+  if (r.rxLen == 0) r.failed = true;
+}
+
+bool ForecastClient::grow(ForecastRequest &r, size_t need) {
+  if (need <= r.rxCap) return true;
+  if (need > FORECAST_RESPONSE_MAX) return false;
+  size_t cap = r.rxCap == 0 ? FORECAST_RX_INITIAL : r.rxCap;
+  while (cap < need) cap *= 2;
+  if (cap > FORECAST_RESPONSE_MAX) cap = FORECAST_RESPONSE_MAX;
+  char *grown = (char *)realloc(r.rx, cap);
+  if (grown == NULL) return false;
+  r.rx = grown;
+  r.rxCap = cap;
+  return true;
+}
+
+bool ForecastClient::open(uint8_t provider) {
+  ForecastRequest &r = requests[provider];
+  memset(&r, 0, sizeof(r));
+  r.owner = this;
+  r.provider = provider;
+  r.generation = generation;
+
+  // Addresses are answered at once, and names the resolver has cached
+  ip_addr_t addr;
+  err_t err = dns_gethostbyname(providers[provider].host, &addr, ForecastCallbacks::resolved,
+                                dnsTag(provider, generation));
+  if (err == ERR_OK) return ForecastCallbacks::connect(r, &addr);
+  return err == ERR_INPROGRESS;
+}
+
+void ForecastClient::drop(ForecastRequest &r) {
+  if (r.pcb) {
+    tcp_arg(r.pcb, NULL);
+    tcp_recv(r.pcb, NULL);
+    tcp_err(r.pcb, NULL);
+    if (!r.closed || tcp_close(r.pcb) != ERR_OK) tcp_abort(r.pcb);
+  }
+  free(r.rx);
+  memset(&r, 0, sizeof(r));
+}
+
+//================ FETCH ================
+int8_t ForecastClient::fetch(const char *requestPath, uint32_t timeoutMs, ForecastBodyHandler handler, void *ctx) {
+  path = requestPath;
+  generation++;
+  lastStatus = -1;
+  hedge.start(millis(), timeoutMs);
+
+  while (!hedge.isDone(millis())) {
+    bool hedging = false;
+    for (uint8_t i = 0; i < hedge.getCount(); i++) hedging |= hedge.isRunning(i);
+    int8_t asked = hedge.due(millis());
+    if (asked >= 0) {
+      if (hedging) metrics.inc(MC_FORECAST_HEDGES);
+      if (!open(asked)) {
+        hedge.failed(asked);
+        drop(requests[asked]);
+      }
+    }
+
+    for (uint8_t i = 0; i < hedge.getCount() && hedge.getWinner() < 0; i++) {
+      if (!hedge.isRunning(i)) continue;
+      ForecastRequest &r = requests[i];
+      if (r.failed) {
+        hedge.failed(i);
+        drop(r);
+        continue;
+      }
+      int status;
+      char *body;
+      size_t len;
+      HttpResponseStatus framed = httpResponseParse(r.rx, r.rxLen, r.closed, status, body, len);
+      if (framed == HTTP_RESPONSE_INCOMPLETE) continue;
+      if (framed == HTTP_RESPONSE_DONE) lastStatus = status;
+      if (framed == HTTP_RESPONSE_DONE && status == 200 && handler(body, len, ctx)) {
+        hedge.succeeded(i, millis());
+      } else {
+        hedge.failed(i);
+      }
+      drop(r);
+    }
+    if (!hedge.isDone(millis())) delay(1);
+  }
+
+  // Whatever is still running lost the race or ran out of time
+  for (uint8_t i = 0; i < hedge.getCount(); i++) {
+    if (!hedge.isRunning(i)) continue;
+    if (hedge.getWinner() >= 0) {
+      hedge.cancel(i);
+    } else {
+      hedge.failed(i);
+    }
+    drop(requests[i]);
+  }
+  int8_t winner = hedge.getWinner();
+  if (winner > 0) metrics.inc(MC_FORECAST_FALLBACK_WINS);
+  return winner;
+}
@@ -0,0 +1,76 @@
+#ifndef FORECAST_CLIENT_H
+#define FORECAST_CLIENT_H
+
+#include <Arduino.h>
+#include "forecast_hedge.h"
+
+#define FORECAST_HOST_MAX 48
+#define FORECAST_RX_INITIAL 2048
+#define FORECAST_RESPONSE_MAX 16384   // Larger answers are dropped
+
+struct tcp_pcb;
+class ForecastClient;
+
+struct ForecastProvider {
+  char host[FORECAST_HOST_MAX];
+  uint16_t port;
+};
+
+// One provider's request in the fetch in progress
+struct ForecastRequest {
+  ForecastClient *owner;
+  tcp_pcb *pcb;
+  uint8_t provider;
+  uint8_t generation;    // Tells a late DNS answer for an earlier fetch apart
+  bool failed;           // No answer is coming: lookup, connect or send failed
+  bool closed;           // The server is done sending
+  char *rx;
+  size_t rxLen;
+  size_t rxCap;
+};
+
+// Parses a 200 answer's body (which may be modified in place); false
+// rejects it and the fetch waits for the other providers
+typedef bool (*ForecastBodyHandler)(char *body, size_t len, void *ctx);
+
+// HTTP client for the forecast providers in config.h. Requests run on lwIP's
+// TCP callbacks so a hedge can be in flight next to the request it backs
+// up; ForecastHedge decides when each provider is asked.
+class ForecastClient {
+private:
+  ForecastProvider providers[FORECAST_MAX_PROVIDERS];
+  ForecastRequest requests[FORECAST_MAX_PROVIDERS];
+  ForecastHedge hedge;
+  const char *path;
+  uint8_t generation;
+  int lastStatus;
+
+  bool open(uint8_t provider);
+  void drop(ForecastRequest &r);
+  bool grow(ForecastRequest &r, size_t need);
+
+  friend struct ForecastCallbacks;
+
+public:
+  ForecastClient();
+
+  // `list` holds "host:port" entries in order of preference; the port
+  // defaults to 80
+  void begin(const char *const *list, uint8_t count, bool hedging);
+
+  // Asks the providers for `requestPath` until one's answer is accepted by
+  // `handler`, or `timeoutMs` passes. Blocks like the HTTPClient fetch it
+  // replaced, yielding to the TCP stack while it waits. Returns the
+  // provider that answered, or -1.
+  int8_t fetch(const char *requestPath, uint32_t timeoutMs, ForecastBodyHandler handler, void *ctx);
+
+  // The last HTTP status a provider answered with, or -1 when none did
+  int getLastStatus() const { return lastStatus; }
+  uint8_t getCount() const { return hedge.getCount(); }
+  const ForecastProvider &getProvider(uint8_t provider) const { return providers[provider]; }
+  const ForecastHedge &getHedge() const { return hedge; }
+};
+
+extern ForecastClient forecastClient;
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef FORECAST_HEDGE_H
+#define FORECAST_HEDGE_H
+
+// Hedged requests over an ordered list of forecast providers. A fetch starts
+// with the first provider; when it has not answered within its usual p90
+// latency, the next one is asked as well and whichever answers first wins.
+// A provider that fails hands over to the next right away. Each provider
+// keeps a window of recent latencies and its request counts.
+// tools/hedge_bench.cpp runs the same policy against local stand-in servers.
+
+#include <stdint.h>
+#include <string.h>
+
+#define FORECAST_MAX_PROVIDERS 4
+#define FORECAST_MAX_IN_FLIGHT 2         // The request being waited on and one hedge
+#define FORECAST_LATENCY_SAMPLES 16
+#define FORECAST_HEDGE_MIN_SAMPLES 4     // Below this the initial delay is used
+#define FORECAST_HEDGE_INITIAL_MS 1500
+#define FORECAST_HEDGE_MIN_MS 100
+
+struct ForecastProviderStats {
+  uint32_t requests;
+  uint32_t successes;
+  uint32_t failures;
+  uint32_t wins;         // Successes that answered the fetch
+  uint32_t hedged;       // Times another provider was asked while this one was slow
+  uint32_t cancelled;    // Requests dropped because another provider won
+  uint32_t lastLatencyMs;
+  uint16_t latencyMs[FORECAST_LATENCY_SAMPLES];  // Successful requests, newest at latencyNext - 1
+  uint8_t latencyCount;
+  uint8_t latencyNext;
+
+  void addLatency(uint32_t ms) {
+    lastLatencyMs = ms;
+    latencyMs[latencyNext] = ms > 0xFFFF ? 0xFFFF : ms;
+    latencyNext = (latencyNext + 1) % FORECAST_LATENCY_SAMPLES;
+    if (latencyCount < FORECAST_LATENCY_SAMPLES) latencyCount++;
+  }
+
+  // Nearest-rank percentile of the window; 0 when it is empty
+  uint32_t percentile(uint8_t pct) const {
+    if (latencyCount == 0) return 0;
+    uint16_t sorted[FORECAST_LATENCY_SAMPLES];
+    memcpy(sorted, latencyMs, latencyCount * sizeof(sorted[0]));
+    for (uint8_t i = 1; i < latencyCount; i++) {
+      uint16_t v = sorted[i];
+      uint8_t j = i;
+      while (j > 0 && sorted[j - 1] > v) {
+        sorted[j] = sorted[j - 1];
+        j--;
+      }
+      sorted[j] = v;
+    }
+    uint8_t rank = (pct * latencyCount + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+  }
+};
+
+enum ForecastAttemptState {
+  FA_IDLE,         // Not asked in this fetch
+  FA_RUNNING,
+  FA_FAILED,
+  FA_CANCELLED,
+  FA_WON
+};
+
+class ForecastHedge {
+private:
+  ForecastProviderStats stats[FORECAST_MAX_PROVIDERS];
+  uint8_t count;
+  bool hedging;
+
+  // The fetch in progress
+  uint8_t state[FORECAST_MAX_PROVIDERS];
+  uint32_t startedMs[FORECAST_MAX_PROVIDERS];
+  uint8_t next;          // Next provider to ask
+  int8_t winner;
+  uint32_t beganMs;
+  uint32_t timeoutMs;
+
+  uint8_t running() const {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      if (state[i] == FA_RUNNING) n++;
+    }
+    return n;
+  }
+
+public:
+  ForecastHedge() : count(0), hedging(true), next(0), winner(-1), beganMs(0), timeoutMs(0) {
+    memset(stats, 0, sizeof(stats));
+    memset(state, FA_IDLE, sizeof(state));
+  }
+
+  void begin(uint8_t providers, bool hedge) {
+    count = providers < FORECAST_MAX_PROVIDERS ? providers : FORECAST_MAX_PROVIDERS;
+    hedging = hedge;
+    memset(stats, 0, sizeof(stats));
+  }
+
+  // How long a request to `provider` may run before the next one is asked
+  uint32_t hedgeDelayMs(uint8_t provider) const {
+    const ForecastProviderStats &s = stats[provider];
+    if (s.latencyCount < FORECAST_HEDGE_MIN_SAMPLES) return FORECAST_HEDGE_INITIAL_MS;
+    uint32_t p90 = s.percentile(90);
+    return p90 > FORECAST_HEDGE_MIN_MS ? p90 : FORECAST_HEDGE_MIN_MS;
+  }
+
+  // Starts a fetch that gives up `timeout` ms from now
+  void start(uint32_t nowMs, uint32_t timeout) {
+    memset(state, FA_IDLE, sizeof(state));
+    next = 0;
+    winner = -1;
+    beganMs = nowMs;
+    timeoutMs = timeout;
+  }
+
+  // The provider to ask now, or -1: the first one straight away, the next
+  // when nothing is running (every request so far failed), or as a hedge
+  // when the oldest running request is past its provider's delay
+  int8_t due(uint32_t nowMs) {
+    if (winner >= 0 || next >= count || isDone(nowMs)) return -1;
+    uint8_t active = running();
+    bool ask = active == 0;
+    if (!ask && hedging && active < FORECAST_MAX_IN_FLIGHT) {
+      for (uint8_t i = 0; i < count; i++) {
+        if (state[i] == FA_RUNNING && nowMs - startedMs[i] >= hedgeDelayMs(i)) {
+          stats[i].hedged++;
+          ask = true;
+          break;
+        }
+      }
+    }
+    if (!ask) return -1;
+    uint8_t provider = next++;
+    state[provider] = FA_RUNNING;
+    startedMs[provider] = nowMs;
+    stats[provider].requests++;
+    return provider;
+  }
+
+  // An error, an unusable answer, or still running when the fetch timed out
+  void failed(uint8_t provider) {
+    if (state[provider] != FA_RUNNING) return;
+    state[provider] = FA_FAILED;
+    stats[provider].failures++;
+  }
+
+  // A complete, usable answer; the first one wins the fetch
+  void succeeded(uint8_t provider, uint32_t nowMs) {
+    if (state[provider] != FA_RUNNING) return;
+    stats[provider].successes++;
+    stats[provider].addLatency(nowMs - startedMs[provider]);
+    if (winner >= 0) {
+      state[provider] = FA_CANCELLED;
+      return;
+    }
+    state[provider] = FA_WON;
+    winner = provider;
+    stats[provider].wins++;
+  }
+
+  // A request still running when another provider won; true when the
+  // caller has a connection to drop
+  bool cancel(uint8_t provider) {
+    if (state[provider] != FA_RUNNING) return false;
+    state[provider] = FA_CANCELLED;
+    stats[provider].cancelled++;
+    return true;
+  }
+
+  bool isRunning(uint8_t provider) const { return provider < count && state[provider] == FA_RUNNING; }
+
+  // A winner, every provider tried without one, or out of time
+  bool isDone(uint32_t nowMs) const {
+    if (winner >= 0) return true;
+    if (nowMs - beganMs >= timeoutMs) return true;
+    return next >= count && running() == 0;
+  }
+
+  uint32_t elapsedMs(uint32_t nowMs) const { return nowMs - beganMs; }
+  int8_t getWinner() const { return winner; }
+  uint8_t getCount() const { return count; }
+  const ForecastProviderStats &getStats(uint8_t provider) const { return stats[provider]; }
+};
+
+#endif
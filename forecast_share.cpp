@@ -0,0 +1,185 @@
+#include "forecast_share.h"
+#include "hmac.h"
+#include "metrics.h"
+#include "trace.h"
+
+ForecastShare forecastShare;
+
+ForecastShare::ForecastShare()
+    : port(0), key(""), enabled(false), joined(false), selfId(0), leaderId(0), lastLeaderMs(0),
+      lastLeaderSentAt(0), lastLeaderSeq(0), txSequence(0), lastTxMs(0), lastRefreshMs(0), startMs(0) {}
+
+void ForecastShare::begin(bool enable, const char *sharedKey, const char *groupAddress, uint16_t groupPort) {
+  enabled = enable && group.fromString(groupAddress);
+  key = sharedKey;
+  port = groupPort;
+  selfId = ESP.getChipId();
+  startMs = millis();
+  lastTxMs = startMs - FORECAST_SHARE_INTERVAL_MS;
+}
+
+ForecastShareRole ForecastShare::getRole() {
+  if (!enabled) return SHARE_OFF;
+  if (leaderId != 0 && leaderId < selfId && millis() - lastLeaderMs < FORECAST_SHARE_TIMEOUT_MS) {
+    return SHARE_FOLLOWER;
+  }
+  return SHARE_LEADER;
+}
+
+static const char ROLE_NAMES[][9] PROGMEM = { "off", "leader", "follower" };
+
+FlashName ForecastShare::roleName(ForecastShareRole role) {
+  return flashName(ROLE_NAMES, role, ROLE_NAMES[SHARE_OFF]);
+}
+
+void ForecastShare::sign(const uint8_t *frame, size_t len, uint8_t *mac) {
+  uint8_t digest[HMAC_SHA256_SIZE];
+  hmacSha256((const uint8_t *)key, strlen(key), frame, len, digest);
+  memcpy(mac, digest, FORECAST_FRAME_MAC_SIZE);
+}
+
+bool ForecastShare::acceptFrame(const uint8_t *frame, size_t len, ForecastCache &cache, uint32_t utcNow,
+                                int32_t latitudeE4, int32_t longitudeE4) {
+  ForecastFrameHeader header;
+  if (len < sizeof(header) + FORECAST_FRAME_MAC_SIZE) return false;
+  memcpy(&header, frame, sizeof(header));
+
+  if (header.magic != FORECAST_FRAME_MAGIC || header.version != FORECAST_FRAME_VERSION ||
+      header.hours > FORECAST_CACHE_HOURS) {
+    return false;
+  }
+  size_t signedLen = sizeof(header) + header.hours * FORECAST_HOUR_BYTES;
+  if (len != signedLen + FORECAST_FRAME_MAC_SIZE) return false;
+
+  uint8_t mac[FORECAST_FRAME_MAC_SIZE];
+  sign(frame, signedLen, mac);
+  if (!digestEqual(mac, frame + signedLen, FORECAST_FRAME_MAC_SIZE)) return false;
+
+  // Another site on the same network elects its own leader
+  if (abs(header.latitudeE4 - latitudeE4) > FORECAST_SHARE_SITE_RADIUS_E4 ||
+      abs(header.longitudeE4 - longitudeE4) > FORECAST_SHARE_SITE_RADIUS_E4) {
+    return false;
+  }
+  if (clockIsSet(utcNow) && abs((int32_t)(header.sentAt - utcNow)) > FORECAST_SHARE_MAX_SKEW) {
+    return false;
+  }
+
+  // Higher IDs defer to us (or to our leader) once they hear us
+  bool leaderAlive = leaderId != 0 && millis() - lastLeaderMs < FORECAST_SHARE_TIMEOUT_MS;
+  if (header.senderId > selfId || (leaderAlive && header.senderId > leaderId)) return true;
+
+  if (header.senderId == leaderId && leaderAlive) {
+    // Replayed frames carry an older send time or sequence
+    if (header.sentAt < lastLeaderSentAt ||
+        (header.sentAt == lastLeaderSentAt && header.sequence <= lastLeaderSeq)) {
+      return false;
+    }
+  } else {
+    TRACE_INFO(TR_SHARE_LEADER, header.senderId);
+  }
+  leaderId = header.senderId;
+  lastLeaderMs = millis();
+  lastLeaderSentAt = header.sentAt;
+  lastLeaderSeq = header.sequence;
+
+  if (header.hours > 0 && header.fetchedAt > cache.fetchedAt) {
+    cache.startEpoch = header.startEpoch;
+    cache.fetchedAt = header.fetchedAt;
+    cache.hours = header.hours;
+    const uint8_t *values = frame + sizeof(header);
+    for (uint8_t c = 0; c < FORECAST_NARROW_COLUMNS; c++) {
+      memcpy(cache.narrow[c], values, header.hours);
+      values += header.hours;
+    }
+    memcpy(cache.radiation, values, header.hours * sizeof(uint16_t));
+  }
+  return true;
+}
+
+void ForecastShare::poll(ForecastCache &cache, uint32_t utcNow, float latitude, float longitude) {
+  if (!enabled) return;
+
+  if (WiFi.status() != WL_CONNECTED) {
+    if (joined) {
+      udp.stop();
+      joined = false;
+    }
+    return;
+  }
+  if (!joined) {
+    joined = udp.beginMulticast(WiFi.localIP(), group, port) == 1;
+    if (!joined) return;
+  }
+
+  int32_t latitudeE4 = (int32_t)(latitude * 10000);
+  int32_t longitudeE4 = (int32_t)(longitude * 10000);
+  uint8_t frame[FORECAST_FRAME_MAX_SIZE];
+
+  for (uint8_t i = 0; i < FORECAST_SHARE_RX_PER_POLL; i++) {
+    int size = udp.parsePacket();
+    if (size <= 0) break;
+    if (size > (int)sizeof(frame)) {
+      udp.flush();
+      metrics.inc(MC_SHARE_REJECTED);
+      continue;
+    }
+    udp.read(frame, size);
+
+    // Our own multicast is looped back
+    ForecastFrameHeader *header = (ForecastFrameHeader *)frame;
+    if (size >= (int)sizeof(ForecastFrameHeader) && header->senderId == selfId) continue;
+
+    if (acceptFrame(frame, size, cache, utcNow, latitudeE4, longitudeE4)) {
+      metrics.inc(MC_SHARE_RECEIVED);
+    } else {
+      metrics.inc(MC_SHARE_REJECTED);
+    }
+  }
+
+  if (getRole() == SHARE_LEADER && millis() - lastTxMs >= FORECAST_SHARE_INTERVAL_MS) {
+    publish(cache, utcNow, latitude, longitude);
+  }
+}
+
+void ForecastShare::publish(const ForecastCache &cache, uint32_t utcNow, float latitude, float longitude) {
+  if (!enabled || !joined || !clockIsSet(utcNow)) return;
+
+  ForecastFrameHeader header;
+  header.magic = FORECAST_FRAME_MAGIC;
+  header.version = FORECAST_FRAME_VERSION;
+  header.hours = cache.fetchedAt != 0 ? cache.hours : 0;
+  header.reserved = 0;
+  header.senderId = selfId;
+  header.sequence = ++txSequence;
+  header.sentAt = utcNow;
+  header.fetchedAt = cache.fetchedAt;
+  header.startEpoch = cache.startEpoch;
+  header.latitudeE4 = (int32_t)(latitude * 10000);
+  header.longitudeE4 = (int32_t)(longitude * 10000);
+
+  uint8_t frame[FORECAST_FRAME_MAX_SIZE];
+  size_t len = sizeof(header);
+  memcpy(frame, &header, sizeof(header));
+  for (uint8_t c = 0; c < FORECAST_NARROW_COLUMNS; c++) {
+    memcpy(frame + len, cache.narrow[c], header.hours);
+    len += header.hours;
+  }
+  memcpy(frame + len, cache.radiation, header.hours * sizeof(uint16_t));
+  len += header.hours * sizeof(uint16_t);
+  sign(frame, len, frame + len);
+  len += FORECAST_FRAME_MAC_SIZE;
+
+  lastTxMs = millis();
+  if (udp.beginPacketMulticast(group, port, WiFi.localIP()) && udp.write(frame, len) == len && udp.endPacket()) {
+    metrics.inc(MC_SHARE_SENT);
+  }
+}
+
+bool ForecastShare::wantsRefresh(const ForecastCache &cache, uint32_t utcNow) {
+  // Two broadcast periods after boot every unit has heard the current leader
+  if (getRole() != SHARE_LEADER || millis() - startMs < 2 * FORECAST_SHARE_INTERVAL_MS) return false;
+  if (!clockIsSet(utcNow) || cache.isFresh(utcNow)) return false;
+  if (lastRefreshMs != 0 && millis() - lastRefreshMs < FORECAST_SHARE_RETRY_MS) return false;
+  lastRefreshMs = millis();
+  return true;
+}
@@ -0,0 +1,96 @@
+#ifndef FORECAST_SHARE_H
+#define FORECAST_SHARE_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include "controller_core.h"
+#include "flash_string.h"
+#include "forecast_cache.h"
+
+#define FORECAST_FRAME_MAGIC 0x3146434C    // "LCF1"
+#define FORECAST_FRAME_VERSION 2         // 2: every forecast column, not just cloud cover
+#define FORECAST_FRAME_MAC_SIZE 16         // HMAC-SHA256 truncated to 128 bits
+#define FORECAST_SHARE_INTERVAL_MS 60000   // Leader broadcast period
+#define FORECAST_SHARE_TIMEOUT_MS (5 * FORECAST_SHARE_INTERVAL_MS) // Leader presumed gone
+#define FORECAST_SHARE_RETRY_MS 60000      // Minimum gap between proactive fetches
+#define FORECAST_SHARE_MAX_SKEW 600        // Seconds a frame's send time may differ from ours
+#define FORECAST_SHARE_SITE_RADIUS_E4 500  // 0.05 degrees; frames from further away are ignored
+#define FORECAST_SHARE_RX_PER_POLL 4       // Frames read per loop pass
+
+// Wire format, little-endian like every unit that speaks it. The header is
+// followed by the cache's columns, `hours` values each, and the MAC covers
+// both.
+struct __attribute__((packed)) ForecastFrameHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t hours;         // 0 for a heartbeat that only announces the sender
+  uint16_t reserved;
+  uint32_t senderId;     // Chip ID; the lowest one heard leads
+  uint32_t sequence;
+  uint32_t sentAt;       // UTC epoch
+  uint32_t fetchedAt;    // UTC epoch of the upstream fetch
+  uint32_t startEpoch;   // UTC epoch of the first hour
+  int32_t latitudeE4;
+  int32_t longitudeE4;
+};
+
+#define FORECAST_FRAME_MAX_SIZE \
+  (sizeof(ForecastFrameHeader) + FORECAST_CACHE_HOURS * FORECAST_HOUR_BYTES + FORECAST_FRAME_MAC_SIZE)
+
+enum ForecastShareRole {
+  SHARE_OFF,
+  SHARE_LEADER,
+  SHARE_FOLLOWER
+};
+
+// Peer mode: the unit with the lowest chip ID at a site fetches the forecast
+// and multicasts it; the others fill their cache from its frames and only
+// fetch themselves once frames stop arriving.
+class ForecastShare {
+private:
+  WiFiUDP udp;
+  IPAddress group;
+  uint16_t port;
+  const char *key;
+  bool enabled;
+  bool joined;
+  uint32_t selfId;
+  uint32_t leaderId;
+  uint32_t lastLeaderMs;
+  uint32_t lastLeaderSentAt;
+  uint32_t lastLeaderSeq;
+  uint32_t txSequence;
+  uint32_t lastTxMs;
+  uint32_t lastRefreshMs;
+  uint32_t startMs;
+
+  void sign(const uint8_t *frame, size_t len, uint8_t *mac);
+  bool acceptFrame(const uint8_t *frame, size_t len, ForecastCache &cache, uint32_t utcNow,
+                   int32_t latitudeE4, int32_t longitudeE4);
+
+public:
+  ForecastShare();
+
+  void begin(bool enable, const char *sharedKey, const char *groupAddress, uint16_t groupPort);
+
+  // Joins the group once Wi-Fi is up, applies received frames to `cache` and,
+  // while leading, rebroadcasts it every interval
+  void poll(ForecastCache &cache, uint32_t utcNow, float latitude, float longitude);
+
+  // Sends `cache` right away; called by the leader after each fetch
+  void publish(const ForecastCache &cache, uint32_t utcNow, float latitude, float longitude);
+
+  // True when this unit leads and should refresh a stale cache on its own
+  bool wantsRefresh(const ForecastCache &cache, uint32_t utcNow);
+
+  ForecastShareRole getRole();
+  uint32_t getSelfId() { return selfId; }
+  uint32_t getLeaderId() { return getRole() == SHARE_FOLLOWER ? leaderId : selfId; }
+
+  static FlashName roleName(ForecastShareRole role);
+};
+
+extern ForecastShare forecastShare;
+
+#endif
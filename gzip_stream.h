@@ -0,0 +1,227 @@
+#ifndef GZIP_STREAM_H
+#define GZIP_STREAM_H
+
+// Streaming gzip encoder for HTTP responses. Deflate with a 1 KB window, one
+// hash candidate per position and the fixed Huffman codes, so input is
+// encoded as it arrives with no block buffering: the whole state is about
+// 3 KB. JSON repeats the same keys on every record, which the window catches
+// even with one candidate. The output can be checked against zlib on a
+// host.
+
+#include <stdint.h>
+#include <string.h>
+
+#define GZIP_WINDOW 1024            // Match distance limit; the buffer holds twice this
+#define GZIP_HASH_BITS 9
+#define GZIP_MAX_INPUT 384          // Bytes per compress() call; GZIP_BOUND of it fits a 512-byte chunk
+#define GZIP_MIN_MATCH 3
+#define GZIP_MAX_MATCH 258
+
+// Output room compress() or finish() may need for `n` input bytes: 9 bits
+// per literal at worst, plus the gzip header or trailer and pending bits
+#define GZIP_BOUND(n) ((n) + (n) / 8 + 32)
+
+class GzipEncoder {
+private:
+  uint8_t window[2 * GZIP_WINDOW];
+  uint16_t head[1 << GZIP_HASH_BITS];  // Last position + 1 with each hash, 0 when none
+  uint16_t pos;                        // End of the data in `window`
+  uint32_t bitBuf;
+  uint8_t bitCount;
+  bool started;
+  uint32_t crc;
+  uint32_t totalIn;
+  uint8_t *out;
+  size_t outLen;
+
+  static uint32_t crcUpdate(uint32_t c, const uint8_t *data, size_t len) {
+    static const uint32_t NIBBLE[16] = {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+      0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    for (size_t i = 0; i < len; i++) {
+      c ^= data[i];
+      c = (c >> 4) ^ NIBBLE[c & 0x0F];
+      c = (c >> 4) ^ NIBBLE[c & 0x0F];
+    }
+    return c;
+  }
+
+  static uint32_t hash3(const uint8_t *p) {
+    uint32_t v = p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16);
+    return (v * 2654435761u) >> (32 - GZIP_HASH_BITS);
+  }
+
+  void bits(uint32_t value, uint8_t count) {
+    bitBuf |= value << bitCount;
+    bitCount += count;
+    while (bitCount >= 8) {
+      out[outLen++] = bitBuf;
+      bitBuf >>= 8;
+      bitCount -= 8;
+    }
+  }
+
+  // Huffman codes go out most significant bit first
+  void code(uint32_t value, uint8_t count) {
+    uint32_t reversed = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      reversed = (reversed << 1) | ((value >> i) & 1);
+    }
+    bits(reversed, count);
+  }
+
+  // Fixed literal/length code (RFC 1951, 3.2.6)
+  void symbol(uint16_t s) {
+    if (s < 144) {
+      code(0x30 + s, 8);
+    } else if (s < 256) {
+      code(0x190 + s - 144, 9);
+    } else if (s < 280) {
+      code(s - 256, 7);
+    } else {
+      code(0xC0 + s - 280, 8);
+    }
+  }
+
+  void match(uint16_t length, uint16_t distance) {
+    static const uint16_t LENGTH_BASE[29] = { 3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                              31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint16_t DIST_BASE[30] = { 1,   2,   3,   4,   5,   7,    9,    13,   17,   25,
+                                            33,  49,  65,  97,  129, 193,  257,  385,  513,  769,
+                                            1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    uint8_t l = 28;
+    while (LENGTH_BASE[l] > length) l--;
+    symbol(257 + l);
+    // Codes 261-284 carry (code - 257) / 4 - 1 extra bits; 285 is 258 exactly
+    uint8_t extra = l < 8 || l == 28 ? 0 : l / 4 - 1;
+    if (extra) bits(length - LENGTH_BASE[l], extra);
+
+    uint8_t d = 29;
+    while (DIST_BASE[d] > distance) d--;
+    code(d, 5);
+    extra = d < 4 ? 0 : d / 2 - 1;
+    if (extra) bits(distance - DIST_BASE[d], extra);
+  }
+
+  void header() {
+    static const uint8_t GZIP_HEADER[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF };
+    memcpy(out + outLen, GZIP_HEADER, sizeof(GZIP_HEADER));
+    outLen += sizeof(GZIP_HEADER);
+    bits(2, 3);   // Not final, fixed codes
+    started = true;
+  }
+
+  // Keeps the last GZIP_WINDOW bytes at the start of the buffer
+  void slide() {
+    memmove(window, window + GZIP_WINDOW, GZIP_WINDOW);
+    pos -= GZIP_WINDOW;
+    for (uint16_t i = 0; i < (1 << GZIP_HASH_BITS); i++) {
+      head[i] = head[i] > GZIP_WINDOW ? head[i] - GZIP_WINDOW : 0;
+    }
+  }
+
+  void insert(uint16_t at) {
+    head[hash3(window + at)] = at + 1;
+  }
+
+public:
+  GzipEncoder() {
+    begin();
+  }
+
+  void begin() {
+    memset(head, 0, sizeof(head));
+    pos = 0;
+    bitBuf = 0;
+    bitCount = 0;
+    started = false;
+    crc = 0xFFFFFFFF;
+    totalIn = 0;
+  }
+
+  // Where the next input goes, for producers that can write in place
+  uint8_t *input(size_t &room) {
+    if (pos > GZIP_WINDOW) slide();
+    room = sizeof(window) - pos;
+    if (room > GZIP_MAX_INPUT) room = GZIP_MAX_INPUT;
+    return window + pos;
+  }
+
+  // Encodes `len` bytes (at most the room input() gave) placed at input();
+  // writes up to GZIP_BOUND(len) bytes to `dest` and returns how many.
+  // Matches don't reach past the end of one call's input.
+  size_t compress(size_t len, uint8_t *dest) {
+    out = dest;
+    outLen = 0;
+    if (!started) header();
+    crc = crcUpdate(crc, window + pos, len);
+    totalIn += len;
+
+    uint16_t end = pos + len;
+    uint16_t i = pos;
+    while (i < end) {
+      uint16_t best = 0;
+      uint16_t distance = 0;
+      if (end - i >= GZIP_MIN_MATCH) {
+        uint32_t h = hash3(window + i);
+        uint16_t candidate = head[h];
+        head[h] = i + 1;
+        if (candidate != 0 && i - (candidate - 1) <= GZIP_WINDOW) {
+          const uint8_t *a = window + candidate - 1;
+          const uint8_t *b = window + i;
+          uint16_t limit = end - i < GZIP_MAX_MATCH ? end - i : GZIP_MAX_MATCH;
+          while (best < limit && a[best] == b[best]) best++;
+          distance = i - (candidate - 1);
+        }
+      }
+      if (best >= GZIP_MIN_MATCH) {
+        match(best, distance);
+        for (uint16_t k = 1; k < best && i + k + GZIP_MIN_MATCH <= end; k++) insert(i + k);
+        i += best;
+      } else {
+        symbol(window[i]);
+        i++;
+      }
+    }
+    pos = end;
+    return outLen;
+  }
+
+  // Copies `len` bytes in and compresses them, in GZIP_MAX_INPUT pieces;
+  // `dest` needs GZIP_BOUND(GZIP_MAX_INPUT) bytes and `sink` takes each piece
+  template <typename Sink>
+  void write(const uint8_t *data, size_t len, uint8_t *dest, Sink sink) {
+    while (len > 0) {
+      size_t room;
+      uint8_t *in = input(room);
+      size_t n = len < room ? len : room;
+      memcpy(in, data, n);
+      size_t produced = compress(n, dest);
+      if (produced > 0) sink(dest, produced);
+      data += n;
+      len -= n;
+    }
+  }
+
+  // Ends the stream: end-of-block, an empty final block and the trailer.
+  // `dest` needs GZIP_BOUND(0) bytes.
+  size_t finish(uint8_t *dest) {
+    out = dest;
+    outLen = 0;
+    if (!started) header();
+    symbol(256);
+    bits(3, 3);   // Final, fixed codes
+    symbol(256);
+    if (bitCount > 0) bits(0, 8 - bitCount);
+    uint32_t trailer[2] = { crc ^ 0xFFFFFFFF, totalIn };
+    for (uint8_t i = 0; i < 8; i++) {
+      out[outLen++] = trailer[i / 4] >> (8 * (i % 4));
+    }
+    return outLen;
+  }
+
+  uint32_t getTotalIn() const { return totalIn; }
+};
+
+#endif
@@ -0,0 +1,20 @@
+#include "hmac.h"
+#include <bearssl/bearssl.h>
+
+void hmacSha256(const uint8_t *key, size_t keyLen, const uint8_t *data, size_t len,
+                uint8_t out[HMAC_SHA256_SIZE]) {
+  br_hmac_key_context keyContext;
+  br_hmac_context context;
+  br_hmac_key_init(&keyContext, &br_sha256_vtable, key, keyLen);
+  br_hmac_init(&context, &keyContext, 0);
+  br_hmac_update(&context, data, len);
+  br_hmac_out(&context, out);
+}
+
+bool digestEqual(const uint8_t *a, const uint8_t *b, size_t len) {
+  uint8_t diff = 0;
+  for (size_t i = 0; i < len; i++) {
+    diff |= a[i] ^ b[i];
+  }
+  return diff == 0;
+}
@@ -0,0 +1,14 @@
+#ifndef HMAC_H
+#define HMAC_H
+
+#include <Arduino.h>
+
+#define HMAC_SHA256_SIZE 32
+
+void hmacSha256(const uint8_t *key, size_t keyLen, const uint8_t *data, size_t len,
+                uint8_t out[HMAC_SHA256_SIZE]);
+
+// Compares without an early exit, so timing doesn't reveal how much matched
+bool digestEqual(const uint8_t *a, const uint8_t *b, size_t len);
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef HTTP_REQUEST_H
+#define HTTP_REQUEST_H
+
+// HTTP/1.1 request parsing for the async web server. The request is parsed
+// in place: strings are terminated and URL-decoded inside the receive
+// buffer, so a request costs no allocations beyond that buffer.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define HTTP_MAX_ARGS 32          // Query and form fields, "plain" included
+#define HTTP_MAX_HEAD 1536        // Request line and headers
+
+enum HttpParseStatus {
+  HTTP_PARSE_INCOMPLETE,
+  HTTP_PARSE_DONE,
+  HTTP_PARSE_BAD,
+  HTTP_PARSE_TOO_LARGE
+};
+
+struct HttpRequest {
+  const char *method;
+  const char *path;
+  const char *authorization;  // Header value, NULL when absent
+  const char *contentType;
+  const char *cookie;
+  const char *acceptEncoding;
+  uint8_t headerCount;
+  uint8_t argCount;
+  const char *argNames[HTTP_MAX_ARGS];
+  const char *argValues[HTTP_MAX_ARGS];
+};
+
+// Reads a Content-Length value running up to `end`: digits between optional
+// blanks, ending the line. Anything else, an empty or a negative value is
+// BAD, and a value over `maxLen` TOO_LARGE.
+inline HttpParseStatus httpContentLength(const char *p, const char *end, size_t maxLen, size_t &value) {
+  while (p < end && (*p == ' ' || *p == '\t')) p++;
+  if (p >= end || *p < '0' || *p > '9') return HTTP_PARSE_BAD;
+  bool tooLarge = false;
+  value = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    if (value > maxLen / 10 || value * 10 + (*p - '0') > maxLen) tooLarge = true;
+    if (!tooLarge) value = value * 10 + (*p - '0');
+  }
+  while (p < end && (*p == ' ' || *p == '\t')) p++;
+  if (p >= end || (*p != '\r' && *p != '\n')) return HTTP_PARSE_BAD;
+  return tooLarge ? HTTP_PARSE_TOO_LARGE : HTTP_PARSE_DONE;
+}
+
+// Checks whether buf[0..len) holds a whole request. On DONE, `headLen` is
+// the length of the head including the blank line and `bodyLen` the length
+// of the body that follows it.
+inline HttpParseStatus httpRequestComplete(const char *buf, size_t len, size_t maxLen, size_t &headLen,
+                                           size_t &bodyLen) {
+  const char *end = NULL;
+  for (size_t i = 3; i < len; i++) {
+    if (buf[i] == '\n' && buf[i - 1] == '\r' && buf[i - 2] == '\n' && buf[i - 3] == '\r') {
+      end = buf + i + 1;
+      break;
+    }
+  }
+  if (end == NULL) return len >= HTTP_MAX_HEAD ? HTTP_PARSE_TOO_LARGE : HTTP_PARSE_INCOMPLETE;
+  headLen = end - buf;
+
+  // Content-Length is the only framing supported; chunked uploads are refused
+  bodyLen = 0;
+  bool haveLength = false;
+  const char *line = strchr(buf, '\n');
+  while (line != NULL && line + 1 < end) {
+    line++;
+    if (strncasecmp(line, "Content-Length:", 15) == 0) {
+      if (haveLength) return HTTP_PARSE_BAD;
+      haveLength = true;
+      HttpParseStatus length = httpContentLength(line + 15, end, maxLen, bodyLen);
+      if (length != HTTP_PARSE_DONE) return length;
+    } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+      return HTTP_PARSE_BAD;
+    }
+    line = strchr(line, '\n');
+  }
+  // Compared without adding, so a huge length can't wrap around
+  if (headLen > maxLen || bodyLen > maxLen - headLen) return HTTP_PARSE_TOO_LARGE;
+  return len - headLen >= bodyLen ? HTTP_PARSE_DONE : HTTP_PARSE_INCOMPLETE;
+}
+
+inline int httpHexDigit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Decodes %XX and '+' in place
+inline void httpUrlDecode(char *s) {
+  char *out = s;
+  for (; *s; s++) {
+    if (*s == '+') {
+      *out++ = ' ';
+    } else if (*s == '%' && httpHexDigit(s[1]) >= 0 && httpHexDigit(s[2]) >= 0) {
+      *out++ = (char)(httpHexDigit(s[1]) * 16 + httpHexDigit(s[2]));
+      s += 2;
+    } else {
+      *out++ = *s;
+    }
+  }
+  *out = 0;
+}
+
+// Splits "a=1&b=2" into the request's arguments
+inline void httpParseArgs(char *s, HttpRequest &req) {
+  while (s != NULL && *s && req.argCount < HTTP_MAX_ARGS) {
+    char *next = strchr(s, '&');
+    if (next) *next++ = 0;
+    char *value = strchr(s, '=');
+    if (value) {
+      *value++ = 0;
+    } else {
+      value = s + strlen(s);
+    }
+    httpUrlDecode(s);
+    httpUrlDecode(value);
+    req.argNames[req.argCount] = s;
+    req.argValues[req.argCount] = value;
+    req.argCount++;
+    s = next;
+  }
+}
+
+// Parses a request that httpRequestComplete() accepted. buf must have room
+// for one byte after the body, which terminates it.
+inline bool httpParseRequest(char *buf, size_t headLen, size_t bodyLen, HttpRequest &req) {
+  memset(&req, 0, sizeof(req));
+  char *body = buf + headLen;
+  body[bodyLen] = 0;
+  buf[headLen - 2] = 0;
+
+  char *line = buf;
+  char *lineEnd = strstr(line, "\r\n");
+  if (lineEnd) *lineEnd = 0;
+
+  // Request line
+  char *sp1 = strchr(line, ' ');
+  if (!sp1) return false;
+  *sp1 = 0;
+  char *target = sp1 + 1;
+  char *sp2 = strchr(target, ' ');
+  if (!sp2) return false;
+  *sp2 = 0;
+  req.method = line;
+
+  char *query = strchr(target, '?');
+  if (query) *query++ = 0;
+  httpUrlDecode(target);
+  req.path = target;
+
+  // Headers
+  while (lineEnd) {
+    line = lineEnd + 2;
+    lineEnd = strstr(line, "\r\n");
+    if (lineEnd) *lineEnd = 0;
+    if (*line == 0) continue;
+
+    char *colon = strchr(line, ':');
+    if (!colon) continue;
+    *colon = 0;
+    char *value = colon + 1;
+    while (*value == ' ') value++;
+    req.headerCount++;
+    if (strcasecmp(line, "Authorization") == 0) {
+      req.authorization = value;
+    } else if (strcasecmp(line, "Content-Type") == 0) {
+      req.contentType = value;
+    } else if (strcasecmp(line, "Cookie") == 0) {
+      req.cookie = value;
+    } else if (strcasecmp(line, "Accept-Encoding") == 0) {
+      req.acceptEncoding = value;
+    }
+  }
+
+  httpParseArgs(query, req);
+  if (bodyLen > 0) {
+    if (req.contentType && strncasecmp(req.contentType, "application/x-www-form-urlencoded", 33) == 0) {
+      httpParseArgs(body, req);
+    } else if (req.argCount < HTTP_MAX_ARGS) {
+      // Other bodies are handed over whole, as ESP8266WebServer does
+      req.argNames[req.argCount] = "plain";
+      req.argValues[req.argCount] = body;
+      req.argCount++;
+    }
+  }
+  return true;
+}
+
+inline const char *httpArg(const HttpRequest &req, const char *name) {
+  for (uint8_t i = 0; i < req.argCount; i++) {
+    if (strcmp(req.argNames[i], name) == 0) return req.argValues[i];
+  }
+  return NULL;
+}
+
+// True when an Accept-Encoding value lists gzip without ruling it out with q=0
+inline bool httpAcceptsGzip(const char *acceptEncoding) {
+  const char *p = acceptEncoding;
+  while (p != NULL && *p) {
+    while (*p == ' ' || *p == ',') p++;
+    size_t len = strcspn(p, ",");
+    if (len >= 4 && strncasecmp(p, "gzip", 4) == 0 && (len == 4 || p[4] == ';' || p[4] == ' ')) {
+      const char *q = strstr(p, "q=");
+      return q == NULL || q >= p + len || strtod(q + 2, NULL) > 0;
+    }
+    p += len;
+  }
+  return false;
+}
+
+// Decodes standard base64; returns the decoded length or -1 if it doesn't fit
+inline int httpBase64Decode(const char *in, uint8_t *out, size_t outSize) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  uint32_t bits = 0;
+  int bitCount = 0;
+  size_t len = 0;
+  for (; *in && *in != '='; in++) {
+    const char *p = strchr(alphabet, *in);
+    if (p == NULL) return -1;
+    bits = (bits << 6) | (uint32_t)(p - alphabet);
+    bitCount += 6;
+    if (bitCount >= 8) {
+      bitCount -= 8;
+      if (len >= outSize) return -1;
+      out[len++] = (uint8_t)(bits >> bitCount);
+    }
+  }
+  return (int)len;
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef HTTP_RESPONSE_H
+#define HTTP_RESPONSE_H
+
+// HTTP/1.1 response parsing for the forecast client. The whole response is
+// collected in one buffer, then framed: Content-Length and chunked bodies
+// are both supported, and a chunked body is decoded in place.
+// tools/hedge_bench.cpp frames responses the same way.
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+enum HttpResponseStatus {
+  HTTP_RESPONSE_INCOMPLETE,
+  HTTP_RESPONSE_DONE,
+  HTTP_RESPONSE_BAD        // Malformed, or cut off by the connection closing
+};
+
+// Undoes chunked transfer coding in place; false when the chunks are
+// malformed or the last one is missing. Sizes are read within body[0..len),
+// so a response cut off in or after a size line never reads past it.
+inline bool httpDechunk(char *body, size_t len, size_t &bodyLen) {
+  size_t in = 0;
+  size_t out = 0;
+  for (;;) {
+    if (in >= len) return false;
+    size_t size = 0;
+    size_t end = in;
+    for (; end < len && isxdigit((unsigned char)body[end]); end++) {
+      if (size > (SIZE_MAX >> 4)) return false;
+      char c = body[end];
+      size = size * 16 + (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+    }
+    if (end == in || end >= len) return false;
+    const char *lineEnd = (const char *)memchr(body + end, '\n', len - end);
+    if (lineEnd == NULL) return false;
+    in = lineEnd + 1 - body;
+    if (size == 0) break;
+    if (size > len - in || len - in - size < 2) return false;
+    memmove(body + out, body + in, size);
+    out += size;
+    in += size + 2;
+  }
+  bodyLen = out;
+  return true;
+}
+
+// Frames buf[0..len) and, once it is DONE, points `body` at the body and
+// terminates it; buf needs one spare byte past `len`. `closed` says the
+// server has closed the connection, which ends a body without a length.
+inline HttpResponseStatus httpResponseParse(char *buf, size_t len, bool closed, int &status, char *&body,
+                                            size_t &bodyLen) {
+  char *end = NULL;
+  for (size_t i = 3; i < len; i++) {
+    if (buf[i] == '\n' && buf[i - 1] == '\r' && buf[i - 2] == '\n' && buf[i - 3] == '\r') {
+      end = buf + i + 1;
+      break;
+    }
+  }
+  if (end == NULL) return closed ? HTTP_RESPONSE_BAD : HTTP_RESPONSE_INCOMPLETE;
+  if (len < 12 || strncmp(buf, "HTTP/1.", 7) != 0) return HTTP_RESPONSE_BAD;
+  status = atoi(buf + 9);
+
+  bool chunked = false;
+  long contentLength = -1;
+  const char *line = (const char *)memchr(buf, '\n', end - buf);
+  while (line != NULL && line + 1 < end) {
+    line++;
+    if (strncasecmp(line, "Content-Length:", 15) == 0) {
+      contentLength = strtol(line + 15, NULL, 10);
+    } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+      const char *value = line + 18;
+      while (*value == ' ') value++;
+      chunked = strncasecmp(value, "chunked", 7) == 0;
+    }
+    line = (const char *)memchr(line, '\n', end - line);
+  }
+
+  body = end;
+  size_t received = len - (end - buf);
+  if (chunked) {
+    // The last chunk is only looked for once the server is done
+    if (!closed) return HTTP_RESPONSE_INCOMPLETE;
+    if (!httpDechunk(body, received, bodyLen)) return HTTP_RESPONSE_BAD;
+  } else if (contentLength >= 0) {
+    if (received < (size_t)contentLength) return closed ? HTTP_RESPONSE_BAD : HTTP_RESPONSE_INCOMPLETE;
+    bodyLen = contentLength;
+  } else {
+    if (!closed) return HTTP_RESPONSE_INCOMPLETE;
+    bodyLen = received;
+  }
+  body[bodyLen] = 0;
+  return HTTP_RESPONSE_DONE;
+}
+
+#endif
@@ -445,6 +445,11 @@ const char INDEX_HTML[] PROGMEM = R"rawliteral(
             </div>
         </div>
 
+        <div class="card" id="zonesCard" style="display: none;">
+            <h2 class="section-title">Zones</h2>
+            <div id="zoneList"></div>
+        </div>
+
         <div class="card">
             <h2 class="section-title">Light Data</h2>
             
@@ -617,6 +622,7 @@ const char INDEX_HTML[] PROGMEM = R"rawliteral(
                     <button class="warning" onclick="location.href='/reset'">Reset Settings</button>
                     <button onclick="location.href='/reconnect'">Reconnect WiFi</button>
                     <button class="danger" onclick="if(confirm('Are you sure you want to reboot the device?')) location.href='/reboot'">Reboot Device</button>
+                    <button onclick="location.href='/logout'">Log Out</button>
                 </div>
             </div>
         </div>
@@ -826,8 +832,11 @@ const char INDEX_HTML[] PROGMEM = R"rawliteral(
             loadLogData('system');
         }
 
+        // Points per chart; the device decimates longer histories
+        const CHART_POINTS = 120;
+
         function loadLogData(type) {
-            fetch('/api/logs?type=' + type)
+            fetch('/api/logs?type=' + type + '&points=' + CHART_POINTS)
                 .then(response => {
                     if (!response.ok) {
                         throw new Error('Network response was not ok: ' + response.status);
@@ -865,6 +874,11 @@ const char INDEX_HTML[] PROGMEM = R"rawliteral(
             chart.data.labels = [];
             chart.data.datasets[0].data = [];
             
+            // Extra zones are listed in the Zones card; the chart shows the main circuit
+            if (type === 'light') {
+                data = data.filter(entry => entry.zone === undefined);
+            }
+            
             if (data.length === 0) {
                 chart.update();
                 return;
@@ -910,6 +924,42 @@ const char INDEX_HTML[] PROGMEM = R"rawliteral(
             chart.update();
         }
 
+        function loadZones() {
+            fetch('/api/zones')
+                .then(response => response.json())
+                .then(data => {
+                    const enabled = data.zones.filter(zone => zone.enabled);
+                    const list = document.getElementById('zoneList');
+                    document.getElementById('zonesCard').style.display = enabled.length ? '' : 'none';
+                    list.innerHTML = '';
+                    
+                    enabled.forEach(zone => {
+                        const row = document.createElement('div');
+                        row.className = 'form-row';
+                        
+                        const label = document.createElement('span');
+                        label.textContent = zone.name + ': ' + (zone.lightOn ? 'ON' : 'OFF') +
+                            ' (' + zone.state + (zone.override ? ', manual' : '') + ')';
+                        label.style.color = zone.lightOn ? '#4CAF50' : '#ff4444';
+                        row.appendChild(label);
+                        
+                        const toggle = document.createElement('button');
+                        toggle.textContent = zone.lightOn ? 'Turn Off' : 'Turn On';
+                        toggle.onclick = () => fetch('/api/zones/toggle?id=' + zone.id).then(loadZones);
+                        row.appendChild(toggle);
+                        
+                        if (zone.override) {
+                            const auto = document.createElement('button');
+                            auto.textContent = 'Automatic';
+                            auto.onclick = () => fetch('/api/zones/toggle?auto=1&id=' + zone.id).then(loadZones);
+                            row.appendChild(auto);
+                        }
+                        list.appendChild(row);
+                    });
+                })
+                .catch(error => console.error('Error fetching zones:', error));
+        }
+
         function activateChartTab(evt, chartId) {
             // Hide all chart contents
             const chartContents = document.getElementsByClassName('chart-tab-content');
@@ -942,12 +992,14 @@ const char INDEX_HTML[] PROGMEM = R"rawliteral(
         // Initialize charts on page load
         document.addEventListener('DOMContentLoaded', function() {
             initCharts();
+            loadZones();
             
             // Add reload button event
             document.getElementById('timeRange').addEventListener('change', updateAllCharts);
             
             // Set up periodic refresh every 5 minutes
             setInterval(updateAllCharts, 300000);
+            setInterval(loadZones, 30000);
         });
     </script>
 </body>
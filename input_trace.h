@@ -0,0 +1,303 @@
+#ifndef INPUT_TRACE_H
+#define INPUT_TRACE_H
+
+// Recorder for the controller's external inputs (clock syncs, forecasts,
+// web commands, Wi-Fi changes, settings) so a field issue can be replayed on
+// a host with tools/trace_replay.cpp. Records go into a byte ring as a type,
+// a varint payload length and a varint millis() delta from the previous
+// record; the oldest records are dropped when it is full. The replay tool
+// reads the exact bytes the device writes.
+
+#include <stdint.h>
+#include <string.h>
+#include "flash_string.h"
+#include "forecast_cache.h"
+
+#define INPUT_TRACE_MAGIC 0x43525449     // "ITRC"
+#define INPUT_TRACE_VERSION 1
+#define INPUT_TRACE_MAX_RECORD_HEADER 9  // Type, 3-byte length, 5-byte delta
+
+enum InputTraceType {
+  IT_BOOT,           // No payload
+  IT_CHECKPOINT,     // uint32_t local epoch as the loop reads it
+  IT_NTP,            // uint32_t local epoch right after a sync
+  IT_SETTINGS,       // InputTraceSettings, at boot and whenever one changes
+  IT_FORECAST,       // InputTraceForecast, then `hours` bytes per narrow column and `hours` radiation values
+  IT_FETCH_FAILED,   // No payload; a forecast fetch that left the cache as it was
+  IT_WIFI,           // uint8_t 1 when connected
+  IT_TOGGLE,         // InputTraceToggle
+  IT_RELAY,          // uint8_t main relay state, so a replay can check itself
+  IT_TYPE_COUNT
+};
+
+// Everything the main circuit's decision reads besides the clock and the
+// forecast. Sun times already include their offsets.
+struct __attribute__((packed)) InputTraceSettings {
+  int16_t sunriseTime;
+  int16_t sunsetTime;
+  int16_t monitoringWindow;
+  int16_t cloudThreshold;
+  int16_t cloudHysteresis;
+  int16_t maxRetries;
+  int16_t overrideDuration;  // Minutes
+  int32_t utcOffset;         // Timezone plus daylight offset, seconds
+  float latitude;
+  float longitude;
+  uint8_t shareRole;         // ForecastShareRole; followers never fetch
+};
+
+struct __attribute__((packed)) InputTraceForecast {
+  uint32_t startEpoch;
+  uint32_t fetchedAt;
+  uint8_t hours;
+};
+
+#define INPUT_TOGGLE_OFF 0
+#define INPUT_TOGGLE_ON 1
+#define INPUT_TOGGLE_AUTO 2   // A zone handed back to its schedule
+
+struct __attribute__((packed)) InputTraceToggle {
+  uint8_t zone;      // 0 for the main relay, then zones from 1
+  uint8_t action;    // INPUT_TOGGLE_*
+};
+
+// Start of a download; `firstMs` is the oldest record's millis(), since its
+// own delta pointed at a record that has been dropped
+struct __attribute__((packed)) InputTraceHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t reserved;
+  uint16_t records;
+  uint32_t dropped;
+  uint32_t firstMs;
+  uint32_t bytes;    // Record bytes after the header
+};
+
+static const char INPUT_TRACE_TYPE_NAMES[IT_TYPE_COUNT][13] PROGMEM = {
+  "boot", "checkpoint", "ntp", "settings", "forecast", "fetch_failed", "wifi", "toggle", "relay",
+};
+
+inline FlashName inputTraceTypeName(uint8_t type) {
+  return flashName(INPUT_TRACE_TYPE_NAMES, type, PSTR("unknown"));
+}
+
+inline size_t inputTraceForecastSize(uint8_t hours) {
+  return sizeof(InputTraceForecast) + (size_t)hours * FORECAST_HOUR_BYTES;
+}
+
+class InputTrace {
+private:
+  uint8_t *ring;
+  size_t capacity;
+  size_t tail;        // Oldest record's first byte
+  size_t used;
+  uint16_t records;
+  uint32_t dropped;
+  uint32_t firstMs;   // millis() of the oldest record
+  uint32_t lastMs;    // millis() of the newest record
+
+  static size_t putVarint(uint8_t *out, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+      out[n++] = (v & 0x7F) | 0x80;
+      v >>= 7;
+    }
+    out[n++] = v;
+    return n;
+  }
+
+  uint32_t getVarint(size_t &offset) const {
+    uint32_t v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+      uint8_t b = ring[(tail + offset++) % capacity];
+      v |= (uint32_t)(b & 0x7F) << shift;
+      if (!(b & 0x80)) break;
+    }
+    return v;
+  }
+
+  // Writes at the head; space has already been made
+  void put(const void *data, size_t len) {
+    const uint8_t *src = (const uint8_t *)data;
+    size_t head = (tail + used) % capacity;
+    size_t first = capacity - head < len ? capacity - head : len;
+    memcpy(ring + head, src, first);
+    memcpy(ring, src + first, len - first);
+    used += len;
+  }
+
+  void dropOldest() {
+    size_t offset = 1;
+    uint32_t length = getVarint(offset);
+    getVarint(offset);
+    offset += length;
+    tail = (tail + offset) % capacity;
+    used -= offset;
+    records--;
+    dropped++;
+    if (records > 0) {
+      offset = 1;
+      getVarint(offset);
+      firstMs += getVarint(offset);
+    }
+  }
+
+public:
+  InputTrace() : ring(NULL), capacity(0) {
+    clear();
+  }
+
+  // A NULL or empty ring leaves recording off
+  void begin(uint8_t *storage, size_t size) {
+    ring = storage;
+    capacity = storage != NULL ? size : 0;
+    clear();
+  }
+
+  void clear() {
+    tail = 0;
+    used = 0;
+    records = 0;
+    dropped = 0;
+    firstMs = 0;
+    lastMs = 0;
+  }
+
+  // Starts a record of `length` payload bytes, dropping the oldest records
+  // to make room; the payload follows through append(). False when
+  // recording is off or the record could never fit.
+  bool open(uint8_t type, uint32_t nowMs, size_t length) {
+    uint8_t header[INPUT_TRACE_MAX_RECORD_HEADER];
+    size_t n = 0;
+    header[n++] = type;
+    n += putVarint(header + n, length);
+    n += putVarint(header + n, nowMs - lastMs);
+    if (capacity == 0 || n + length > capacity) return false;
+
+    while (capacity - used < n + length) dropOldest();
+    if (records == 0) firstMs = nowMs;
+    put(header, n);
+    records++;
+    lastMs = nowMs;
+    return true;
+  }
+
+  void append(const void *data, size_t len) {
+    put(data, len);
+  }
+
+  bool record(uint8_t type, uint32_t nowMs, const void *payload = NULL, size_t length = 0) {
+    if (!open(type, nowMs, length)) return false;
+    if (length > 0) append(payload, length);
+    return true;
+  }
+
+  bool recordForecast(uint32_t nowMs, const ForecastCache &cache) {
+    if (!open(IT_FORECAST, nowMs, inputTraceForecastSize(cache.hours))) return false;
+    InputTraceForecast f = { cache.startEpoch, cache.fetchedAt, cache.hours };
+    append(&f, sizeof(f));
+    for (uint8_t c = 0; c < FORECAST_NARROW_COLUMNS; c++) {
+      append(cache.narrow[c], cache.hours);
+    }
+    append(cache.radiation, cache.hours * sizeof(cache.radiation[0]));
+    return true;
+  }
+
+  // Header and records, oldest first; 0 when `size` is too small
+  size_t copyTo(uint8_t *out, size_t size) const {
+    InputTraceHeader h = { INPUT_TRACE_MAGIC, INPUT_TRACE_VERSION, 0, records, dropped, firstMs, (uint32_t)used };
+    if (size < sizeof(h) + used) return 0;
+    memcpy(out, &h, sizeof(h));
+    size_t first = capacity - tail < used ? capacity - tail : used;
+    memcpy(out + sizeof(h), ring + tail, first);
+    memcpy(out + sizeof(h) + first, ring, used - first);
+    return sizeof(h) + used;
+  }
+
+  size_t getCapacity() const { return capacity; }
+  size_t getUsed() const { return used; }
+  uint16_t getRecords() const { return records; }
+  uint32_t getDropped() const { return dropped; }
+  size_t downloadSize() const { return sizeof(InputTraceHeader) + used; }
+};
+
+// One record of a download
+struct InputTraceRecord {
+  uint8_t type;
+  uint32_t ms;
+  const uint8_t *payload;
+  uint32_t length;
+};
+
+// Walks a download from InputTrace::copyTo()
+class InputTraceReader {
+private:
+  const uint8_t *data;
+  size_t end;
+  size_t offset;
+  uint16_t index;
+  uint32_t ms;
+  InputTraceHeader header;
+
+  bool varint(uint32_t &v) {
+    v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+      if (offset >= end) return false;
+      uint8_t b = data[offset++];
+      v |= (uint32_t)(b & 0x7F) << shift;
+      if (!(b & 0x80)) return true;
+    }
+    return false;
+  }
+
+public:
+  // False when the bytes aren't a download this version can read
+  bool begin(const uint8_t *bytes, size_t size) {
+    data = bytes;
+    index = 0;
+    if (size < sizeof(header)) return false;
+    memcpy(&header, bytes, sizeof(header));
+    if (header.magic != INPUT_TRACE_MAGIC || header.version != INPUT_TRACE_VERSION) return false;
+    if (header.bytes > size - sizeof(header)) return false;
+    offset = sizeof(header);
+    end = offset + header.bytes;
+    ms = header.firstMs;
+    return true;
+  }
+
+  // False at the end or on a truncated record
+  bool next(InputTraceRecord &r) {
+    if (offset >= end || index >= header.records) return false;
+    r.type = data[offset++];
+    uint32_t delta;
+    if (!varint(r.length) || !varint(delta) || r.length > end - offset) return false;
+    if (index > 0) ms += delta;
+    r.ms = ms;
+    r.payload = data + offset;
+    offset += r.length;
+    index++;
+    return true;
+  }
+
+  const InputTraceHeader &getHeader() const { return header; }
+};
+
+// Rebuilds the cache a forecast record was taken from
+inline bool readInputTraceForecast(const InputTraceRecord &r, ForecastCache &cache) {
+  InputTraceForecast f;
+  if (r.type != IT_FORECAST || r.length < sizeof(f)) return false;
+  memcpy(&f, r.payload, sizeof(f));
+  if (f.hours > FORECAST_CACHE_HOURS || r.length != inputTraceForecastSize(f.hours)) return false;
+  const uint8_t *p = r.payload + sizeof(f);
+  for (uint8_t c = 0; c < FORECAST_NARROW_COLUMNS; c++) {
+    memcpy(cache.narrow[c], p, f.hours);
+    p += f.hours;
+  }
+  memcpy(cache.radiation, p, f.hours * sizeof(cache.radiation[0]));
+  cache.startEpoch = f.startEpoch;
+  cache.fetchedAt = f.fetchedAt;
+  cache.hours = f.hours;
+  return true;
+}
+
+#endif
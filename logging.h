@@ -4,11 +4,17 @@
 #include <Arduino.h>
 #include <EEPROM.h>
 #include <TimeLib.h>
+#include "flash_string.h"
+#include "trace.h"
+#include "metrics.h"
 
 #define LOG_EEPROM_START 512
 #define LOG_EEPROM_SIZE 3072  // 3KB for logs
+#define EEPROM_IMAGE_SIZE 4096 // The whole emulated EEPROM sector; every begin() must use it
 #define MAX_LOG_ENTRIES 100   // Maximum number of log entries to store
 #define COMMIT_THRESHOLD 5    // Commit to EEPROM after this many writes
+#define LOG_CURSOR_RESERVE 64 // Space kept for the cursor in getLogsSinceJson
+#define LOG_CHART_MAX_POINTS 120 // Largest points=N accepted for chart decimation
 
 enum LogEntryType {
   LOG_CLOUD_COVERAGE = 0,
@@ -24,6 +30,19 @@ struct LogEntry {
   uint16_t extraData;    
 };
 
+// Running sums of one time bucket of a decimated cloud series
+struct LogBucket {
+  float sumOffset;       // Seconds after the series start
+  float sumValue;
+  uint16_t count;
+};
+
+// SystemState names as the log API has always spelled them
+static const char LOG_STATE_NAMES[][11] PROGMEM = { "NORMAL", "MONITORING", "ACTIVE", "SCHEDULED", "MANUAL" };
+
+// Sees every entry as it is added, e.g. to forward it as telemetry
+typedef void (*LogListener)(const LogEntry &entry);
+
 class LogManager {
 private:
   uint16_t logCount;             
@@ -31,6 +50,8 @@ private:
   uint32_t lastResetTimestamp;   
   bool initialized;
   uint8_t uncommittedWrites;     // Track writes before committing
+  bool commitsSuspended;         // Writes stay in the RAM copy (benchmarks)
+  LogListener listener;
 
   uint16_t getMetadataAddress() {
     return LOG_EEPROM_START;
@@ -53,22 +74,154 @@ private:
 
   // Commit EEPROM if we've reached the threshold or force is true
   void commitIfNeeded(bool force = false) {
+    if (commitsSuspended) return;
     if (force || uncommittedWrites >= COMMIT_THRESHOLD) {
+      uint32_t commitStart = micros();
       bool success = EEPROM.commit();
+      metrics.observe(MH_EEPROM_COMMIT, micros() - commitStart);
       if (success) {
         uncommittedWrites = 0;
+      } else {
+        metrics.inc(MC_EEPROM_COMMIT_FAILED);
       }
     }
   }
 
+  bool chartEntry(const LogEntry &entry, LogEntryType type, uint16_t zone) {
+    return entry.type == type && (type != LOG_LIGHT_STATE || entry.extraData == zone);
+  }
+
+  // Appends one entry to a JSON array; false when it doesn't fit
+  bool appendEntryJson(const LogEntry &entry, bool &first, char *out, size_t &len, size_t limit) {
+    int n;
+    if (entry.type == LOG_CLOUD_COVERAGE) {
+      n = snprintf_P(out + len, limit - len, PSTR("%s{\"time\":%lu,\"value\":%u.%u}"),
+                     first ? "" : ",", (unsigned long)entry.timestamp, entry.extraData / 10, entry.extraData % 10);
+    } else if (entry.type == LOG_SYSTEM_STATE) {
+      n = snprintf_P(out + len, limit - len, PSTR("%s{\"time\":%lu,\"value\":%d,\"stateName\":\"%s\"}"),
+                     first ? "" : ",", (unsigned long)entry.timestamp, entry.value, getStateName(entry.value).c_str());
+    } else if (entry.type == LOG_LIGHT_STATE && entry.extraData != 0) {
+      // Light changes of extra zones carry the zone number
+      n = snprintf_P(out + len, limit - len, PSTR("%s{\"time\":%lu,\"value\":%d,\"zone\":%u}"),
+                     first ? "" : ",", (unsigned long)entry.timestamp, entry.value, entry.extraData);
+    } else {
+      n = snprintf_P(out + len, limit - len, PSTR("%s{\"time\":%lu,\"value\":%d}"),
+                     first ? "" : ",", (unsigned long)entry.timestamp, entry.value);
+    }
+    if (n < 0 || len + n >= limit) return false;
+    len += n;
+    first = false;
+    return true;
+  }
+
+  static uint16_t bucketOf(uint32_t offset, uint32_t span, uint16_t bucketCount) {
+    uint32_t b = (uint64_t)offset * bucketCount / span;
+    return b < bucketCount ? b : bucketCount - 1;
+  }
+
+  // LTTB: the first and last entry are kept, one entry per bucket between
+  void decimateCloud(uint16_t points, LogBucket *buckets, int firstIndex, int lastIndex, const LogEntry &head,
+                     const LogEntry &tail, bool &first, char *out, size_t &len, size_t limit) {
+    uint32_t span = tail.timestamp - head.timestamp;
+    uint16_t bucketCount = points > 2 ? points - 2 : 0;
+    if (!appendEntryJson(head, first, out, len, limit) || firstIndex == lastIndex) return;
+    if (bucketCount == 0 || span == 0) {
+      appendEntryJson(tail, first, out, len, limit);
+      return;
+    }
+
+    memset(buckets, 0, sizeof(LogBucket) * bucketCount);
+    LogEntry entry;
+    for (int i = firstIndex + 1; i < lastIndex; i++) {
+      if (!getLogEntry(i, &entry) || entry.type != LOG_CLOUD_COVERAGE) continue;
+      uint32_t offset = entry.timestamp - head.timestamp;
+      LogBucket &b = buckets[bucketOf(offset, span, bucketCount)];
+      b.sumOffset += offset;
+      b.sumValue += entry.extraData;
+      b.count++;
+    }
+
+    float ax = 0, ay = head.extraData;    // Previous pick
+    float cx = 0, cy = 0;                 // Mean of the next bucket with entries
+    int current = -1;
+    float bestArea = -1;
+    LogEntry best;
+    for (int i = firstIndex + 1; i < lastIndex; i++) {
+      if (!getLogEntry(i, &entry) || entry.type != LOG_CLOUD_COVERAGE) continue;
+      uint32_t offset = entry.timestamp - head.timestamp;
+      int b = bucketOf(offset, span, bucketCount);
+      if (b != current) {
+        if (bestArea >= 0) {
+          if (!appendEntryJson(best, first, out, len, limit)) return;
+          ax = best.timestamp - head.timestamp;
+          ay = best.extraData;
+        }
+        current = b;
+        bestArea = -1;
+        int next = b + 1;
+        while (next < bucketCount && buckets[next].count == 0) next++;
+        if (next < bucketCount) {
+          cx = buckets[next].sumOffset / buckets[next].count;
+          cy = buckets[next].sumValue / buckets[next].count;
+        } else {
+          cx = span;
+          cy = tail.extraData;
+        }
+      }
+      float area = fabsf((ax - cx) * (entry.extraData - ay) - (ax - offset) * (cy - ay));
+      if (area > bestArea) {
+        bestArea = area;
+        best = entry;
+      }
+    }
+    if (bestArea >= 0 && !appendEntryJson(best, first, out, len, limit)) return;
+    appendEntryJson(tail, first, out, len, limit);
+  }
+
+  // Run-length merges repeated states, then holds back changes that come
+  // within minGap of the last one shown and shows the state they settled on
+  void decimateStates(LogEntryType type, uint16_t points, uint16_t zone, int firstIndex, int lastIndex,
+                      uint32_t span, bool &first, char *out, size_t &len, size_t limit) {
+    uint32_t minGap = points > 1 ? span * 2 / points : 0;
+    LogEntry entry, shown, pending;
+    bool hasShown = false, hasPending = false, hasRun = false;
+    uint8_t runValue = 0;
+    for (int i = firstIndex; i <= lastIndex; i++) {
+      if (!getLogEntry(i, &entry) || !chartEntry(entry, type, zone)) continue;
+      if (hasRun && entry.value == runValue) continue;
+      hasRun = true;
+      runValue = entry.value;
+
+      if (hasPending && entry.timestamp - shown.timestamp >= minGap) {
+        if (pending.value != shown.value) {
+          if (!appendEntryJson(pending, first, out, len, limit)) return;
+          shown = pending;
+        }
+        hasPending = false;
+      }
+      if (!hasShown || (!hasPending && entry.timestamp - shown.timestamp >= minGap)) {
+        if (!appendEntryJson(entry, first, out, len, limit)) return;
+        shown = entry;
+        hasShown = true;
+      } else {
+        pending = entry;
+        hasPending = true;
+      }
+    }
+    if (hasPending && pending.value != shown.value) {
+      appendEntryJson(pending, first, out, len, limit);
+    }
+  }
+
 public:
-  LogManager() : logCount(0), logHead(0), lastResetTimestamp(0), initialized(false), uncommittedWrites(0) {}
+  LogManager() : logCount(0), logHead(0), lastResetTimestamp(0), initialized(false), uncommittedWrites(0),
+                 commitsSuspended(false), listener(NULL) {}
 
   void begin() {
     if (initialized) return; // Only initialize once
     
     // Start with total EEPROM size needed
-    EEPROM.begin(LOG_EEPROM_START + LOG_EEPROM_SIZE);
+    EEPROM.begin(EEPROM_IMAGE_SIZE);
     
     uint16_t metaAddr = getMetadataAddress();
     EEPROM.get(metaAddr, logCount);
@@ -81,7 +234,7 @@ public:
     // Validate the data we loaded
     if (logCount > MAX_LOG_ENTRIES || logHead >= MAX_LOG_ENTRIES || 
         lastResetTimestamp > now() + 86400) { // Don't accept future timestamps (allow 1 day for clock inaccuracy)
-      Serial.println("Invalid log data detected, resetting logs");
+      TRACE_WARN(TR_LOG_INVALID);
       logCount = 0;
       logHead = 0;
       lastResetTimestamp = now();
@@ -89,7 +242,25 @@ public:
     }
     
     initialized = true;
-    Serial.printf("Log system initialized. Count: %d, Head: %d\n", logCount, logHead);
+    TRACE_INFO(TR_LOG_INIT, logCount, logHead);
+  }
+
+  // While suspended nothing reaches flash; reload() afterwards discards the
+  // RAM-only changes by re-reading the image
+  void setCommitsSuspended(bool suspended) {
+    commitsSuspended = suspended;
+  }
+
+  // Not called while commits are suspended, so benchmark writes stay private
+  void setListener(LogListener l) {
+    listener = l;
+  }
+
+  void reload() {
+    EEPROM.begin(EEPROM_IMAGE_SIZE);
+    uncommittedWrites = 0;
+    initialized = false;
+    begin();
   }
 
   // Save metadata to EEPROM
@@ -128,6 +299,8 @@ public:
     
     saveMetadata();
     commitIfNeeded();
+    
+    if (listener && !commitsSuspended) listener(entry);
   }
 
   void logCloudCoverage(float cloudCoverage) {
@@ -137,8 +310,9 @@ public:
     }
   }
 
-  void logLightState(bool isOn) {
-    addLog(LOG_LIGHT_STATE, isOn ? 1 : 0);
+  // Zone 0 is the main circuit
+  void logLightState(bool isOn, uint8_t zone = 0) {
+    addLog(LOG_LIGHT_STATE, isOn ? 1 : 0, zone);
   }
 
   void logSystemState(uint8_t state) {
@@ -154,7 +328,7 @@ public:
     logHead = 0;
     lastResetTimestamp = resetTime;
     saveMetadata();
-    Serial.println("Log system reset");
+    TRACE_INFO(TR_LOG_RESET);
   }
 
   bool getLogEntry(uint16_t index, LogEntry* entry) {
@@ -178,48 +352,117 @@ public:
     return logCount;
   }
 
-  String getLogsAsJson(LogEntryType type) {
+  static FlashName getStateName(uint8_t state) {
+    return flashName(LOG_STATE_NAMES, state, PSTR("UNKNOWN"));
+  }
+
+  // Writes the entries of one type as a JSON array into `out`. Entries that
+  // don't fit are dropped so the result is always a complete array.
+  size_t getLogsAsJson(LogEntryType type, char *out, size_t size) {
     if (!initialized) begin();
+    if (size < 3) return 0;
     
-    String json = "[";
+    size_t len = 0;
+    size_t limit = size - 2; // Room for the closing bracket and terminator
+    out[len++] = '[';
     bool first = true;
     
     for (uint16_t i = 0; i < logCount; i++) {
       LogEntry entry;
-      if (getLogEntry(i, &entry) && entry.type == type) {
-        if (!first) json += ",";
-        first = false;
-        
-        json += "{\"time\":";
-        json += entry.timestamp;
-        json += ",\"value\":";
-        
-        if (type == LOG_CLOUD_COVERAGE) {
-          float cloudValue = entry.extraData / 10.0;
-          json += cloudValue;
-        } else {
-          json += (int)entry.value;
-        }
-        
-        if (type == LOG_SYSTEM_STATE) {
-          json += ",\"stateName\":\"";
-          switch (entry.value) {
-            case 0: json += "NORMAL"; break;
-            case 1: json += "MONITORING"; break;
-            case 2: json += "ACTIVE"; break;
-            case 3: json += "SCHEDULED"; break;
-            case 4: json += "MANUAL"; break;
-            default: json += "UNKNOWN"; break;
-          }
-          json += "\"";
-        }
-        
-        json += "}";
+      if (!getLogEntry(i, &entry) || entry.type != type) continue;
+      
+      if (!appendEntryJson(entry, first, out, len, limit)) break;
+    }
+
+    out[len++] = ']';
+    out[len] = 0;
+    return len;
+  }
+
+  // Like getLogsAsJson, but at most about `points` entries shaped for a
+  // chart, chosen in passes over the ring with O(points) memory. Cloud
+  // coverage uses Largest-Triangle-Three-Buckets over equal time buckets:
+  // one pass sums each bucket, the next keeps per bucket the entry spanning
+  // the largest triangle with the previous pick and the next bucket's mean.
+  // States keep only their changes, and changes closer together than the
+  // chart can show collapse into the state they settled on. `buckets` needs
+  // `points` slots; light entries are those of `zone`.
+  size_t getDecimatedLogsAsJson(LogEntryType type, uint16_t points, uint16_t zone, LogBucket *buckets, char *out,
+                                size_t size) {
+    if (!initialized) begin();
+    if (size < 3) return 0;
+
+    size_t len = 0;
+    size_t limit = size - 2;
+    out[len++] = '[';
+    bool first = true;
+
+    // The ring is in time order, so the span is found from both ends
+    LogEntry head, tail;
+    int firstIndex = -1, lastIndex = -1;
+    for (int i = 0; i < logCount && firstIndex < 0; i++) {
+      if (getLogEntry(i, &head) && chartEntry(head, type, zone)) firstIndex = i;
+    }
+    for (int i = logCount - 1; firstIndex >= 0 && i >= firstIndex && lastIndex < 0; i--) {
+      if (getLogEntry(i, &tail) && chartEntry(tail, type, zone)) lastIndex = i;
+    }
+
+    if (firstIndex >= 0 && type == LOG_CLOUD_COVERAGE) {
+      decimateCloud(points, buckets, firstIndex, lastIndex, head, tail, first, out, len, limit);
+    } else if (firstIndex >= 0) {
+      decimateStates(type, points, zone, firstIndex, lastIndex, tail.timestamp - head.timestamp, first, out, len,
+                     limit);
+    }
+
+    out[len++] = ']';
+    out[len] = 0;
+    return len;
+  }
+
+  // Entries of every type stamped `since` or later, for collectors that poll
+  // incrementally. The first `skip` entries stamped exactly `since` were
+  // returned by the previous call. Writes a JSON object whose "next" cursor
+  // continues after the last entry that fit; "more" is true if some didn't.
+  size_t getLogsSinceJson(uint32_t since, uint16_t skip, char *out, size_t size) {
+    if (!initialized) begin();
+    if (size < LOG_CURSOR_RESERVE + 16) return 0;
+    
+    size_t len = snprintf_P(out, size, PSTR("{\"entries\":["));
+    size_t limit = size - LOG_CURSOR_RESERVE; // Room for the cursor and closing braces
+    uint32_t nextSince = since;
+    uint16_t nextSkip = skip;
+    uint16_t skipped = 0;
+    bool more = false;
+    bool first = true;
+    
+    for (uint16_t i = 0; i < logCount; i++) {
+      LogEntry entry;
+      if (!getLogEntry(i, &entry) || entry.timestamp < since) continue;
+      if (entry.timestamp == since && skipped < skip) {
+        skipped++;
+        continue;
+      }
+      
+      int n = snprintf_P(out + len, limit - len, PSTR("%s{\"time\":%lu,\"type\":%u,\"value\":%u,\"extra\":%u}"),
+                         first ? "" : ",", (unsigned long)entry.timestamp, entry.type, entry.value, entry.extraData);
+      if (n < 0 || len + n >= limit) {
+        more = true;
+        break;
+      }
+      len += n;
+      first = false;
+      
+      if (entry.timestamp == nextSince) {
+        nextSkip++;
+      } else {
+        nextSince = entry.timestamp;
+        nextSkip = 1;
       }
     }
     
-    json += "]";
-    return json;
+    len += snprintf_P(out + len, size - len, PSTR("],\"next\":{\"since\":%lu,\"skip\":%u},\"more\":%s}"),
+                      (unsigned long)nextSince, nextSkip, more ? "true" : "false");
+    return len;
   }
 };
 
@@ -0,0 +1,120 @@
+#include "metrics.h"
+
+const uint32_t METRIC_BUCKET_BOUNDS[METRIC_BUCKET_COUNT] = {
+  500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000
+};
+
+static const char bucketLabel0[] PROGMEM = "0.0005";
+static const char bucketLabel1[] PROGMEM = "0.001";
+static const char bucketLabel2[] PROGMEM = "0.005";
+static const char bucketLabel3[] PROGMEM = "0.01";
+static const char bucketLabel4[] PROGMEM = "0.05";
+static const char bucketLabel5[] PROGMEM = "0.1";
+static const char bucketLabel6[] PROGMEM = "0.5";
+static const char bucketLabel7[] PROGMEM = "1";
+static const char bucketLabel8[] PROGMEM = "5";
+static const char bucketLabelInf[] PROGMEM = "+Inf";
+static const char *const bucketLabels[METRIC_BUCKET_COUNT + 1] = {
+  bucketLabel0, bucketLabel1, bucketLabel2, bucketLabel3, bucketLabel4,
+  bucketLabel5, bucketLabel6, bucketLabel7, bucketLabel8, bucketLabelInf
+};
+
+struct MetricName {
+  const char *name;
+  const char *labels;
+};
+
+#define METRIC_NAME_STRINGS(id, name, labels) \
+  static const char id##_NAME[] PROGMEM = name; \
+  static const char id##_LABELS[] PROGMEM = labels;
+METRIC_COUNTERS(METRIC_NAME_STRINGS)
+METRIC_GAUGES(METRIC_NAME_STRINGS)
+METRIC_HISTOGRAMS(METRIC_NAME_STRINGS)
+#undef METRIC_NAME_STRINGS
+
+#define METRIC_NAME_ENTRY(id, name, labels) { id##_NAME, id##_LABELS },
+static const MetricName counterNames[MC_COUNT] = { METRIC_COUNTERS(METRIC_NAME_ENTRY) };
+static const MetricName gaugeNames[MG_COUNT] = { METRIC_GAUGES(METRIC_NAME_ENTRY) };
+static const MetricName histogramNames[MH_COUNT] = { METRIC_HISTOGRAMS(METRIC_NAME_ENTRY) };
+#undef METRIC_NAME_ENTRY
+
+MetricsRegistry metrics;
+
+#define METRIC_NAME_SIZE 48
+#define METRIC_LABELS_SIZE 32
+#define METRIC_LINE_SIZE 128
+
+// Copies a family's name and labels out of flash and emits the TYPE line
+// when it differs from the previous family
+static void beginSeries(MetricsSink sink, const MetricName &metric, const char *type,
+                        char *name, char *labels, char *previous) {
+  char line[METRIC_LINE_SIZE];
+  strncpy_P(name, metric.name, METRIC_NAME_SIZE - 1);
+  name[METRIC_NAME_SIZE - 1] = 0;
+  strncpy_P(labels, metric.labels, METRIC_LABELS_SIZE - 1);
+  labels[METRIC_LABELS_SIZE - 1] = 0;
+
+  if (strcmp(name, previous) != 0) {
+    int n = snprintf_P(line, sizeof(line), PSTR("# TYPE %s %s\n"), name, type);
+    if (n > 0) sink(line, n < (int)sizeof(line) ? n : sizeof(line) - 1);
+    strcpy(previous, name);
+  }
+}
+
+static void emitSample(MetricsSink sink, const char *name, const char *suffix,
+                       const char *labels, const char *extraLabel, const char *value) {
+  char line[METRIC_LINE_SIZE];
+  int n;
+  bool hasLabels = labels[0] != 0;
+  bool hasExtra = extraLabel != NULL && extraLabel[0] != 0;
+
+  if (hasLabels || hasExtra) {
+    n = snprintf_P(line, sizeof(line), PSTR("%s%s{%s%s%s} %s\n"), name, suffix, labels,
+                   hasLabels && hasExtra ? "," : "", hasExtra ? extraLabel : "", value);
+  } else {
+    n = snprintf_P(line, sizeof(line), PSTR("%s%s %s\n"), name, suffix, value);
+  }
+  if (n > 0) sink(line, n < (int)sizeof(line) ? n : sizeof(line) - 1);
+}
+
+void MetricsRegistry::render(MetricsSink sink) {
+  char name[METRIC_NAME_SIZE];
+  char labels[METRIC_LABELS_SIZE];
+  char previous[METRIC_NAME_SIZE] = "";
+  char value[24];
+
+  for (uint8_t i = 0; i < MC_COUNT; i++) {
+    beginSeries(sink, counterNames[i], "counter", name, labels, previous);
+    snprintf_P(value, sizeof(value), PSTR("%u"), counters[i]);
+    emitSample(sink, name, "", labels, NULL, value);
+  }
+
+  for (uint8_t i = 0; i < MG_COUNT; i++) {
+    beginSeries(sink, gaugeNames[i], "gauge", name, labels, previous);
+    snprintf_P(value, sizeof(value), PSTR("%d"), gauges[i]);
+    emitSample(sink, name, "", labels, NULL, value);
+  }
+
+  for (uint8_t i = 0; i < MH_COUNT; i++) {
+    const Histogram &h = histograms[i];
+    beginSeries(sink, histogramNames[i], "histogram", name, labels, previous);
+
+    uint32_t cumulative = 0;
+    char le[24];
+    char bound[12];
+    for (uint8_t b = 0; b <= METRIC_BUCKET_COUNT; b++) {
+      cumulative += h.buckets[b];
+      strncpy_P(bound, bucketLabels[b], sizeof(bound) - 1);
+      bound[sizeof(bound) - 1] = 0;
+      snprintf_P(le, sizeof(le), PSTR("le=\"%s\""), bound);
+      snprintf_P(value, sizeof(value), PSTR("%u"), cumulative);
+      emitSample(sink, name, "_bucket", labels, le, value);
+    }
+
+    snprintf_P(value, sizeof(value), PSTR("%u.%06u"),
+               (uint32_t)(h.sumMicros / 1000000), (uint32_t)(h.sumMicros % 1000000));
+    emitSample(sink, name, "_sum", labels, NULL, value);
+    snprintf_P(value, sizeof(value), PSTR("%u"), h.count);
+    emitSample(sink, name, "_count", labels, NULL, value);
+  }
+}
@@ -0,0 +1,135 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+
+#define METRIC_BUCKET_COUNT 9 // Finite histogram buckets, +Inf is implied
+
+// Counters, gauges and histograms as (id, metric name, label set). Series of
+// one family must be listed next to each other so TYPE is emitted once.
+#define METRIC_COUNTERS(X) \
+  X(MC_FORECAST_OK,          "lightctl_forecast_fetch_total", "result=\"ok\"") \
+  X(MC_FORECAST_WIFI_DOWN,   "lightctl_forecast_fetch_total", "result=\"wifi_down\"") \
+  X(MC_FORECAST_HTTP_ERROR,  "lightctl_forecast_fetch_total", "result=\"http_error\"") \
+  X(MC_FORECAST_JSON_ERROR,  "lightctl_forecast_fetch_total", "result=\"json_error\"") \
+  X(MC_FORECAST_NO_MATCH,    "lightctl_forecast_fetch_total", "result=\"no_match\"") \
+  X(MC_FORECAST_HEDGES,      "lightctl_forecast_hedges_total", "") \
+  X(MC_FORECAST_FALLBACK_WINS, "lightctl_forecast_fallback_wins_total", "") \
+  X(MC_FORECAST_CACHE_HIT,   "lightctl_forecast_lookup_total", "result=\"hit\"") \
+  X(MC_FORECAST_CACHE_MISS,  "lightctl_forecast_lookup_total", "result=\"miss\"") \
+  X(MC_SHARE_SENT,           "lightctl_forecast_share_frames_total", "result=\"sent\"") \
+  X(MC_SHARE_RECEIVED,       "lightctl_forecast_share_frames_total", "result=\"accepted\"") \
+  X(MC_SHARE_REJECTED,       "lightctl_forecast_share_frames_total", "result=\"rejected\"") \
+  X(MC_MQTT_MESSAGES,        "lightctl_mqtt_messages_total", "") \
+  X(MC_MQTT_EVENTS_SENT,     "lightctl_mqtt_events_total", "result=\"sent\"") \
+  X(MC_MQTT_EVENTS_DROPPED,  "lightctl_mqtt_events_total", "result=\"dropped\"") \
+  X(MC_MQTT_CONNECTS,        "lightctl_mqtt_connects_total", "") \
+  X(MC_HTTP_REJECTED_RATE,   "lightctl_http_rejected_total", "reason=\"rate\"") \
+  X(MC_HTTP_REJECTED_EXPENSIVE, "lightctl_http_rejected_total", "reason=\"expensive\"") \
+  X(MC_HTTP_DEFERRED,        "lightctl_http_deferred_passes_total", "") \
+  X(MC_HTTP_REFUSED,         "lightctl_http_connections_refused_total", "") \
+  X(MC_HTTP_TIMEOUTS,        "lightctl_http_timeouts_total", "") \
+  X(MC_HTTP_AUTH_SESSION,    "lightctl_http_auth_total", "method=\"session\"") \
+  X(MC_HTTP_AUTH_BASIC,      "lightctl_http_auth_total", "method=\"basic\"") \
+  X(MC_HTTP_AUTH_FAILED,     "lightctl_http_auth_total", "method=\"none\"") \
+  X(MC_HTTP_LOGIN_FAILED,    "lightctl_http_login_failures_total", "") \
+  X(MC_HTTP_GZIP_RESPONSES,  "lightctl_http_gzip_responses_total", "") \
+  X(MC_HTTP_GZIP_BYTES_IN,   "lightctl_http_gzip_bytes_total", "direction=\"in\"") \
+  X(MC_HTTP_GZIP_BYTES_OUT,  "lightctl_http_gzip_bytes_total", "direction=\"out\"") \
+  X(MC_HTTP_GZIP_MICROS,     "lightctl_http_gzip_cpu_microseconds_total", "") \
+  X(MC_CLOUDCHECK_COALESCED, "lightctl_cloudcheck_coalesced_total", "") \
+  X(MC_PLAN_BUILDS,          "lightctl_plan_builds_total", "") \
+  X(MC_ENERGY_CHECKPOINTS,   "lightctl_energy_checkpoints_total", "") \
+  X(MC_EEPROM_COMMIT_FAILED, "lightctl_eeprom_commit_failures_total", "") \
+  X(MC_WIFI_RECONNECTS,      "lightctl_wifi_reconnects_total", "") \
+  X(MC_RELAY_SWITCHES,       "lightctl_relay_switches_total", "")
+
+#define METRIC_GAUGES(X) \
+  X(MG_FREE_HEAP,            "lightctl_free_heap_bytes", "") \
+  X(MG_MIN_FREE_HEAP,        "lightctl_min_free_heap_bytes", "") \
+  X(MG_HEAP_FRAGMENTATION,   "lightctl_heap_fragmentation_percent", "") \
+  X(MG_MAX_FREE_BLOCK,       "lightctl_max_free_block_bytes", "") \
+  X(MG_NTP_OFFSET,           "lightctl_ntp_sync_offset_seconds", "") \
+  X(MG_UPTIME,               "lightctl_uptime_seconds", "") \
+  X(MG_MQTT_QUEUE_DEPTH,     "lightctl_mqtt_queue_events", "") \
+  X(MG_HTTP_CONNECTIONS,     "lightctl_http_connections", "") \
+  X(MG_HTTP_BUFFERED,        "lightctl_http_buffered_bytes", "")
+
+#define METRIC_HISTOGRAMS(X) \
+  X(MH_FORECAST_FETCH,       "lightctl_forecast_fetch_duration_seconds", "") \
+  X(MH_EEPROM_COMMIT,        "lightctl_eeprom_commit_duration_seconds", "") \
+  X(MH_HTTP_ROOT,            "lightctl_http_handler_duration_seconds", "handler=\"root\"") \
+  X(MH_HTTP_API,             "lightctl_http_handler_duration_seconds", "handler=\"api\"") \
+  X(MH_LOOP,                 "lightctl_loop_duration_seconds", "")
+
+#define METRIC_ENUM_ENTRY(id, name, labels) id,
+enum MetricCounterId { METRIC_COUNTERS(METRIC_ENUM_ENTRY) MC_COUNT };
+enum MetricGaugeId { METRIC_GAUGES(METRIC_ENUM_ENTRY) MG_COUNT };
+enum MetricHistogramId { METRIC_HISTOGRAMS(METRIC_ENUM_ENTRY) MH_COUNT };
+#undef METRIC_ENUM_ENTRY
+
+// Upper bounds in microseconds, shared by every histogram
+extern const uint32_t METRIC_BUCKET_BOUNDS[METRIC_BUCKET_COUNT];
+
+// Receives rendered exposition text piece by piece
+typedef void (*MetricsSink)(const char *text, size_t len);
+
+class MetricsRegistry {
+private:
+  struct Histogram {
+    uint32_t buckets[METRIC_BUCKET_COUNT + 1]; // Last slot is +Inf
+    uint32_t count;
+    uint64_t sumMicros;
+  };
+
+  uint32_t counters[MC_COUNT];
+  int32_t gauges[MG_COUNT];
+  Histogram histograms[MH_COUNT];
+
+public:
+  MetricsRegistry() {
+    memset(counters, 0, sizeof(counters));
+    memset(gauges, 0, sizeof(gauges));
+    memset(histograms, 0, sizeof(histograms));
+  }
+
+  void inc(MetricCounterId id, uint32_t n = 1) {
+    counters[id] += n;
+  }
+
+  void set(MetricGaugeId id, int32_t value) {
+    gauges[id] = value;
+  }
+
+  void observe(MetricHistogramId id, uint32_t micros) {
+    Histogram &h = histograms[id];
+    uint8_t bucket = 0;
+    while (bucket < METRIC_BUCKET_COUNT && micros > METRIC_BUCKET_BOUNDS[bucket]) bucket++;
+    h.buckets[bucket]++;
+    h.count++;
+    h.sumMicros += micros;
+  }
+
+  uint32_t getCounter(MetricCounterId id) { return counters[id]; }
+  int32_t getGauge(MetricGaugeId id) { return gauges[id]; }
+
+  // Writes every metric in Prometheus text exposition format
+  void render(MetricsSink sink);
+};
+
+extern MetricsRegistry metrics;
+
+// Records the lifetime of the enclosing scope into a histogram
+class MetricTimer {
+private:
+  MetricHistogramId id;
+  uint32_t start;
+
+public:
+  MetricTimer(MetricHistogramId histogram) : id(histogram), start(micros()) {}
+  ~MetricTimer() {
+    metrics.observe(id, micros() - start);
+  }
+};
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef MQTT_BATCH_H
+#define MQTT_BATCH_H
+
+// MQTT 3.1.1 packet encoding and the event queue behind the telemetry
+// publisher. tools/mqtt_load.cpp drives a real broker with exactly the bytes
+// the device sends.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "flash_string.h"
+
+#define MQTT_QUEUE_EVENTS 256       // Events kept while the broker is unreachable, 8 bytes each
+#define MQTT_PACKET_SIZE 1024       // Largest packet built, batch included
+#define MQTT_KEEPALIVE_SEC 60
+
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_PINGREQ 0xC0
+#define MQTT_PINGRESP 0xD0
+
+// One telemetry event; the same fields as a log entry
+struct MqttEvent {
+  uint32_t timestamp;
+  uint8_t type;
+  uint8_t value;
+  uint16_t extra;
+};
+
+// Fixed ring of events. When it is full the oldest events are dropped and
+// counted, so a long outage costs history but never memory.
+class MqttEventQueue {
+private:
+  MqttEvent events[MQTT_QUEUE_EVENTS];
+  uint16_t tail;      // Oldest event
+  uint16_t count;
+  uint32_t dropped;
+
+public:
+  MqttEventQueue() : tail(0), count(0), dropped(0) {}
+
+  void push(const MqttEvent &e) {
+    if (count == MQTT_QUEUE_EVENTS) {
+      tail = (tail + 1) % MQTT_QUEUE_EVENTS;
+      count--;
+      dropped++;
+    }
+    events[(tail + count) % MQTT_QUEUE_EVENTS] = e;
+    count++;
+  }
+
+  // i counts from the oldest event
+  const MqttEvent &peek(uint16_t i) const {
+    return events[(tail + i) % MQTT_QUEUE_EVENTS];
+  }
+
+  void pop(uint16_t n) {
+    if (n > count) n = count;
+    tail = (tail + n) % MQTT_QUEUE_EVENTS;
+    count -= n;
+  }
+
+  uint16_t size() const { return count; }
+  uint32_t getDropped() const { return dropped; }
+  static uint16_t capacity() { return MQTT_QUEUE_EVENTS; }
+  static size_t memoryBytes() { return sizeof(MqttEvent) * MQTT_QUEUE_EVENTS; }
+};
+
+// Appends to a fixed buffer; once anything doesn't fit the result is unusable
+struct MqttWriter {
+  uint8_t *buf;
+  size_t size;
+  size_t len;
+  bool overflow;
+
+  MqttWriter(uint8_t *out, size_t outSize, size_t start) : buf(out), size(outSize), len(start), overflow(false) {}
+
+  void byte(uint8_t b) {
+    if (len >= size) {
+      overflow = true;
+      return;
+    }
+    buf[len++] = b;
+  }
+
+  void bytes(const void *data, size_t n) {
+    if (len + n > size) {
+      overflow = true;
+      return;
+    }
+    memcpy(buf + len, data, n);
+    len += n;
+  }
+
+  void u16(uint16_t v) {
+    byte(v >> 8);
+    byte(v & 0xFF);
+  }
+
+  void str(const char *s) {
+    size_t n = strlen(s);
+    u16((uint16_t)n);
+    bytes(s, n);
+  }
+};
+
+// The body is written after a 5-byte gap; the fixed header is then packed
+// in front of it. Returns the packet length, or 0 if it didn't fit.
+inline size_t mqttFinishPacket(MqttWriter &w, uint8_t type) {
+  if (w.overflow) return 0;
+  size_t remaining = w.len - 5;
+  uint8_t header[5];
+  size_t headerLen = 0;
+  header[headerLen++] = type;
+  size_t n = remaining;
+  do {
+    uint8_t digit = n % 128;
+    n /= 128;
+    header[headerLen++] = n > 0 ? (digit | 0x80) : digit;
+  } while (n > 0 && headerLen < 5);
+  memmove(w.buf + headerLen, w.buf + 5, remaining);
+  memcpy(w.buf, header, headerLen);
+  return headerLen + remaining;
+}
+
+// Clean session; the will marks the unit offline if the connection drops.
+// Empty user means no credentials.
+inline size_t mqttEncodeConnect(uint8_t *out, size_t size, const char *clientId, const char *user,
+                                const char *password, const char *willTopic, const char *willMessage) {
+  MqttWriter w(out, size, 5);
+  w.str("MQTT");
+  w.byte(4);                                    // Protocol level 3.1.1
+  uint8_t flags = 0x02 | 0x04 | 0x20;           // Clean session, will, will retain
+  if (user[0]) flags |= 0x80 | 0x40;            // User name and password
+  w.byte(flags);
+  w.u16(MQTT_KEEPALIVE_SEC);
+  w.str(clientId);
+  w.str(willTopic);
+  w.str(willMessage);
+  if (user[0]) {
+    w.str(user);
+    w.str(password);
+  }
+  return mqttFinishPacket(w, MQTT_CONNECT);
+}
+
+// Where a PUBLISH payload for `topic` starts in the packet buffer, so a
+// batch can be written in place instead of being copied
+inline size_t mqttPayloadOffset(const char *topic) {
+  return 5 + 2 + strlen(topic);
+}
+
+// QoS 0, with `payloadLen` bytes already at mqttPayloadOffset(topic)
+inline size_t mqttFinishPublish(uint8_t *out, size_t size, const char *topic, size_t payloadLen, bool retain) {
+  MqttWriter w(out, size, 5);
+  w.str(topic);
+  if (w.len + payloadLen > size) return 0;
+  w.len += payloadLen;
+  return mqttFinishPacket(w, MQTT_PUBLISH | (retain ? 0x01 : 0x00));
+}
+
+inline size_t mqttEncodePublish(uint8_t *out, size_t size, const char *topic, const char *payload,
+                                size_t payloadLen, bool retain) {
+  size_t offset = mqttPayloadOffset(topic);
+  if (offset + payloadLen > size) return 0;
+  memcpy(out + offset, payload, payloadLen);
+  return mqttFinishPublish(out, size, topic, payloadLen, retain);
+}
+
+inline size_t mqttEncodePingreq(uint8_t *out) {
+  out[0] = MQTT_PINGREQ;
+  out[1] = 0;
+  return 2;
+}
+
+// Return code of a CONNACK (0 = accepted), or -1 if `in` isn't one
+inline int mqttParseConnack(const uint8_t *in, size_t len) {
+  if (len < 4 || in[0] != MQTT_CONNACK || in[1] != 2) return -1;
+  return in[3];
+}
+
+// Writes {"seq":N,"dropped":D,"events":[[time,type,value,extra],...],"state":{...}}
+// with as many queued events as fit, oldest first. `state` is a JSON object
+// (or NULL) describing the unit right now. Returns the number of events
+// included; `len` is 0 if even an empty batch didn't fit.
+inline uint16_t mqttBuildBatch(const MqttEventQueue &queue, uint32_t seq, const char *state, char *out,
+                               size_t size, size_t &len) {
+  size_t stateLen = state ? strlen(state) : 0;
+  size_t reserve = stateLen + 16;               // ],"state": and the closing brace
+  len = 0;
+  if (size <= reserve) return 0;
+
+  size_t limit = size - reserve;
+  int n = snprintf_P(out, limit, PSTR("{\"seq\":%lu,\"dropped\":%lu,\"events\":["), (unsigned long)seq,
+                     (unsigned long)queue.getDropped());
+  if (n < 0 || (size_t)n >= limit) return 0;
+  size_t used = n;
+
+  uint16_t included = 0;
+  for (; included < queue.size(); included++) {
+    const MqttEvent &e = queue.peek(included);
+    n = snprintf_P(out + used, limit - used, PSTR("%s[%lu,%u,%u,%u]"), included == 0 ? "" : ",",
+                   (unsigned long)e.timestamp, e.type, e.value, e.extra);
+    if (n < 0 || used + n >= limit) break;
+    used += n;
+  }
+
+  if (state) {
+    used += snprintf_P(out + used, size - used, PSTR("],\"state\":%s}"), state);
+  } else {
+    used += snprintf_P(out + used, size - used, PSTR("]}"));
+  }
+  len = used;
+  return included;
+}
+
+#endif
@@ -0,0 +1,214 @@
+#include "mqtt_publisher.h"
+#include "metrics.h"
+#include "trace.h"
+
+MqttPublisher mqttPublisher;
+
+MqttPublisher::MqttPublisher()
+    : host(""), port(0), user(""), password(""), intervalMs(0), stateWriter(NULL), state(MQTT_OFF), stateMs(0),
+      backoffMs(0), lastBatchMs(0), lastPingMs(0), lastRxMs(0), sequence(0), connackLen(0), backlog(false),
+      windowStartMs(0), windowMessages(0), windowEvents(0), messagesPerSec(0), eventsPerSec(0) {
+  eventsTopic[0] = 0;
+  statusTopic[0] = 0;
+  clientId[0] = 0;
+}
+
+void MqttPublisher::begin(bool enable, const char *brokerHost, uint16_t brokerPort, const char *brokerUser,
+                          const char *brokerPassword, const char *topicPrefix, uint32_t batchIntervalMs,
+                          MqttStateWriter writer) {
+  host = brokerHost;
+  port = brokerPort;
+  user = brokerUser;
+  password = brokerPassword;
+  intervalMs = batchIntervalMs;
+  stateWriter = writer;
+
+  // The chip ID keeps topics stable when the device is renamed
+  uint32_t chipId = ESP.getChipId();
+  snprintf_P(clientId, sizeof(clientId), PSTR("lightctl-%08x"), chipId);
+  snprintf_P(eventsTopic, sizeof(eventsTopic), PSTR("%s/%08x/events"), topicPrefix, chipId);
+  snprintf_P(statusTopic, sizeof(statusTopic), PSTR("%s/%08x/status"), topicPrefix, chipId);
+
+  state = enable ? MQTT_WAITING : MQTT_OFF;
+  stateMs = millis() - MQTT_BACKOFF_MIN_MS;
+  backoffMs = MQTT_BACKOFF_MIN_MS;
+  windowStartMs = millis();
+}
+
+static const char STATE_NAMES[][11] PROGMEM = { "off", "waiting", "connecting", "connected" };
+
+FlashName MqttPublisher::stateName(MqttState s) {
+  return flashName(STATE_NAMES, s, STATE_NAMES[MQTT_OFF]);
+}
+
+void MqttPublisher::enqueue(const MqttEvent &e) {
+  if (state == MQTT_OFF) return;
+  uint32_t dropped = queue.getDropped();
+  queue.push(e);
+  if (queue.getDropped() != dropped) {
+    metrics.inc(MC_MQTT_EVENTS_DROPPED);
+  }
+}
+
+// Only whole packets go out: if the TCP send buffer can't take all of it
+// the caller tries again on a later poll instead of waiting here
+bool MqttPublisher::writePacket(size_t len) {
+  if (len == 0 || (size_t)client.availableForWrite() < len) return false;
+  return client.write(packet, len) == len;
+}
+
+void MqttPublisher::open(uint32_t nowMs) {
+  // connect() is the one call that can hold the loop, bounded by this timeout
+  client.setTimeout(MQTT_CONNECT_TIMEOUT_MS);
+  if (!client.connect(host, port)) {
+    fail(-1, nowMs);
+    return;
+  }
+  client.setNoDelay(true);
+
+  size_t len = mqttEncodeConnect(packet, sizeof(packet), clientId, user, password, statusTopic, "offline");
+  if (!writePacket(len)) {
+    fail(-2, nowMs);
+    return;
+  }
+  state = MQTT_CONNECTING;
+  stateMs = nowMs;
+  connackLen = 0;
+}
+
+void MqttPublisher::fail(int code, uint32_t nowMs) {
+  client.stop();
+  if (state == MQTT_CONNECTED) {
+    backoffMs = MQTT_BACKOFF_MIN_MS;
+  } else {
+    TRACE_WARN(TR_MQTT_FAILED, code, backoffMs / 1000);
+    backoffMs *= 2;
+    if (backoffMs > MQTT_BACKOFF_MAX_MS) backoffMs = MQTT_BACKOFF_MAX_MS;
+  }
+  state = MQTT_WAITING;
+  stateMs = nowMs;
+}
+
+void MqttPublisher::readConnack(uint32_t nowMs) {
+  while (connackLen < sizeof(connack) && client.available() > 0) {
+    connack[connackLen++] = client.read();
+  }
+  if (connackLen < sizeof(connack)) {
+    if (!client.connected() || nowMs - stateMs >= MQTT_CONNACK_TIMEOUT_MS) fail(-3, nowMs);
+    return;
+  }
+
+  int code = mqttParseConnack(connack, connackLen);
+  if (code != 0) {
+    fail(code, nowMs);
+    return;
+  }
+
+  state = MQTT_CONNECTED;
+  stateMs = nowMs;
+  lastRxMs = nowMs;
+  lastPingMs = nowMs;
+  backoffMs = MQTT_BACKOFF_MIN_MS;
+  metrics.inc(MC_MQTT_CONNECTS);
+  TRACE_INFO_S(TR_MQTT_CONNECTED, host);
+
+  // Retained, so subscribers see the unit online until the will fires;
+  // the first batch, queued events included, follows on the next poll
+  writePacket(mqttEncodePublish(packet, sizeof(packet), statusTopic, "online", 6, true));
+  lastBatchMs = nowMs - intervalMs;
+}
+
+void MqttPublisher::publishBatch(uint32_t nowMs) {
+  char snapshot[MQTT_STATE_SIZE];
+  const char *stateJson = NULL;
+  if (stateWriter) {
+    size_t n = stateWriter(snapshot, sizeof(snapshot));
+    if (n > 0 && n < sizeof(snapshot)) stateJson = snapshot;
+  }
+
+  // The payload is built straight into the packet behind the topic
+  size_t offset = mqttPayloadOffset(eventsTopic);
+  size_t payloadLen;
+  uint16_t included = mqttBuildBatch(queue, sequence, stateJson, (char *)packet + offset,
+                                     sizeof(packet) - offset, payloadLen);
+  if (payloadLen == 0) return;
+
+  size_t len = mqttFinishPublish(packet, sizeof(packet), eventsTopic, payloadLen, false);
+  if (!writePacket(len)) {
+    if (!client.connected()) fail(-4, nowMs);
+    return;
+  }
+
+  // Only events that reached the socket leave the queue
+  queue.pop(included);
+  backlog = queue.size() > 0;
+  sequence++;
+  lastBatchMs = nowMs;
+  windowMessages++;
+  windowEvents += included;
+  metrics.inc(MC_MQTT_MESSAGES);
+  metrics.inc(MC_MQTT_EVENTS_SENT, included);
+}
+
+void MqttPublisher::updateRates(uint32_t nowMs) {
+  uint32_t elapsed = nowMs - windowStartMs;
+  if (elapsed < MQTT_RATE_WINDOW_MS) return;
+  messagesPerSec = windowMessages * 1000.0f / elapsed;
+  eventsPerSec = windowEvents * 1000.0f / elapsed;
+  windowMessages = 0;
+  windowEvents = 0;
+  windowStartMs = nowMs;
+}
+
+void MqttPublisher::poll(uint32_t nowMs) {
+  if (state == MQTT_OFF) return;
+  updateRates(nowMs);
+
+  if (WiFi.status() != WL_CONNECTED) {
+    if (state != MQTT_WAITING) fail(0, nowMs);
+    return;
+  }
+
+  switch (state) {
+    case MQTT_WAITING:
+      if (nowMs - stateMs >= backoffMs) open(nowMs);
+      return;
+
+    case MQTT_CONNECTING:
+      readConnack(nowMs);
+      return;
+
+    default:
+      break;
+  }
+
+  if (!client.connected()) {
+    fail(0, nowMs);
+    return;
+  }
+
+  // Only PINGRESPs arrive since nothing is subscribed
+  while (client.available() > 0) {
+    client.read();
+    lastRxMs = nowMs;
+  }
+  if (nowMs - lastRxMs >= MQTT_KEEPALIVE_SEC * 1500UL) {
+    fail(-5, nowMs);
+    return;
+  }
+
+  // A backlog left by an outage drains one packet per poll
+  if (backlog || nowMs - lastBatchMs >= intervalMs) {
+    publishBatch(nowMs);
+  }
+
+  // Pinged on a timer of its own: batches keep the broker's keepalive happy
+  // but only a PINGRESP tells us the broker is still there
+  if (nowMs - lastPingMs >= MQTT_KEEPALIVE_SEC * 500UL) {
+    uint8_t ping[2];
+    size_t len = mqttEncodePingreq(ping);
+    if ((size_t)client.availableForWrite() >= len && client.write(ping, len) == len) {
+      lastPingMs = nowMs;
+    }
+  }
+}
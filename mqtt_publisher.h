@@ -0,0 +1,99 @@
+#ifndef MQTT_PUBLISHER_H
+#define MQTT_PUBLISHER_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include "flash_string.h"
+#include "mqtt_batch.h"
+
+#define MQTT_CONNECT_TIMEOUT_MS 1000   // Longest the loop waits for the TCP handshake
+#define MQTT_CONNACK_TIMEOUT_MS 5000
+#define MQTT_BACKOFF_MIN_MS 2000       // Doubles after each failed attempt
+#define MQTT_BACKOFF_MAX_MS 120000
+#define MQTT_RATE_WINDOW_MS 60000      // Period the reported rates are averaged over
+#define MQTT_STATE_SIZE 160            // Snapshot JSON appended to every batch
+#define MQTT_TOPIC_SIZE 64
+
+enum MqttState {
+  MQTT_OFF,
+  MQTT_WAITING,      // Disconnected, next attempt after the backoff
+  MQTT_CONNECTING,   // CONNECT sent, CONNACK pending
+  MQTT_CONNECTED
+};
+
+// Writes a JSON object describing the unit right now; returns its length
+typedef size_t (*MqttStateWriter)(char *out, size_t size);
+
+// Telemetry over a hand-rolled QoS 0 client. Nothing here waits for the
+// broker: the CONNACK, outgoing batches and PINGRESPs are all handled a step
+// per poll, and events queue up in RAM while the broker is unreachable.
+class MqttPublisher {
+private:
+  WiFiClient client;
+  MqttEventQueue queue;
+  uint8_t packet[MQTT_PACKET_SIZE];
+  char eventsTopic[MQTT_TOPIC_SIZE];
+  char statusTopic[MQTT_TOPIC_SIZE];
+  char clientId[24];
+  const char *host;
+  uint16_t port;
+  const char *user;
+  const char *password;
+  uint32_t intervalMs;
+  MqttStateWriter stateWriter;
+  MqttState state;
+
+  uint32_t stateMs;        // When the current state was entered
+  uint32_t backoffMs;
+  uint32_t lastBatchMs;
+  uint32_t lastPingMs;
+  uint32_t lastRxMs;
+  uint32_t sequence;
+  uint8_t connack[4];
+  uint8_t connackLen;
+  bool backlog;            // The last batch left events behind
+
+  uint32_t windowStartMs;
+  uint32_t windowMessages;
+  uint32_t windowEvents;
+  float messagesPerSec;
+  float eventsPerSec;
+
+  void open(uint32_t nowMs);
+  void fail(int code, uint32_t nowMs);
+  void readConnack(uint32_t nowMs);
+  bool writePacket(size_t len);
+  void publishBatch(uint32_t nowMs);
+  void updateRates(uint32_t nowMs);
+
+public:
+  MqttPublisher();
+
+  void begin(bool enable, const char *brokerHost, uint16_t brokerPort, const char *brokerUser,
+             const char *brokerPassword, const char *topicPrefix, uint32_t batchIntervalMs,
+             MqttStateWriter writer);
+
+  // Queued even while disconnected; the oldest events go once the queue is full
+  void enqueue(const MqttEvent &e);
+
+  // Advances the connection by at most one step and publishes when a batch is due
+  void poll(uint32_t nowMs);
+
+  MqttState getState() { return state; }
+  uint16_t getQueueDepth() { return queue.size(); }
+  uint32_t getDropped() { return queue.getDropped(); }
+  uint32_t getSequence() { return sequence; }
+  float getMessagesPerSec() { return messagesPerSec; }
+  float getEventsPerSec() { return eventsPerSec; }
+  const char *getEventsTopic() { return eventsTopic; }
+
+  // RAM held by the queue and by the packet buffer
+  static size_t queueBytes() { return MqttEventQueue::memoryBytes(); }
+  static size_t bufferBytes() { return MQTT_PACKET_SIZE; }
+
+  static FlashName stateName(MqttState s);
+};
+
+extern MqttPublisher mqttPublisher;
+
+#endif
@@ -0,0 +1,152 @@
+#include "profiler.h"
+#include <user_interface.h>
+
+LoopProfiler profiler;
+
+LoopProfiler::LoopProfiler() : loopStartCycles(0), loopStartMs(0), loopCount(0), stallCount(0), hasStall(false) {
+  memset(&lastStall, 0, sizeof(lastStall));
+  reset();
+}
+
+void LoopProfiler::reset() {
+  memset(stages, 0, sizeof(stages));
+  memset(currentCycles, 0, sizeof(currentCycles));
+  for (uint8_t i = 0; i < PROF_STAGE_COUNT; i++) {
+    stages[i].minCycles = 0xFFFFFFFF;
+  }
+}
+
+void LoopProfiler::saveInFlight(uint8_t stage) {
+  InFlightMarker marker;
+  marker.magic = PROFILER_RTC_MAGIC;
+  marker.sequence = loopCount;
+  marker.uptimeMs = loopStartMs;
+  marker.activeStage = stage;
+  ESP.rtcUserMemoryWrite(PROFILER_RTC_OFFSET, (uint32_t *)&marker, sizeof(marker));
+}
+
+void LoopProfiler::saveStall() {
+  ESP.rtcUserMemoryWrite(PROFILER_RTC_STALL_OFFSET, (uint32_t *)&lastStall, sizeof(lastStall));
+}
+
+void LoopProfiler::begin() {
+  InFlightMarker marker;
+  ESP.rtcUserMemoryRead(PROFILER_RTC_OFFSET, (uint32_t *)&marker, sizeof(marker));
+
+  struct rst_info *info = ESP.getResetInfoPtr();
+  uint8_t reason = info ? info->reason : REASON_DEFAULT_RST;
+  bool crashed = reason == REASON_WDT_RST || reason == REASON_SOFT_WDT_RST || reason == REASON_EXCEPTION_RST;
+
+  if (crashed && marker.magic == PROFILER_RTC_MAGIC) {
+    // The iteration never finished, so only the stage it was stuck in is known
+    memset(&lastStall, 0, sizeof(lastStall));
+    lastStall.magic = PROFILER_RTC_MAGIC;
+    lastStall.sequence = marker.sequence;
+    lastStall.uptimeMs = marker.uptimeMs;
+    lastStall.activeStage = marker.activeStage;
+    lastStall.watchdog = 1;
+    lastStall.resetReason = reason;
+    hasStall = true;
+    saveStall();
+  } else {
+    ESP.rtcUserMemoryRead(PROFILER_RTC_STALL_OFFSET, (uint32_t *)&lastStall, sizeof(lastStall));
+    hasStall = lastStall.magic == PROFILER_RTC_MAGIC;
+  }
+
+  saveInFlight(PROF_NO_STAGE);
+}
+
+void LoopProfiler::beginLoop() {
+  loopStartCycles = ESP.getCycleCount();
+  loopStartMs = millis();
+  loopCount++;
+  memset(currentCycles, 0, sizeof(currentCycles));
+}
+
+uint32_t LoopProfiler::beginStage(ProfileStage stage) {
+  saveInFlight(stage);
+  return ESP.getCycleCount();
+}
+
+void LoopProfiler::endStage(ProfileStage stage, uint32_t startCycles) {
+  uint32_t cycles = ESP.getCycleCount() - startCycles;
+  StageStats &s = stages[stage];
+
+  currentCycles[stage] += cycles;
+  if (cycles < s.minCycles) s.minCycles = cycles;
+  if (cycles > s.maxCycles) s.maxCycles = cycles;
+  s.sumCycles += cycles;
+  s.count++;
+
+  uint32_t us = cycles / ESP.getCpuFreqMHz();
+  s.ring[s.ringHead] = us > 0xFFFF ? 0xFFFF : us;
+  s.ringHead = (s.ringHead + 1) % PROFILER_RING_SIZE;
+  if (s.ringCount < PROFILER_RING_SIZE) s.ringCount++;
+}
+
+void LoopProfiler::endLoop() {
+  uint32_t loopUs = (ESP.getCycleCount() - loopStartCycles) / ESP.getCpuFreqMHz();
+  saveInFlight(PROF_NO_STAGE);
+
+  if (loopUs < (uint32_t)PROFILER_STALL_MS * 1000) return;
+
+  stallCount++;
+  lastStall.magic = PROFILER_RTC_MAGIC;
+  lastStall.sequence = loopCount;
+  lastStall.uptimeMs = loopStartMs;
+  lastStall.loopMicros = loopUs;
+  lastStall.activeStage = PROF_NO_STAGE;
+  lastStall.watchdog = 0;
+  lastStall.resetReason = 0;
+  for (uint8_t i = 0; i < PROF_STAGE_COUNT; i++) {
+    lastStall.stageMicros[i] = currentCycles[i] / ESP.getCpuFreqMHz();
+  }
+  hasStall = true;
+  saveStall();
+}
+
+bool LoopProfiler::getLastStall(StallReport &report) {
+  if (!hasStall) return false;
+  report = lastStall;
+  return true;
+}
+
+void LoopProfiler::getStageSummary(ProfileStage stage, uint32_t &count, uint32_t &minUs,
+                                   uint32_t &avgUs, uint32_t &maxUs, uint32_t &p99Us) {
+  StageStats &s = stages[stage];
+  uint32_t mhz = ESP.getCpuFreqMHz();
+
+  count = s.count;
+  if (s.count == 0) {
+    minUs = avgUs = maxUs = p99Us = 0;
+    return;
+  }
+  minUs = s.minCycles / mhz;
+  maxUs = s.maxCycles / mhz;
+  avgUs = (uint32_t)(s.sumCycles / s.count) / mhz;
+
+  // Insertion sort of a copy; the ring is small and this only runs on request
+  uint16_t sorted[PROFILER_RING_SIZE];
+  uint8_t n = s.ringCount;
+  for (uint8_t i = 0; i < n; i++) {
+    uint16_t v = s.ring[i];
+    int8_t j = i - 1;
+    while (j >= 0 && sorted[j] > v) {
+      sorted[j + 1] = sorted[j];
+      j--;
+    }
+    sorted[j + 1] = v;
+  }
+  uint8_t index = (uint8_t)(((uint16_t)n * 99 + 99) / 100) - 1;
+  p99Us = sorted[index];
+}
+
+// In ProfileStage order
+static const char STAGE_NAMES[PROF_STAGE_COUNT][21] PROGMEM = {
+  "handleClient", "ota", "ntpSync", "wifiConnect", "stateLog", "shouldActivateLights",
+  "relayUpdate", "forecastShare", "zones", "mqtt", "inputTrace",
+};
+
+FlashName LoopProfiler::stageName(uint8_t stage) {
+  return flashName(STAGE_NAMES, stage, PSTR("none"));
+}
@@ -0,0 +1,101 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+#include "flash_string.h"
+
+#define PROFILER_RING_SIZE 64      // Samples kept per stage for percentiles
+#define PROFILER_STALL_MS 2000     // Loop iterations slower than this are reported
+#define PROFILER_RTC_OFFSET 32     // RTC user memory block; 0-31 belong to the OTA bootloader
+#define PROFILER_RTC_STALL_OFFSET (PROFILER_RTC_OFFSET + sizeof(InFlightMarker) / 4)
+#define PROFILER_RTC_MAGIC 0x50524F4A   // Bumped whenever StallReport changes shape
+
+enum ProfileStage {
+  PROF_HANDLE_CLIENT = 0,
+  PROF_OTA,
+  PROF_NTP_SYNC,
+  PROF_WIFI_CONNECT,
+  PROF_STATE_LOG,
+  PROF_DECISION,
+  PROF_RELAY_UPDATE,
+  PROF_FORECAST_SHARE,
+  PROF_ZONES,
+  PROF_MQTT,
+  PROF_INPUT_TRACE,
+  PROF_STAGE_COUNT
+};
+
+#define PROF_NO_STAGE 0xFF
+
+struct StageStats {
+  uint32_t minCycles;
+  uint32_t maxCycles;
+  uint64_t sumCycles;
+  uint32_t count;
+  uint16_t ring[PROFILER_RING_SIZE]; // Recent samples in microseconds, saturating
+  uint8_t ringHead;
+  uint8_t ringCount;
+};
+
+// Written to RTC memory at every stage boundary; cheap enough to leave on
+struct InFlightMarker {
+  uint32_t magic;
+  uint32_t sequence;
+  uint32_t uptimeMs;
+  uint32_t activeStage;
+};
+
+// Kept in RTC memory so it survives a watchdog reset
+struct StallReport {
+  uint32_t magic;
+  uint32_t sequence;                     // Loop iteration the report belongs to
+  uint32_t uptimeMs;                     // millis() at the start of that iteration
+  uint32_t loopMicros;                   // 0 when the iteration never finished
+  uint32_t stageMicros[PROF_STAGE_COUNT];
+  uint8_t activeStage;                   // Stage running when the report was taken
+  uint8_t watchdog;                      // 1 if recovered after a watchdog/exception reset
+  uint8_t resetReason;
+  uint8_t reserved;
+};
+
+class LoopProfiler {
+private:
+  StageStats stages[PROF_STAGE_COUNT];
+  uint32_t currentCycles[PROF_STAGE_COUNT];
+  uint32_t loopStartCycles;
+  uint32_t loopStartMs;
+  uint32_t loopCount;
+  uint32_t stallCount;
+  StallReport lastStall;
+  bool hasStall;
+
+  void saveInFlight(uint8_t stage);
+  void saveStall();
+
+public:
+  LoopProfiler();
+
+  // Recovers an in-flight marker left behind by a watchdog reset
+  void begin();
+
+  void beginLoop();
+  uint32_t beginStage(ProfileStage stage);
+  void endStage(ProfileStage stage, uint32_t startCycles);
+  void endLoop();
+
+  void reset();
+
+  uint32_t getLoopCount() { return loopCount; }
+  uint32_t getStallCount() { return stallCount; }
+  bool getLastStall(StallReport &report);
+
+  // Summary in microseconds; p99 is taken over the recent sample ring
+  void getStageSummary(ProfileStage stage, uint32_t &count, uint32_t &minUs,
+                       uint32_t &avgUs, uint32_t &maxUs, uint32_t &p99Us);
+
+  static FlashName stageName(uint8_t stage);
+};
+
+extern LoopProfiler profiler;
+
+#endif
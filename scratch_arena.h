@@ -0,0 +1,140 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <Arduino.h>
+#include <stdarg.h>
+
+#define SCRATCH_ALIGN 4
+
+// Bump allocator over a fixed buffer. Everything handed out lives until the
+// next reset(), which the main loop does before each request is handled.
+class ScratchArena {
+private:
+  char *base;
+  size_t capacity;
+  size_t used;
+  size_t highWater;
+  uint32_t overflowCount;
+
+public:
+  ScratchArena(char *buf, size_t size) : base(buf), capacity(size), used(0), highWater(0), overflowCount(0) {}
+
+  void reset() {
+    used = 0;
+  }
+
+  void *alloc(size_t size) {
+    size_t start = (used + SCRATCH_ALIGN - 1) & ~(size_t)(SCRATCH_ALIGN - 1);
+    if (start + size > capacity) {
+      overflowCount++;
+      return NULL;
+    }
+    used = start + size;
+    if (used > highWater) highWater = used;
+    return base + start;
+  }
+
+  // Free tail of the arena, for writers that don't know their final size yet
+  char *tail(size_t &available) {
+    size_t start = (used + SCRATCH_ALIGN - 1) & ~(size_t)(SCRATCH_ALIGN - 1);
+    available = start < capacity ? capacity - start : 0;
+    return base + start;
+  }
+
+  // Claims the first `size` bytes of the current tail
+  void commitTail(size_t size) {
+    alloc(size);
+  }
+
+  void noteOverflow() {
+    overflowCount++;
+  }
+
+  size_t getCapacity() { return capacity; }
+  size_t getUsed() { return used; }
+  size_t getHighWater() { return highWater; }
+  uint32_t getOverflowCount() { return overflowCount; }
+};
+
+// snprintf-style builder writing into the arena tail. Only one writer may be
+// open at a time and nothing else may allocate from the arena until it is done.
+class ScratchWriter {
+private:
+  ScratchArena &arena;
+  char *start;
+  size_t cap;
+  size_t len;
+  bool overflow;
+  bool finished;
+
+  // Counts what a vsnprintf into the tail wrote, or marks the overflow
+  void add(int n) {
+    if (n < 0 || len + n >= cap) {
+      overflow = true;
+      start[len] = 0;
+      return;
+    }
+    len += n;
+  }
+
+public:
+  ScratchWriter(ScratchArena &a) : arena(a), len(0), overflow(false), finished(false) {
+    start = arena.tail(cap);
+    if (cap > 0) start[0] = 0;
+  }
+
+  ~ScratchWriter() {
+    finish();
+  }
+
+  void printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+    if (overflow || cap == 0) return;
+    va_list args;
+    va_start(args, fmt);
+    add(vsnprintf(start + len, cap - len, fmt, args));
+    va_end(args);
+  }
+
+  // printf with a PSTR format, so the format stays in flash
+  void printf_P(PGM_P fmt, ...) {
+    if (overflow || cap == 0) return;
+    va_list args;
+    va_start(args, fmt);
+    add(vsnprintf_P(start + len, cap - len, fmt, args));
+    va_end(args);
+  }
+
+  void append(const char *s) {
+    printf("%s", s);
+  }
+
+  // Appends a quoted JSON string, escaping quotes, backslashes and control characters
+  void jsonString(const char *s) {
+    printf("\"");
+    for (; *s && !overflow; s++) {
+      char c = *s;
+      if (c == '"' || c == '\\') {
+        printf("\\%c", c);
+      } else if ((uint8_t)c < 0x20) {
+        printf("\\u%04x", (uint8_t)c);
+      } else {
+        printf("%c", c);
+      }
+    }
+    printf("\"");
+  }
+
+  void finish() {
+    if (finished) return;
+    finished = true;
+    if (overflow) arena.noteOverflow();
+    if (cap > 0) arena.commitTail(len + 1);
+  }
+
+  const char *c_str() { return cap > 0 ? start : ""; }
+  size_t length() { return len; }
+  size_t remaining() { return cap > len ? cap - len - 1 : 0; }
+  bool overflowed() { return overflow; }
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include "session.h"
+#include "hmac.h"
+#include <bearssl/bearssl.h>
+
+static uint8_t bootSecret[HMAC_SHA256_SIZE];
+static uint8_t credentialDigest[HMAC_SHA256_SIZE];
+static bool keyed = false;
+// The HMAC key's padded states, so a check only hashes the token
+static br_hmac_key_context keyContext;
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+static void tokenMac(const char *expiryHex, uint8_t mac[HMAC_SHA256_SIZE]) {
+  br_hmac_context context;
+  br_hmac_init(&context, &keyContext, 0);
+  br_hmac_update(&context, expiryHex, 8);
+  br_hmac_out(&context, mac);
+}
+
+void sessionBegin() {
+  ESP.random(bootSecret, sizeof(bootSecret));
+  keyed = false;
+}
+
+void sessionSetCredentials(const char *username, const char *password) {
+  uint8_t material[64];
+  size_t userLen = strnlen(username, 31);
+  size_t passLen = strnlen(password, 31);
+  memcpy(material, username, userLen);
+  material[userLen] = 0;
+  memcpy(material + userLen + 1, password, passLen);
+
+  uint8_t digest[HMAC_SHA256_SIZE];
+  hmacSha256(bootSecret, sizeof(bootSecret), material, userLen + 1 + passLen, digest);
+  if (keyed && memcmp(digest, credentialDigest, sizeof(digest)) == 0) return;
+  memcpy(credentialDigest, digest, sizeof(digest));
+  br_hmac_key_init(&keyContext, &br_sha256_vtable, digest, sizeof(digest));
+  keyed = true;
+}
+
+void sessionIssue(uint32_t nowSec, char token[SESSION_TOKEN_LEN + 1]) {
+  snprintf_P(token, 9, PSTR("%08x"), (unsigned)(nowSec + SESSION_LIFETIME_S));
+  uint8_t mac[HMAC_SHA256_SIZE];
+  tokenMac(token, mac);
+  for (int i = 0; i < SESSION_MAC_SIZE; i++) {
+    token[8 + 2 * i] = HEX_DIGITS[mac[i] >> 4];
+    token[9 + 2 * i] = HEX_DIGITS[mac[i] & 0x0F];
+  }
+  token[SESSION_TOKEN_LEN] = 0;
+}
+
+bool sessionTokenValid(const char *token, size_t len, uint32_t nowSec) {
+  if (!keyed || len != SESSION_TOKEN_LEN) return false;
+
+  uint32_t expiry = 0;
+  for (int i = 0; i < 8; i++) {
+    int v = hexValue(token[i]);
+    if (v < 0) return false;
+    expiry = (expiry << 4) | v;
+  }
+  // Tokens that straddle the 49-day millis() wrap fail here, costing one login
+  int32_t left = (int32_t)(expiry - nowSec);
+  if (left <= 0 || (uint32_t)left > SESSION_LIFETIME_S) return false;
+
+  uint8_t presented[SESSION_MAC_SIZE];
+  for (int i = 0; i < SESSION_MAC_SIZE; i++) {
+    int hi = hexValue(token[8 + 2 * i]);
+    int lo = hexValue(token[9 + 2 * i]);
+    if (hi < 0 || lo < 0) return false;
+    presented[i] = (hi << 4) | lo;
+  }
+  uint8_t mac[HMAC_SHA256_SIZE];
+  tokenMac(token, mac);
+  return digestEqual(mac, presented, SESSION_MAC_SIZE);
+}
+
+bool sessionCookieValid(const char *cookies, uint32_t nowSec) {
+  static const size_t nameLen = sizeof(SESSION_COOKIE_NAME) - 1;
+  const char *p = cookies;
+  while (p != NULL && *p) {
+    while (*p == ' ') p++;
+    const char *end = strchr(p, ';');
+    size_t len = end ? (size_t)(end - p) : strlen(p);
+    if (len > nameLen && strncmp(p, SESSION_COOKIE_NAME, nameLen) == 0 && p[nameLen] == '=') {
+      return sessionTokenValid(p + nameLen + 1, len - nameLen - 1, nowSec);
+    }
+    p = end ? end + 1 : NULL;
+  }
+  return false;
+}
@@ -0,0 +1,30 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+// Signed session cookies. A token is its expiry (seconds of uptime, hex)
+// followed by an HMAC over it, so checking one costs a MAC and no stored
+// state or allocations. The key is derived from a secret drawn at boot and
+// the admin credentials: a reboot or a credential change ends every session.
+
+#include <Arduino.h>
+
+#define SESSION_COOKIE_NAME "session"
+#define SESSION_LIFETIME_S (12UL * 60 * 60)
+#define SESSION_MAC_SIZE 16     // HMAC-SHA256 truncated to 128 bits, as forecast frames are
+#define SESSION_TOKEN_LEN (8 + 2 * SESSION_MAC_SIZE)
+
+// Draws the boot secret; call once before sessionSetCredentials()
+void sessionBegin();
+
+// Re-keys when the credentials differ from the ones the key was made with
+void sessionSetCredentials(const char *username, const char *password);
+
+// Writes SESSION_TOKEN_LEN characters and a terminator
+void sessionIssue(uint32_t nowSec, char token[SESSION_TOKEN_LEN + 1]);
+
+bool sessionTokenValid(const char *token, size_t len, uint32_t nowSec);
+
+// Finds the session cookie in a Cookie header value and checks it
+bool sessionCookieValid(const char *cookies, uint32_t nowSec);
+
+#endif
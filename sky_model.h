@@ -0,0 +1,87 @@
+#ifndef SKY_MODEL_H
+#define SKY_MODEL_H
+
+// How dark the sky gets, estimated from the forecast's cloud layers,
+// precipitation and radiation rather than total cloud cover alone: low cloud
+// and rain block far more daylight than high cirrus.
+
+#include <math.h>
+#include <stdint.h>
+
+// Share of daylight a layer blocks at 100% cover
+#define SKY_BLOCK_LOW 1.0f
+#define SKY_BLOCK_MID 0.8f
+#define SKY_BLOCK_HIGH 0.3f
+#define SKY_RAIN_MM_HALVES 1.0f           // Precipitation (mm/h) that halves what gets through
+#define SKY_RADIATION_MIN_WM2 100.0f      // Clear-sky radiation below which forecast radiation is ignored
+#define SKY_LUMINOUS_EFFICACY 110.0f      // Lux per W/m² of daylight
+
+// One forecast hour; each value is negative when the forecast lacks it
+struct ForecastHour {
+  float cloudCover;      // Percent
+  float cloudLow;
+  float cloudMid;
+  float cloudHigh;
+  float radiation;       // Shortwave, W/m²
+  float precipitation;   // mm
+};
+
+// Solar elevation in degrees (NOAA approximation, within a few tenths of a degree)
+inline float solarElevation(uint32_t utcEpoch, float latitude, float longitude) {
+  const float rad = (float)M_PI / 180.0f;
+  float days = (utcEpoch % 31557600UL) / 86400.0f;          // Into the (Julian) year
+  float gamma = 2.0f * (float)M_PI / 365.25f * days;
+  float declination = 0.006918f - 0.399912f * cosf(gamma) + 0.070257f * sinf(gamma) -
+                      0.006758f * cosf(2 * gamma) + 0.000907f * sinf(2 * gamma);
+  float equationMin = 229.18f * (0.000075f + 0.001868f * cosf(gamma) - 0.032077f * sinf(gamma) -
+                                 0.014615f * cosf(2 * gamma) - 0.040849f * sinf(2 * gamma));
+  float utcMin = (utcEpoch % 86400UL) / 60.0f;
+  float hourAngle = ((utcMin + equationMin + 4.0f * longitude) / 4.0f - 180.0f) * rad;
+  float sinElevation = sinf(latitude * rad) * sinf(declination) +
+                       cosf(latitude * rad) * cosf(declination) * cosf(hourAngle);
+  return asinf(sinElevation) / rad;
+}
+
+// Haurwitz clear-sky global radiation, W/m²
+inline float clearSkyRadiation(float elevationDeg) {
+  if (elevationDeg <= 0) return 0;
+  float s = sinf(elevationDeg * (float)M_PI / 180.0f);
+  return 1098.0f * s * expf(-0.057f / s);
+}
+
+// Fraction of clear-sky daylight expected to reach the ground, or a negative
+// value when the hour has no cloud data
+inline float skyLightFraction(const ForecastHour &h, float elevationDeg) {
+  float light;
+  if (h.cloudLow >= 0 && h.cloudMid >= 0 && h.cloudHigh >= 0) {
+    light = (1 - SKY_BLOCK_LOW * h.cloudLow / 100) * (1 - SKY_BLOCK_MID * h.cloudMid / 100) *
+            (1 - SKY_BLOCK_HIGH * h.cloudHigh / 100);
+  } else if (h.cloudCover >= 0) {
+    light = 1 - h.cloudCover / 100;
+  } else {
+    return -1;
+  }
+  if (h.precipitation > 0) light /= 1 + h.precipitation / SKY_RAIN_MM_HALVES;
+
+  // With the sun well up, the radiation forecast is a second opinion
+  float clear = clearSkyRadiation(elevationDeg);
+  if (h.radiation >= 0 && clear >= SKY_RADIATION_MIN_WM2) {
+    float ratio = h.radiation / clear;
+    light = (light + (ratio > 1 ? 1 : ratio)) / 2;
+  }
+  return light < 0 ? 0 : light > 1 ? 1 : light;
+}
+
+// Darkness on the cloud cover scale, so the existing threshold and
+// hysteresis apply: full low overcast reads 100, full cirrus 30
+inline float effectiveCloudCover(const ForecastHour &h, float elevationDeg) {
+  float light = skyLightFraction(h, elevationDeg);
+  return light < 0 ? -1 : 100 * (1 - light);
+}
+
+inline float estimateIlluminance(const ForecastHour &h, float elevationDeg) {
+  float light = skyLightFraction(h, elevationDeg);
+  return light < 0 ? -1 : clearSkyRadiation(elevationDeg) * SKY_LUMINOUS_EFFICACY * light;
+}
+
+#endif
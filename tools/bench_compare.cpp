@@ -0,0 +1,85 @@
+// Compares two /api/bench results and flags cases that got slower.
+//
+// Build: g++ -O2 -std=c++11 -o bench_compare tools/bench_compare.cpp
+// Usage: host_bench > current.json
+//        (or on the device: curl -u admin:admin http://<device>/api/bench > current.json)
+//        bench_compare baseline.json current.json [threshold_percent]
+//
+// Exits with 1 if any case's average cycle count grew by more than the
+// threshold (default 10%), or if a case disappeared from the current run.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+
+static bool readFile(const char *path, std::string &out) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return false;
+  char chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) out.append(chunk, n);
+  fclose(f);
+  return true;
+}
+
+// Average cycles per case; cases reported with an error are skipped
+static std::map<std::string, double> parseResults(const std::string &json) {
+  std::map<std::string, double> results;
+  size_t pos = 0;
+  while ((pos = json.find("\"name\":\"", pos)) != std::string::npos) {
+    pos += 8;
+    size_t nameEnd = json.find('"', pos);
+    size_t objectEnd = json.find('}', pos);
+    if (nameEnd == std::string::npos || objectEnd == std::string::npos) break;
+
+    std::string name = json.substr(pos, nameEnd - pos);
+    size_t avg = json.find("\"avgCycles\":", nameEnd);
+    if (avg != std::string::npos && avg < objectEnd) {
+      results[name] = atof(json.c_str() + avg + 12);
+    }
+    pos = objectEnd;
+  }
+  return results;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: bench_compare baseline.json current.json [threshold_percent]\n");
+    return 2;
+  }
+  double threshold = argc > 3 ? atof(argv[3]) : 10.0;
+
+  std::string baselineJson, currentJson;
+  if (!readFile(argv[1], baselineJson) || !readFile(argv[2], currentJson)) {
+    fprintf(stderr, "could not read input files\n");
+    return 2;
+  }
+
+  std::map<std::string, double> baseline = parseResults(baselineJson);
+  std::map<std::string, double> current = parseResults(currentJson);
+  bool regressed = false;
+
+  printf("%-22s %14s %14s %9s\n", "case", "baseline", "current", "change");
+  for (const auto &entry : baseline) {
+    auto it = current.find(entry.first);
+    if (it == current.end()) {
+      printf("%-22s %14.0f %14s %9s  MISSING\n", entry.first.c_str(), entry.second, "-", "-");
+      regressed = true;
+      continue;
+    }
+    double change = entry.second > 0 ? (it->second - entry.second) * 100.0 / entry.second : 0;
+    bool slower = change > threshold;
+    printf("%-22s %14.0f %14.0f %+8.1f%%%s\n", entry.first.c_str(), entry.second, it->second,
+           change, slower ? "  REGRESSION" : "");
+    regressed = regressed || slower;
+  }
+  for (const auto &entry : current) {
+    if (baseline.find(entry.first) == baseline.end()) {
+      printf("%-22s %14s %14.0f %9s  NEW\n", entry.first.c_str(), "-", entry.second, "-");
+    }
+  }
+
+  return regressed ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+#ifndef CLOUD_SERIES_H
+#define CLOUD_SERIES_H
+
+// Cloud coverage history for the host tools. Reads either "epoch,coverage"
+// CSV lines (archived Open-Meteo series) or the JSON array returned by the
+// device's /api/logs?type=cloud.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define CLOUD_SAMPLE_MAX_AGE 7200   // Seconds a sample stays valid without a newer one
+
+struct CloudSample {
+  long epoch;
+  float coverage;
+};
+
+class CloudSeries {
+private:
+  std::vector<CloudSample> samples;
+
+  void parseCsv(const std::string &text) {
+    const char *p = text.c_str();
+    while (*p) {
+      char *end;
+      long epoch = strtol(p, &end, 10);
+      if (end != p && *end == ',') {
+        float coverage = strtof(end + 1, &end);
+        samples.push_back({ epoch, coverage });
+      }
+      p = strchr(end, '\n');
+      if (p == NULL) break;
+      p++;
+    }
+  }
+
+  void parseLogJson(const std::string &text) {
+    size_t pos = 0;
+    while ((pos = text.find("\"time\":", pos)) != std::string::npos) {
+      long epoch = strtol(text.c_str() + pos + 7, NULL, 10);
+      size_t value = text.find("\"value\":", pos);
+      if (value == std::string::npos) break;
+      samples.push_back({ epoch, strtof(text.c_str() + value + 8, NULL) });
+      pos = value;
+    }
+  }
+
+public:
+  bool load(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    std::string text;
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) text.append(chunk, n);
+    fclose(f);
+
+    size_t first = text.find_first_not_of(" \t\r\n");
+    if (first != std::string::npos && text[first] == '[') {
+      parseLogJson(text);
+    } else {
+      parseCsv(text);
+    }
+    finish();
+    return !samples.empty();
+  }
+
+  void add(long epoch, float coverage) {
+    samples.push_back({ epoch, coverage });
+  }
+
+  // Hourly random walk for trying the tools without recorded history
+  void generate(long startEpoch, int days, unsigned seed) {
+    unsigned state = seed;
+    float coverage = 50;
+    for (long t = startEpoch; t < startEpoch + (long)days * 86400; t += 3600) {
+      state = state * 1103515245u + 12345u;
+      coverage += ((int)(((state >> 8) & 0xFFFFFF) % 41) - 20) * 0.75f;
+      if (coverage < 0) coverage = 0;
+      if (coverage > 100) coverage = 100;
+      samples.push_back({ t, coverage });
+    }
+    finish();
+  }
+
+  // Call after add(); lookups need the samples in time order
+  void finish() {
+    std::stable_sort(samples.begin(), samples.end(),
+                     [](const CloudSample &a, const CloudSample &b) { return a.epoch < b.epoch; });
+  }
+
+  bool empty() const { return samples.empty(); }
+  long firstEpoch() const { return samples.front().epoch; }
+  long lastEpoch() const { return samples.back().epoch; }
+
+  // Latest sample at or before `epoch`, or -1 if there is none recent enough.
+  // `cursor` is caller state so each replay can walk forward without searching.
+  float at(long epoch, size_t &cursor) const {
+    if (cursor >= samples.size() || samples[cursor].epoch > epoch) cursor = 0;
+    while (cursor + 1 < samples.size() && samples[cursor + 1].epoch <= epoch) cursor++;
+    if (samples.empty() || samples[cursor].epoch > epoch) return -1;
+    if (epoch - samples[cursor].epoch > CLOUD_SAMPLE_MAX_AGE) return -1;
+    return samples[cursor].coverage;
+  }
+};
+
+#endif
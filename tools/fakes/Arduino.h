@@ -0,0 +1,90 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+// The parts of the ESP8266 Arduino core the sketch uses, for the host build.
+// millis() and micros() are 32-bit as on the device, so they wrap after 49.7
+// days and 71.6 minutes; values the sketch keeps in `unsigned long` are 64
+// bits here, so a difference taken across the wrap in one of those is off
+// once. See fake_host.h for the controls.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "pgmspace.h"
+#include "WString.h"
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x00
+#define OUTPUT 0x01
+#define INPUT_PULLUP 0x02
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+using std::max;
+using std::min;
+
+uint32_t millis();
+uint32_t micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+class HardwareSerial {
+public:
+  void begin(unsigned long baud);
+  int availableForWrite() { return 128; }   // The UART FIFO
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t write(const uint8_t *data, size_t len);
+  size_t print(const char *s) { return write(s); }
+  size_t println(const char *s = "") { return write(s) + write("\r\n"); }
+};
+
+extern HardwareSerial Serial;
+
+#define WDTO_8S 8000
+
+struct rst_info;
+
+// Heap figures are fixed; the host has no 80 KB heap to report on. Cycles
+// are host nanoseconds, hence the 1000 MHz.
+class EspClass {
+public:
+  void wdtEnable(uint32_t timeoutMs = 0) { (void)timeoutMs; }
+  void wdtDisable() {}
+  void wdtFeed() {}
+  void restart();
+
+  uint32_t getChipId() { return 0x00C0FFEE; }
+  uint32_t getFreeHeap() { return 40000; }
+  uint8_t getHeapFragmentation() { return 5; }
+  uint32_t getMaxFreeBlockSize() { return 36000; }
+  uint32_t getCpuFreqMHz() { return 1000; }
+  uint32_t getCycleCount();
+  struct rst_info *getResetInfoPtr();
+
+  bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size);
+  bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size);
+  uint8_t *random(uint8_t *result, size_t length);
+  uint32_t random();
+};
+
+extern EspClass ESP;
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef ARDUINOOTA_H
+#define ARDUINOOTA_H
+
+// No uploads arrive on the host
+
+#include <stdint.h>
+
+class ArduinoOTAClass {
+public:
+  void setHostname(const char *hostname) { (void)hostname; }
+  void setPassword(const char *password) { (void)password; }
+  void setPort(uint16_t port) { (void)port; }
+  void begin(bool useMDNS = true) { (void)useMDNS; }
+  void handle() {}
+};
+
+extern ArduinoOTAClass ArduinoOTA;
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef EEPROM_H
+#define EEPROM_H
+
+// The ESP8266 EEPROM emulation: begin() copies the flash sector into RAM and
+// commit() writes it back, here to the file given to fakeEepromFile(). As on
+// the device, begin() again drops changes that were not committed.
+
+#include <Arduino.h>
+#include <vector>
+
+class EEPROMClass {
+private:
+  std::vector<uint8_t> data;
+  bool dirty = false;
+
+public:
+  void begin(size_t size);
+  bool commit();
+  bool end();
+
+  uint8_t read(int address) { return address >= 0 && (size_t)address < data.size() ? data[address] : 0; }
+  void write(int address, uint8_t value) {
+    if (address < 0 || (size_t)address >= data.size() || data[address] == value) return;
+    data[address] = value;
+    dirty = true;
+  }
+
+  template <typename T>
+  T &get(int address, T &value) {
+    if (address >= 0 && address + sizeof(T) <= data.size()) memcpy((void *)&value, &data[address], sizeof(T));
+    return value;
+  }
+
+  template <typename T>
+  const T &put(int address, const T &value) {
+    if (address >= 0 && address + sizeof(T) <= data.size()) {
+      memcpy(&data[address], (const void *)&value, sizeof(T));
+      dirty = true;
+    }
+    return value;
+  }
+
+  size_t length() { return data.size(); }
+  uint8_t *getDataPtr() { dirty = true; return data.data(); }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef ESP8266WIFI_H
+#define ESP8266WIFI_H
+
+// Station mode only. WiFi.begin() connects at once when fakeWifiUp() allows
+// it; nothing is scanned or negotiated.
+
+#include <Arduino.h>
+#include "IPAddress.h"
+#include "WiFiClient.h"
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } WiFiMode_t;
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+class ESP8266WiFiClass {
+private:
+  bool started = false;
+
+public:
+  bool mode(WiFiMode_t m) { (void)m; return true; }
+  wl_status_t begin(const char *ssid, const char *passphrase = NULL) {
+    (void)ssid;
+    (void)passphrase;
+    started = true;
+    return status();
+  }
+  bool disconnect(bool wifiOff = false) { (void)wifiOff; started = false; return true; }
+  bool setAutoReconnect(bool autoReconnect) { (void)autoReconnect; return true; }
+  void persistent(bool persistent) { (void)persistent; }
+
+  wl_status_t status();
+  IPAddress localIP();
+  int32_t RSSI();
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif
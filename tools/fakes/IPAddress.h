@@ -0,0 +1,43 @@
+#ifndef IPADDRESS_H
+#define IPADDRESS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "WString.h"
+
+class IPAddress {
+private:
+  uint8_t bytes[4];
+
+public:
+  IPAddress() : bytes{ 0, 0, 0, 0 } {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{ a, b, c, d } {}
+  IPAddress(uint32_t address) { fromNetworkOrder(address); }   // As lwIP stores it
+
+  bool fromString(const char *address) {
+    unsigned a, b, c, d;
+    char extra;
+    if (sscanf(address, "%u.%u.%u.%u%c", &a, &b, &c, &d, &extra) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+      return false;
+    }
+    *this = IPAddress(a, b, c, d);
+    return true;
+  }
+
+  uint8_t operator[](int index) const { return bytes[index]; }
+  uint8_t &operator[](int index) { return bytes[index]; }
+  operator uint32_t() const { return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24; }
+
+  String toString() const {
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+    return String(text);
+  }
+
+private:
+  void fromNetworkOrder(uint32_t address) {
+    for (int i = 0; i < 4; i++) bytes[i] = address >> (8 * i);
+  }
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef NTPCLIENT_H
+#define NTPCLIENT_H
+
+// The NTPClient library's polling: update() syncs once per interval and
+// returns false in between. A sync answers with fakeEpoch() while WiFi is up
+// and times out after a second otherwise.
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+class NTPClient {
+private:
+  long timeOffset;
+  uint32_t updateInterval;
+  uint32_t currentEpoch;
+  uint32_t lastUpdate;
+
+public:
+  NTPClient(WiFiUDP &udp, const char *poolServerName, long offset = 0, unsigned long intervalMs = 60000)
+      : timeOffset(offset), updateInterval(intervalMs), currentEpoch(0), lastUpdate(0) {
+    (void)udp;
+    (void)poolServerName;
+  }
+
+  void begin() {}
+  void end() {}
+  bool update();
+  bool forceUpdate();
+  bool isTimeSet() const { return lastUpdate != 0; }
+
+  void setTimeOffset(int offset) { timeOffset = offset; }
+  void setUpdateInterval(unsigned long intervalMs) { updateInterval = intervalMs; }
+
+  unsigned long getEpochTime() const;
+  int getDay() const { return ((getEpochTime() / 86400L) + 4) % 7; }
+  int getHours() const { return (getEpochTime() % 86400L) / 3600; }
+  int getMinutes() const { return (getEpochTime() % 3600) / 60; }
+  int getSeconds() const { return getEpochTime() % 60; }
+  String getFormattedTime() const;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef WSTRING_H
+#define WSTRING_H
+
+// Arduino's String over std::string, with the members the sketch and its
+// modules call.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+class String {
+private:
+  std::string text;
+
+public:
+  String(const char *cstr = "") : text(cstr ? cstr : "") {}
+  String(const std::string &s) : text(s) {}
+  explicit String(char c) : text(1, c) {}
+  explicit String(int value) : text(std::to_string(value)) {}
+  explicit String(unsigned int value) : text(std::to_string(value)) {}
+  explicit String(long value) : text(std::to_string(value)) {}
+  explicit String(unsigned long value) : text(std::to_string(value)) {}
+  explicit String(float value, unsigned char decimals = 2) { format(value, decimals); }
+  explicit String(double value, unsigned char decimals = 2) { format(value, decimals); }
+
+  const char *c_str() const { return text.c_str(); }
+  unsigned int length() const { return text.length(); }
+  bool isEmpty() const { return text.empty(); }
+  bool reserve(unsigned int size) { text.reserve(size); return true; }
+  char operator[](unsigned int index) const { return index < text.size() ? text[index] : 0; }
+  char charAt(unsigned int index) const { return (*this)[index]; }
+
+  long toInt() const { return atol(text.c_str()); }
+  float toFloat() const { return (float)atof(text.c_str()); }
+
+  bool equals(const String &s) const { return text == s.text; }
+  bool equals(const char *s) const { return text == (s ? s : ""); }
+  bool operator==(const String &s) const { return equals(s); }
+  bool operator==(const char *s) const { return equals(s); }
+  bool operator!=(const String &s) const { return !equals(s); }
+  bool operator!=(const char *s) const { return !equals(s); }
+  bool startsWith(const String &prefix) const { return text.compare(0, prefix.text.size(), prefix.text) == 0; }
+  bool endsWith(const String &suffix) const {
+    return text.size() >= suffix.text.size() &&
+           text.compare(text.size() - suffix.text.size(), suffix.text.size(), suffix.text) == 0;
+  }
+
+  int indexOf(char c, unsigned int from = 0) const {
+    size_t at = text.find(c, from);
+    return at == std::string::npos ? -1 : (int)at;
+  }
+  int indexOf(const String &s, unsigned int from = 0) const {
+    size_t at = text.find(s.text, from);
+    return at == std::string::npos ? -1 : (int)at;
+  }
+  String substring(unsigned int from) const { return from < text.size() ? String(text.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    return from < to && from < text.size() ? String(text.substr(from, to - from)) : String();
+  }
+
+  bool concat(const String &s) { text += s.text; return true; }
+  bool concat(const char *s) { text += s ? s : ""; return true; }
+  bool concat(char c) { text += c; return true; }
+  String &operator+=(const String &s) { concat(s); return *this; }
+  String &operator+=(const char *s) { concat(s); return *this; }
+  String &operator+=(char c) { concat(c); return *this; }
+
+private:
+  void format(double value, unsigned char decimals) {
+    char buf[40];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+    text = buf;
+  }
+};
+
+inline String operator+(const String &a, const String &b) { String s(a); s += b; return s; }
+inline String operator+(const String &a, const char *b) { String s(a); s += b; return s; }
+inline String operator+(const char *a, const String &b) { String s(a); s += b; return s; }
+inline String operator+(const String &a, char b) { String s(a); s += b; return s; }
+
+#endif
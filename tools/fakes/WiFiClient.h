@@ -0,0 +1,21 @@
+#ifndef WIFICLIENT_H
+#define WIFICLIENT_H
+
+// Nothing is reachable through the blocking client, so connect() always fails
+
+#include <Arduino.h>
+
+class WiFiClient {
+public:
+  void setTimeout(unsigned long timeoutMs) { (void)timeoutMs; }
+  int connect(const char *host, uint16_t port) { (void)host; (void)port; return 0; }
+  void setNoDelay(bool noDelay) { (void)noDelay; }
+  size_t availableForWrite() { return 0; }
+  size_t write(const uint8_t *data, size_t len) { (void)data; (void)len; return 0; }
+  int available() { return 0; }
+  int read() { return -1; }
+  uint8_t connected() { return 0; }
+  void stop() {}
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef WIFIUDP_H
+#define WIFIUDP_H
+
+// Multicast joins and sends succeed and go nowhere; no packet ever arrives
+
+#include <ESP8266WiFi.h>
+
+class WiFiUDP {
+public:
+  uint8_t begin(uint16_t port) { (void)port; return 1; }
+  uint8_t beginMulticast(IPAddress interfaceAddr, IPAddress multicast, uint16_t port) {
+    (void)interfaceAddr;
+    (void)multicast;
+    (void)port;
+    return 1;
+  }
+  void stop() {}
+  int parsePacket() { return 0; }
+  int read(uint8_t *buffer, size_t len) { (void)buffer; (void)len; return 0; }
+  void flush() {}
+  int beginPacketMulticast(IPAddress multicast, uint16_t port, IPAddress interfaceAddr, int ttl = 1) {
+    (void)multicast;
+    (void)port;
+    (void)interfaceAddr;
+    (void)ttl;
+    return 1;
+  }
+  size_t write(const uint8_t *buffer, size_t size) { (void)buffer; return size; }
+  int endPacket() { return 1; }
+};
+
+#endif
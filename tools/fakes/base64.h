@@ -0,0 +1,14 @@
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <Arduino.h>
+
+class base64 {
+public:
+  static String encode(const uint8_t *data, size_t length, bool doNewLines = true);
+  static String encode(const String &text, bool doNewLines = true) {
+    return encode((const uint8_t *)text.c_str(), text.length(), doNewLines);
+  }
+};
+
+#endif
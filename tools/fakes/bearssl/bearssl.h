@@ -0,0 +1,39 @@
+#ifndef BR_BEARSSL_H__
+#define BR_BEARSSL_H__
+
+// HMAC over SHA-256, the only hash the sketch uses, with BearSSL's names
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+  uint32_t state[8];
+  uint64_t count;
+  uint8_t buf[64];
+} br_sha256_context;
+
+typedef struct br_hash_class_ {
+  size_t context_size;
+  uint32_t desc;
+} br_hash_class;
+
+extern const br_hash_class br_sha256_vtable;
+
+typedef struct {
+  const br_hash_class *dig_vtable;
+  br_sha256_context ksi;   // After the inner and outer padded keys
+  br_sha256_context kso;
+} br_hmac_key_context;
+
+typedef struct {
+  br_sha256_context dig;
+  br_sha256_context kso;
+  size_t out_len;
+} br_hmac_context;
+
+void br_hmac_key_init(br_hmac_key_context *kc, const br_hash_class *digest_vtable, const void *key, size_t key_len);
+void br_hmac_init(br_hmac_context *ctx, const br_hmac_key_context *kc, size_t out_len);
+void br_hmac_update(br_hmac_context *ctx, const void *data, size_t len);
+size_t br_hmac_out(const br_hmac_context *ctx, void *out);
+
+#endif
@@ -0,0 +1,152 @@
+#include <Arduino.h>
+#include <ArduinoOTA.h>
+#include <ESP8266WiFi.h>
+#include <base64.h>
+#include <user_interface.h>
+#include <chrono>
+#include "fake_host.h"
+#include "fake_net.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+ESP8266WiFiClass WiFi;
+ArduinoOTAClass ArduinoOTA;
+
+//================ CLOCK ================
+static uint64_t clockUs = 0;
+static int64_t epochAtBoot = 0;
+
+uint64_t fakeMicros() { return clockUs; }
+uint64_t fakeMillis() { return clockUs / 1000; }
+uint32_t millis() { return (uint32_t)(clockUs / 1000); }
+uint32_t micros() { return (uint32_t)clockUs; }
+
+// Network events due meanwhile are delivered at their own time, so a
+// response with latency arrives partway through a long delay
+void fakeAdvance(uint32_t ms) {
+  uint64_t target = clockUs + (uint64_t)ms * 1000;
+  for (;;) {
+    fakeNetRun();
+    uint64_t due = fakeNetNextDue();
+    if (due > target) break;
+    if (due > clockUs) clockUs = due;
+  }
+  clockUs = target;
+  fakeNetRun();
+}
+
+void delay(unsigned long ms) { fakeAdvance(ms); }
+void delayMicroseconds(unsigned int us) { clockUs += us; }
+void yield() { fakeNetRun(); }
+
+void fakeSetEpoch(uint32_t utc) { epochAtBoot = (int64_t)utc - (int64_t)(clockUs / 1000000); }
+uint32_t fakeEpoch() { return (uint32_t)(epochAtBoot + (int64_t)(clockUs / 1000000)); }
+
+//================ GPIO ================
+#define FAKE_PIN_COUNT 17
+
+static uint8_t pinLevels[FAKE_PIN_COUNT];
+static std::vector<FakePinChange> pinChanges;
+
+void pinMode(uint8_t pin, uint8_t mode) { (void)pin; (void)mode; }
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin >= FAKE_PIN_COUNT) return;
+  uint8_t level = value ? HIGH : LOW;
+  if (pinLevels[pin] == level) return;
+  pinLevels[pin] = level;
+  pinChanges.push_back({ fakeMillis(), pin, level });
+}
+
+int digitalRead(uint8_t pin) { return pin < FAKE_PIN_COUNT ? pinLevels[pin] : LOW; }
+
+const std::vector<FakePinChange> &fakePinChanges() { return pinChanges; }
+void fakeClearPinChanges() { pinChanges.clear(); }
+int fakePinLevel(uint8_t pin) { return digitalRead(pin); }
+
+//================ SERIAL ================
+static bool serialEcho = false;
+
+void fakeSerialEcho(bool on) { serialEcho = on; }
+
+void HardwareSerial::begin(unsigned long baud) { (void)baud; }
+
+size_t HardwareSerial::write(const uint8_t *data, size_t len) {
+  if (serialEcho) fwrite(data, 1, len, stderr);
+  return len;
+}
+
+//================ ESP ================
+// Seeded, so runs repeat; session keys are only as secret as the seed
+static uint32_t rngState = 0x2545F491;
+static rst_info resetInfo = { REASON_DEFAULT_RST, 0, 0, 0, 0, 0, 0 };
+static uint32_t rtcUserMemory[128];
+
+static uint32_t nextRandom() {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState;
+}
+
+void fakeResetReason(uint32_t reason) { resetInfo.reason = reason; }
+
+void EspClass::restart() { throw FakeRestart(); }
+
+uint32_t EspClass::getCycleCount() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct rst_info *EspClass::getResetInfoPtr() { return &resetInfo; }
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size) {
+  if (offset * 4 + size > sizeof(rtcUserMemory)) return false;
+  memcpy(data, (uint8_t *)rtcUserMemory + offset * 4, size);
+  return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size) {
+  if (offset * 4 + size > sizeof(rtcUserMemory)) return false;
+  memcpy((uint8_t *)rtcUserMemory + offset * 4, data, size);
+  return true;
+}
+
+uint8_t *EspClass::random(uint8_t *result, size_t length) {
+  for (size_t i = 0; i < length; i++) result[i] = nextRandom() >> 24;
+  return result;
+}
+
+uint32_t EspClass::random() { return nextRandom(); }
+
+long random(long howbig) { return howbig <= 0 ? 0 : (long)(nextRandom() % (uint32_t)howbig); }
+long random(long howsmall, long howbig) { return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall); }
+void randomSeed(unsigned long seed) { rngState = seed ? (uint32_t)seed : 1; }
+
+//================ WIFI ================
+static bool wifiUp = true;
+
+void fakeWifiUp(bool up) { wifiUp = up; }
+
+wl_status_t ESP8266WiFiClass::status() { return started && wifiUp ? WL_CONNECTED : WL_DISCONNECTED; }
+
+IPAddress ESP8266WiFiClass::localIP() { return status() == WL_CONNECTED ? IPAddress(192, 168, 1, 50) : IPAddress(); }
+
+int32_t ESP8266WiFiClass::RSSI() { return status() == WL_CONNECTED ? -60 : 31; }
+
+//================ BASE64 ================
+String base64::encode(const uint8_t *data, size_t length, bool doNewLines) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t n = (uint32_t)data[i] << 16;
+    if (i + 1 < length) n |= (uint32_t)data[i + 1] << 8;
+    if (i + 2 < length) n |= data[i + 2];
+    out += alphabet[(n >> 18) & 63];
+    out += alphabet[(n >> 12) & 63];
+    out += i + 1 < length ? alphabet[(n >> 6) & 63] : '=';
+    out += i + 2 < length ? alphabet[n & 63] : '=';
+    if (doNewLines && (i + 3) % 54 == 0 && i + 3 < length) out += '\n';   // 72 characters a line
+  }
+  return String(out);
+}
@@ -0,0 +1,55 @@
+#include <EEPROM.h>
+#include <string>
+#include "fake_host.h"
+
+#define FAKE_FLASH_SECTOR 4096
+
+EEPROMClass EEPROM;
+
+// The sector the emulation reads and commits, erased until it is loaded
+static uint8_t flashSector[FAKE_FLASH_SECTOR];
+static bool flashLoaded = false;
+static std::string flashPath;
+
+void fakeEepromFile(const char *path) {
+  flashPath = path ? path : "";
+  flashLoaded = false;
+}
+
+static void loadSector() {
+  if (flashLoaded) return;
+  flashLoaded = true;
+  memset(flashSector, 0xFF, sizeof(flashSector));
+  if (flashPath.empty()) return;
+  FILE *f = fopen(flashPath.c_str(), "rb");
+  if (f == NULL) return;
+  size_t n = fread(flashSector, 1, sizeof(flashSector), f);
+  (void)n;
+  fclose(f);
+}
+
+void EEPROMClass::begin(size_t size) {
+  if (size == 0 || size > FAKE_FLASH_SECTOR) return;
+  loadSector();
+  size = (size + 3) & ~3;
+  data.assign(flashSector, flashSector + size);
+  dirty = false;
+}
+
+bool EEPROMClass::commit() {
+  if (data.empty()) return false;
+  if (!dirty) return true;
+  memcpy(flashSector, data.data(), data.size());
+  dirty = false;
+  if (flashPath.empty()) return true;
+  FILE *f = fopen(flashPath.c_str(), "wb");
+  if (f == NULL) return false;
+  bool written = fwrite(flashSector, 1, sizeof(flashSector), f) == sizeof(flashSector);
+  return fclose(f) == 0 && written;
+}
+
+bool EEPROMClass::end() {
+  bool committed = commit();
+  data.clear();
+  return committed;
+}
@@ -0,0 +1,60 @@
+#ifndef FAKE_HOST_H
+#define FAKE_HOST_H
+
+// Controls for the Arduino fakes the host build runs the sketch on. A
+// harness sets the scene before setup(), then calls loop() itself; virtual
+// time only passes in the sketch's delay()s and in fakeAdvance(), and lwIP
+// events are delivered there and in yield(), as on the device.
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+//================ CLOCK ================
+uint64_t fakeMillis();                 // Since boot, without millis()'s 32-bit wrap
+void fakeAdvance(uint32_t ms);         // Lets time pass between loop() calls
+void fakeSetEpoch(uint32_t utc);       // UTC at the current instant, as NTP will report it
+uint32_t fakeEpoch();
+
+//================ GPIO ================
+struct FakePinChange {
+  uint64_t ms;
+  uint8_t pin;
+  uint8_t level;
+};
+
+// Every level change written to an output, oldest first
+const std::vector<FakePinChange> &fakePinChanges();
+void fakeClearPinChanges();
+int fakePinLevel(uint8_t pin);
+
+//================ DEVICE ================
+void fakeEepromFile(const char *path);  // Flash sector image kept in this file; NULL keeps it in RAM
+void fakeWifiUp(bool up);               // Whether WiFi.begin() connects and NTP answers
+void fakeSerialEcho(bool on);           // Copy Serial output to stderr
+void fakeResetReason(uint32_t reason);  // REASON_* reported for this boot
+
+// Thrown by ESP.restart(); the sketch's globals can't be rebuilt in-process
+struct FakeRestart {};
+
+//================ NETWORK ================
+// A host the sketch can connect to. `respond` gets the whole request and
+// returns the raw response, delivered after `latencyMs` and followed by a
+// close; an empty response leaves the connection hanging.
+typedef std::function<std::string(const std::string &request)> FakeResponder;
+void fakeAddHost(const char *name, const char *address, uint16_t port, FakeResponder respond,
+                 uint32_t latencyMs = 0);
+
+// One request to a port the sketch listens on. `done` is set once the sketch
+// closes the connection, `reset` if it aborted it instead.
+struct FakeExchange {
+  bool done;
+  bool reset;
+  std::string response;
+};
+std::shared_ptr<FakeExchange> fakeRequest(uint16_t port, const std::string &request,
+                                          const char *from = "192.168.1.100");
+
+#endif
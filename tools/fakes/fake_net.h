@@ -0,0 +1,12 @@
+#ifndef FAKE_NET_H
+#define FAKE_NET_H
+
+// Between the fake clock and the fake lwIP; not for harnesses
+
+#include <stdint.h>
+
+uint64_t fakeMicros();          // Virtual time since boot, unwrapped
+void fakeNetRun();              // Delivers every lwIP event due by now
+uint64_t fakeNetNextDue();      // When the next one is due, UINT64_MAX for never
+
+#endif
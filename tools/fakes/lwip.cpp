@@ -0,0 +1,338 @@
+#include <lwip/dns.h>
+#include <lwip/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "fake_host.h"
+#include "fake_net.h"
+
+const ip_addr_t ip_addr_any = { 0 };
+
+struct FakeHost {
+  std::string name;
+  u32_t addr;
+  u16_t port;
+  FakeResponder respond;
+  uint32_t latencyMs;
+};
+
+// The far end of a pcb: a fake host the sketch connected to, a harness
+// request to one of its listeners, or nothing for a listener itself
+struct FakeTcpPeer {
+  bool listening;
+  bool accepting;           // A harness request waiting for the listener's accept
+  bool connecting;          // The sketch called tcp_connect()
+  bool dead;                // Closed or aborted; freed once the current run is over
+  const FakeHost *host;
+  bool answered;
+  std::string written;      // What the sketch sent to a fake host
+  std::string incoming;     // Still to be delivered to the sketch
+  uint64_t deliverAt;
+  bool finPending;          // Close the sketch's receive side once `incoming` is through
+  uint32_t unacked;
+  uint64_t nextPoll;
+  std::shared_ptr<FakeExchange> exchange;
+};
+
+struct FakeLookup {
+  std::string name;
+  dns_found_callback found;
+  void *arg;
+};
+
+static std::vector<FakeHost> hosts;
+static std::vector<tcp_pcb *> pcbs;
+static std::vector<FakeLookup> lookups;
+static bool running = false;
+
+static bool parseAddress(const char *text, u32_t &addr) {
+  unsigned a, b, c, d;
+  char extra;
+  if (sscanf(text, "%u.%u.%u.%u%c", &a, &b, &c, &d, &extra) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+    return false;
+  }
+  addr = a | b << 8 | c << 16 | d << 24;
+  return true;
+}
+
+static tcp_pcb *newPcb() {
+  tcp_pcb *pcb = new tcp_pcb();
+  pcb->peer = new FakeTcpPeer();
+  pcbs.push_back(pcb);
+  return pcb;
+}
+
+// Once dead a pcb gets no more callbacks, as after lwIP frees it
+static void kill(tcp_pcb *pcb, bool reset) {
+  FakeTcpPeer &peer = *pcb->peer;
+  peer.dead = true;
+  if (peer.exchange) {
+    peer.exchange->done = true;
+    peer.exchange->reset = reset;
+    peer.exchange.reset();
+  }
+}
+
+//================ HARNESS ================
+void fakeAddHost(const char *name, const char *address, uint16_t port, FakeResponder respond, uint32_t latencyMs) {
+  FakeHost host;
+  host.name = name;
+  host.addr = 0;
+  parseAddress(address, host.addr);
+  host.port = port;
+  host.respond = respond;
+  host.latencyMs = latencyMs;
+  hosts.push_back(host);
+}
+
+std::shared_ptr<FakeExchange> fakeRequest(uint16_t port, const std::string &request, const char *from) {
+  std::shared_ptr<FakeExchange> exchange(new FakeExchange());
+  tcp_pcb *pcb = newPcb();
+  parseAddress(from, pcb->remote_ip.addr);
+  pcb->remote_port = 50000 + pcbs.size() % 10000;
+  pcb->local_port = port;
+  FakeTcpPeer &peer = *pcb->peer;
+  peer.accepting = true;
+  peer.incoming = request;
+  peer.deliverAt = fakeMicros();
+  peer.exchange = exchange;
+  return exchange;
+}
+
+//================ EVENTS ================
+static tcp_pcb *findListener(u16_t port) {
+  for (tcp_pcb *pcb : pcbs) {
+    if (pcb->peer->listening && !pcb->peer->dead && pcb->local_port == port) return pcb;
+  }
+  return NULL;
+}
+
+static const FakeHost *findHost(u32_t addr, u16_t port) {
+  for (const FakeHost &host : hosts) {
+    if (host.addr == addr && host.port == port) return &host;
+  }
+  return NULL;
+}
+
+static void refuse(tcp_pcb *pcb) {
+  tcp_err_fn errf = pcb->errf;
+  void *arg = pcb->callback_arg;
+  kill(pcb, true);
+  if (errf) errf(arg, ERR_RST);
+}
+
+static void deliver(tcp_pcb *pcb, uint64_t now) {
+  FakeTcpPeer &peer = *pcb->peer;
+  while (!peer.dead && !peer.incoming.empty() && now >= peer.deliverAt) {
+    size_t n = peer.incoming.size() < TCP_MSS ? peer.incoming.size() : TCP_MSS;
+    if (pcb->recv == NULL) {
+      peer.incoming.erase(0, n);
+      continue;
+    }
+    pbuf *p = new pbuf();
+    p->payload = new char[n];
+    memcpy(p->payload, peer.incoming.data(), n);
+    p->tot_len = p->len = n;
+    peer.incoming.erase(0, n);
+    pcb->recv(pcb->callback_arg, pcb, p, ERR_OK);
+  }
+  if (!peer.dead && peer.finPending && peer.incoming.empty() && now >= peer.deliverAt) {
+    peer.finPending = false;
+    if (pcb->recv) pcb->recv(pcb->callback_arg, pcb, NULL, ERR_OK);
+  }
+}
+
+static void step(tcp_pcb *pcb, uint64_t now) {
+  FakeTcpPeer &peer = *pcb->peer;
+  if (peer.dead || peer.listening) return;
+
+  if (peer.accepting) {
+    peer.accepting = false;
+    tcp_pcb *listener = findListener(pcb->local_port);
+    if (listener == NULL || listener->accept == NULL) {
+      kill(pcb, true);
+      return;
+    }
+    pcb->callback_arg = listener->callback_arg;
+    if (listener->accept(listener->callback_arg, pcb, ERR_OK) != ERR_OK && !peer.dead) kill(pcb, true);
+    if (peer.dead) return;
+  }
+
+  if (peer.connecting) {
+    peer.connecting = false;
+    peer.host = findHost(pcb->remote_ip.addr, pcb->remote_port);
+    if (peer.host == NULL) {
+      refuse(pcb);
+      return;
+    }
+    if (pcb->connected) pcb->connected(pcb->callback_arg, pcb, ERR_OK);
+    if (peer.dead) return;
+  }
+
+  // A fake host answers once it has the whole request head
+  if (peer.host && !peer.answered && peer.written.find("\r\n\r\n") != std::string::npos) {
+    peer.answered = true;
+    std::string response = peer.host->respond(peer.written);
+    if (!response.empty()) {
+      peer.incoming = response;
+      peer.deliverAt = now + (uint64_t)peer.host->latencyMs * 1000;
+      peer.finPending = true;
+    }
+  }
+
+  deliver(pcb, now);
+  if (peer.dead) return;
+
+  if (peer.unacked > 0) {
+    u16_t acked = peer.unacked;
+    peer.unacked = 0;
+    if (pcb->sent) pcb->sent(pcb->callback_arg, pcb, acked);
+    if (peer.dead) return;
+  }
+
+  if (pcb->poll && pcb->pollinterval > 0 && now >= peer.nextPoll) {
+    peer.nextPoll = now + pcb->pollinterval * 500000ULL;
+    pcb->poll(pcb->callback_arg, pcb);
+  }
+}
+
+void fakeNetRun() {
+  if (running) return;
+  running = true;
+  uint64_t now = fakeMicros();
+
+  std::vector<FakeLookup> failed;
+  failed.swap(lookups);
+  for (const FakeLookup &lookup : failed) lookup.found(lookup.name.c_str(), NULL, lookup.arg);
+
+  // By index: callbacks may open more pcbs
+  for (size_t i = 0; i < pcbs.size(); i++) step(pcbs[i], now);
+
+  size_t kept = 0;
+  for (size_t i = 0; i < pcbs.size(); i++) {
+    if (pcbs[i]->peer->dead) {
+      delete pcbs[i]->peer;
+      delete pcbs[i];
+    } else {
+      pcbs[kept++] = pcbs[i];
+    }
+  }
+  pcbs.resize(kept);
+  running = false;
+}
+
+uint64_t fakeNetNextDue() {
+  uint64_t now = fakeMicros();
+  if (!lookups.empty()) return now;
+  uint64_t due = UINT64_MAX;
+  for (tcp_pcb *pcb : pcbs) {
+    const FakeTcpPeer &peer = *pcb->peer;
+    if (peer.dead || peer.listening) continue;
+    if (peer.accepting || peer.connecting || peer.unacked > 0) return now;
+    if (peer.host && !peer.answered && peer.written.find("\r\n\r\n") != std::string::npos) return now;
+    if ((!peer.incoming.empty() || peer.finPending) && peer.deliverAt < due) due = peer.deliverAt;
+    if (pcb->poll && pcb->pollinterval > 0 && peer.nextPoll < due) due = peer.nextPoll;
+  }
+  return due < now ? now : due;
+}
+
+//================ PBUF ================
+u16_t pbuf_copy_partial(const struct pbuf *p, void *dataptr, u16_t len, u16_t offset) {
+  if (offset >= p->len) return 0;
+  u16_t n = p->len - offset < len ? p->len - offset : len;
+  memcpy(dataptr, (const char *)p->payload + offset, n);
+  return n;
+}
+
+u8_t pbuf_free(struct pbuf *p) {
+  delete[] (char *)p->payload;
+  delete p;
+  return 1;
+}
+
+//================ TCP ================
+struct tcp_pcb *tcp_new(void) { return newPcb(); }
+
+err_t tcp_bind(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port) {
+  if (findListener(port)) return ERR_USE;
+  pcb->local_ip = *ipaddr;
+  pcb->local_port = port;
+  return ERR_OK;
+}
+
+struct tcp_pcb *tcp_listen_with_backlog(struct tcp_pcb *pcb, u8_t backlog) {
+  (void)backlog;
+  pcb->peer->listening = true;
+  return pcb;
+}
+
+err_t tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port, tcp_connected_fn connected) {
+  pcb->remote_ip = *ipaddr;
+  pcb->remote_port = port;
+  pcb->connected = connected;
+  pcb->peer->connecting = true;
+  return ERR_OK;
+}
+
+// Data already written still reaches the peer; what the peer had yet to
+// send is dropped
+err_t tcp_close(struct tcp_pcb *pcb) {
+  kill(pcb, false);
+  return ERR_OK;
+}
+
+void tcp_abort(struct tcp_pcb *pcb) {
+  tcp_err_fn errf = pcb->errf;
+  void *arg = pcb->callback_arg;
+  kill(pcb, true);
+  if (errf) errf(arg, ERR_ABRT);
+}
+
+void tcp_arg(struct tcp_pcb *pcb, void *arg) { pcb->callback_arg = arg; }
+void tcp_accept(struct tcp_pcb *pcb, tcp_accept_fn accept) { pcb->accept = accept; }
+void tcp_recv(struct tcp_pcb *pcb, tcp_recv_fn recv) { pcb->recv = recv; }
+void tcp_sent(struct tcp_pcb *pcb, tcp_sent_fn sent) { pcb->sent = sent; }
+void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err) { pcb->errf = err; }
+
+void tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval) {
+  pcb->poll = poll;
+  pcb->pollinterval = interval;
+  pcb->peer->nextPoll = fakeMicros() + interval * 500000ULL;
+}
+
+void tcp_nagle_disable(struct tcp_pcb *pcb) { (void)pcb; }
+void tcp_recved(struct tcp_pcb *pcb, u16_t len) { (void)pcb; (void)len; }
+
+u16_t tcp_sndbuf(struct tcp_pcb *pcb) { return TCP_SND_BUF - pcb->peer->unacked; }
+
+err_t tcp_write(struct tcp_pcb *pcb, const void *dataptr, u16_t len, u8_t apiflags) {
+  (void)apiflags;
+  FakeTcpPeer &peer = *pcb->peer;
+  if (peer.dead) return ERR_CONN;
+  if (len > tcp_sndbuf(pcb)) return ERR_MEM;
+  if (peer.exchange) {
+    peer.exchange->response.append((const char *)dataptr, len);
+  } else {
+    peer.written.append((const char *)dataptr, len);
+  }
+  peer.unacked += len;
+  return ERR_OK;
+}
+
+err_t tcp_output(struct tcp_pcb *pcb) {
+  (void)pcb;
+  return ERR_OK;
+}
+
+//================ DNS ================
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg) {
+  if (parseAddress(hostname, addr->addr)) return ERR_OK;
+  for (const FakeHost &host : hosts) {
+    if (host.name == hostname) {
+      addr->addr = host.addr;
+      return ERR_OK;
+    }
+  }
+  lookups.push_back({ hostname, found, callback_arg });
+  return ERR_INPROGRESS;
+}
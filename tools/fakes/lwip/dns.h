@@ -0,0 +1,13 @@
+#ifndef LWIP_HDR_DNS_H
+#define LWIP_HDR_DNS_H
+
+// Dotted addresses and fakeAddHost() names resolve at once, as if cached;
+// any other name fails from the next delay() or yield()
+
+#include "tcp.h"
+
+typedef void (*dns_found_callback)(const char *name, const ip_addr_t *ipaddr, void *callback_arg);
+
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg);
+
+#endif
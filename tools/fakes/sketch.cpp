@@ -0,0 +1,4 @@
+// The sketch as one translation unit, the way the Arduino build turns an
+// .ino into a .cpp
+#include <Arduino.h>
+#include "../../SunTimeCloudLightController.ino"
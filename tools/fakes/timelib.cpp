@@ -0,0 +1,126 @@
+#include <NTPClient.h>
+#include <TimeLib.h>
+#include "fake_host.h"
+
+//================ TIMELIB ================
+static time_t sysTime = 0;
+static uint32_t prevMillis = 0;
+
+static const uint8_t monthDays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+#define LEAP_YEAR(Y) (((1970 + (Y)) > 0) && !((1970 + (Y)) % 4) && (((1970 + (Y)) % 100) || !((1970 + (Y)) % 400)))
+
+time_t now() {
+  uint32_t elapsed = millis() - prevMillis;
+  sysTime += elapsed / 1000;
+  prevMillis += elapsed / 1000 * 1000;
+  return sysTime;
+}
+
+void setTime(time_t t) {
+  sysTime = t;
+  prevMillis = millis();
+}
+
+void setTime(int hr, int min, int sec, int dy, int mnth, int yr) {
+  tmElements_t tm;
+  tm.Year = yr > 99 ? yr - 1970 : yr + 30;
+  tm.Month = mnth;
+  tm.Day = dy;
+  tm.Hour = hr;
+  tm.Minute = min;
+  tm.Second = sec;
+  setTime(makeTime(tm));
+}
+
+void adjustTime(long adjustment) { sysTime += adjustment; }
+
+void breakTime(time_t timeInput, tmElements_t &tm) {
+  uint32_t time = (uint32_t)timeInput;
+  tm.Second = time % 60;
+  time /= 60;
+  tm.Minute = time % 60;
+  time /= 60;
+  tm.Hour = time % 24;
+  time /= 24;
+  tm.Wday = ((time + 4) % 7) + 1;
+
+  uint8_t year = 0;
+  unsigned long days = 0;
+  while ((unsigned)(days += (LEAP_YEAR(year) ? 366 : 365)) <= time) year++;
+  tm.Year = year;
+  days -= LEAP_YEAR(year) ? 366 : 365;
+  time -= days;
+
+  uint8_t month;
+  for (month = 0; month < 12; month++) {
+    uint8_t length = month == 1 && LEAP_YEAR(year) ? 29 : monthDays[month];
+    if (time < length) break;
+    time -= length;
+  }
+  tm.Month = month + 1;
+  tm.Day = time + 1;
+}
+
+time_t makeTime(const tmElements_t &tm) {
+  uint32_t seconds = tm.Year * (SECS_PER_DAY * 365);
+  for (int i = 0; i < tm.Year; i++) {
+    if (LEAP_YEAR(i)) seconds += SECS_PER_DAY;
+  }
+  for (int i = 1; i < tm.Month; i++) {
+    seconds += SECS_PER_DAY * (i == 2 && LEAP_YEAR(tm.Year) ? 29 : monthDays[i - 1]);
+  }
+  seconds += (tm.Day - 1) * SECS_PER_DAY;
+  seconds += tm.Hour * SECS_PER_HOUR;
+  seconds += tm.Minute * SECS_PER_MIN;
+  seconds += tm.Second;
+  return (time_t)seconds;
+}
+
+static tmElements_t brokenDown(time_t t) {
+  tmElements_t tm;
+  breakTime(t, tm);
+  return tm;
+}
+
+int hour() { return hour(now()); }
+int hour(time_t t) { return brokenDown(t).Hour; }
+int minute() { return minute(now()); }
+int minute(time_t t) { return brokenDown(t).Minute; }
+int second() { return second(now()); }
+int second(time_t t) { return brokenDown(t).Second; }
+int day() { return day(now()); }
+int day(time_t t) { return brokenDown(t).Day; }
+int weekday() { return weekday(now()); }
+int weekday(time_t t) { return brokenDown(t).Wday; }
+int month() { return month(now()); }
+int month(time_t t) { return brokenDown(t).Month; }
+int year() { return year(now()); }
+int year(time_t t) { return tmYearToCalendar(brokenDown(t).Year); }
+
+//================ NTP ================
+bool NTPClient::update() {
+  if (millis() - lastUpdate >= updateInterval || lastUpdate == 0) return forceUpdate();
+  return false;
+}
+
+bool NTPClient::forceUpdate() {
+  if (WiFi.status() != WL_CONNECTED) {
+    delay(1000);   // The library gives up on the reply after a second
+    return false;
+  }
+  delay(10);
+  currentEpoch = fakeEpoch();
+  lastUpdate = millis();
+  return true;
+}
+
+unsigned long NTPClient::getEpochTime() const {
+  return timeOffset + currentEpoch + (millis() - lastUpdate) / 1000;
+}
+
+String NTPClient::getFormattedTime() const {
+  char text[9];
+  snprintf(text, sizeof(text), "%02d:%02d:%02d", getHours(), getMinutes(), getSeconds());
+  return String(text);
+}
@@ -0,0 +1,1082 @@
+// Fleet log collector: polls /api/logs on many controllers at once and keeps
+// every entry in an on-disk column store that answers time-range queries
+// without reading the whole history.
+//
+// Build: g++ -O2 -std=c++11 -pthread -o fleet_collector tools/fleet_collector.cpp
+// Usage: fleet_collector collect --devices FILE --store DIR [--auth USER:PASS]
+//                                [--concurrency N] [--interval SEC] [--timeout MS] [--once]
+//        fleet_collector query --store DIR [--from EPOCH] [--to EPOCH] [--device NAME] [--type N]
+//        fleet_collector simulate [--port N] [--period SEC]
+//        fleet_collector loadtest [--devices N] [--concurrency N] [--passes N] [--period SEC]
+//                                 [--store DIR]
+//
+// The devices file lists one controller per line as host[:port][/prefix];
+// blank lines and lines starting with # are skipped. Each poll asks for
+// /api/logs?since=S&skip=K and stores what comes back, so only entries newer
+// than the saved cursor cross the network. Cursors are written to the store
+// after the entries they cover, so a crash can repeat entries but never lose
+// them. All controllers in one run share the --auth credentials.
+//
+// `simulate` serves any number of fake controllers from one port as
+// /d<N>/api/logs, and `loadtest` runs it in-process against the collector to
+// measure how many devices one collector keeps up with.
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define BLOCK_ROWS 1024                // Rows per entry in a partition's time index
+#define FLUSH_ROWS 65536               // Buffered rows per partition before writing
+#define MAX_RESPONSE_BYTES (256 * 1024)
+#define SIM_MAX_ENTRIES 100            // Ring size of a real controller (MAX_LOG_ENTRIES)
+#define SIM_ENTRIES_PER_RESPONSE 64    // About what fits in the device's response buffer
+
+typedef std::chrono::steady_clock Clock;
+
+struct LogRecord {
+  uint32_t time;
+  uint32_t device;
+  uint8_t type;
+  uint8_t value;
+  uint16_t extra;
+};
+
+static double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static bool writeAll(int fd, const void *data, size_t len) {
+  const char *p = (const char *)data;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+static bool readAt(int fd, void *data, size_t len, off_t offset) {
+  return pread(fd, data, len, offset) == (ssize_t)len;
+}
+
+static off_t fileSize(int fd) {
+  struct stat st;
+  return fstat(fd, &st) == 0 ? st.st_size : 0;
+}
+
+static void raiseFileLimit() {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+//================ COLUMN STORE ================
+// One directory per UTC day. Every column is its own file of fixed-width
+// values, so a query only reads the columns it needs, and blocks.idx keeps
+// the time range of each BLOCK_ROWS rows so blocks outside the requested
+// range are never read at all.
+struct BlockIndexEntry {
+  uint32_t firstRow;
+  uint32_t rows;
+  uint32_t minTime;
+  uint32_t maxTime;
+};
+
+enum Column { COL_TIME, COL_DEVICE, COL_TYPE, COL_VALUE, COL_EXTRA, COLUMN_COUNT };
+static const char *COLUMN_FILES[COLUMN_COUNT] = { "time.u32", "device.u32", "type.u8", "value.u8", "extra.u16" };
+static const size_t COLUMN_WIDTHS[COLUMN_COUNT] = { 4, 4, 1, 1, 2 };
+
+static std::string dayName(uint32_t epoch) {
+  time_t t = epoch;
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  char name[16];
+  strftime(name, sizeof(name), "%Y%m%d", &tm);
+  return name;
+}
+
+static void startBlock(BlockIndexEntry &block, uint32_t firstRow) {
+  block = { firstRow, 0, UINT32_MAX, 0 };
+}
+
+class Partition {
+private:
+  int fds[COLUMN_COUNT];
+  int indexFd;
+  uint32_t rows;
+  BlockIndexEntry tail;          // Last block, possibly partial
+  std::vector<LogRecord> pending;
+
+public:
+  bool touched;
+
+  Partition() : indexFd(-1), rows(0), touched(false) {
+    for (int c = 0; c < COLUMN_COUNT; c++) fds[c] = -1;
+  }
+
+  ~Partition() {
+    for (int c = 0; c < COLUMN_COUNT; c++)
+      if (fds[c] >= 0) close(fds[c]);
+    if (indexFd >= 0) close(indexFd);
+  }
+
+  bool open(const std::string &dir) {
+    mkdir(dir.c_str(), 0755);
+    for (int c = 0; c < COLUMN_COUNT; c++) {
+      fds[c] = ::open((dir + "/" + COLUMN_FILES[c]).c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+      if (fds[c] < 0) return false;
+    }
+    indexFd = ::open((dir + "/blocks.idx").c_str(), O_RDWR | O_CREAT, 0644);
+    if (indexFd < 0) return false;
+
+    // A crash mid-flush can leave columns of different lengths; keep only
+    // the rows every column has and rebuild the last block's range
+    off_t minRows = fileSize(fds[0]) / COLUMN_WIDTHS[0];
+    for (int c = 1; c < COLUMN_COUNT; c++) {
+      off_t n = fileSize(fds[c]) / COLUMN_WIDTHS[c];
+      if (n < minRows) minRows = n;
+    }
+    rows = (uint32_t)minRows;
+    for (int c = 0; c < COLUMN_COUNT; c++)
+      if (ftruncate(fds[c], (off_t)rows * COLUMN_WIDTHS[c]) != 0) return false;
+
+    startBlock(tail, rows - rows % BLOCK_ROWS);
+    std::vector<uint32_t> times(rows - tail.firstRow);
+    if (!times.empty() && !readAt(fds[COL_TIME], times.data(), times.size() * 4, (off_t)tail.firstRow * 4)) return false;
+    for (uint32_t t : times) {
+      tail.rows++;
+      if (t < tail.minTime) tail.minTime = t;
+      if (t > tail.maxTime) tail.maxTime = t;
+    }
+    off_t blocks = (rows + BLOCK_ROWS - 1) / BLOCK_ROWS;
+    return ftruncate(indexFd, blocks * (off_t)sizeof(BlockIndexEntry)) == 0;
+  }
+
+  void append(const LogRecord &record) {
+    pending.push_back(record);
+    touched = true;
+  }
+
+  size_t pendingRows() const {
+    return pending.size();
+  }
+
+  bool flush() {
+    if (pending.empty()) return true;
+
+    std::vector<char> column;
+    for (int c = 0; c < COLUMN_COUNT; c++) {
+      column.resize(pending.size() * COLUMN_WIDTHS[c]);
+      char *p = column.data();
+      for (const LogRecord &r : pending) {
+        switch (c) {
+          case COL_TIME: memcpy(p, &r.time, 4); break;
+          case COL_DEVICE: memcpy(p, &r.device, 4); break;
+          case COL_TYPE: *p = (char)r.type; break;
+          case COL_VALUE: *p = (char)r.value; break;
+          case COL_EXTRA: memcpy(p, &r.extra, 2); break;
+        }
+        p += COLUMN_WIDTHS[c];
+      }
+      if (!writeAll(fds[c], column.data(), column.size())) return false;
+    }
+
+    for (const LogRecord &r : pending) {
+      tail.rows++;
+      if (r.time < tail.minTime) tail.minTime = r.time;
+      if (r.time > tail.maxTime) tail.maxTime = r.time;
+      if (tail.rows == BLOCK_ROWS) {
+        if (!writeBlock()) return false;
+        startBlock(tail, tail.firstRow + BLOCK_ROWS);
+      }
+    }
+    if (tail.rows > 0 && !writeBlock()) return false;
+
+    rows += (uint32_t)pending.size();
+    pending.clear();
+    return true;
+  }
+
+private:
+  bool writeBlock() {
+    off_t offset = (off_t)(tail.firstRow / BLOCK_ROWS) * sizeof(BlockIndexEntry);
+    return pwrite(indexFd, &tail, sizeof(tail), offset) == (ssize_t)sizeof(tail);
+  }
+};
+
+class ColumnStore {
+private:
+  std::string root;
+  std::map<std::string, std::unique_ptr<Partition>> partitions;
+  std::vector<std::string> deviceNames;
+  std::map<std::string, uint32_t> deviceIds;
+
+public:
+  bool open(const std::string &path) {
+    root = path;
+    mkdir(root.c_str(), 0755);
+    FILE *f = fopen((root + "/devices.txt").c_str(), "r");
+    if (f) {
+      char line[512];
+      while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = 0;
+        deviceIds[line] = (uint32_t)deviceNames.size();
+        deviceNames.push_back(line);
+      }
+      fclose(f);
+    }
+    struct stat st;
+    return stat(root.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+  }
+
+  // Device names are numbered in the order they were first seen
+  uint32_t deviceId(const std::string &name) {
+    auto it = deviceIds.find(name);
+    if (it != deviceIds.end()) return it->second;
+    uint32_t id = (uint32_t)deviceNames.size();
+    FILE *f = fopen((root + "/devices.txt").c_str(), "a");
+    if (f) {
+      fprintf(f, "%s\n", name.c_str());
+      fclose(f);
+    }
+    deviceIds[name] = id;
+    deviceNames.push_back(name);
+    return id;
+  }
+
+  bool findDevice(const std::string &name, uint32_t &id) const {
+    auto it = deviceIds.find(name);
+    if (it == deviceIds.end()) return false;
+    id = it->second;
+    return true;
+  }
+
+  const std::string &deviceName(uint32_t id) const {
+    static const std::string unknown = "?";
+    return id < deviceNames.size() ? deviceNames[id] : unknown;
+  }
+
+  bool append(const LogRecord &record) {
+    std::string day = dayName(record.time);
+    std::unique_ptr<Partition> &part = partitions[day];
+    if (!part) {
+      part.reset(new Partition());
+      if (!part->open(root + "/" + day)) {
+        partitions.erase(day);
+        return false;
+      }
+    }
+    part->append(record);
+    return part->pendingRows() < FLUSH_ROWS || part->flush();
+  }
+
+  // Partitions nobody wrote to since the last flush are closed, so a
+  // long-running collector only holds today's (and late stragglers') files
+  bool flush() {
+    bool ok = true;
+    for (auto it = partitions.begin(); it != partitions.end();) {
+      ok = it->second->flush() && ok;
+      if (!it->second->touched) {
+        it = partitions.erase(it);
+      } else {
+        it->second->touched = false;
+        ++it;
+      }
+    }
+    return ok;
+  }
+
+  // Calls `visit` for every row with from <= time <= to, partition by
+  // partition in write order. Returns the number of blocks read.
+  size_t query(uint32_t from, uint32_t to, const std::function<void(const LogRecord &)> &visit) const {
+    std::vector<std::string> days;
+    std::string first = dayName(from), last = dayName(to);
+    DIR *dir = opendir(root.c_str());
+    if (!dir) return 0;
+    while (struct dirent *e = readdir(dir)) {
+      std::string name = e->d_name;
+      if (name.size() == 8 && name >= first && name <= last) days.push_back(name);
+    }
+    closedir(dir);
+    std::sort(days.begin(), days.end());
+
+    size_t blocksRead = 0;
+    for (const std::string &day : days) {
+      std::string path = root + "/" + day + "/";
+      int fds[COLUMN_COUNT];
+      bool ok = true;
+      for (int c = 0; c < COLUMN_COUNT; c++) {
+        fds[c] = ::open((path + COLUMN_FILES[c]).c_str(), O_RDONLY);
+        ok = ok && fds[c] >= 0;
+      }
+      int indexFd = ::open((path + "blocks.idx").c_str(), O_RDONLY);
+      if (ok && indexFd >= 0) blocksRead += queryPartition(fds, indexFd, from, to, visit);
+      for (int c = 0; c < COLUMN_COUNT; c++)
+        if (fds[c] >= 0) close(fds[c]);
+      if (indexFd >= 0) close(indexFd);
+    }
+    return blocksRead;
+  }
+
+private:
+  static size_t queryPartition(const int *fds, int indexFd, uint32_t from, uint32_t to,
+                               const std::function<void(const LogRecord &)> &visit) {
+    std::vector<BlockIndexEntry> index(fileSize(indexFd) / sizeof(BlockIndexEntry));
+    if (!index.empty() && !readAt(indexFd, index.data(), index.size() * sizeof(BlockIndexEntry), 0)) return 0;
+
+    size_t blocksRead = 0;
+    std::vector<uint32_t> times, devices;
+    std::vector<uint8_t> types, values;
+    std::vector<uint16_t> extras;
+    for (const BlockIndexEntry &block : index) {
+      if (block.rows == 0 || block.maxTime < from || block.minTime > to) continue;
+      blocksRead++;
+
+      // The time column decides which rows match; the rest are only read
+      // for blocks that have at least one
+      times.resize(block.rows);
+      if (!readAt(fds[COL_TIME], times.data(), block.rows * 4, (off_t)block.firstRow * 4)) continue;
+      bool any = false;
+      for (uint32_t t : times) any = any || (t >= from && t <= to);
+      if (!any) continue;
+
+      devices.resize(block.rows);
+      types.resize(block.rows);
+      values.resize(block.rows);
+      extras.resize(block.rows);
+      if (!readAt(fds[COL_DEVICE], devices.data(), block.rows * 4, (off_t)block.firstRow * 4) ||
+          !readAt(fds[COL_TYPE], types.data(), block.rows, block.firstRow) ||
+          !readAt(fds[COL_VALUE], values.data(), block.rows, block.firstRow) ||
+          !readAt(fds[COL_EXTRA], extras.data(), block.rows * 2, (off_t)block.firstRow * 2)) continue;
+
+      for (uint32_t i = 0; i < block.rows; i++) {
+        if (times[i] < from || times[i] > to) continue;
+        LogRecord r = { times[i], devices[i], types[i], values[i], extras[i] };
+        visit(r);
+      }
+    }
+    return blocksRead;
+  }
+};
+
+//================ RESPONSE PARSING ================
+// Just enough JSON for the /api/logs?since= object the firmware writes
+static bool findNumber(const char *begin, const char *end, const char *key, unsigned long &value) {
+  size_t keyLen = strlen(key);
+  for (const char *p = begin; p + keyLen + 3 <= end; p++) {
+    if (*p != '"' || memcmp(p + 1, key, keyLen) != 0 || p[keyLen + 1] != '"' || p[keyLen + 2] != ':') continue;
+    char *after;
+    value = strtoul(p + keyLen + 3, &after, 10);
+    return after != p + keyLen + 3;
+  }
+  return false;
+}
+
+struct LogsResponse {
+  std::vector<LogRecord> entries;
+  uint32_t nextSince;
+  uint16_t nextSkip;
+  bool more;
+};
+
+static bool parseLogsBody(const char *body, const char *end, uint32_t deviceId, LogsResponse &out) {
+  out.entries.clear();
+  const char *p = strstr(body, "\"entries\":[");
+  if (!p || p >= end) return false;
+  p += 11;
+
+  for (;;) {
+    while (p < end && (*p == ',' || *p == ' ' || *p == '\n')) p++;
+    if (p >= end) return false;
+    if (*p == ']') break;
+    if (*p != '{') return false;
+    const char *close = (const char *)memchr(p, '}', end - p);
+    if (!close) return false;
+    unsigned long t, type, value, extra;
+    if (!findNumber(p, close, "time", t) || !findNumber(p, close, "type", type) ||
+        !findNumber(p, close, "value", value) || !findNumber(p, close, "extra", extra)) return false;
+    out.entries.push_back({ (uint32_t)t, deviceId, (uint8_t)type, (uint8_t)value, (uint16_t)extra });
+    p = close + 1;
+  }
+
+  unsigned long since, skip;
+  const char *next = strstr(p, "\"next\":{");
+  const char *nextEnd = next ? (const char *)memchr(next, '}', end - next) : nullptr;
+  if (!nextEnd || !findNumber(next, nextEnd, "since", since) || !findNumber(next, nextEnd, "skip", skip)) return false;
+  out.nextSince = (uint32_t)since;
+  out.nextSkip = (uint16_t)skip;
+  out.more = strstr(nextEnd, "\"more\":true") != nullptr;
+  return true;
+}
+
+//================ COLLECTOR ================
+struct CollectorConfig {
+  const char *devicesFile = nullptr;
+  const char *store = nullptr;
+  const char *auth = nullptr;
+  int concurrency = 256;
+  int intervalSec = 60;
+  int timeoutMs = 5000;
+  bool once = false;
+};
+
+struct Device {
+  std::string name;
+  std::string host;
+  std::string prefix;
+  sockaddr_in addr;
+  uint32_t id;
+  uint32_t since;
+  uint16_t skip;
+};
+
+struct PassStats {
+  size_t devices;
+  size_t requests;
+  size_t failures;
+  size_t records;
+  double seconds;
+};
+
+enum ConnectionState { CONN_CONNECTING, CONN_SENDING, CONN_RECEIVING };
+
+struct Connection {
+  int fd;
+  size_t device;
+  ConnectionState state;
+  std::string request;
+  size_t sent;
+  std::string response;
+  Clock::time_point deadline;
+};
+
+static std::string base64(const std::string &in) {
+  static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  for (size_t i = 0; i < in.size(); i += 3) {
+    uint32_t n = (uint8_t)in[i] << 16;
+    if (i + 1 < in.size()) n |= (uint8_t)in[i + 1] << 8;
+    if (i + 2 < in.size()) n |= (uint8_t)in[i + 2];
+    out += table[(n >> 18) & 63];
+    out += table[(n >> 12) & 63];
+    out += i + 1 < in.size() ? table[(n >> 6) & 63] : '=';
+    out += i + 2 < in.size() ? table[n & 63] : '=';
+  }
+  return out;
+}
+
+// host[:port][/prefix], resolved once up front
+static bool parseDevice(const std::string &line, Device &device) {
+  std::string address = line;
+  size_t slash = address.find('/');
+  device.prefix = slash == std::string::npos ? "" : address.substr(slash);
+  if (slash != std::string::npos) address.resize(slash);
+  size_t colon = address.find(':');
+  int port = colon == std::string::npos ? 80 : atoi(address.c_str() + colon + 1);
+  device.host = address.substr(0, colon);
+  if (port <= 0 || port > 65535 || device.host.empty()) return false;
+
+  addrinfo hints, *result;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(device.host.c_str(), nullptr, &hints, &result) != 0) return false;
+  device.addr = *(sockaddr_in *)result->ai_addr;
+  device.addr.sin_port = htons((uint16_t)port);
+  freeaddrinfo(result);
+  device.name = line;
+  device.since = 0;
+  device.skip = 0;
+  return true;
+}
+
+// Polls every device once per pass over non-blocking sockets, with at most
+// `concurrency` requests in flight. A device that reports more entries than
+// fit in one response is queued again straight away.
+class Collector {
+private:
+  const CollectorConfig &config;
+  ColumnStore &store;
+  std::vector<Device> &devices;
+  std::string authHeader;
+  int epollFd;
+
+public:
+  Collector(const CollectorConfig &cfg, ColumnStore &columnStore, std::vector<Device> &deviceList)
+      : config(cfg), store(columnStore), devices(deviceList) {
+    if (config.auth) authHeader = "Authorization: Basic " + base64(config.auth) + "\r\n";
+    epollFd = epoll_create1(0);
+  }
+
+  ~Collector() {
+    close(epollFd);
+  }
+
+  PassStats runPass() {
+    PassStats stats = { devices.size(), 0, 0, 0, 0 };
+    Clock::time_point start = Clock::now();
+    std::deque<size_t> queue;
+    for (size_t i = 0; i < devices.size(); i++) queue.push_back(i);
+    std::map<int, std::unique_ptr<Connection>> active;
+    std::vector<epoll_event> events(config.concurrency);
+
+    while (!queue.empty() || !active.empty()) {
+      while (!queue.empty() && (int)active.size() < config.concurrency) {
+        size_t d = queue.front();
+        queue.pop_front();
+        stats.requests++;
+        Connection *conn = startRequest(d);
+        if (conn) {
+          active[conn->fd].reset(conn);
+        } else {
+          stats.failures++;
+        }
+      }
+
+      int n = epoll_wait(epollFd, events.data(), (int)events.size(), 50);
+      for (int i = 0; i < n; i++) {
+        auto it = active.find(events[i].data.fd);
+        if (it == active.end()) continue;
+        Connection &conn = *it->second;
+        int result = advance(conn, events[i].events);
+        if (result == 0) continue;
+        if (result > 0 && finish(conn, stats)) {
+          queue.push_front(conn.device);
+        } else if (result < 0) {
+          stats.failures++;
+        }
+        close(conn.fd);
+        active.erase(it);
+      }
+
+      Clock::time_point now = Clock::now();
+      for (auto it = active.begin(); it != active.end();) {
+        if (now < it->second->deadline) {
+          ++it;
+          continue;
+        }
+        stats.failures++;
+        close(it->first);
+        it = active.erase(it);
+      }
+    }
+
+    store.flush();
+    stats.seconds = secondsSince(start);
+    return stats;
+  }
+
+private:
+  Connection *startRequest(size_t d) {
+    Device &device = devices[d];
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) return nullptr;
+    if (connect(fd, (sockaddr *)&device.addr, sizeof(device.addr)) != 0 && errno != EINPROGRESS) {
+      close(fd);
+      return nullptr;
+    }
+
+    Connection *conn = new Connection();
+    conn->fd = fd;
+    conn->device = d;
+    conn->state = CONN_CONNECTING;
+    conn->sent = 0;
+    conn->deadline = Clock::now() + std::chrono::milliseconds(config.timeoutMs);
+    char line[256];
+    snprintf(line, sizeof(line), "GET %s/api/logs?since=%u&skip=%u HTTP/1.0\r\nHost: %s\r\n", device.prefix.c_str(),
+             device.since, device.skip, device.host.c_str());
+    conn->request = std::string(line) + authHeader + "Connection: close\r\n\r\n";
+
+    epoll_event ev;
+    ev.events = EPOLLOUT | EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    return conn;
+  }
+
+  // 0 while the exchange is in progress, 1 once the server closed after a
+  // response, -1 on error
+  int advance(Connection &conn, uint32_t events) {
+    if (conn.state == CONN_CONNECTING) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      if (err != 0) return -1;
+      conn.state = CONN_SENDING;
+    }
+    if (conn.state == CONN_SENDING && (events & EPOLLOUT)) {
+      ssize_t n = send(conn.fd, conn.request.data() + conn.sent, conn.request.size() - conn.sent, MSG_NOSIGNAL);
+      if (n < 0 && errno != EAGAIN) return -1;
+      if (n > 0) conn.sent += (size_t)n;
+      if (conn.sent == conn.request.size()) {
+        conn.state = CONN_RECEIVING;
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = conn.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+      }
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+      char buf[16384];
+      for (;;) {
+        ssize_t n = recv(conn.fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+          conn.response.append(buf, (size_t)n);
+          if (conn.response.size() > MAX_RESPONSE_BYTES) return -1;
+          continue;
+        }
+        if (n == 0) return conn.state == CONN_RECEIVING ? 1 : -1;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  // Stores the entries and moves the cursor; true if the device has more
+  bool finish(Connection &conn, PassStats &stats) {
+    Device &device = devices[conn.device];
+    const std::string &raw = conn.response;
+    size_t headerEnd = raw.find("\r\n\r\n");
+    int status = 0;
+    if (headerEnd == std::string::npos || sscanf(raw.c_str(), "HTTP/%*s %d", &status) != 1 || status != 200) {
+      stats.failures++;
+      return false;
+    }
+
+    LogsResponse response;
+    if (!parseLogsBody(raw.c_str() + headerEnd + 4, raw.c_str() + raw.size(), device.id, response)) {
+      stats.failures++;
+      return false;
+    }
+    for (const LogRecord &r : response.entries) store.append(r);
+    stats.records += response.entries.size();
+    device.since = response.nextSince;
+    device.skip = response.nextSkip;
+    return response.more && !response.entries.empty();
+  }
+};
+
+static bool loadDevices(const char *path, ColumnStore &store, std::vector<Device> &devices) {
+  FILE *f = fopen(path, "r");
+  if (!f) return false;
+  char line[512];
+  int lineNo = 0;
+  while (fgets(line, sizeof(line), f)) {
+    lineNo++;
+    line[strcspn(line, "\r\n")] = 0;
+    if (line[0] == 0 || line[0] == '#') continue;
+    Device device;
+    if (!parseDevice(line, device)) {
+      fprintf(stderr, "%s:%d: cannot resolve %s\n", path, lineNo, line);
+      continue;
+    }
+    device.id = store.deviceId(device.name);
+    devices.push_back(device);
+  }
+  fclose(f);
+  return true;
+}
+
+static void loadCursors(const std::string &store, std::vector<Device> &devices) {
+  std::map<std::string, std::pair<uint32_t, uint16_t>> cursors;
+  FILE *f = fopen((store + "/cursors.txt").c_str(), "r");
+  if (!f) return;
+  char name[512];
+  unsigned since, skip;
+  while (fscanf(f, "%511s %u %u", name, &since, &skip) == 3) cursors[name] = { since, (uint16_t)skip };
+  fclose(f);
+  for (Device &d : devices) {
+    auto it = cursors.find(d.name);
+    if (it == cursors.end()) continue;
+    d.since = it->second.first;
+    d.skip = it->second.second;
+  }
+}
+
+static bool saveCursors(const std::string &store, const std::vector<Device> &devices) {
+  std::string tmp = store + "/cursors.txt.tmp";
+  FILE *f = fopen(tmp.c_str(), "w");
+  if (!f) return false;
+  for (const Device &d : devices) fprintf(f, "%s %u %u\n", d.name.c_str(), d.since, d.skip);
+  bool ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+  fclose(f);
+  return ok && rename(tmp.c_str(), (store + "/cursors.txt").c_str()) == 0;
+}
+
+static void printPass(const PassStats &s) {
+  fprintf(stderr, "devices=%zu requests=%zu failures=%zu records=%zu seconds=%.3f devices_per_second=%.0f\n",
+          s.devices, s.requests, s.failures, s.records, s.seconds, s.devices / (s.seconds > 0 ? s.seconds : 1e-9));
+}
+
+static int runCollect(const CollectorConfig &cfg) {
+  ColumnStore store;
+  std::vector<Device> devices;
+  if (!store.open(cfg.store)) {
+    fprintf(stderr, "cannot open store %s\n", cfg.store);
+    return 1;
+  }
+  if (!loadDevices(cfg.devicesFile, store, devices)) {
+    fprintf(stderr, "cannot read %s\n", cfg.devicesFile);
+    return 1;
+  }
+  loadCursors(cfg.store, devices);
+
+  Collector collector(cfg, store, devices);
+  for (;;) {
+    PassStats stats = collector.runPass();
+    if (!saveCursors(cfg.store, devices)) fprintf(stderr, "cannot save cursors\n");
+    printPass(stats);
+    if (cfg.once) return stats.failures == 0 ? 0 : 1;
+    double wait = cfg.intervalSec - stats.seconds;
+    if (wait > 0) std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+  }
+}
+
+//================ QUERY ================
+static int runQuery(int argc, char **argv) {
+  const char *storePath = nullptr;
+  const char *deviceName = nullptr;
+  uint32_t from = 0, to = UINT32_MAX;
+  int typeFilter = -1;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--store") == 0) storePath = argv[i + 1];
+    else if (strcmp(argv[i], "--from") == 0) from = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+    else if (strcmp(argv[i], "--to") == 0) to = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+    else if (strcmp(argv[i], "--device") == 0) deviceName = argv[i + 1];
+    else if (strcmp(argv[i], "--type") == 0) typeFilter = atoi(argv[i + 1]);
+    else storePath = nullptr, i = argc;
+  }
+  ColumnStore store;
+  if (!storePath || !store.open(storePath)) {
+    fprintf(stderr, "usage: see the comment at the top of tools/fleet_collector.cpp\n");
+    return 2;
+  }
+  uint32_t deviceId = UINT32_MAX;
+  if (deviceName && !store.findDevice(deviceName, deviceId)) {
+    fprintf(stderr, "unknown device %s\n", deviceName);
+    return 1;
+  }
+
+  size_t rows = 0;
+  printf("time,device,type,value,extra\n");
+  size_t blocks = store.query(from, to, [&](const LogRecord &r) {
+    if (deviceName && r.device != deviceId) return;
+    if (typeFilter >= 0 && r.type != typeFilter) return;
+    printf("%u,%s,%u,%u,%u\n", r.time, store.deviceName(r.device).c_str(), r.type, r.value, r.extra);
+    rows++;
+  });
+  fprintf(stderr, "rows=%zu blocks_read=%zu\n", rows, blocks);
+  return 0;
+}
+
+//================ SIMULATED FLEET ================
+// Serves /d<N>/api/logs?since=&skip= for any N from one epoll loop,
+// following the firmware's cursor rules. Device N logs a cloud sample and a
+// light state in the same second every `period` seconds, so the skip half of
+// the cursor gets exercised, and like the real ring keeps only the newest
+// SIM_MAX_ENTRIES. Credentials are not checked.
+class SimulatedFleet {
+private:
+  int listenFd;
+  int epollFd;
+  int period;
+  uint32_t origin;
+  std::atomic<bool> stopping;
+  std::map<int, std::pair<std::string, size_t>> clients; // fd -> buffered request, then response and bytes sent
+
+  static uint32_t hash(uint32_t a, uint32_t b) {
+    uint32_t h = a * 0x9E3779B1u ^ (b + 0x7F4A7C15u);
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    return h ^ (h >> 12);
+  }
+
+  uint32_t entryTime(uint32_t device, uint64_t k) const {
+    return origin + device % period + (uint32_t)(k / 2) * period;
+  }
+
+  std::string respond(uint32_t device, uint32_t since, uint32_t skip) const {
+    uint32_t now = (uint32_t)time(nullptr);
+    uint32_t base = entryTime(device, 0);
+    uint64_t total = now < base ? 0 : 2 * ((uint64_t)(now - base) / period + 1);
+    uint64_t k = since <= base ? 0 : 2 * (((uint64_t)since - base + period - 1) / period);
+    if (total > SIM_MAX_ENTRIES && k < total - SIM_MAX_ENTRIES) k = total - SIM_MAX_ENTRIES;
+    for (uint32_t s = 0; s < skip && k < total && entryTime(device, k) == since; s++) k++;
+
+    std::string body = "{\"entries\":[";
+    uint32_t nextSince = since, nextSkip = skip;
+    uint64_t end = k + SIM_ENTRIES_PER_RESPONSE < total ? k + SIM_ENTRIES_PER_RESPONSE : total;
+    char item[128];
+    for (uint64_t i = k; i < end; i++) {
+      uint32_t t = entryTime(device, i);
+      uint32_t h = hash(device, (uint32_t)i);
+      bool cloud = (i % 2) == 0;
+      snprintf(item, sizeof(item), "%s{\"time\":%u,\"type\":%u,\"value\":%u,\"extra\":%u}", i == k ? "" : ",", t,
+               cloud ? 0u : 1u, cloud ? 0u : (h & 1), cloud ? h % 1001 : 0u);
+      body += item;
+      if (t == nextSince) {
+        nextSkip++;
+      } else {
+        nextSince = t;
+        nextSkip = 1;
+      }
+    }
+    snprintf(item, sizeof(item), "],\"next\":{\"since\":%u,\"skip\":%u},\"more\":%s}", nextSince, nextSkip,
+             end < total ? "true" : "false");
+    body += item;
+
+    char header[128];
+    snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n\r\n",
+             body.size());
+    return header + body;
+  }
+
+  static std::string notFound() {
+    return "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+  }
+
+  std::string route(const std::string &request) const {
+    unsigned device, since = 0, skip = 0;
+    if (sscanf(request.c_str(), "GET /d%u/api/logs?since=%u&skip=%u", &device, &since, &skip) < 2) return notFound();
+    return respond(device, since, skip);
+  }
+
+  void closeClient(int fd) {
+    close(fd);
+    clients.erase(fd);
+  }
+
+  void acceptAll() {
+    for (;;) {
+      int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK);
+      if (fd < 0) return;
+      epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.fd = fd;
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+      clients[fd] = { std::string(), std::string::npos };
+    }
+  }
+
+  void service(int fd) {
+    auto it = clients.find(fd);
+    if (it == clients.end()) return;
+    std::string &buf = it->second.first;
+    size_t &sent = it->second.second;
+
+    if (sent == std::string::npos) {
+      char chunk[4096];
+      ssize_t n;
+      while ((n = recv(fd, chunk, sizeof(chunk), 0)) > 0) buf.append(chunk, (size_t)n);
+      if (n == 0 || (n < 0 && errno != EAGAIN) || buf.size() > 8192) return closeClient(fd);
+      if (buf.find("\r\n\r\n") == std::string::npos) return;
+      buf = route(buf);
+      sent = 0;
+      epoll_event ev;
+      ev.events = EPOLLOUT;
+      ev.data.fd = fd;
+      epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+    }
+
+    ssize_t n = send(fd, buf.data() + sent, buf.size() - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno != EAGAIN) return closeClient(fd);
+    if (n > 0) sent += (size_t)n;
+    if (sent == buf.size()) closeClient(fd);
+  }
+
+public:
+  SimulatedFleet(int periodSec) : listenFd(-1), epollFd(-1), period(periodSec > 0 ? periodSec : 1), stopping(false) {
+    // Start a day back so the first poll finds a full ring on every device
+    origin = (uint32_t)time(nullptr) - 86400;
+  }
+
+  ~SimulatedFleet() {
+    for (auto &c : clients) close(c.first);
+    if (listenFd >= 0) close(listenFd);
+    if (epollFd >= 0) close(epollFd);
+  }
+
+  // Port 0 picks a free one; returns the port actually bound or -1
+  int listenOn(int port) {
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listenFd, SOMAXCONN) != 0) return -1;
+    socklen_t len = sizeof(addr);
+    getsockname(listenFd, (sockaddr *)&addr, &len);
+
+    epollFd = epoll_create1(0);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = listenFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+    return ntohs(addr.sin_port);
+  }
+
+  void run() {
+    epoll_event events[256];
+    while (!stopping) {
+      int n = epoll_wait(epollFd, events, 256, 100);
+      for (int i = 0; i < n; i++) {
+        if (events[i].data.fd == listenFd) {
+          acceptAll();
+        } else {
+          service(events[i].data.fd);
+        }
+      }
+    }
+  }
+
+  void stop() {
+    stopping = true;
+  }
+};
+
+static int runSimulate(int argc, char **argv) {
+  int port = 8090, period = 60;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--port") == 0) port = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--period") == 0) period = atoi(argv[i + 1]);
+  }
+  SimulatedFleet fleet(period);
+  int bound = fleet.listenOn(port);
+  if (bound < 0) {
+    fprintf(stderr, "cannot listen on port %d\n", port);
+    return 1;
+  }
+  fprintf(stderr, "simulated controllers at http://0.0.0.0:%d/d<N>/api/logs\n", bound);
+  fleet.run();
+  return 0;
+}
+
+//================ LOAD TEST ================
+static int runLoadTest(int argc, char **argv) {
+  int deviceCount = 5000, passes = 3, period = 1;
+  CollectorConfig cfg;
+  cfg.concurrency = 256;
+  std::string storePath;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--devices") == 0) deviceCount = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--concurrency") == 0) cfg.concurrency = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--passes") == 0) passes = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--period") == 0) period = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--store") == 0) storePath = argv[i + 1];
+  }
+  if (storePath.empty()) {
+    char tmpl[] = "/tmp/fleet_loadtest_XXXXXX";
+    if (!mkdtemp(tmpl)) return 1;
+    storePath = tmpl;
+  }
+
+  SimulatedFleet fleet(period);
+  int port = fleet.listenOn(0);
+  if (port < 0) return 1;
+  std::thread server([&fleet]() { fleet.run(); });
+
+  ColumnStore store;
+  store.open(storePath);
+  std::vector<Device> devices;
+  for (int i = 0; i < deviceCount; i++) {
+    Device device;
+    parseDevice("127.0.0.1:" + std::to_string(port) + "/d" + std::to_string(i), device);
+    device.id = store.deviceId(device.name);
+    devices.push_back(device);
+  }
+
+  fprintf(stderr, "store=%s devices=%d concurrency=%d period=%ds\n", storePath.c_str(), deviceCount,
+          cfg.concurrency, period);
+  Collector collector(cfg, store, devices);
+  size_t stored = 0, failures = 0;
+  for (int p = 0; p < passes; p++) {
+    if (p > 0) std::this_thread::sleep_for(std::chrono::seconds(period));
+    PassStats stats = collector.runPass();
+    saveCursors(storePath, devices);
+    stored += stats.records;
+    failures += stats.failures;
+    printPass(stats);
+  }
+  fleet.stop();
+  server.join();
+
+  // Everything collected should come back from a full-range query
+  size_t queried = 0;
+  Clock::time_point queryStart = Clock::now();
+  size_t blocks = store.query(0, UINT32_MAX, [&](const LogRecord &) { queried++; });
+  fprintf(stderr, "stored=%zu queried=%zu blocks=%zu query_seconds=%.3f failures=%zu\n", stored, queried, blocks,
+          secondsSince(queryStart), failures);
+  return queried == stored && failures == 0 ? 0 : 1;
+}
+
+//================ COMMAND LINE ================
+static bool parseCollectArgs(int argc, char **argv, CollectorConfig &cfg) {
+  for (int i = 2; i < argc; i++) {
+    const char *arg = argv[i];
+    if (strcmp(arg, "--once") == 0) {
+      cfg.once = true;
+      continue;
+    }
+    if (i + 1 >= argc) return false;
+    const char *value = argv[++i];
+    if (strcmp(arg, "--devices") == 0) cfg.devicesFile = value;
+    else if (strcmp(arg, "--store") == 0) cfg.store = value;
+    else if (strcmp(arg, "--auth") == 0) cfg.auth = value;
+    else if (strcmp(arg, "--concurrency") == 0) cfg.concurrency = atoi(value);
+    else if (strcmp(arg, "--interval") == 0) cfg.intervalSec = atoi(value);
+    else if (strcmp(arg, "--timeout") == 0) cfg.timeoutMs = atoi(value);
+    else return false;
+  }
+  return cfg.devicesFile && cfg.store && cfg.concurrency > 0;
+}
+
+int main(int argc, char **argv) {
+  signal(SIGPIPE, SIG_IGN);
+  raiseFileLimit();
+  const char *mode = argc > 1 ? argv[1] : "";
+
+  if (strcmp(mode, "collect") == 0) {
+    CollectorConfig cfg;
+    if (parseCollectArgs(argc, argv, cfg)) return runCollect(cfg);
+  } else if (strcmp(mode, "query") == 0) {
+    return runQuery(argc, argv);
+  } else if (strcmp(mode, "simulate") == 0) {
+    return runSimulate(argc, argv);
+  } else if (strcmp(mode, "loadtest") == 0) {
+    return runLoadTest(argc, argv);
+  }
+  fprintf(stderr, "usage: see the comment at the top of tools/fleet_collector.cpp\n");
+  return 2;
+}
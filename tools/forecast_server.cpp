@@ -0,0 +1,438 @@
+// Local stand-in for the Open-Meteo forecast API, for testing forecast fetches
+// offline. Serves /v1/forecast for any latitude/longitude, forecast_days and
+// hourly variable list, with optional latency and fault injection.
+//
+// Build: g++ -O2 -std=c++11 -pthread -o forecast_server tools/forecast_server.cpp
+// Usage: forecast_server [--port N] [--seed N] [--clouds FILE]
+//                        [--latency MS] [--jitter MS] [--chunked]
+//                        [--slow P] [--truncate P] [--fail-5xx P] [--timeout P]
+//                        [--hang-ms MS]
+//
+// Point the device at it by adding "address:port" (default port 8080) to
+// FORECAST_PROVIDERS in config.h.
+//
+// Values are generated from --seed, latitude, longitude and the hour, so the
+// same request always gets the same answer. --clouds replaces generated
+// cloud_cover with a recorded series (same formats as the other tools).
+// Fault probabilities are 0..1 and drawn per request from the seeded RNG:
+//   --slow      body dribbles out in 64-byte chunks every 200 ms
+//   --truncate  body is cut off halfway and the connection closed
+//   --fail-5xx  503 with an Open-Meteo style error body
+//   --timeout   nothing is sent for --hang-ms, then the connection closes
+
+#include "cloud_series.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define MAX_FORECAST_DAYS 16
+#define SLOW_CHUNK_BYTES 64
+#define SLOW_CHUNK_DELAY_MS 200
+#define CHUNK_BYTES 512
+
+struct ServerConfig {
+  int port = 8080;
+  unsigned seed = 1;
+  const char *cloudFile = nullptr;
+  int latencyMs = 0;
+  int jitterMs = 0;
+  bool chunked = false;
+  double slowRate = 0;
+  double truncateRate = 0;
+  double failRate = 0;
+  double timeoutRate = 0;
+  int hangMs = 30000;
+};
+
+enum Fault { FAULT_NONE, FAULT_SLOW, FAULT_TRUNCATE, FAULT_5XX, FAULT_TIMEOUT };
+
+static const char *faultName(Fault f) {
+  switch (f) {
+    case FAULT_SLOW: return "slow";
+    case FAULT_TRUNCATE: return "truncate";
+    case FAULT_5XX: return "5xx";
+    case FAULT_TIMEOUT: return "timeout";
+    default: return "none";
+  }
+}
+
+static ServerConfig config;
+static CloudSeries recordedClouds;
+static std::mutex rngLock;
+static unsigned rngState = 1;
+static std::mutex logLock;
+
+static double nextUniform() {
+  std::lock_guard<std::mutex> guard(rngLock);
+  rngState = rngState * 1103515245u + 12345u;
+  return ((rngState >> 8) & 0xFFFFFF) / (double)0x1000000;
+}
+
+//================ DATA GENERATION ================
+static uint32_t hashValues(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+  uint32_t h = 2166136261u;
+  uint32_t parts[4] = { a, b, c, d };
+  for (uint32_t v : parts) {
+    for (int i = 0; i < 4; i++) {
+      h ^= (v >> (i * 8)) & 0xFF;
+      h *= 16777619u;
+    }
+  }
+  return h;
+}
+
+// Smooth noise in [0, 1]: hashed knots every six hours, cosine-interpolated
+static double smoothNoise(uint32_t variable, double latitude, double longitude, long hourIndex) {
+  uint32_t lat = (uint32_t)lround(latitude * 100);
+  uint32_t lon = (uint32_t)lround(longitude * 100);
+  long knot = hourIndex / 6;
+  double frac = (hourIndex % 6) / 6.0;
+  double a = (hashValues(config.seed ^ variable, lat, lon, (uint32_t)knot) & 0xFFFF) / 65535.0;
+  double b = (hashValues(config.seed ^ variable, lat, lon, (uint32_t)(knot + 1)) & 0xFFFF) / 65535.0;
+  double t = (1 - cos(frac * M_PI)) / 2;
+  return a + (b - a) * t;
+}
+
+struct HourlyVariable {
+  const char *name;
+  const char *unit;
+  double minValue;
+  double maxValue;
+  int decimals;
+};
+
+static const HourlyVariable HOURLY_VARIABLES[] = {
+  { "cloud_cover", "%", 0, 100, 0 },
+  { "cloud_cover_low", "%", 0, 100, 0 },
+  { "cloud_cover_mid", "%", 0, 100, 0 },
+  { "cloud_cover_high", "%", 0, 100, 0 },
+  { "temperature_2m", "°C", -10, 30, 1 },
+  { "precipitation_probability", "%", 0, 100, 0 },
+  { "shortwave_radiation", "W/m²", 0, 900, 1 },
+  { "visibility", "m", 1000, 50000, 1 },
+  { "precipitation", "mm", 0, 4, 1 },
+};
+
+static const HourlyVariable *findVariable(const std::string &name, uint32_t &index) {
+  for (uint32_t i = 0; i < sizeof(HOURLY_VARIABLES) / sizeof(HOURLY_VARIABLES[0]); i++) {
+    if (name == HOURLY_VARIABLES[i].name) {
+      index = i;
+      return &HOURLY_VARIABLES[i];
+    }
+  }
+  return nullptr;
+}
+
+static double variableValue(const HourlyVariable &v, uint32_t index, double latitude, double longitude, long epoch) {
+  if (index == 0 && !recordedClouds.empty()) {
+    size_t cursor = 0;
+    float recorded = recordedClouds.at(epoch, cursor);
+    if (recorded >= 0) return recorded;
+  }
+  double value = v.minValue + (v.maxValue - v.minValue) * smoothNoise(index + 1, latitude, longitude, epoch / 3600);
+  if (index == 6) {
+    // Radiation follows the sun: zero at night, peaking at local solar noon
+    double solarHour = fmod(epoch / 3600.0 + longitude / 15.0 + 24.0, 24.0);
+    double daylight = sin((solarHour - 6) / 12 * M_PI);
+    value = daylight > 0 ? value * daylight : 0;
+  } else if (index == 8) {
+    // Showers: dry most of the time
+    double wet = (smoothNoise(index + 1, latitude, longitude, epoch / 3600) - 0.6) / 0.4;
+    value = wet > 0 ? v.maxValue * wet : 0;
+  }
+  return value;
+}
+
+//================ REQUEST HANDLING ================
+static std::string queryParam(const std::string &query, const char *name) {
+  std::string key = std::string(name) + "=";
+  size_t pos = 0;
+  while (pos < query.size()) {
+    size_t end = query.find('&', pos);
+    if (end == std::string::npos) end = query.size();
+    if (query.compare(pos, key.size(), key) == 0) return query.substr(pos + key.size(), end - pos - key.size());
+    pos = end + 1;
+  }
+  return "";
+}
+
+static std::string urlDecode(const std::string &text) {
+  std::string out;
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == '%' && i + 2 < text.size()) {
+      out += (char)strtol(text.substr(i + 1, 2).c_str(), nullptr, 16);
+      i += 2;
+    } else {
+      out += text[i] == '+' ? ' ' : text[i];
+    }
+  }
+  return out;
+}
+
+static std::string errorBody(const char *reason) {
+  return std::string("{\"error\":true,\"reason\":\"") + reason + "\"}";
+}
+
+// Builds the forecast body; returns the HTTP status
+static int buildForecast(const std::string &query, std::string &body) {
+  std::string latText = queryParam(query, "latitude");
+  std::string lonText = queryParam(query, "longitude");
+  if (latText.empty() || lonText.empty()) {
+    body = errorBody("Parameter 'latitude' and 'longitude' are required");
+    return 400;
+  }
+  double latitude = atof(latText.c_str());
+  double longitude = atof(lonText.c_str());
+  if (latitude < -90 || latitude > 90 || longitude < -180 || longitude > 180) {
+    body = errorBody("Latitude must be in range of -90 to 90°. Longitude must be in range of -180 to 180°.");
+    return 400;
+  }
+
+  std::string daysText = queryParam(query, "forecast_days");
+  int days = daysText.empty() ? 7 : atoi(daysText.c_str());
+  if (days < 0 || days > MAX_FORECAST_DAYS) {
+    body = errorBody("Forecast days is invalid. Allowed range 0 to 16.");
+    return 400;
+  }
+
+  std::string hourly = urlDecode(queryParam(query, "hourly"));
+  char header[384];
+  snprintf(header, sizeof(header),
+           "{\"latitude\":%.4f,\"longitude\":%.4f,\"generationtime_ms\":0.05,\"utc_offset_seconds\":0,"
+           "\"timezone\":\"GMT\",\"timezone_abbreviation\":\"GMT\",\"elevation\":10.0",
+           latitude, longitude);
+  body = header;
+  if (hourly.empty()) {
+    body += "}";
+    return 200;
+  }
+
+  // Validate every variable before writing any of them
+  std::vector<std::pair<const HourlyVariable *, uint32_t>> variables;
+  size_t pos = 0;
+  while (pos <= hourly.size()) {
+    size_t end = hourly.find(',', pos);
+    if (end == std::string::npos) end = hourly.size();
+    std::string name = hourly.substr(pos, end - pos);
+    uint32_t index;
+    const HourlyVariable *v = findVariable(name, index);
+    if (v == nullptr) {
+      body = errorBody(("Cannot initialize WeatherVariable from invalid String value " + name).c_str());
+      return 400;
+    }
+    variables.push_back(std::make_pair(v, index));
+    pos = end + 1;
+  }
+
+  long dayStart = (long)time(nullptr) / 86400 * 86400;
+  int hours = days * 24;
+
+  body += ",\"hourly_units\":{\"time\":\"iso8601\"";
+  for (auto &v : variables) body += std::string(",\"") + v.first->name + "\":\"" + v.first->unit + "\"";
+  body += "},\"hourly\":{\"time\":[";
+  char item[48];
+  for (int h = 0; h < hours; h++) {
+    time_t t = dayStart + h * 3600;
+    struct tm tmUtc;
+    gmtime_r(&t, &tmUtc);
+    strftime(item, sizeof(item), "\"%Y-%m-%dT%H:00\"", &tmUtc);
+    if (h > 0) body += ",";
+    body += item;
+  }
+  body += "]";
+  for (auto &v : variables) {
+    body += std::string(",\"") + v.first->name + "\":[";
+    for (int h = 0; h < hours; h++) {
+      double value = variableValue(*v.first, v.second, latitude, longitude, dayStart + h * 3600);
+      snprintf(item, sizeof(item), "%s%.*f", h > 0 ? "," : "", v.first->decimals, value);
+      body += item;
+    }
+    body += "]";
+  }
+  body += "}}";
+  return 200;
+}
+
+static bool sendAll(int fd, const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+static bool sendChunk(int fd, const char *data, size_t len) {
+  char size[16];
+  int n = snprintf(size, sizeof(size), "%zx\r\n", len);
+  return sendAll(fd, size, n) && sendAll(fd, data, len) && sendAll(fd, "\r\n", 2);
+}
+
+static void sleepMs(int ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static Fault pickFault() {
+  double r = nextUniform();
+  if ((r -= config.timeoutRate) < 0) return FAULT_TIMEOUT;
+  if ((r -= config.failRate) < 0) return FAULT_5XX;
+  if ((r -= config.truncateRate) < 0) return FAULT_TRUNCATE;
+  if ((r -= config.slowRate) < 0) return FAULT_SLOW;
+  return FAULT_NONE;
+}
+
+static void handleConnection(int fd, std::string peer) {
+  std::string request;
+  char chunk[2048];
+  while (request.find("\r\n\r\n") == std::string::npos && request.size() < 16384) {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      close(fd);
+      return;
+    }
+    request.append(chunk, n);
+  }
+
+  std::string line = request.substr(0, request.find("\r\n"));
+  size_t pathStart = line.find(' ');
+  size_t pathEnd = line.find(' ', pathStart + 1);
+  std::string target = pathStart == std::string::npos ? "" : line.substr(pathStart + 1, pathEnd - pathStart - 1);
+  std::string path = target.substr(0, target.find('?'));
+  std::string query = target.find('?') == std::string::npos ? "" : target.substr(target.find('?') + 1);
+
+  Fault fault = pickFault();
+  int delay = config.latencyMs + (config.jitterMs > 0 ? (int)(nextUniform() * config.jitterMs) : 0);
+  if (delay > 0) sleepMs(delay);
+
+  std::string body;
+  int status;
+  if (line.compare(0, 4, "GET ") != 0) {
+    status = 405;
+    body = errorBody("Method not allowed");
+  } else if (path != "/v1/forecast") {
+    status = 404;
+    body = errorBody("Not Found");
+  } else if (fault == FAULT_5XX) {
+    status = 503;
+    body = errorBody("Service temporarily unavailable");
+  } else {
+    status = buildForecast(query, body);
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(logLock);
+    fprintf(stderr, "%s %s -> %d fault=%s delay_ms=%d bytes=%zu\n", peer.c_str(), target.c_str(),
+            fault == FAULT_TIMEOUT ? 0 : status, faultName(fault), delay, body.size());
+  }
+
+  if (fault == FAULT_TIMEOUT) {
+    sleepMs(config.hangMs);
+    close(fd);
+    return;
+  }
+
+  bool chunked = config.chunked || fault == FAULT_SLOW;
+  const char *reason = status == 200 ? "OK" : status == 400 ? "Bad Request" : status == 404 ? "Not Found"
+                       : status == 405 ? "Method Not Allowed" : "Service Unavailable";
+  char header[256];
+  int headerLen;
+  if (chunked) {
+    headerLen = snprintf(header, sizeof(header),
+                         "HTTP/1.1 %d %s\r\nContent-Type: application/json; charset=utf-8\r\n"
+                         "Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n", status, reason);
+  } else {
+    headerLen = snprintf(header, sizeof(header),
+                         "HTTP/1.1 %d %s\r\nContent-Type: application/json; charset=utf-8\r\n"
+                         "Content-Length: %zu\r\nConnection: close\r\n\r\n", status, reason, body.size());
+  }
+  if (!sendAll(fd, header, headerLen)) {
+    close(fd);
+    return;
+  }
+
+  // A truncated body still announces its full length, like a dropped connection would
+  size_t bodyLen = fault == FAULT_TRUNCATE ? body.size() / 2 : body.size();
+  size_t step = fault == FAULT_SLOW ? SLOW_CHUNK_BYTES : CHUNK_BYTES;
+  bool ok = true;
+  for (size_t sent = 0; ok && sent < bodyLen; sent += step) {
+    size_t len = bodyLen - sent < step ? bodyLen - sent : step;
+    ok = chunked ? sendChunk(fd, body.data() + sent, len) : sendAll(fd, body.data() + sent, len);
+    if (fault == FAULT_SLOW) sleepMs(SLOW_CHUNK_DELAY_MS);
+  }
+  if (ok && chunked && fault != FAULT_TRUNCATE) sendAll(fd, "0\r\n\r\n", 5);
+
+  close(fd);
+}
+
+static bool parseArgs(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    if (strcmp(arg, "--chunked") == 0) { config.chunked = true; continue; }
+    if (i + 1 >= argc) return false;
+    const char *value = argv[++i];
+    if (strcmp(arg, "--port") == 0) config.port = atoi(value);
+    else if (strcmp(arg, "--seed") == 0) config.seed = (unsigned)atoi(value);
+    else if (strcmp(arg, "--clouds") == 0) config.cloudFile = value;
+    else if (strcmp(arg, "--latency") == 0) config.latencyMs = atoi(value);
+    else if (strcmp(arg, "--jitter") == 0) config.jitterMs = atoi(value);
+    else if (strcmp(arg, "--slow") == 0) config.slowRate = atof(value);
+    else if (strcmp(arg, "--truncate") == 0) config.truncateRate = atof(value);
+    else if (strcmp(arg, "--fail-5xx") == 0) config.failRate = atof(value);
+    else if (strcmp(arg, "--timeout") == 0) config.timeoutRate = atof(value);
+    else if (strcmp(arg, "--hang-ms") == 0) config.hangMs = atoi(value);
+    else return false;
+  }
+  return config.port > 0;
+}
+
+int main(int argc, char **argv) {
+  if (!parseArgs(argc, argv)) {
+    fprintf(stderr, "usage: see the comment at the top of tools/forecast_server.cpp\n");
+    return 2;
+  }
+  if (config.cloudFile && !recordedClouds.load(config.cloudFile)) {
+    fprintf(stderr, "could not read cloud series from %s\n", config.cloudFile);
+    return 1;
+  }
+  rngState = config.seed;
+  signal(SIGPIPE, SIG_IGN);
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int yes = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(config.port);
+  if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listener, 64) < 0) {
+    perror("listen");
+    return 1;
+  }
+  fprintf(stderr, "forecast stand-in listening on port %d\n", config.port);
+
+  for (;;) {
+    struct sockaddr_in peerAddr;
+    socklen_t peerLen = sizeof(peerAddr);
+    int fd = accept(listener, (struct sockaddr *)&peerAddr, &peerLen);
+    if (fd < 0) continue;
+    char peer[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &peerAddr.sin_addr, peer, sizeof(peer));
+    std::thread(handleConnection, fd, std::string(peer)).detach();
+  }
+}
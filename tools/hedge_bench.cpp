@@ -0,0 +1,350 @@
+// Hedged forecast fetching against local stand-in servers: runs the device's
+// provider policy (forecast_hedge.h) and response framing (http_response.h)
+// over real sockets and compares fetch latency with and without hedging.
+//
+// Build: g++ -O2 -std=c++11 -o hedge_bench tools/hedge_bench.cpp
+// Usage: hedge_bench --provider HOST:PORT [--provider HOST:PORT]...
+//                    [--fetches N] [--timeout MS] [--mode all|primary|fallback|hedged]
+//                    [--path P]
+//
+// Each fetch asks the providers the way fetchForecast() does: "primary" only
+// uses the first one, "fallback" moves on when one fails, and "hedged" also
+// asks the next one when the first is slower than its usual p90. Start two
+// tools/forecast_server instances with different latency profiles, e.g.
+//
+//   ./forecast_server --port 8080 --latency 80 --jitter 40 --timeout 0.05 --hang-ms 3000 &
+//   ./forecast_server --port 8081 --latency 250 --jitter 50 --seed 2 &
+//   ./hedge_bench --provider 127.0.0.1:8080 --provider 127.0.0.1:8081 --fetches 200
+//
+// A fetch succeeds on a 200 whose body looks like a forecast. Before timing
+// anything, canned responses (cut-off chunked ones included) are framed from
+// buffers without a terminating NUL; a mismatch exits with 1.
+
+#include "../forecast_hedge.h"
+#include "../http_response.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define FORECAST_RESPONSE_MAX (1 << 20)
+
+//================ OPTIONS ================
+struct Provider {
+  std::string host;
+  int port;
+  sockaddr_in addr;
+};
+
+struct Options {
+  std::vector<Provider> providers;
+  int fetches = 100;
+  int timeoutMs = 5000;
+  std::string mode = "all";
+  std::string path = "/v1/forecast?latitude=52.0&longitude=5.0&forecast_days=1"
+                     "&hourly=cloud_cover,cloud_cover_low,cloud_cover_mid,cloud_cover_high";
+};
+
+static void usage() {
+  fprintf(stderr,
+          "usage: hedge_bench --provider HOST:PORT [--provider HOST:PORT]...\n"
+          "                   [--fetches N] [--timeout MS] [--mode all|primary|fallback|hedged] [--path P]\n");
+  exit(2);
+}
+
+static bool resolve(Provider &p) {
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *found = NULL;
+  if (getaddrinfo(p.host.c_str(), NULL, &hints, &found) != 0 || found == NULL) return false;
+  p.addr = *(sockaddr_in *)found->ai_addr;
+  p.addr.sin_port = htons(p.port);
+  freeaddrinfo(found);
+  return true;
+}
+
+static bool parseOptions(int argc, char **argv, Options &o) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (i + 1 >= argc) return false;
+    const char *v = argv[++i];
+    if (a == "--provider") {
+      const char *colon = strrchr(v, ':');
+      Provider p;
+      p.host = colon ? std::string(v, colon - v) : std::string(v);
+      p.port = colon ? atoi(colon + 1) : 80;
+      if (!resolve(p)) {
+        fprintf(stderr, "cannot resolve %s\n", p.host.c_str());
+        exit(1);
+      }
+      o.providers.push_back(p);
+    } else if (a == "--fetches") o.fetches = atoi(v);
+    else if (a == "--timeout") o.timeoutMs = atoi(v);
+    else if (a == "--mode") o.mode = v;
+    else if (a == "--path") o.path = v;
+    else return false;
+  }
+  bool modeOk = o.mode == "all" || o.mode == "primary" || o.mode == "fallback" || o.mode == "hedged";
+  return !o.providers.empty() && o.providers.size() <= FORECAST_MAX_PROVIDERS && o.fetches > 0 &&
+         o.timeoutMs > 0 && modeOk;
+}
+
+typedef std::chrono::steady_clock Clock;
+static const Clock::time_point epoch = Clock::now();
+
+// Milliseconds like the device's millis()
+static uint32_t millis() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - epoch).count();
+}
+
+//================ REQUESTS ================
+struct Request {
+  int fd = -1;
+  bool connected = false;
+  bool failed = false;
+  bool closed = false;
+  std::string sendBuf;
+  size_t sent = 0;
+  std::vector<char> rx;
+  size_t rxLen = 0;
+};
+
+static void drop(Request &r) {
+  if (r.fd >= 0) close(r.fd);
+  r = Request();
+}
+
+static bool open(Request &r, const Provider &p, const std::string &path) {
+  r = Request();
+  r.fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (r.fd < 0) return false;
+  fcntl(r.fd, F_SETFL, O_NONBLOCK);
+  int one = 1;
+  setsockopt(r.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  r.sendBuf = "GET " + path + " HTTP/1.1\r\nHost: " + p.host + "\r\nConnection: close\r\n\r\n";
+  if (connect(r.fd, (sockaddr *)&p.addr, sizeof(p.addr)) == 0) {
+    r.connected = true;
+  } else if (errno != EINPROGRESS) {
+    return false;
+  }
+  return true;
+}
+
+// Moves a request along as far as its socket allows
+static void service(Request &r, short revents) {
+  if (revents & (POLLERR | POLLNVAL)) {
+    r.closed = true;
+    if (r.rxLen == 0) r.failed = true;
+    return;
+  }
+  if (!r.connected && (revents & POLLOUT)) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(r.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0) {
+      r.failed = true;
+      return;
+    }
+    r.connected = true;
+  }
+  while (r.connected && r.sent < r.sendBuf.size()) {
+    ssize_t n = send(r.fd, r.sendBuf.data() + r.sent, r.sendBuf.size() - r.sent, MSG_NOSIGNAL);
+    if (n <= 0) break;
+    r.sent += n;
+  }
+  if (revents & (POLLIN | POLLHUP)) {
+    for (;;) {
+      if (r.rx.size() < r.rxLen + 4096 + 1) r.rx.resize(r.rxLen + 16384 + 1);
+      ssize_t n = recv(r.fd, r.rx.data() + r.rxLen, r.rx.size() - r.rxLen - 1, 0);
+      if (n > 0) {
+        r.rxLen += n;
+        r.rx[r.rxLen] = 0;
+        if (r.rxLen > FORECAST_RESPONSE_MAX) {
+          r.failed = true;
+          return;
+        }
+        continue;
+      }
+      if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+        r.closed = true;
+        if (n < 0 && r.rxLen == 0) r.failed = true;
+      }
+      break;
+    }
+  }
+}
+
+static bool looksLikeForecast(const char *body, size_t len) {
+  return len > 0 && body[0] == '{' && strstr(body, "\"hourly\"") != NULL;
+}
+
+// One fetch as fetchForecast() runs it; returns the winner or -1
+static int fetch(ForecastHedge &hedge, const Options &o, std::vector<Request> &requests) {
+  hedge.start(millis(), o.timeoutMs);
+  while (!hedge.isDone(millis())) {
+    int asked = hedge.due(millis());
+    if (asked >= 0 && !open(requests[asked], o.providers[asked], o.path)) {
+      hedge.failed(asked);
+      drop(requests[asked]);
+    }
+
+    std::vector<pollfd> fds;
+    std::vector<int> owners;
+    for (uint8_t i = 0; i < hedge.getCount(); i++) {
+      if (!hedge.isRunning(i)) continue;
+      Request &r = requests[i];
+      short events = POLLIN;
+      if (!r.connected || r.sent < r.sendBuf.size()) events |= POLLOUT;
+      fds.push_back({r.fd, events, 0});
+      owners.push_back(i);
+    }
+    // Short waits so the hedge starts on time
+    if (!fds.empty()) poll(fds.data(), fds.size(), 2);
+
+    for (size_t k = 0; k < fds.size() && hedge.getWinner() < 0; k++) {
+      int i = owners[k];
+      Request &r = requests[i];
+      if (fds[k].revents) service(r, fds[k].revents);
+      if (r.failed) {
+        hedge.failed(i);
+        drop(r);
+        continue;
+      }
+      int status;
+      char *body;
+      size_t len;
+      HttpResponseStatus framed = httpResponseParse(r.rx.data(), r.rxLen, r.closed, status, body, len);
+      if (framed == HTTP_RESPONSE_INCOMPLETE) continue;
+      if (framed == HTTP_RESPONSE_DONE && status == 200 && looksLikeForecast(body, len)) {
+        hedge.succeeded(i, millis());
+      } else {
+        hedge.failed(i);
+      }
+      drop(r);
+    }
+  }
+
+  for (uint8_t i = 0; i < hedge.getCount(); i++) {
+    if (!hedge.isRunning(i)) continue;
+    if (hedge.getWinner() >= 0) {
+      hedge.cancel(i);
+    } else {
+      hedge.failed(i);
+    }
+    drop(requests[i]);
+  }
+  return hedge.getWinner();
+}
+
+//================ FRAMING ================
+struct FramingCase {
+  const char *name;
+  const char *response;
+  bool closed;
+  HttpResponseStatus expect;
+  const char *body;
+};
+
+static const FramingCase framingCases[] = {
+  {"length", "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello", false, HTTP_RESPONSE_DONE, "hello"},
+  {"length cut off", "HTTP/1.1 200 OK\r\nContent-Length: 9\r\n\r\nhello", true, HTTP_RESPONSE_BAD, NULL},
+  {"chunked", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n0\r\n\r\n", true,
+   HTTP_RESPONSE_DONE, "hello"},
+  // What forecast_server --chunked --truncate sends
+  {"chunked cut off after a chunk", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n",
+   true, HTTP_RESPONSE_BAD, NULL},
+  {"chunked cut off in a size", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n1f", true,
+   HTTP_RESPONSE_BAD, NULL},
+  {"chunked cut off in a chunk", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhel", true,
+   HTTP_RESPONSE_BAD, NULL},
+};
+
+// Frames each case from a buffer whose spare byte is a hex digit rather
+// than a NUL, sized so a read past it leaves the allocation
+static bool checkFraming() {
+  bool ok = true;
+  for (const FramingCase &c : framingCases) {
+    size_t len = strlen(c.response);
+    char *buf = (char *)malloc(len + 1);
+    memcpy(buf, c.response, len);
+    buf[len] = 'a';
+    int status = 0;
+    char *body = NULL;
+    size_t bodyLen = 0;
+    HttpResponseStatus framed = httpResponseParse(buf, len, c.closed, status, body, bodyLen);
+    bool pass = framed == c.expect &&
+                (c.body == NULL || (bodyLen == strlen(c.body) && memcmp(body, c.body, bodyLen) == 0));
+    if (!pass) {
+      fprintf(stderr, "framing: %s: got %d, expected %d\n", c.name, framed, c.expect);
+      ok = false;
+    }
+    free(buf);
+  }
+  return ok;
+}
+
+//================ MAIN ================
+static double percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+static void run(const Options &o, const char *mode, uint8_t providers, bool hedging) {
+  ForecastHedge hedge;
+  hedge.begin(providers, hedging);
+  std::vector<Request> requests(providers);
+  std::vector<double> latencies;
+  int failures = 0;
+  int fallbackWins = 0;
+  for (int f = 0; f < o.fetches; f++) {
+    Clock::time_point start = Clock::now();
+    int winner = fetch(hedge, o, requests);
+    double ms = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count() / 1000.0;
+    if (winner < 0) {
+      failures++;
+    } else {
+      latencies.push_back(ms);
+      if (winner > 0) fallbackWins++;
+    }
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  printf("%-8s %zu ok, %d failed, %d answered by a later provider\n", mode, latencies.size(), failures,
+         fallbackWins);
+  printf("         latency ms: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", percentile(latencies, 0.5),
+         percentile(latencies, 0.9), percentile(latencies, 0.99), latencies.empty() ? 0 : latencies.back());
+  for (uint8_t i = 0; i < providers; i++) {
+    const ForecastProviderStats &s = hedge.getStats(i);
+    printf("         %s:%d requests %u ok %u failed %u wins %u hedged %u cancelled %u p50 %u p90 %u delay %u\n",
+           o.providers[i].host.c_str(), o.providers[i].port, s.requests, s.successes, s.failures, s.wins, s.hedged,
+           s.cancelled, s.percentile(50), s.percentile(90), hedge.hedgeDelayMs(i));
+  }
+}
+
+int main(int argc, char **argv) {
+  Options o;
+  if (!parseOptions(argc, argv, o)) usage();
+  if (!checkFraming()) return 1;
+
+  uint8_t count = o.providers.size();
+  if (o.mode == "all" || o.mode == "primary") run(o, "primary", 1, false);
+  if (o.mode == "all" || o.mode == "fallback") run(o, "fallback", count, false);
+  if (o.mode == "all" || o.mode == "hedged") run(o, "hedged", count, true);
+  return 0;
+}
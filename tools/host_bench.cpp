@@ -0,0 +1,120 @@
+// The /api/bench cases on a Linux host, as a baseline for bench_compare.
+//
+// Links the real sketch on the Arduino fakes in tools/fakes (see
+// CMakeLists.txt), runs setup() and requests /api/bench from it, so the
+// cases and their setup are exactly the device's. The fake core counts
+// cycles in nanoseconds (cpuMHz 1000), so host and device results are
+// each only comparable with their own kind.
+//
+// Build: cmake -S . -B build && cmake --build build --target host_bench
+// Usage: host_bench [--runs N] > current.json
+//        bench_compare baseline.json current.json [threshold_percent]
+//
+// With --runs (default 5) every case is measured N times and the run with
+// the lowest average is kept, which takes most scheduler noise out of the
+// comparison.
+
+#include "../admission.h"
+#include "fake_host.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#define BENCH_REQUEST_LIMIT_MS 60000  // Virtual time the request may take
+
+// The sketch, from the sketch library
+void setup();
+void loop();
+
+struct CaseResult {
+  std::string object;  // The case's JSON object as the sketch wrote it
+  double avgCycles;
+};
+
+// The body of GET /api/bench, or an empty string without a 200 answer
+static std::string requestBench() {
+  std::shared_ptr<FakeExchange> exchange = fakeRequest(80,
+      "GET /api/bench HTTP/1.1\r\nHost: lightcontroller\r\n"
+      "Authorization: Basic YWRtaW46YWRtaW4=\r\nConnection: close\r\n\r\n");
+  uint64_t deadline = fakeMillis() + BENCH_REQUEST_LIMIT_MS;
+  while (!exchange->done && fakeMillis() < deadline) loop();
+  const std::string &response = exchange->response;
+  if (response.compare(0, 13, "HTTP/1.1 200 ") != 0) {
+    fprintf(stderr, "/api/bench answered: %.*s\n", (int)response.find("\r\n"), response.c_str());
+    return "";
+  }
+  size_t body = response.find("\r\n\r\n");
+  return body == std::string::npos ? "" : response.substr(body + 4);
+}
+
+// Keeps each case's fastest run; cases reported with an error are kept
+// only until a run measures them
+static void mergeResults(const std::string &json, std::vector<std::string> &order,
+                         std::map<std::string, CaseResult> &best) {
+  size_t pos = 0;
+  while ((pos = json.find("{\"name\":\"", pos)) != std::string::npos) {
+    size_t nameStart = pos + 9;
+    size_t nameEnd = json.find('"', nameStart);
+    size_t end = json.find('}', nameStart);
+    if (nameEnd == std::string::npos || end == std::string::npos) break;
+    std::string name = json.substr(nameStart, nameEnd - nameStart);
+    CaseResult result = { json.substr(pos, end + 1 - pos), -1 };
+    size_t avg = json.find("\"avgCycles\":", nameEnd);
+    if (avg != std::string::npos && avg < end) result.avgCycles = atof(json.c_str() + avg + 12);
+    pos = end + 1;
+
+    auto found = best.find(name);
+    if (found == best.end()) {
+      order.push_back(name);
+      best[name] = result;
+    } else if (result.avgCycles >= 0 &&
+               (found->second.avgCycles < 0 || result.avgCycles < found->second.avgCycles)) {
+      found->second = result;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  int runs = 5;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+    } else {
+      runs = 0;
+      break;
+    }
+  }
+  if (runs < 1) {
+    fprintf(stderr, "usage: host_bench [--runs N] > current.json\n");
+    return 2;
+  }
+
+  std::string head;  // cpuMHz and freeHeap from the first run
+  std::vector<std::string> order;
+  std::map<std::string, CaseResult> best;
+  try {
+    setup();
+    for (int run = 0; run < runs; run++) {
+      // Each run spends one of the shared blocking-request tokens
+      if (run > 0) fakeAdvance(ADMISSION_EXPENSIVE_REFILL_MS);
+      std::string json = requestBench();
+      if (json.empty()) return 1;
+      if (run == 0) head = json.substr(0, json.find("\"results\":["));
+      mergeResults(json, order, best);
+    }
+  } catch (const FakeRestart &) {
+    fprintf(stderr, "the sketch restarted at %llu ms\n", (unsigned long long)fakeMillis());
+    return 1;
+  }
+
+  printf("%s\"runs\":%d,\"results\":[", head.c_str(), runs);
+  for (size_t i = 0; i < order.size(); i++) {
+    printf("%s%s", i == 0 ? "" : ",", best[order[i]].object.c_str());
+  }
+  printf("]}\n");
+  return 0;
+}
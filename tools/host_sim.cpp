@@ -0,0 +1,262 @@
+// Accelerated-time run of the sketch itself on a Linux host.
+//
+// Links the real setup() and loop(), built on the Arduino fakes in
+// tools/fakes (see CMakeLists.txt), and drives them on a simulated clock:
+// forecast requests are answered from a cloud coverage series by a fake
+// Open-Meteo host, settings go in through PUT /api/config, and relay
+// transitions come from the sketch's own GPIO writes.
+//
+// Build: cmake -S . -B build && cmake --build build --target host_sim
+// Usage: host_sim [--days N] [--tick-ms MS] [--lat DEG] [--lon DEG] [--tz SEC]
+//                 [--threshold PCT] [--hysteresis PCT] [--window MIN]
+//                 [--sunrise-offset MIN] [--sunset-offset MIN] [--retries N]
+//                 [--clouds FILE] [--seed N] [--fail-rate P] [--eeprom FILE]
+//                 [--serial] [--transitions]
+//
+// Each loop() pass ends in the sketch's delay(100); --tick-ms lets more
+// virtual time pass between passes so a year runs in seconds. --clouds reads
+// "epoch,coverage" lines (hourly samples, UTC epoch seconds) or an
+// /api/logs?type=cloud export; without it a seeded random-walk series is
+// generated. The fake provider only fills in total cloud cover, so the sky
+// model works from that alone. --eeprom keeps the flash image in a file
+// between runs; --serial copies the sketch's trace output to stderr.
+
+#include "../controller_core.h"
+#include "cloud_series.h"
+#include "fake_host.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+#define SIM_RELAY_PIN 12            // RELAY_PIN in config.h
+#define SIM_FORECAST_HOST "api.open-meteo.com"
+#define SIM_FORECAST_ADDRESS "10.0.0.2"
+#define SIM_REQUEST_LIMIT_MS 60000  // Virtual time a request to the sketch may take
+
+// The sketch, from the sketch library
+void setup();
+void loop();
+extern DecisionState decision;
+
+struct SimConfig {
+  int days = 365;
+  int tickMs = 10000;
+  double latitude = 52.0;
+  double longitude = 5.0;
+  int tzSeconds = 3600;
+  int threshold = 78;
+  int hysteresis = 5;
+  int window = 30;
+  int sunriseOffset = 0;
+  int sunsetOffset = 0;
+  int retries = 3;
+  const char *cloudFile = nullptr;
+  unsigned seed = 1;
+  double failRate = 0.0;
+  const char *eepromFile = nullptr;
+  bool serial = false;
+  bool printTransitions = false;
+  long startEpoch = 1735689600; // 2025-01-01T00:00:00Z
+};
+
+struct SimStats {
+  long long passes = 0;
+  long long fetches = 0;
+  long long failedFetches = 0;
+  long long switches = 0;
+  long long earlyActivations = 0;
+  double onMinutes = 0;
+};
+
+static CloudSeries cloudSeries;
+static size_t cloudCursor = 0;
+static unsigned rngState = 1;
+static SimConfig cfg;
+static SimStats stats;
+
+static unsigned nextRandom() {
+  rngState = rngState * 1103515245u + 12345u;
+  return (rngState >> 8) & 0xFFFFFF;
+}
+
+// Open-Meteo's /v1/forecast for the fake provider: hourly total cloud cover
+// from the series for `forecast_days` UTC days, starting today
+static std::string serveForecast(const std::string &request) {
+  stats.fetches++;
+  if (cfg.failRate > 0 && nextRandom() < cfg.failRate * 0xFFFFFF) {
+    stats.failedFetches++;
+    return "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+  }
+
+  int days = 1;
+  size_t at = request.find("forecast_days=");
+  if (at != std::string::npos) days = atoi(request.c_str() + at + 14);
+  if (days < 1 || days > 16) days = 1;
+
+  long start = fakeEpoch() - fakeEpoch() % 86400;
+  std::string times = "[";
+  std::string cover = "[";
+  for (int h = 0; h < days * 24; h++) {
+    long epoch = start + h * 3600L;
+    time_t t = epoch;
+    struct tm utc;
+    gmtime_r(&t, &utc);
+    char text[32];
+    strftime(text, sizeof(text), "\"%Y-%m-%dT%H:%M\"", &utc);
+    float value = cloudSeries.at(epoch, cloudCursor);
+    if (value < 0) {
+      cover += "null";
+    } else {
+      char number[16];
+      snprintf(number, sizeof(number), "%.0f", value);
+      cover += number;
+    }
+    times += text;
+    if (h + 1 < days * 24) {
+      times += ",";
+      cover += ",";
+    }
+  }
+  char head[128];
+  snprintf(head, sizeof(head), "{\"latitude\":%.4f,\"longitude\":%.4f,\"hourly\":{\"time\":", cfg.latitude, cfg.longitude);
+  std::string body = std::string(head) + times + "],\"cloud_cover\":" + cover + "]}}";
+  return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) +
+         "\r\nConnection: close\r\n\r\n" + body;
+}
+
+// Sends one request to the sketch's web server and runs the loop until it
+// has answered; the status code, or -1 without an answer
+static int requestSketch(const std::string &method, const std::string &path, const std::string &body) {
+  std::string request = method + " " + path + " HTTP/1.1\r\nHost: lightcontroller\r\n"
+                        "Authorization: Basic YWRtaW46YWRtaW4=\r\nContent-Type: application/json\r\n"
+                        "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+  std::shared_ptr<FakeExchange> exchange = fakeRequest(80, request);
+  uint64_t deadline = fakeMillis() + SIM_REQUEST_LIMIT_MS;
+  while (!exchange->done && fakeMillis() < deadline) loop();
+  if (exchange->response.compare(0, 9, "HTTP/1.1 ") != 0) return -1;
+  return atoi(exchange->response.c_str() + 9);
+}
+
+static bool configureSketch() {
+  char body[512];
+  snprintf(body, sizeof(body),
+           "{\"latitude\":%.4f,\"longitude\":%.4f,\"timezoneOffset\":%d,\"daylightOffset\":0,"
+           "\"cloudThreshold\":%d,\"cloudHysteresis\":%d,\"monitoringWindow\":%d,"
+           "\"sunriseOffset\":%d,\"sunsetOffset\":%d,\"maxRetries\":%d,\"relayLogic\":\"active_high\"}",
+           cfg.latitude, cfg.longitude, cfg.tzSeconds, cfg.threshold, cfg.hysteresis, cfg.window,
+           cfg.sunriseOffset, cfg.sunsetOffset, cfg.retries);
+  int status = requestSketch("PUT", "/api/config", body);
+  if (status != 200) {
+    fprintf(stderr, "PUT /api/config answered %d\n", status);
+    return false;
+  }
+  return true;
+}
+
+static bool parseArgs(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (strcmp(arg, "--transitions") == 0) { cfg.printTransitions = true; continue; }
+    if (strcmp(arg, "--serial") == 0) { cfg.serial = true; continue; }
+    if (!value) return false;
+    i++;
+    if (strcmp(arg, "--days") == 0) cfg.days = atoi(value);
+    else if (strcmp(arg, "--tick-ms") == 0) cfg.tickMs = atoi(value);
+    else if (strcmp(arg, "--lat") == 0) cfg.latitude = atof(value);
+    else if (strcmp(arg, "--lon") == 0) cfg.longitude = atof(value);
+    else if (strcmp(arg, "--tz") == 0) cfg.tzSeconds = atoi(value);
+    else if (strcmp(arg, "--threshold") == 0) cfg.threshold = atoi(value);
+    else if (strcmp(arg, "--hysteresis") == 0) cfg.hysteresis = atoi(value);
+    else if (strcmp(arg, "--window") == 0) cfg.window = atoi(value);
+    else if (strcmp(arg, "--retries") == 0) cfg.retries = atoi(value);
+    else if (strcmp(arg, "--sunrise-offset") == 0) cfg.sunriseOffset = atoi(value);
+    else if (strcmp(arg, "--sunset-offset") == 0) cfg.sunsetOffset = atoi(value);
+    else if (strcmp(arg, "--clouds") == 0) cfg.cloudFile = value;
+    else if (strcmp(arg, "--seed") == 0) cfg.seed = (unsigned)atoi(value);
+    else if (strcmp(arg, "--fail-rate") == 0) cfg.failRate = atof(value);
+    else if (strcmp(arg, "--eeprom") == 0) cfg.eepromFile = value;
+    else return false;
+  }
+  return cfg.days > 0 && cfg.tickMs > 0;
+}
+
+int main(int argc, char **argv) {
+  if (!parseArgs(argc, argv)) {
+    fprintf(stderr, "usage: see the comment at the top of tools/host_sim.cpp\n");
+    return 2;
+  }
+
+  if (cfg.cloudFile) {
+    if (!cloudSeries.load(cfg.cloudFile)) {
+      fprintf(stderr, "could not read cloud series from %s\n", cfg.cloudFile);
+      return 1;
+    }
+    cfg.startEpoch = cloudSeries.firstEpoch() - cloudSeries.firstEpoch() % 86400;
+    rngState = cfg.seed;
+  } else {
+    cloudSeries.generate(cfg.startEpoch - 86400, cfg.days + 2, cfg.seed);
+    rngState = cfg.seed * 2654435761u + 1;
+  }
+
+  fakeSetEpoch(cfg.startEpoch);
+  fakeEepromFile(cfg.eepromFile);
+  fakeSerialEcho(cfg.serial);
+  fakeAddHost(SIM_FORECAST_HOST, SIM_FORECAST_ADDRESS, 80, serveForecast);
+
+  auto wallStart = std::chrono::steady_clock::now();
+  try {
+    setup();
+    if (!configureSketch()) return 1;
+    fakeClearPinChanges();
+
+    bool lightOn = fakePinLevel(SIM_RELAY_PIN) == 1;
+    uint64_t startMs = fakeMillis();
+    uint64_t lastOnMs = startMs;
+    uint64_t endMs = startMs + (uint64_t)cfg.days * 86400 * 1000;
+    while (fakeMillis() < endMs) {
+      uint64_t passStart = fakeMillis();
+      loop();
+      stats.passes++;
+      uint64_t spent = fakeMillis() - passStart;
+      if (spent < (uint64_t)cfg.tickMs) fakeAdvance(cfg.tickMs - spent);
+
+      for (const FakePinChange &change : fakePinChanges()) {
+        if (change.pin != SIM_RELAY_PIN || (change.level == 1) == lightOn) continue;
+        lightOn = change.level == 1;
+        stats.switches++;
+        if (lightOn) {
+          lastOnMs = change.ms;
+          if (decision.cloudTriggered) stats.earlyActivations++;
+        } else {
+          stats.onMinutes += (change.ms - lastOnMs) / 60000.0;
+        }
+        if (cfg.printTransitions) {
+          long epoch = cfg.startEpoch + (long)(change.ms / 1000);
+          printf("%ld relay=%s cause=%s\n", epoch, lightOn ? "on" : "off",
+                 lightOn && decision.cloudTriggered ? "cloud" : "schedule");
+        }
+      }
+      fakeClearPinChanges();
+    }
+    if (lightOn) stats.onMinutes += (endMs - lastOnMs) / 60000.0;
+  } catch (const FakeRestart &) {
+    fprintf(stderr, "the sketch restarted at %llu ms\n", (unsigned long long)fakeMillis());
+    return 1;
+  }
+
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  printf("days=%d tick_ms=%d loop_passes=%lld\n", cfg.days, cfg.tickMs, stats.passes);
+  printf("lights_on_minutes=%.0f switches=%lld early_activations=%lld\n",
+         stats.onMinutes, stats.switches, stats.earlyActivations);
+  printf("cloud_fetches=%lld failed_fetches=%lld\n", stats.fetches, stats.failedFetches);
+  printf("wall_seconds=%.3f passes_per_second=%.0f speedup=%.0fx\n", wallSeconds,
+         stats.passes / (wallSeconds > 0 ? wallSeconds : 1e-9),
+         (double)cfg.days * 86400 / (wallSeconds > 0 ? wallSeconds : 1e-9));
+  return 0;
+}
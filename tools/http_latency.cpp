@@ -0,0 +1,240 @@
+// Web server latency under concurrent clients: each client thread requests
+// the given paths in turn over a fresh connection, the way a browser on the
+// dashboard does, and the tool reports throughput and latency percentiles.
+//
+// Build: g++ -O2 -std=c++11 -pthread -o http_latency tools/http_latency.cpp
+// Usage: http_latency --host ADDR [--port N] [--path P]... [--auth USER:PASS]
+//                     [--clients N] [--seconds N] [--rate REQ_PER_SEC] [--timeout MS]
+//
+// Latency runs from connect() to the server closing the connection, so it
+// includes the time a request waits for the loop. Admission control limits
+// each client address to a few requests per second; run with --rate to stay
+// under it or the results mostly measure 429 responses, which are counted
+// separately. Compare runs with --clients 1 and --clients 5..10 to see how
+// much one client's requests are held up by the others.
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//================ OPTIONS ================
+struct Options {
+  std::string host;
+  int port = 80;
+  std::vector<std::string> paths;
+  std::string auth;
+  int clients = 5;
+  int seconds = 30;
+  double rate = 0;           // Requests per second per client, 0 for back to back
+  int timeoutMs = 10000;
+};
+
+static void usage() {
+  fprintf(stderr,
+          "usage: http_latency --host ADDR [--port N] [--path P]... [--auth USER:PASS]\n"
+          "                    [--clients N] [--seconds N] [--rate REQ_PER_SEC] [--timeout MS]\n");
+  exit(2);
+}
+
+static bool parseOptions(int argc, char **argv, Options &o) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (i + 1 >= argc) return false;
+    const char *v = argv[++i];
+    if (a == "--host") o.host = v;
+    else if (a == "--port") o.port = atoi(v);
+    else if (a == "--path") o.paths.push_back(v);
+    else if (a == "--auth") o.auth = v;
+    else if (a == "--clients") o.clients = atoi(v);
+    else if (a == "--seconds") o.seconds = atoi(v);
+    else if (a == "--rate") o.rate = atof(v);
+    else if (a == "--timeout") o.timeoutMs = atoi(v);
+    else return false;
+  }
+  if (o.paths.empty()) o.paths.push_back("/api/status");
+  return !o.host.empty() && o.clients > 0 && o.seconds > 0 && o.rate >= 0 && o.timeoutMs > 0;
+}
+
+typedef std::chrono::steady_clock Clock;
+
+static double msSince(Clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count() / 1000.0;
+}
+
+static std::string base64(const std::string &in) {
+  static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  for (size_t i = 0; i < in.size(); i += 3) {
+    uint32_t n = (uint8_t)in[i] << 16;
+    if (i + 1 < in.size()) n |= (uint8_t)in[i + 1] << 8;
+    if (i + 2 < in.size()) n |= (uint8_t)in[i + 2];
+    out += table[(n >> 18) & 63];
+    out += table[(n >> 12) & 63];
+    out += i + 1 < in.size() ? table[(n >> 6) & 63] : '=';
+    out += i + 2 < in.size() ? table[n & 63] : '=';
+  }
+  return out;
+}
+
+//================ REQUESTS ================
+enum Outcome { OK, REJECTED, HTTP_ERROR, FAILED };
+
+struct Results {
+  std::mutex lock;
+  std::vector<double> latencies;   // Successful requests only
+  uint64_t rejected = 0;
+  uint64_t httpErrors = 0;
+  uint64_t failures = 0;
+  uint64_t bytes = 0;
+};
+
+static sockaddr_in serverAddr;
+
+static bool waitFor(int fd, short events, Clock::time_point deadline) {
+  int left = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+  if (left <= 0) return false;
+  pollfd p = {fd, events, 0};
+  return poll(&p, 1, left) == 1;
+}
+
+// One request on its own connection; the body ends when the server closes
+static Outcome request(const std::string &text, int timeoutMs, size_t &bytes) {
+  Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return FAILED;
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (connect(fd, (sockaddr *)&serverAddr, sizeof(serverAddr)) != 0) {
+    close(fd);
+    return FAILED;
+  }
+
+  size_t sent = 0;
+  while (sent < text.size()) {
+    ssize_t n = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      close(fd);
+      return FAILED;
+    }
+    sent += n;
+  }
+
+  std::string response;
+  char buf[4096];
+  for (;;) {
+    if (!waitFor(fd, POLLIN, deadline)) {
+      close(fd);
+      return FAILED;
+    }
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n < 0) {
+      close(fd);
+      return FAILED;
+    }
+    if (n == 0) break;
+    // Only the status line is looked at
+    if (response.size() < 64) response.append(buf, n);
+    bytes += n;
+  }
+  close(fd);
+
+  int status = 0;
+  if (sscanf(response.c_str(), "HTTP/1.%*d %d", &status) != 1) return FAILED;
+  if (status == 429) return REJECTED;
+  return status < 400 ? OK : HTTP_ERROR;
+}
+
+static void runClient(const Options &o, int index, Clock::time_point end, Results &results) {
+  std::vector<std::string> texts;
+  for (const std::string &path : o.paths) {
+    std::string text = "GET " + path + " HTTP/1.1\r\nHost: " + o.host + "\r\n";
+    if (!o.auth.empty()) text += "Authorization: Basic " + base64(o.auth) + "\r\n";
+    texts.push_back(text + "Connection: close\r\n\r\n");
+  }
+
+  std::vector<double> latencies;
+  uint64_t rejected = 0, httpErrors = 0, failures = 0;
+  size_t bytes = 0;
+  double periodMs = o.rate > 0 ? 1000.0 / o.rate : 0;
+  Clock::time_point next = Clock::now();
+  // Clients start on different paths so each path sees concurrent requests
+  for (size_t i = index; Clock::now() < end; i++) {
+    Clock::time_point start = Clock::now();
+    Outcome outcome = request(texts[i % texts.size()], o.timeoutMs, bytes);
+    if (outcome == OK) latencies.push_back(msSince(start));
+    else if (outcome == REJECTED) rejected++;
+    else if (outcome == HTTP_ERROR) httpErrors++;
+    else failures++;
+
+    if (periodMs > 0) {
+      next += std::chrono::microseconds((int64_t)(periodMs * 1000));
+      std::this_thread::sleep_until(std::min(next, end));
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(results.lock);
+  results.latencies.insert(results.latencies.end(), latencies.begin(), latencies.end());
+  results.rejected += rejected;
+  results.httpErrors += httpErrors;
+  results.failures += failures;
+  results.bytes += bytes;
+}
+
+//================ MAIN ================
+static double percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+int main(int argc, char **argv) {
+  Options o;
+  if (!parseOptions(argc, argv, o)) usage();
+
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *found = NULL;
+  if (getaddrinfo(o.host.c_str(), NULL, &hints, &found) != 0 || found == NULL) {
+    fprintf(stderr, "cannot resolve %s\n", o.host.c_str());
+    return 1;
+  }
+  serverAddr = *(sockaddr_in *)found->ai_addr;
+  serverAddr.sin_port = htons(o.port);
+  freeaddrinfo(found);
+
+  Results results;
+  Clock::time_point start = Clock::now();
+  Clock::time_point end = start + std::chrono::seconds(o.seconds);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < o.clients; i++) {
+    threads.push_back(std::thread(runClient, std::cref(o), i, end, std::ref(results)));
+  }
+  for (std::thread &t : threads) t.join();
+  double elapsedSec = msSince(start) / 1000;
+
+  std::vector<double> &l = results.latencies;
+  std::sort(l.begin(), l.end());
+  printf("clients %d, %.1f s: %zu ok, %llu rejected (429), %llu http errors, %llu failed\n", o.clients, elapsedSec,
+         l.size(), (unsigned long long)results.rejected, (unsigned long long)results.httpErrors,
+         (unsigned long long)results.failures);
+  printf("throughput %.1f req/s, %.1f KB/s\n", l.size() / elapsedSec, results.bytes / 1024.0 / elapsedSec);
+  printf("latency ms: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", percentile(l, 0.5), percentile(l, 0.9),
+         percentile(l, 0.99), l.empty() ? 0 : l.back());
+  return l.empty() ? 1 : 0;
+}
@@ -0,0 +1,375 @@
+// MQTT telemetry load generator: runs many simulated controllers against a
+// broker, each with the firmware's event queue and batch encoder, and reports
+// the message rate, event rate, bandwidth and queue memory.
+//
+// Build: g++ -O2 -std=c++11 -o mqtt_load tools/mqtt_load.cpp
+// Usage: mqtt_load [--host ADDR] [--port N] [--clients N] [--rate EVENTS_PER_SEC]
+//                  [--seconds N] [--interval MS] [--outage-at SEC] [--outage-for SEC]
+//                  [--prefix TOPIC]
+//
+// Every client connects like a unit does (clean session, retained will on
+// <prefix>/<id>/status), queues --rate events per second and publishes one
+// batch per --interval on <prefix>/<id>/events. --outage-at/--outage-for
+// drops every connection for a while; events keep queueing (and the oldest
+// are dropped once a queue is full) and are replayed after reconnecting.
+// Watch the traffic with: mosquitto_sub -t 'loadtest/#' -v
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "../mqtt_batch.h"
+
+//================ OPTIONS ================
+struct Options {
+  std::string host = "127.0.0.1";
+  int port = 1883;
+  int clients = 100;
+  double rate = 1;          // Events per second per client
+  int seconds = 30;
+  int intervalMs = 5000;
+  int outageAt = -1;        // Seconds after start, -1 for none
+  int outageFor = 0;
+  std::string prefix = "loadtest";
+};
+
+static void usage() {
+  fprintf(stderr,
+          "usage: mqtt_load [--host ADDR] [--port N] [--clients N] [--rate EVENTS_PER_SEC]\n"
+          "                 [--seconds N] [--interval MS] [--outage-at SEC] [--outage-for SEC]\n"
+          "                 [--prefix TOPIC]\n");
+  exit(2);
+}
+
+static bool parseOptions(int argc, char **argv, Options &o) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (i + 1 >= argc) return false;
+    const char *v = argv[++i];
+    if (a == "--host") o.host = v;
+    else if (a == "--port") o.port = atoi(v);
+    else if (a == "--clients") o.clients = atoi(v);
+    else if (a == "--rate") o.rate = atof(v);
+    else if (a == "--seconds") o.seconds = atoi(v);
+    else if (a == "--interval") o.intervalMs = atoi(v);
+    else if (a == "--outage-at") o.outageAt = atoi(v);
+    else if (a == "--outage-for") o.outageFor = atoi(v);
+    else if (a == "--prefix") o.prefix = v;
+    else return false;
+  }
+  return o.clients > 0 && o.rate >= 0 && o.seconds > 0 && o.intervalMs > 0;
+}
+
+static double nowMs() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count() / 1000.0;
+}
+
+//================ CLIENTS ================
+enum ClientState { C_WAITING, C_TCP, C_CONNACK, C_CONNECTED };
+
+struct Client {
+  int fd = -1;
+  ClientState state = C_WAITING;
+  MqttEventQueue queue;
+  uint8_t packet[MQTT_PACKET_SIZE];
+  std::string pending;       // Unsent tail of the last packet
+  uint8_t connack[4];
+  int connackLen = 0;
+  uint32_t sequence = 0;
+  double nextEventMs = 0;
+  double lastBatchMs = 0;
+  double lastPingMs = 0;
+  double retryAtMs = 0;
+  double backoffMs = 2000;
+  bool backlog = false;
+  char clientId[32];
+  char eventsTopic[96];
+  char statusTopic[96];
+};
+
+struct Totals {
+  uint64_t messages = 0;
+  uint64_t events = 0;
+  uint64_t bytes = 0;
+  uint64_t connects = 0;
+  uint64_t failures = 0;
+};
+
+static sockaddr_in brokerAddr;
+static Totals totals;
+
+static void closeClient(Client &c, double now, bool failed) {
+  if (c.fd >= 0) close(c.fd);
+  c.fd = -1;
+  c.pending.clear();
+  if (failed) {
+    totals.failures++;
+    c.backoffMs = c.backoffMs * 2 > 120000 ? 120000 : c.backoffMs * 2;
+  } else {
+    c.backoffMs = 2000;
+  }
+  c.retryAtMs = now + c.backoffMs;
+  c.state = C_WAITING;
+}
+
+// Sends what the socket takes now and keeps the rest for the next pass, the
+// host stand-in for the firmware's availableForWrite() check
+static bool sendPacket(Client &c, const uint8_t *data, size_t len) {
+  ssize_t n = send(c.fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+  if (n < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+    n = 0;
+  }
+  if ((size_t)n < len) c.pending.assign((const char *)data + n, len - n);
+  totals.bytes += len;
+  return true;
+}
+
+static bool flushPending(Client &c) {
+  if (c.pending.empty()) return true;
+  ssize_t n = send(c.fd, c.pending.data(), c.pending.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+  if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+  c.pending.erase(0, n);
+  return true;
+}
+
+static void startConnect(Client &c, double now) {
+  c.fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (c.fd < 0) {
+    closeClient(c, now, true);
+    return;
+  }
+  fcntl(c.fd, F_SETFL, fcntl(c.fd, F_GETFL) | O_NONBLOCK);
+  int one = 1;
+  setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (connect(c.fd, (sockaddr *)&brokerAddr, sizeof(brokerAddr)) < 0 && errno != EINPROGRESS) {
+    closeClient(c, now, true);
+    return;
+  }
+  c.state = C_TCP;
+  c.retryAtMs = now + 5000; // Handshake and CONNACK deadline
+}
+
+static void sendConnect(Client &c, double now) {
+  int err = 0;
+  socklen_t errLen = sizeof(err);
+  getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &errLen);
+  if (err != 0) {
+    closeClient(c, now, true);
+    return;
+  }
+  size_t len = mqttEncodeConnect(c.packet, sizeof(c.packet), c.clientId, "", "", c.statusTopic, "offline");
+  if (!sendPacket(c, c.packet, len)) {
+    closeClient(c, now, true);
+    return;
+  }
+  c.state = C_CONNACK;
+  c.connackLen = 0;
+}
+
+static void readIncoming(Client &c, double now) {
+  uint8_t in[256];
+  ssize_t n = recv(c.fd, in, sizeof(in), MSG_DONTWAIT);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    closeClient(c, now, true);
+    return;
+  }
+  if (n < 0 || c.state != C_CONNACK) return;
+
+  for (ssize_t i = 0; i < n && c.connackLen < 4; i++) c.connack[c.connackLen++] = in[i];
+  if (c.connackLen < 4) return;
+  if (mqttParseConnack(c.connack, 4) != 0) {
+    closeClient(c, now, true);
+    return;
+  }
+  c.state = C_CONNECTED;
+  c.backoffMs = 2000;
+  c.lastPingMs = now;
+  c.lastBatchMs = now - 1e9; // First batch right away, replaying the queue
+  totals.connects++;
+  size_t len = mqttEncodePublish(c.packet, sizeof(c.packet), c.statusTopic, "online", 6, true);
+  if (!sendPacket(c, c.packet, len)) closeClient(c, now, true);
+}
+
+static void publishBatch(Client &c, double now, uint32_t uptime) {
+  char state[64];
+  snprintf(state, sizeof(state), "{\"uptime\":%u,\"queued\":%u}", uptime, c.queue.size());
+
+  size_t offset = mqttPayloadOffset(c.eventsTopic);
+  size_t payloadLen;
+  uint16_t included = mqttBuildBatch(c.queue, c.sequence, state, (char *)c.packet + offset,
+                                     sizeof(c.packet) - offset, payloadLen);
+  if (payloadLen == 0) return;
+  size_t len = mqttFinishPublish(c.packet, sizeof(c.packet), c.eventsTopic, payloadLen, false);
+  if (!sendPacket(c, c.packet, len)) {
+    closeClient(c, now, true);
+    return;
+  }
+  c.queue.pop(included);
+  c.backlog = c.queue.size() > 0;
+  c.sequence++;
+  c.lastBatchMs = now;
+  totals.messages++;
+  totals.events += included;
+}
+
+//================ MAIN ================
+static void printLine(double t, const std::vector<Client> &clients, const Totals &delta, double seconds) {
+  int connected = 0;
+  uint64_t queued = 0, dropped = 0;
+  for (const Client &c : clients) {
+    if (c.state == C_CONNECTED) connected++;
+    queued += c.queue.size();
+    dropped += c.queue.getDropped();
+  }
+  printf("%6.1f  %6d  %9.1f  %9.1f  %9.1f  %8llu  %8llu\n", t, connected, delta.messages / seconds,
+         delta.events / seconds, delta.bytes / seconds / 1024, (unsigned long long)queued,
+         (unsigned long long)dropped);
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  Options opt;
+  if (!parseOptions(argc, argv, opt)) usage();
+  signal(SIGPIPE, SIG_IGN);
+
+  memset(&brokerAddr, 0, sizeof(brokerAddr));
+  brokerAddr.sin_family = AF_INET;
+  brokerAddr.sin_port = htons(opt.port);
+  if (inet_pton(AF_INET, opt.host.c_str(), &brokerAddr.sin_addr) != 1) {
+    fprintf(stderr, "mqtt_load: --host must be an IPv4 address\n");
+    return 2;
+  }
+
+  double start = nowMs();
+  double eventGapMs = opt.rate > 0 ? 1000.0 / opt.rate : 1e18;
+  std::vector<Client> clients(opt.clients);
+  for (int i = 0; i < opt.clients; i++) {
+    Client &c = clients[i];
+    snprintf(c.clientId, sizeof(c.clientId), "mqtt-load-%06d", i);
+    snprintf(c.eventsTopic, sizeof(c.eventsTopic), "%s/%06d/events", opt.prefix.c_str(), i);
+    snprintf(c.statusTopic, sizeof(c.statusTopic), "%s/%06d/status", opt.prefix.c_str(), i);
+    // Spread connects, events and batches so the clients don't move in lockstep
+    c.retryAtMs = start + (double)i * 1000 / opt.clients;
+    c.nextEventMs = start + eventGapMs * i / opt.clients;
+  }
+
+  printf("%6s  %6s  %9s  %9s  %9s  %8s  %8s\n", "t", "conn", "msgs/s", "events/s", "KB/s", "queued", "dropped");
+  Totals lastTotals;
+  double lastReport = start;
+  double end = start + opt.seconds * 1000.0;
+  double outageStart = opt.outageAt >= 0 ? start + opt.outageAt * 1000.0 : -1;
+  double outageEnd = outageStart + opt.outageFor * 1000.0;
+  uint64_t produced = 0;
+  std::vector<pollfd> fds;
+  std::vector<int> owners;
+
+  while (nowMs() < end) {
+    double now = nowMs();
+    bool outage = outageStart >= 0 && now >= outageStart && now < outageEnd;
+    uint32_t uptime = (uint32_t)((now - start) / 1000);
+
+    fds.clear();
+    owners.clear();
+    for (int i = 0; i < opt.clients; i++) {
+      Client &c = clients[i];
+      while (now >= c.nextEventMs) {
+        MqttEvent e = { (uint32_t)time(NULL), (uint8_t)(produced % 4), (uint8_t)(produced & 1), (uint16_t)i };
+        c.queue.push(e);
+        c.nextEventMs += eventGapMs;
+        produced++;
+      }
+
+      if (outage) {
+        if (c.fd >= 0) closeClient(c, now, false);
+        c.retryAtMs = outageEnd;
+        continue;
+      }
+
+      if (c.state == C_WAITING && now >= c.retryAtMs) startConnect(c, now);
+      if ((c.state == C_TCP || c.state == C_CONNACK) && now >= c.retryAtMs) closeClient(c, now, true);
+      if (c.fd < 0) continue;
+
+      if (!flushPending(c)) {
+        closeClient(c, now, true);
+        continue;
+      }
+      if (c.state == C_CONNECTED && c.pending.empty()) {
+        if (c.backlog || now - c.lastBatchMs >= opt.intervalMs) publishBatch(c, now, uptime);
+        if (c.fd >= 0 && c.pending.empty() && now - c.lastPingMs >= MQTT_KEEPALIVE_SEC * 500.0) {
+          uint8_t ping[2];
+          sendPacket(c, ping, mqttEncodePingreq(ping));
+          c.lastPingMs = now;
+        }
+      }
+      if (c.fd < 0) continue;
+
+      pollfd p;
+      p.fd = c.fd;
+      p.events = c.state == C_TCP ? POLLOUT : POLLIN;
+      p.revents = 0;
+      fds.push_back(p);
+      owners.push_back(i);
+    }
+
+    if (poll(fds.data(), fds.size(), 10) > 0) {
+      now = nowMs();
+      for (size_t k = 0; k < fds.size(); k++) {
+        if (fds[k].revents == 0) continue;
+        Client &c = clients[owners[k]];
+        if (c.state == C_TCP) {
+          sendConnect(c, now);
+        } else {
+          readIncoming(c, now);
+        }
+      }
+    } else if (fds.empty()) {
+      usleep(10000);
+    }
+
+    now = nowMs();
+    if (now - lastReport >= 1000) {
+      Totals delta;
+      delta.messages = totals.messages - lastTotals.messages;
+      delta.events = totals.events - lastTotals.events;
+      delta.bytes = totals.bytes - lastTotals.bytes;
+      printLine((now - start) / 1000, clients, delta, (now - lastReport) / 1000);
+      lastTotals = totals;
+      lastReport = now;
+    }
+  }
+
+  double seconds = (nowMs() - start) / 1000;
+  uint64_t queued = 0, dropped = 0;
+  for (Client &c : clients) {
+    queued += c.queue.size();
+    dropped += c.queue.getDropped();
+    if (c.fd >= 0) close(c.fd);
+  }
+  size_t perClient = MqttEventQueue::memoryBytes() + MQTT_PACKET_SIZE;
+  printf("\nclients %d, %.0f s: %llu messages (%.1f/s), %llu of %llu events sent (%.1f/s), %.1f KB/s\n",
+         opt.clients, seconds, (unsigned long long)totals.messages, totals.messages / seconds,
+         (unsigned long long)totals.events, (unsigned long long)produced, totals.events / seconds,
+         totals.bytes / seconds / 1024);
+  printf("connects %llu, failed attempts %llu, still queued %llu, dropped %llu\n",
+         (unsigned long long)totals.connects, (unsigned long long)totals.failures, (unsigned long long)queued,
+         (unsigned long long)dropped);
+  printf("device memory: queue %zu bytes (%u events) + packet buffer %u bytes = %zu bytes\n",
+         MqttEventQueue::memoryBytes(), MqttEventQueue::capacity(), MQTT_PACKET_SIZE, perClient);
+  return 0;
+}
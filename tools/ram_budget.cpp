@@ -0,0 +1,397 @@
+// RAM and flash use per translation unit and per subsystem of a firmware
+// build, read from the object files the Arduino build leaves behind, with a
+// data+bss budget that fails the build when it is exceeded.
+//
+// Build: g++ -O2 -std=c++11 -o ram_budget tools/ram_budget.cpp
+// Usage: ram_budget --build DIR [--elf FILE] [--budget BYTES] [--budget-for NAME=BYTES]...
+//                   [--top N]
+//
+// DIR is the sketch's build path ({build.path}): sketch/ holds one object per
+// source file, core/ the ESP8266 core and libraries/<name>/ each library.
+// Each section is counted as data (.data and .rodata, which the ESP8266
+// copies into RAM at boot), bss, iram or flash (.text, .irom and PROGMEM).
+// With --elf the totals come from the linked firmware instead, by address.
+//
+// Exits with 1 when data+bss is over --budget, or a subsystem or translation
+// unit is over its --budget-for.
+
+#include <cxxabi.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#define EM_XTENSA 94
+#define ESP_DRAM_SIZE 81920   // 0x3FFE8000-0x3FFFC000: data, bss and heap
+
+//================ OPTIONS ================
+struct Options {
+  std::string build;
+  std::string elf;
+  long budget = -1;
+  std::map<std::string, long> budgets;
+  int top = 10;
+};
+
+static void usage() {
+  fprintf(stderr,
+          "usage: ram_budget --build DIR [--elf FILE] [--budget BYTES] [--budget-for NAME=BYTES]...\n"
+          "                  [--top N]\n");
+  exit(2);
+}
+
+static bool parseOptions(int argc, char **argv, Options &o) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (i + 1 >= argc) return false;
+    const char *v = argv[++i];
+    if (a == "--build") o.build = v;
+    else if (a == "--elf") o.elf = v;
+    else if (a == "--budget") o.budget = atol(v);
+    else if (a == "--top") o.top = atoi(v);
+    else if (a == "--budget-for") {
+      const char *eq = strchr(v, '=');
+      if (eq == NULL) return false;
+      o.budgets[std::string(v, eq - v)] = atol(eq + 1);
+    } else return false;
+  }
+  return !o.build.empty() || !o.elf.empty();
+}
+
+//================ ELF ================
+enum MemClass { MEM_DATA, MEM_BSS, MEM_IRAM, MEM_FLASH, MEM_NONE };
+
+struct Usage {
+  long bytes[MEM_NONE] = {};
+
+  long ram() const { return bytes[MEM_DATA] + bytes[MEM_BSS]; }
+  void add(const Usage &u) {
+    for (int i = 0; i < MEM_NONE; i++) bytes[i] += u.bytes[i];
+  }
+};
+
+struct Symbol {
+  std::string name;
+  std::string unit;
+  MemClass mem;
+  long size;
+};
+
+struct Section {
+  std::string name;
+  uint32_t type;
+  uint64_t flags;
+  uint64_t addr;
+  uint64_t offset;
+  uint64_t size;
+  uint32_t link;
+  uint64_t entsize;
+};
+
+#define SHT_SYMTAB 2
+#define SHT_NOBITS 8
+#define SHF_ALLOC 2
+#define SHN_COMMON 0xFFF2
+#define STT_OBJECT 1
+#define ET_EXEC 2
+
+class ElfFile {
+private:
+  std::vector<unsigned char> bytes;
+  bool wide;
+
+  uint64_t get(size_t at, size_t size) const {
+    uint64_t v = 0;
+    for (size_t i = size; i-- > 0;) v = (v << 8) | bytes[at + i];
+    return v;
+  }
+
+  // Field `narrow` bytes wide in ELF32, `wideSize` in ELF64
+  uint64_t field(size_t at, size_t narrow, size_t wideSize) const { return get(at, wide ? wideSize : narrow); }
+
+public:
+  std::vector<Section> sections;
+  uint16_t type;
+  uint16_t machine;
+
+  bool load(const std::string &path) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    unsigned char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) bytes.insert(bytes.end(), chunk, chunk + n);
+    fclose(f);
+    // Little-endian only, like both the ESP8266 and the machines running this
+    if (bytes.size() < 64 || memcmp(bytes.data(), "\x7f" "ELF", 4) != 0 || bytes[5] != 1) return false;
+    wide = bytes[4] == 2;
+    type = get(16, 2);
+    machine = get(18, 2);
+    uint64_t shoff = wide ? get(40, 8) : get(32, 4);
+    size_t shentsize = get(wide ? 58 : 46, 2);
+    size_t shnum = get(wide ? 60 : 48, 2);
+    size_t shstrndx = get(wide ? 62 : 50, 2);
+    if (shoff + shnum * shentsize > bytes.size() || shstrndx >= shnum) return false;
+
+    for (size_t i = 0; i < shnum; i++) {
+      size_t at = shoff + i * shentsize;
+      Section s;
+      s.type = get(at + 4, 4);
+      s.flags = field(at + 8, 4, 8);
+      s.addr = field(at + (wide ? 16 : 12), 4, 8);
+      s.offset = field(at + (wide ? 24 : 16), 4, 8);
+      s.size = field(at + (wide ? 32 : 20), 4, 8);
+      s.link = get(at + (wide ? 40 : 24), 4);
+      s.entsize = field(at + (wide ? 56 : 36), 4, 8);
+      s.name = std::to_string(get(at, 4));   // Resolved below
+      sections.push_back(s);
+    }
+    const Section &names = sections[shstrndx];
+    for (Section &s : sections) s.name = string(names, strtoul(s.name.c_str(), NULL, 10));
+    return true;
+  }
+
+  std::string string(const Section &table, uint64_t index) const {
+    uint64_t at = table.offset + index;
+    if (at >= bytes.size()) return "";
+    const char *p = (const char *)bytes.data() + at;
+    return std::string(p, strnlen(p, bytes.size() - at));
+  }
+
+  // Calls f(name, size, section index) for each sized data object
+  template <typename F>
+  void objects(F f) const {
+    for (const Section &s : sections) {
+      if (s.type != SHT_SYMTAB || s.entsize == 0 || s.link >= sections.size()) continue;
+      const Section &names = sections[s.link];
+      for (uint64_t at = s.offset; at + s.entsize <= s.offset + s.size; at += s.entsize) {
+        uint32_t name = get(at, 4);
+        uint8_t info = bytes[at + (wide ? 4 : 12)];
+        uint16_t shndx = get(at + (wide ? 6 : 14), 2);
+        uint64_t size = wide ? get(at + 16, 8) : get(at + 8, 4);
+        if ((info & 0xF) == STT_OBJECT && size > 0) f(string(names, name), size, shndx);
+      }
+    }
+  }
+};
+
+// Where an object file's section ends up on the ESP8266
+static MemClass classifyByName(const Section &s) {
+  if (!(s.flags & SHF_ALLOC)) return MEM_NONE;
+  const std::string &n = s.name;
+  if (n.compare(0, 5, ".iram") == 0) return MEM_IRAM;
+  if (s.type == SHT_NOBITS || n.compare(0, 4, ".bss") == 0) return MEM_BSS;
+  if (n.compare(0, 5, ".data") == 0 || n.compare(0, 7, ".rodata") == 0) return MEM_DATA;
+  return MEM_FLASH;
+}
+
+// Where a linked ESP8266 firmware's section was placed
+static MemClass classifyByAddress(const Section &s) {
+  if (!(s.flags & SHF_ALLOC) || s.size == 0) return MEM_NONE;
+  if (s.addr >= 0x3FFE8000 && s.addr < 0x40000000) return s.type == SHT_NOBITS ? MEM_BSS : MEM_DATA;
+  if (s.addr >= 0x40100000 && s.addr < 0x40200000) return MEM_IRAM;
+  return MEM_FLASH;
+}
+
+static std::string demangle(const std::string &name) {
+  int status = 0;
+  char *plain = abi::__cxa_demangle(name.c_str(), NULL, NULL, &status);
+  if (status != 0 || plain == NULL) return name;
+  std::string out = plain;
+  free(plain);
+  return out;
+}
+
+static bool scanObject(const std::string &path, const std::string &unit, Usage &usage,
+                       std::vector<Symbol> &symbols) {
+  ElfFile elf;
+  if (!elf.load(path)) return false;
+  std::vector<MemClass> mem;
+  for (const Section &s : elf.sections) {
+    mem.push_back(classifyByName(s));
+    if (mem.back() != MEM_NONE) usage.bytes[mem.back()] += s.size;
+  }
+  elf.objects([&](const std::string &name, uint64_t size, uint16_t shndx) {
+    // -fcommon globals have no section; the linker puts them in .bss
+    if (shndx == SHN_COMMON) usage.bytes[MEM_BSS] += size;
+    MemClass m = shndx == SHN_COMMON ? MEM_BSS : shndx < mem.size() ? mem[shndx] : MEM_NONE;
+    if (m == MEM_DATA || m == MEM_BSS) symbols.push_back({demangle(name), unit, m, (long)size});
+  });
+  return true;
+}
+
+//================ BUILD DIRECTORY ================
+// Sketch sources by subsystem; anything else in the sketch is "other"
+static const struct {
+  const char *source;
+  const char *subsystem;
+} SUBSYSTEMS[] = {
+  {"SunTimeCloudLightController.ino", "controller"},
+  {"async_http.cpp", "web"},
+  {"session.cpp", "web"},
+  {"hmac.cpp", "web"},
+  {"forecast_client.cpp", "forecast"},
+  {"forecast_share.cpp", "forecast"},
+  {"logging.cpp", "telemetry"},
+  {"trace.cpp", "telemetry"},
+  {"metrics.cpp", "telemetry"},
+  {"profiler.cpp", "telemetry"},
+  {"bench.cpp", "telemetry"},
+  {"mqtt_publisher.cpp", "mqtt"},
+};
+
+struct Unit {
+  std::string subsystem;
+  Usage usage;
+};
+
+static void listObjects(const std::string &dir, std::vector<std::string> &out) {
+  DIR *d = opendir(dir.c_str());
+  if (d == NULL) return;
+  while (dirent *e = readdir(d)) {
+    std::string name = e->d_name;
+    if (name == "." || name == "..") continue;
+    std::string path = dir + "/" + name;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) continue;
+    if (S_ISDIR(st.st_mode)) {
+      listObjects(path, out);
+    } else if (name.size() > 2 && name.compare(name.size() - 2, 2, ".o") == 0) {
+      out.push_back(path);
+    }
+  }
+  closedir(d);
+}
+
+// The report line and subsystem for an object: a row per sketch source, one
+// for the core and one per library
+static void unitOf(const std::string &relative, std::string &unit, std::string &subsystem) {
+  std::string base = relative.substr(relative.rfind('/') + 1);
+  if (relative.compare(0, 7, "sketch/") == 0) {
+    unit = base.substr(0, base.size() - 2);   // Drop ".o"
+    if (unit.size() > 8 && unit.compare(unit.size() - 8, 8, ".ino.cpp") == 0) unit.resize(unit.size() - 4);
+    subsystem = "other";
+    for (const auto &s : SUBSYSTEMS) {
+      if (unit == s.source) subsystem = s.subsystem;
+    }
+  } else if (relative.compare(0, 10, "libraries/") == 0) {
+    std::string lib = relative.substr(10, relative.find('/', 10) - 10);
+    unit = "lib:" + lib;
+    subsystem = unit;
+  } else if (relative.compare(0, 5, "core/") == 0) {
+    unit = subsystem = "core";
+  } else {
+    unit = base;
+    subsystem = "other";
+  }
+}
+
+//================ REPORT ================
+static void printHeader(const char *first, const char *second) {
+  printf("%-34s %-12s %8s %8s %8s %8s %9s\n", first, second, "data", "bss", "d+bss", "iram", "flash");
+}
+
+static void printRow(const std::string &name, const std::string &subsystem, const Usage &u, const char *flag) {
+  printf("%-34s %-12s %8ld %8ld %8ld %8ld %9ld%s\n", name.c_str(), subsystem.c_str(), u.bytes[MEM_DATA],
+         u.bytes[MEM_BSS], u.ram(), u.bytes[MEM_IRAM], u.bytes[MEM_FLASH], flag);
+}
+
+static bool over(const Options &o, const std::string &name, long ram) {
+  auto it = o.budgets.find(name);
+  return it != o.budgets.end() && ram > it->second;
+}
+
+int main(int argc, char **argv) {
+  Options o;
+  if (!parseOptions(argc, argv, o)) usage();
+
+  bool failed = false;
+  Usage total;
+  std::map<std::string, Unit> units;
+  std::map<std::string, Usage> subsystems;
+  std::vector<Symbol> symbols;
+
+  if (!o.build.empty()) {
+    std::vector<std::string> objects;
+    listObjects(o.build, objects);
+    if (objects.empty()) {
+      fprintf(stderr, "no object files under %s\n", o.build.c_str());
+      return 2;
+    }
+    for (const std::string &path : objects) {
+      std::string unit, subsystem;
+      unitOf(path.substr(o.build.size() + 1), unit, subsystem);
+      Usage u;
+      if (!scanObject(path, unit, u, symbols)) {
+        fprintf(stderr, "skipping %s: not an ELF object\n", path.c_str());
+        continue;
+      }
+      units[unit].subsystem = subsystem;
+      units[unit].usage.add(u);
+      subsystems[subsystem].add(u);
+      total.add(u);
+    }
+
+    printHeader("translation unit", "subsystem");
+    for (const auto &e : units) {
+      bool unitOver = over(o, e.first, e.second.usage.ram());
+      failed |= unitOver;
+      printRow(e.first, e.second.subsystem, e.second.usage, unitOver ? "  OVER BUDGET" : "");
+    }
+    printf("\n");
+    printHeader("subsystem", "");
+    for (const auto &e : subsystems) {
+      bool subsystemOver = over(o, e.first, e.second.ram());
+      failed |= subsystemOver;
+      printRow(e.first, "", e.second, subsystemOver ? "  OVER BUDGET" : "");
+    }
+    printRow("objects", "", total, "");
+  }
+
+  // The linked firmware drops unused sections and adds the SDK's blobs, so
+  // its totals are the ones the budget is checked against when given
+  if (!o.elf.empty()) {
+    ElfFile elf;
+    if (!elf.load(o.elf)) {
+      fprintf(stderr, "cannot read %s\n", o.elf.c_str());
+      return 2;
+    }
+    bool esp = elf.type == ET_EXEC && elf.machine == EM_XTENSA;
+    total = Usage();
+    for (const Section &s : elf.sections) {
+      MemClass m = esp ? classifyByAddress(s) : classifyByName(s);
+      if (m != MEM_NONE) total.bytes[m] += s.size;
+    }
+    printRow("linked", "", total, "");
+    if (esp) {
+      printf("%-34s %-12s %8ld bytes of DRAM left for heap and stack\n", "", "", ESP_DRAM_SIZE - total.ram());
+    }
+  }
+
+  if (o.top > 0 && !symbols.empty()) {
+    std::stable_sort(symbols.begin(), symbols.end(),
+                     [](const Symbol &a, const Symbol &b) { return a.size > b.size; });
+    printf("\nlargest RAM objects\n");
+    for (int i = 0; i < o.top && i < (int)symbols.size(); i++) {
+      const Symbol &s = symbols[i];
+      printf("%8ld %-4s %-34s %s\n", s.size, s.mem == MEM_BSS ? "bss" : "data", s.unit.c_str(), s.name.c_str());
+    }
+  }
+
+  if (o.budget >= 0) {
+    bool totalOver = total.ram() > o.budget;
+    printf("\ndata+bss %ld of %ld budget%s\n", total.ram(), o.budget, totalOver ? "  OVER BUDGET" : "");
+    failed |= totalOver;
+  }
+  for (const auto &b : o.budgets) {
+    if (units.count(b.first) == 0 && subsystems.count(b.first) == 0) {
+      fprintf(stderr, "--budget-for %s matches no subsystem or translation unit\n", b.first.c_str());
+    }
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,290 @@
+// What-if replay of recorded cloud coverage across a grid of controller
+// settings, to pick threshold, hysteresis, monitoring window and sun offsets
+// from data instead of by guesswork.
+//
+// Every combination replays the whole history through controller_core.h at
+// one-minute resolution (the decision only changes on minute boundaries and
+// cloud samples are hourly). Combinations are spread over all cores with a
+// work-stealing pool.
+//
+// Build: g++ -O2 -std=c++11 -pthread -o replay_sweep tools/replay_sweep.cpp
+// Usage: replay_sweep (--clouds FILE | --synthetic DAYS) [--lat DEG] [--lon DEG]
+//                     [--tz SEC] [--threshold A:B:STEP] [--hysteresis A:B:STEP]
+//                     [--window A:B:STEP] [--sunrise-offset A:B:STEP]
+//                     [--sunset-offset A:B:STEP] [--retries N] [--threads N]
+//
+// Ranges are inclusive; a single number is a one-value range. Results go to
+// stdout as CSV, one row per combination; a summary goes to stderr.
+
+#include "../controller_core.h"
+#include "sun_model.h"
+#include "cloud_series.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Range {
+  int first, last, step;
+};
+
+struct SweepConfig {
+  const char *cloudFile = nullptr;
+  int syntheticDays = 0;
+  double latitude = 52.0;
+  double longitude = 5.0;
+  int tzSeconds = 3600;
+  Range threshold = { 78, 78, 1 };
+  Range hysteresis = { 5, 5, 1 };
+  Range window = { 30, 30, 1 };
+  Range sunriseOffset = { 0, 0, 1 };
+  Range sunsetOffset = { 0, 0, 1 };
+  int maxRetries = 3;
+  unsigned threads = 0;
+};
+
+struct Combination {
+  int threshold, hysteresis, window, sunriseOffset, sunsetOffset;
+};
+
+struct ReplayResult {
+  long long onMinutes;
+  long long switches;
+  long long earlyActivations;
+};
+
+// Raw sun times for one local day, before offsets
+struct SunDay {
+  long startEpoch;      // UTC epoch of local midnight
+  double sunrise;
+  double sunset;
+};
+
+//================ WORK-STEALING POOL ================
+// Each worker drains its own deque from the back and, once empty, steals
+// from the front of the others. Tasks don't spawn tasks, so a worker stops
+// after a full pass over every queue finds nothing.
+class WorkStealingPool {
+private:
+  struct Queue {
+    std::mutex lock;
+    std::deque<size_t> tasks;
+  };
+  std::vector<std::unique_ptr<Queue>> queues;
+
+  bool popLocal(unsigned worker, size_t &task) {
+    Queue &q = *queues[worker];
+    std::lock_guard<std::mutex> guard(q.lock);
+    if (q.tasks.empty()) return false;
+    task = q.tasks.back();
+    q.tasks.pop_back();
+    return true;
+  }
+
+  bool steal(unsigned worker, size_t &task) {
+    for (size_t i = 1; i < queues.size(); i++) {
+      Queue &q = *queues[(worker + i) % queues.size()];
+      std::lock_guard<std::mutex> guard(q.lock);
+      if (q.tasks.empty()) continue;
+      task = q.tasks.front();
+      q.tasks.pop_front();
+      return true;
+    }
+    return false;
+  }
+
+public:
+  std::atomic<size_t> steals{0};
+
+  explicit WorkStealingPool(unsigned workers) {
+    for (unsigned i = 0; i < workers; i++) queues.emplace_back(new Queue());
+  }
+
+  void run(size_t taskCount, const std::function<void(size_t)> &body) {
+    // Contiguous blocks keep neighbouring grid points on one core
+    size_t perWorker = (taskCount + queues.size() - 1) / queues.size();
+    for (size_t t = 0; t < taskCount; t++) queues[t / perWorker]->tasks.push_back(t);
+
+    std::vector<std::thread> threads;
+    for (unsigned w = 0; w < queues.size(); w++) {
+      threads.emplace_back([this, w, &body]() {
+        size_t task;
+        for (;;) {
+          if (popLocal(w, task)) {
+            body(task);
+          } else if (steal(w, task)) {
+            steals++;
+            body(task);
+          } else {
+            return;
+          }
+        }
+      });
+    }
+    for (auto &t : threads) t.join();
+  }
+};
+
+//================ REPLAY ================
+// The decision core takes a plain function, so each thread points it at its
+// own replay position
+struct ReplayCursor {
+  const CloudSeries *series;
+  size_t index;
+  long epoch;
+};
+
+static thread_local ReplayCursor *activeCursor = nullptr;
+
+static float replayCloudCoverage() {
+  return activeCursor->series->at(activeCursor->epoch, activeCursor->index);
+}
+
+static ReplayResult replay(const Combination &c, int maxRetries, const std::vector<SunDay> &days,
+                           const CloudSeries &series) {
+  ReplayResult result = { 0, 0, 0 };
+  ReplayCursor cursor = { &series, 0, 0 };
+  activeCursor = &cursor;
+
+  DecisionParams p = { 0, 0, c.window, c.threshold, c.hysteresis, maxRetries };
+  DecisionState st;
+  initDecisionState(st);
+  bool lightOn = false;
+
+  for (const SunDay &day : days) {
+    p.sunriseTime = applySunOffset(day.sunrise, c.sunriseOffset);
+    p.sunsetTime = applySunOffset(day.sunset, c.sunsetOffset);
+
+    for (int minute = 0; minute < MINUTES_PER_DAY; minute++) {
+      cursor.epoch = day.startEpoch + minute * 60;
+      updateMonitoringWindow(st, p, minute);
+      bool on = shouldActivateLights(st, p, minute, replayCloudCoverage);
+
+      if (on) result.onMinutes++;
+      if (on != lightOn) {
+        result.switches++;
+        if (on && st.cloudTriggered) result.earlyActivations++;
+        lightOn = on;
+      }
+    }
+  }
+  return result;
+}
+
+//================ COMMAND LINE ================
+static bool parseRange(const char *text, Range &range) {
+  int a, b, step;
+  int n = sscanf(text, "%d:%d:%d", &a, &b, &step);
+  if (n == 1) {
+    range = { a, a, 1 };
+  } else if (n == 2) {
+    range = { a, b, 1 };
+  } else if (n == 3 && step > 0) {
+    range = { a, b, step };
+  } else {
+    return false;
+  }
+  return range.first <= range.last;
+}
+
+static bool parseArgs(int argc, char **argv, SweepConfig &cfg) {
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const char *arg = argv[i];
+    const char *value = argv[i + 1];
+    bool ok = true;
+    if (strcmp(arg, "--clouds") == 0) cfg.cloudFile = value;
+    else if (strcmp(arg, "--synthetic") == 0) cfg.syntheticDays = atoi(value);
+    else if (strcmp(arg, "--lat") == 0) cfg.latitude = atof(value);
+    else if (strcmp(arg, "--lon") == 0) cfg.longitude = atof(value);
+    else if (strcmp(arg, "--tz") == 0) cfg.tzSeconds = atoi(value);
+    else if (strcmp(arg, "--threshold") == 0) ok = parseRange(value, cfg.threshold);
+    else if (strcmp(arg, "--hysteresis") == 0) ok = parseRange(value, cfg.hysteresis);
+    else if (strcmp(arg, "--window") == 0) ok = parseRange(value, cfg.window);
+    else if (strcmp(arg, "--sunrise-offset") == 0) ok = parseRange(value, cfg.sunriseOffset);
+    else if (strcmp(arg, "--sunset-offset") == 0) ok = parseRange(value, cfg.sunsetOffset);
+    else if (strcmp(arg, "--retries") == 0) cfg.maxRetries = atoi(value);
+    else if (strcmp(arg, "--threads") == 0) cfg.threads = (unsigned)atoi(value);
+    else ok = false;
+    if (!ok) return false;
+  }
+  return (argc % 2) == 1 && (cfg.cloudFile != nullptr || cfg.syntheticDays > 0);
+}
+
+static std::vector<Combination> buildGrid(const SweepConfig &cfg) {
+  std::vector<Combination> grid;
+  for (int t = cfg.threshold.first; t <= cfg.threshold.last; t += cfg.threshold.step)
+    for (int h = cfg.hysteresis.first; h <= cfg.hysteresis.last; h += cfg.hysteresis.step)
+      for (int w = cfg.window.first; w <= cfg.window.last; w += cfg.window.step)
+        for (int r = cfg.sunriseOffset.first; r <= cfg.sunriseOffset.last; r += cfg.sunriseOffset.step)
+          for (int s = cfg.sunsetOffset.first; s <= cfg.sunsetOffset.last; s += cfg.sunsetOffset.step)
+            grid.push_back({ t, h, w, r, s });
+  return grid;
+}
+
+int main(int argc, char **argv) {
+  SweepConfig cfg;
+  if (!parseArgs(argc, argv, cfg)) {
+    fprintf(stderr, "usage: see the comment at the top of tools/replay_sweep.cpp\n");
+    return 2;
+  }
+
+  CloudSeries series;
+  if (cfg.cloudFile) {
+    if (!series.load(cfg.cloudFile)) {
+      fprintf(stderr, "could not read cloud series from %s\n", cfg.cloudFile);
+      return 1;
+    }
+  } else {
+    series.generate(1735689600 - 86400, cfg.syntheticDays + 2, 1); // From 2025-01-01
+  }
+
+  // Sun times don't depend on the grid, so compute them once per day
+  std::vector<SunDay> days;
+  long firstDay = (series.firstEpoch() + cfg.tzSeconds) / 86400;
+  long lastDay = (series.lastEpoch() + cfg.tzSeconds) / 86400;
+  if (cfg.syntheticDays > 0) {
+    firstDay += 1;
+    lastDay = firstDay + cfg.syntheticDays - 1;
+  }
+  for (long d = firstDay; d <= lastDay; d++) {
+    SunDay day;
+    day.startEpoch = d * 86400 - cfg.tzSeconds;
+    sunEventsLocalMinutes((int)d, cfg.latitude, cfg.longitude, cfg.tzSeconds / 3600.0, day.sunrise, day.sunset);
+    days.push_back(day);
+  }
+
+  std::vector<Combination> grid = buildGrid(cfg);
+  std::vector<ReplayResult> results(grid.size());
+
+  unsigned threads = cfg.threads > 0 ? cfg.threads : std::thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
+  WorkStealingPool pool(threads);
+
+  auto wallStart = std::chrono::steady_clock::now();
+  pool.run(grid.size(), [&](size_t i) {
+    results[i] = replay(grid[i], cfg.maxRetries, days, series);
+  });
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  printf("threshold,hysteresis,window,sunrise_offset,sunset_offset,lights_on_minutes,switches,early_activations\n");
+  for (size_t i = 0; i < grid.size(); i++) {
+    const Combination &c = grid[i];
+    printf("%d,%d,%d,%d,%d,%lld,%lld,%lld\n", c.threshold, c.hysteresis, c.window, c.sunriseOffset,
+           c.sunsetOffset, results[i].onMinutes, results[i].switches, results[i].earlyActivations);
+  }
+
+  double simulatedDays = (double)grid.size() * days.size();
+  fprintf(stderr, "combinations=%zu days=%zu simulated_days=%.0f threads=%u steals=%zu\n",
+          grid.size(), days.size(), simulatedDays, threads, pool.steals.load());
+  fprintf(stderr, "wall_seconds=%.3f simulated_days_per_second=%.0f\n", wallSeconds,
+          simulatedDays / (wallSeconds > 0 ? wallSeconds : 1e-9));
+  return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef SUN_MODEL_H
+#define SUN_MODEL_H
+
+// Host-side stand-in for the sunset.h library the sketch uses on the device:
+// the classic almanac sunrise/sunset approximation, accurate to a minute or two.
+
+#include <cmath>
+
+static inline double sunDegToRad(double d) { return d * M_PI / 180.0; }
+static inline double sunRadToDeg(double r) { return r * 180.0 / M_PI; }
+
+static inline double sunNormalize(double value, double range) {
+  value = fmod(value, range);
+  return value < 0 ? value + range : value;
+}
+
+// Returns the event in local minutes from midnight, or -1 if the sun doesn't cross the horizon
+static inline double sunEventMinutes(int dayOfYear, double latitude, double longitude,
+                   double tzHours, bool rising) {
+  const double zenith = 90.833;
+  double lngHour = longitude / 15.0;
+  double t = dayOfYear + ((rising ? 6.0 : 18.0) - lngHour) / 24.0;
+  double M = 0.9856 * t - 3.289;
+  double L = sunNormalize(M + 1.916 * sin(sunDegToRad(M)) + 0.020 * sin(sunDegToRad(2 * M)) + 282.634, 360.0);
+  double RA = sunNormalize(sunRadToDeg(atan(0.91764 * tan(sunDegToRad(L)))), 360.0);
+  RA += floor(L / 90.0) * 90.0 - floor(RA / 90.0) * 90.0;
+  RA /= 15.0;
+
+  double sinDec = 0.39782 * sin(sunDegToRad(L));
+  double cosDec = cos(asin(sinDec));
+  double cosH = (cos(sunDegToRad(zenith)) - sinDec * sin(sunDegToRad(latitude))) /
+          (cosDec * cos(sunDegToRad(latitude)));
+  if (cosH > 1 || cosH < -1) return -1;
+
+  double H = rising ? 360.0 - sunRadToDeg(acos(cosH)) : sunRadToDeg(acos(cosH));
+  H /= 15.0;
+  double T = H + RA - 0.06571 * t - 6.622;
+  double localHours = sunNormalize(T - lngHour + tzHours, 24.0);
+  return localHours * 60.0;
+}
+
+// `localDay` is days since the epoch in local time; polar days/nights fall back to fixed times
+static inline void sunEventsLocalMinutes(int localDay, double latitude, double longitude,
+                     double tzHours, double &sunrise, double &sunset) {
+  // Day of year from days since 1970-01-01 (civil calendar)
+  long z = localDay + 719468;
+  long era = (z >= 0 ? z : z - 146096) / 146097;
+  long doe = z - era * 146097;
+  long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);          // Day of year starting March 1st
+  long year = yoe + era * 400;
+  bool leap = false;
+  long mp = (5 * doy + 2) / 153;
+  long month = mp < 10 ? mp + 3 : mp - 9;
+  if (month <= 2) year++;
+  leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+  long marchFirst = 59 + (leap ? 1 : 0);                        // Day of year of March 1st minus one
+  long dayOfYear = month <= 2 ? doy - 306 + 1 : doy + marchFirst + 1;
+
+  sunrise = sunEventMinutes((int)dayOfYear, latitude, longitude, tzHours, true);
+  sunset = sunEventMinutes((int)dayOfYear, latitude, longitude, tzHours, false);
+  if (sunrise < 0 || sunset < 0) {
+    sunrise = 6 * 60;
+    sunset = 18 * 60;
+  }
+}
+
+#endif
@@ -0,0 +1,411 @@
+// Deterministic replay of an input trace downloaded from /api/inputtrace.
+//
+// Feeds the recorded clock, settings, forecasts and web commands through the
+// same controller_core.h and day_plan.h code the sketch's loop() runs for the
+// main relay, with loop passes on a fixed grid between records, and checks
+// the relay transitions it produces against the ones the device recorded.
+// The same trace always gives the same result, so a field issue can be
+// stepped through under a debugger or rerun after a fix.
+//
+// Build: g++ -O2 -std=c++11 -o trace_replay tools/trace_replay.cpp
+// Usage: trace_replay [--tick-ms MS] [--tolerance-ms MS] [--repeat N]
+//                     [--records] [--transitions] FILE
+//
+// --records prints every record as it is read, --transitions every relay
+// change on either side. --repeat replays the trace N times to time it. The
+// exit status is 1 when the replayed transitions differ from the recorded
+// ones.
+
+#include "../controller_core.h"
+#include "../day_plan.h"
+#include "../forecast_cache.h"
+#include "../input_trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// From forecast_share.h, which needs the Arduino core
+static const uint8_t ROLE_FOLLOWER = 2;
+// A live-path fetch is taken from a fetch record this soon after the pass
+static const uint32_t FETCH_LOOKAHEAD_MS = 20000;
+
+struct ReplayConfig {
+  int tickMs = 100;
+  int toleranceMs = 5000;
+  int repeat = 1;
+  bool printRecords = false;
+  bool printTransitions = false;
+  const char *file = nullptr;
+};
+
+struct Transition {
+  uint32_t ms;
+  bool on;
+};
+
+//================ REPLAYED CONTROLLER ================
+// The main relay's part of loop(): manual override, then the day plan or,
+// without one, the live decision
+
+struct Controller {
+  bool anchored;
+  uint32_t anchorEpoch;    // Local epoch timeClient reported at anchorMs
+  uint32_t anchorMs;
+  bool configured;
+  InputTraceSettings settings;
+  ForecastCache cache;
+  DecisionState decision;
+  DayPlan plan;
+  bool manualOverride;
+  bool manualLightState;
+  uint32_t manualOverrideStartMs;
+  bool previousLightState;
+  bool relay;
+  std::vector<Transition> transitions;
+};
+
+static Controller ctl;
+static InputTraceReader reader;
+static InputTraceRecord pending;   // Next record, read ahead
+static bool hasPending = false;
+static uint32_t passMs = 0;
+static long long passes = 0;
+static bool printRecords = false;
+static std::vector<Transition> recorded;   // Relay changes the device made
+static long long records = 0;
+static uint32_t lastMs = 0;
+
+static void resetController() {
+  ctl.anchored = false;
+  ctl.configured = false;
+  ctl.cache.clear();
+  initDecisionState(ctl.decision);
+  ctl.plan.valid = false;
+  ctl.manualOverride = false;
+  ctl.manualLightState = false;
+  ctl.previousLightState = false;
+  ctl.relay = false;
+}
+
+static uint32_t localNow(uint32_t ms) {
+  return ctl.anchorEpoch + (ms - ctl.anchorMs) / 1000;
+}
+
+static uint32_t utcAt(uint32_t local) {
+  return local - ctl.settings.utcOffset;
+}
+
+static void setRelay(bool on, uint32_t ms) {
+  if (on == ctl.relay) return;
+  ctl.relay = on;
+  ctl.transitions.push_back({ ms, on });
+}
+
+static bool lookupCloud(uint32_t utc, float &cloudCover) {
+  ForecastHour hour;
+  if (!ctl.cache.lookup(utc, hour)) return false;
+  cloudCover = effectiveCloudCover(hour, solarElevation(utc, ctl.settings.latitude, ctl.settings.longitude));
+  return cloudCover >= 0;
+}
+
+static bool nextRecord() {
+  hasPending = reader.next(pending);
+  return hasPending;
+}
+
+static void applyRecord(const InputTraceRecord &r);
+
+// getCloudCoverage(): the cache while fresh, otherwise whatever the fetch
+// the device made in this pass brought in
+static float liveCloudSource() {
+  uint32_t utc = utcAt(localNow(passMs));
+  float cloudCover;
+  if (ctl.cache.isFresh(utc) && lookupCloud(utc, cloudCover)) return cloudCover;
+  if (ctl.settings.shareRole == ROLE_FOLLOWER) {
+    return lookupCloud(utc, cloudCover) ? cloudCover : -1;
+  }
+  if (hasPending && (pending.type == IT_FORECAST || pending.type == IT_FETCH_FAILED) &&
+      pending.ms - passMs <= FETCH_LOOKAHEAD_MS) {
+    bool fetched = pending.type == IT_FORECAST;
+    applyRecord(pending);
+    nextRecord();
+    if (fetched && lookupCloud(utc, cloudCover)) return cloudCover;
+  }
+  return -1;
+}
+
+// planCloudAt(); ctx is the plan's local midnight
+static float planCloudAt(void *ctx, int minute) {
+  uint32_t utc = utcAt(*(uint32_t *)ctx) + minute * 60;
+  float cloudCover;
+  return lookupCloud(utc, cloudCover) ? cloudCover : -1;
+}
+
+static DecisionParams currentParams() {
+  const InputTraceSettings &s = ctl.settings;
+  DecisionParams p = { s.sunriseTime, s.sunsetTime, s.monitoringWindow, s.cloudThreshold, s.cloudHysteresis,
+                       s.maxRetries };
+  return p;
+}
+
+static const PlanEntry *currentPlanEntry(uint32_t local) {
+  if (!clockIsSet(utcAt(local))) return nullptr;
+  uint32_t dayStart = local - local % 86400;
+  DecisionParams params = currentParams();
+  if (!ctl.plan.valid || ctl.plan.dayStart != dayStart || ctl.plan.forecastFetchedAt != ctl.cache.fetchedAt ||
+      !sameDecisionParams(ctl.plan.params, params)) {
+    buildDayPlan(ctl.plan, params, dayStart, ctl.cache.fetchedAt, planCloudAt, &dayStart);
+  }
+  return planEntryAt(ctl.plan, (local - dayStart) / 60);
+}
+
+static void runPass() {
+  passes++;
+  if (!ctl.anchored || !ctl.configured) return;
+
+  if (ctl.manualOverride) {
+    if ((passMs - ctl.manualOverrideStartMs) / 60000 >= (uint32_t)ctl.settings.overrideDuration) {
+      ctl.manualOverride = false;
+      ctl.decision.state = NORMAL;
+      ctl.decision.cloudTriggered = false;
+    } else if (ctl.relay != ctl.manualLightState) {
+      setRelay(ctl.manualLightState, passMs);
+    }
+    return;
+  }
+
+  uint32_t local = localNow(passMs);
+  int currentTime = (int)(local % 86400 / 60);
+  DecisionParams params = currentParams();
+  updateMonitoringWindow(ctl.decision, params, currentTime);
+
+  bool shouldBeOn;
+  const PlanEntry *entry = currentPlanEntry(local);
+  if (entry != nullptr) {
+    ctl.decision.state = (SystemState)entry->state;
+    ctl.decision.cloudStatus = (CloudStatus)entry->cloudStatus;
+    ctl.decision.cloudTriggered = entry->cloudTriggered;
+    ctl.decision.cloudCoverage = entry->cloudCoverage;
+    shouldBeOn = entry->lightOn;
+  } else {
+    shouldBeOn = shouldActivateLights(ctl.decision, params, currentTime, liveCloudSource);
+  }
+
+  if (shouldBeOn != ctl.previousLightState) {
+    setRelay(shouldBeOn, passMs);
+    ctl.previousLightState = shouldBeOn;
+  }
+}
+
+//================ RECORDS ================
+
+static void printRecord(const InputTraceRecord &r) {
+  printf("%10u %-12s", r.ms, inputTraceTypeName(r.type).c_str());
+  uint32_t epoch;
+  switch (r.type) {
+    case IT_CHECKPOINT:
+    case IT_NTP:
+      memcpy(&epoch, r.payload, sizeof(epoch));
+      printf(" local=%u", epoch);
+      break;
+    case IT_SETTINGS: {
+      InputTraceSettings s;
+      memcpy(&s, r.payload, sizeof(s));
+      printf(" sunrise=%d sunset=%d window=%d threshold=%d hysteresis=%d retries=%d override=%d utc_offset=%d"
+             " lat=%.4f lon=%.4f role=%u", s.sunriseTime, s.sunsetTime, s.monitoringWindow, s.cloudThreshold,
+             s.cloudHysteresis, s.maxRetries, s.overrideDuration, s.utcOffset, s.latitude, s.longitude, s.shareRole);
+      break;
+    }
+    case IT_FORECAST: {
+      InputTraceForecast f;
+      memcpy(&f, r.payload, sizeof(f));
+      printf(" start=%u fetched=%u hours=%u", f.startEpoch, f.fetchedAt, f.hours);
+      break;
+    }
+    case IT_WIFI:
+    case IT_RELAY:
+      printf(" %s", r.payload[0] ? "on" : "off");
+      break;
+    case IT_TOGGLE: {
+      static const char *ACTIONS[] = { "off", "on", "auto" };
+      InputTraceToggle t;
+      memcpy(&t, r.payload, sizeof(t));
+      printf(" zone=%u %s", t.zone, t.action <= INPUT_TOGGLE_AUTO ? ACTIONS[t.action] : "?");
+      break;
+    }
+  }
+  printf("\n");
+}
+
+static bool payloadIs(const InputTraceRecord &r, size_t size) {
+  if (r.length == size) return true;
+  fprintf(stderr, "skipping %s record at %u ms: %u bytes\n", inputTraceTypeName(r.type).c_str(), r.ms, r.length);
+  return false;
+}
+
+static void applyRecord(const InputTraceRecord &r) {
+  if (printRecords) printRecord(r);
+  records++;
+  lastMs = r.ms;
+  switch (r.type) {
+    case IT_BOOT:
+      resetController();
+      break;
+    case IT_RELAY:
+      if (payloadIs(r, sizeof(uint8_t))) recorded.push_back({ r.ms, r.payload[0] != 0 });
+      break;
+    case IT_CHECKPOINT:
+    case IT_NTP:
+      if (!payloadIs(r, sizeof(uint32_t))) break;
+      memcpy(&ctl.anchorEpoch, r.payload, sizeof(uint32_t));
+      ctl.anchorMs = r.ms;
+      ctl.anchored = true;
+      break;
+    case IT_SETTINGS:
+      if (!payloadIs(r, sizeof(InputTraceSettings))) break;
+      memcpy(&ctl.settings, r.payload, sizeof(InputTraceSettings));
+      ctl.configured = true;
+      break;
+    case IT_FORECAST:
+      if (!readInputTraceForecast(r, ctl.cache)) {
+        fprintf(stderr, "skipping malformed forecast record at %u ms\n", r.ms);
+      }
+      break;
+    case IT_TOGGLE: {
+      if (!payloadIs(r, sizeof(InputTraceToggle))) break;
+      InputTraceToggle t;
+      memcpy(&t, r.payload, sizeof(t));
+      if (t.zone != 0) break;    // Zones aren't replayed
+      ctl.manualOverride = true;
+      ctl.manualOverrideStartMs = r.ms;
+      ctl.manualLightState = t.action == INPUT_TOGGLE_ON;
+      setRelay(ctl.manualLightState, r.ms);
+      ctl.decision.state = MANUAL;
+      break;
+    }
+    default:
+      break;    // Wi-Fi changes and failed fetches only matter through the records around them
+  }
+}
+
+//================ COMPARISON ================
+
+// Pairs transitions in order; a pair must agree on the state and be within
+// the tolerance, anything else is reported on its own
+static int compareTransitions(const std::vector<Transition> &recorded, const std::vector<Transition> &replayed,
+                              int toleranceMs, bool print) {
+  size_t i = 0;
+  size_t j = 0;
+  int mismatches = 0;
+  while (i < recorded.size() || j < replayed.size()) {
+    if (i < recorded.size() && j < replayed.size() && recorded[i].on == replayed[j].on &&
+        labs((long)(recorded[i].ms - replayed[j].ms)) <= toleranceMs) {
+      if (print) {
+        printf("%10u relay=%-3s replayed at %u\n", recorded[i].ms, recorded[i].on ? "on" : "off", replayed[j].ms);
+      }
+      i++;
+      j++;
+    } else if (j >= replayed.size() || (i < recorded.size() && recorded[i].ms <= replayed[j].ms)) {
+      printf("%10u relay=%-3s MISSING from replay\n", recorded[i].ms, recorded[i].on ? "on" : "off");
+      mismatches++;
+      i++;
+    } else {
+      printf("%10u relay=%-3s EXTRA in replay\n", replayed[j].ms, replayed[j].on ? "on" : "off");
+      mismatches++;
+      j++;
+    }
+  }
+  return mismatches;
+}
+
+static bool parseArgs(int argc, char **argv, ReplayConfig &cfg) {
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (strcmp(arg, "--records") == 0) { cfg.printRecords = true; continue; }
+    if (strcmp(arg, "--transitions") == 0) { cfg.printTransitions = true; continue; }
+    if (arg[0] != '-') { cfg.file = arg; continue; }
+    if (!value) return false;
+    i++;
+    if (strcmp(arg, "--tick-ms") == 0) cfg.tickMs = atoi(value);
+    else if (strcmp(arg, "--tolerance-ms") == 0) cfg.toleranceMs = atoi(value);
+    else if (strcmp(arg, "--repeat") == 0) cfg.repeat = atoi(value);
+    else return false;
+  }
+  return cfg.file != nullptr && cfg.tickMs > 0 && cfg.repeat > 0;
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &data) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return false;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) data.insert(data.end(), chunk, chunk + n);
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  ReplayConfig cfg;
+  if (!parseArgs(argc, argv, cfg)) {
+    fprintf(stderr, "usage: see the comment at the top of tools/trace_replay.cpp\n");
+    return 2;
+  }
+
+  std::vector<uint8_t> data;
+  if (!readFile(cfg.file, data)) {
+    fprintf(stderr, "could not read %s\n", cfg.file);
+    return 1;
+  }
+  if (!reader.begin(data.data(), data.size())) {
+    fprintf(stderr, "%s is not an input trace this version can read\n", cfg.file);
+    return 1;
+  }
+
+  uint32_t firstMs = reader.getHeader().firstMs;
+  auto wallStart = std::chrono::steady_clock::now();
+
+  for (int run = 0; run < cfg.repeat; run++) {
+    reader.begin(data.data(), data.size());
+    resetController();
+    ctl.transitions.clear();
+    recorded.clear();
+    printRecords = cfg.printRecords && run == 0;
+    records = 0;
+    passes = 0;
+    passMs = firstMs;
+    lastMs = firstMs;
+
+    nextRecord();
+    while (hasPending) {
+      // Passes up to the next record; one of them may take it as its fetch
+      for (uint32_t ms = pending.ms; hasPending && pending.ms == ms && (int32_t)(ms - passMs) > 0;
+           passMs += cfg.tickMs) {
+        runPass();
+      }
+      if (!hasPending) break;
+      if ((int32_t)(pending.ms - passMs) > 0) continue;
+      applyRecord(pending);
+      nextRecord();
+    }
+    runPass();
+  }
+
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  double spanSeconds = (lastMs - firstMs) / 1000.0 * cfg.repeat;
+
+  int mismatches = compareTransitions(recorded, ctl.transitions, cfg.toleranceMs, cfg.printTransitions);
+  const InputTraceHeader &h = reader.getHeader();
+  printf("records=%u dropped=%u span_hours=%.1f tick_ms=%d passes=%lld\n", h.records, h.dropped,
+         (lastMs - firstMs) / 3600000.0, cfg.tickMs, passes);
+  printf("relay_recorded=%zu relay_replayed=%zu mismatches=%d\n", recorded.size(), ctl.transitions.size(),
+         mismatches);
+  printf("wall_seconds=%.3f records_per_second=%.0f passes_per_second=%.0f speedup=%.0fx\n", wallSeconds,
+         records * cfg.repeat / (wallSeconds > 0 ? wallSeconds : 1e-9),
+         passes * cfg.repeat / (wallSeconds > 0 ? wallSeconds : 1e-9),
+         spanSeconds / (wallSeconds > 0 ? wallSeconds : 1e-9));
+  return mismatches == 0 ? 0 : 1;
+}
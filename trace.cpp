@@ -0,0 +1,121 @@
+#include "trace.h"
+
+struct TraceFormat {
+  const char *fmt;
+  uint8_t flags;
+};
+
+#define TRACE_FORMAT_STRING(id, fmt, flags) static const char id##_FMT[] PROGMEM = fmt;
+TRACE_FORMATS(TRACE_FORMAT_STRING)
+#undef TRACE_FORMAT_STRING
+
+#define TRACE_FORMAT_ENTRY(id, fmt, flags) { id##_FMT, flags },
+static const TraceFormat traceFormats[TRACE_FORMAT_COUNT] PROGMEM = {
+  TRACE_FORMATS(TRACE_FORMAT_ENTRY)
+};
+#undef TRACE_FORMAT_ENTRY
+
+static void readFormat(uint8_t formatId, TraceFormat &f) {
+  memcpy_P(&f, &traceFormats[formatId], sizeof(TraceFormat));
+}
+
+TraceBuffer traceLog;
+
+TraceRecord *TraceBuffer::claim(uint8_t level, uint8_t formatId) {
+  if (nextSeq - drainedSeq >= TRACE_RING_SIZE) {
+    drainedSeq++;
+    droppedCount++;
+  }
+
+  TraceRecord *rec = &ring[nextSeq % TRACE_RING_SIZE];
+  rec->seq = nextSeq++;
+  rec->timestamp = millis();
+  rec->level = level;
+  rec->formatId = formatId;
+  rec->str[0] = 0;
+  return rec;
+}
+
+void TraceBuffer::record(uint8_t level, uint8_t formatId, int32_t a, int32_t b, int32_t c, int32_t d) {
+  TraceRecord *rec = claim(level, formatId);
+  rec->args[0] = a;
+  rec->args[1] = b;
+  rec->args[2] = c;
+  rec->args[3] = d;
+}
+
+void TraceBuffer::recordStr(uint8_t level, uint8_t formatId, const char *s, int32_t a, int32_t b, int32_t c) {
+  TraceRecord *rec = claim(level, formatId);
+  rec->args[0] = a;
+  rec->args[1] = b;
+  rec->args[2] = c;
+  rec->args[3] = 0;
+
+  TraceFormat f;
+  readFormat(formatId < TRACE_FORMAT_COUNT ? formatId : 0, f);
+  if ((f.flags & TRACE_F_SENSITIVE) && !TRACE_SHOW_SENSITIVE) {
+    strcpy(rec->str, "***");
+  } else {
+    strncpy(rec->str, s ? s : "", TRACE_STR_SIZE - 1);
+    rec->str[TRACE_STR_SIZE - 1] = 0;
+  }
+}
+
+void TraceBuffer::recordFloat(uint8_t level, uint8_t formatId, float a, float b) {
+  TraceRecord *rec = claim(level, formatId);
+  memcpy(&rec->args[0], &a, sizeof(float));
+  memcpy(&rec->args[1], &b, sizeof(float));
+  rec->args[2] = 0;
+  rec->args[3] = 0;
+}
+
+size_t TraceBuffer::format(const TraceRecord &rec, char *out, size_t size) {
+  if (size == 0) return 0;
+  if (rec.formatId >= TRACE_FORMAT_COUNT) {
+    return snprintf_P(out, size, PSTR("Unknown trace format %d"), rec.formatId);
+  }
+
+  TraceFormat f;
+  readFormat(rec.formatId, f);
+
+  int n;
+  if (f.flags & TRACE_F_FLOAT) {
+    float a, b;
+    memcpy(&a, &rec.args[0], sizeof(float));
+    memcpy(&b, &rec.args[1], sizeof(float));
+    n = snprintf_P(out, size, f.fmt, (double)a, (double)b);
+  } else if (f.flags & TRACE_F_STR) {
+    n = snprintf_P(out, size, f.fmt, rec.str, rec.args[0], rec.args[1], rec.args[2]);
+  } else {
+    n = snprintf_P(out, size, f.fmt, rec.args[0], rec.args[1], rec.args[2], rec.args[3]);
+  }
+
+  if (n < 0) return 0;
+  return (size_t)n < size ? n : size - 1;
+}
+
+void TraceBuffer::drain(uint8_t maxRecords) {
+  char line[TRACE_LINE_SIZE];
+
+  while (maxRecords > 0 && drainedSeq < nextSeq) {
+    size_t len = format(ring[drainedSeq % TRACE_RING_SIZE], line, sizeof(line));
+    if ((size_t)Serial.availableForWrite() < len + 2) return; // FIFO full, try next pass
+
+    Serial.write((const uint8_t *)line, len);
+    Serial.write("\r\n");
+    drainedSeq++;
+    maxRecords--;
+  }
+}
+
+const TraceRecord *TraceBuffer::get(uint32_t seq) {
+  if (seq >= nextSeq || seq < getOldestSeq()) return NULL;
+  return &ring[seq % TRACE_RING_SIZE];
+}
+
+// Indexed by TRACE_LEVEL_*
+static const char LEVEL_NAMES[][6] PROGMEM = { "none", "error", "warn", "info", "debug" };
+
+FlashName TraceBuffer::levelName(uint8_t level) {
+  return flashName(LEVEL_NAMES, level, LEVEL_NAMES[TRACE_LEVEL_NONE]);
+}
@@ -0,0 +1,169 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include "flash_string.h"
+
+#define TRACE_LEVEL_NONE 0
+#define TRACE_LEVEL_ERROR 1
+#define TRACE_LEVEL_WARN 2
+#define TRACE_LEVEL_INFO 3
+#define TRACE_LEVEL_DEBUG 4
+
+// Override before including this header (config.h does) to change what is compiled in
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_LEVEL_INFO
+#endif
+
+// Credentials and auth headers are replaced by "***" unless this is set to 1
+#ifndef TRACE_SHOW_SENSITIVE
+#define TRACE_SHOW_SENSITIVE 0
+#endif
+
+#define TRACE_RING_SIZE 32     // Records kept in RAM
+#define TRACE_MAX_ARGS 4       // Numeric arguments per record
+#define TRACE_STR_SIZE 16      // Inline copy of the optional string argument
+#define TRACE_LINE_SIZE 96     // Longest formatted line
+#define TRACE_DRAIN_PER_TICK 4 // Records written to Serial per loop pass
+
+// Format flags
+#define TRACE_F_NONE 0x00
+#define TRACE_F_STR 0x01       // First placeholder is the string argument
+#define TRACE_F_SENSITIVE 0x02 // String argument is redacted
+#define TRACE_F_FLOAT 0x04     // Numeric arguments are floats
+
+// Every trace message, in one place so the ids and the flash-resident format
+// table can't drift apart. Formats are only expanded when a record is read.
+#define TRACE_FORMATS(X) \
+  X(TR_EEPROM_SAVE,          "EEPROM save %s", TRACE_F_STR) \
+  X(TR_SETTINGS_SUNRISE,     "Loaded sunrise %d:%02d (offset %d min)", TRACE_F_NONE) \
+  X(TR_SETTINGS_SUNSET,      "Loaded sunset %d:%02d (offset %d min)", TRACE_F_NONE) \
+  X(TR_SETTINGS_CLOUD,       "Cloud threshold %d%% with %d%% hysteresis, window %d min", TRACE_F_NONE) \
+  X(TR_SETTINGS_LOCATION,    "Location: %f, %f", TRACE_F_FLOAT) \
+  X(TR_SETTINGS_TIME,        "Relay %s, TZ=%d, DST=%d", TRACE_F_STR) \
+  X(TR_SETTINGS_AUTH,        "Auth user: %s", TRACE_F_STR | TRACE_F_SENSITIVE) \
+  X(TR_SETTINGS_DEVICE,      "Device name: %s", TRACE_F_STR) \
+  X(TR_WIFI_CONNECTING,      "Connecting to WiFi", TRACE_F_NONE) \
+  X(TR_WIFI_CONNECTED,       "Connected to WiFi, IP %d.%d.%d.%d", TRACE_F_NONE) \
+  X(TR_WIFI_FAILED,          "Failed to connect to WiFi", TRACE_F_NONE) \
+  X(TR_WIFI_ENABLED,         "WiFi enabled", TRACE_F_NONE) \
+  X(TR_NTP_TIME,             "Current time (GMT): %02d:%02d:%02d", TRACE_F_NONE) \
+  X(TR_FORECAST_JSON_ERROR,  "JSON deserialization error", TRACE_F_NONE) \
+  X(TR_FORECAST_HTTP_ERROR,  "HTTP GET failed, error: %d", TRACE_F_NONE) \
+  X(TR_SHARE_LEADER,         "Forecast sharing leader is now %08x", TRACE_F_NONE) \
+  X(TR_MQTT_CONNECTED,       "MQTT connected to %s", TRACE_F_STR) \
+  X(TR_MQTT_FAILED,          "MQTT connect failed (%d), retry in %d s", TRACE_F_NONE) \
+  X(TR_PLAN_BUILT,           "Day plan built: %d entries, %d us", TRACE_F_NONE) \
+  X(TR_SUN_TIMES,            "Updated sun times - Sunrise: %02d:%02d, Sunset: %02d:%02d", TRACE_F_NONE) \
+  X(TR_AUTH_HEADER,          "Auth header: %s", TRACE_F_STR | TRACE_F_SENSITIVE) \
+  X(TR_AUTH_FAILED,          "Authentication failed (%d headers)", TRACE_F_NONE) \
+  X(TR_LOGIN_FAILED,         "Login failed", TRACE_F_NONE) \
+  X(TR_ROOT_SENT,            "Authentication successful, sending root page", TRACE_F_NONE) \
+  X(TR_SAVE_TIMES,           "Saving new times - Sunrise: %02d:%02d, Sunset: %02d:%02d", TRACE_F_NONE) \
+  X(TR_MANUAL_TOGGLE,        "Manual light toggled to: %s", TRACE_F_STR) \
+  X(TR_SAVE_CONFIG,          "Saving %s configuration changes", TRACE_F_STR) \
+  X(TR_CREDENTIALS_CHANGED,  "Credentials changed - new auth will be required", TRACE_F_NONE) \
+  X(TR_LOCATION_UPDATED,     "Location updated to: %f, %f", TRACE_F_FLOAT) \
+  X(TR_CREDENTIALS_DEFAULT,  "Set and saved default credentials", TRACE_F_NONE) \
+  X(TR_CREDENTIAL_BAD_CHAR,  "Bad character in %s at position %d: %d", TRACE_F_STR) \
+  X(TR_CREDENTIALS_RESET,    "Non-printable characters in credentials, reset to defaults", TRACE_F_NONE) \
+  X(TR_USING_CREDENTIALS,    "Using credentials for user %s", TRACE_F_STR | TRACE_F_SENSITIVE) \
+  X(TR_SETUP_COMPLETE,       "Setup complete", TRACE_F_NONE) \
+  X(TR_OVERRIDE_EXPIRED,     "Manual override expired, returning to automatic control", TRACE_F_NONE) \
+  X(TR_LIGHTS_ON_CLOUD,      "Lights ON: Cloud coverage triggered early activation", TRACE_F_NONE) \
+  X(TR_LIGHTS_ON_SCHEDULE,   "Lights ON: Regular schedule", TRACE_F_NONE) \
+  X(TR_LIGHTS_OFF,           "Lights OFF: Regular schedule", TRACE_F_NONE) \
+  X(TR_ZONE_LIGHTS,          "Lights %s in zone %d", TRACE_F_STR) \
+  X(TR_FACTORY_RESET,        "FACTORY RESET requested - resetting credentials", TRACE_F_NONE) \
+  X(TR_ROUTES_CONFIGURED,    "Web server routes configured", TRACE_F_NONE) \
+  X(TR_LOG_INVALID,          "Invalid log data detected, resetting logs", TRACE_F_NONE) \
+  X(TR_ENERGY_RESET,         "No stored energy counters, starting from zero", TRACE_F_NONE) \
+  X(TR_LOG_INIT,             "Log system initialized. Count: %d, Head: %d", TRACE_F_NONE) \
+  X(TR_LOG_RESET,            "Log system reset", TRACE_F_NONE)
+
+#define TRACE_ENUM_ENTRY(id, fmt, flags) id,
+enum TraceFormatId {
+  TRACE_FORMATS(TRACE_ENUM_ENTRY)
+  TRACE_FORMAT_COUNT
+};
+#undef TRACE_ENUM_ENTRY
+
+struct TraceRecord {
+  uint32_t seq;
+  uint32_t timestamp;    // millis() when recorded
+  uint8_t level;
+  uint8_t formatId;
+  int32_t args[TRACE_MAX_ARGS];
+  char str[TRACE_STR_SIZE];
+};
+
+class TraceBuffer {
+private:
+  TraceRecord ring[TRACE_RING_SIZE];
+  uint32_t nextSeq;      // Sequence number of the next record
+  uint32_t drainedSeq;   // Next record to write to Serial
+  uint32_t droppedCount; // Records overwritten before they reached Serial
+
+  TraceRecord *claim(uint8_t level, uint8_t formatId);
+
+public:
+  TraceBuffer() : nextSeq(0), drainedSeq(0), droppedCount(0) {}
+
+  void record(uint8_t level, uint8_t formatId, int32_t a = 0, int32_t b = 0, int32_t c = 0, int32_t d = 0);
+  void recordStr(uint8_t level, uint8_t formatId, const char *s, int32_t a = 0, int32_t b = 0, int32_t c = 0);
+  void recordFloat(uint8_t level, uint8_t formatId, float a, float b = 0);
+
+  // Formats one record into `out`; returns the length written
+  size_t format(const TraceRecord &rec, char *out, size_t size);
+
+  // Writes pending records to Serial without blocking on a full UART FIFO
+  void drain(uint8_t maxRecords);
+
+  // Returns the record with sequence number `seq` if it is still in the ring
+  const TraceRecord *get(uint32_t seq);
+
+  uint32_t getNextSeq() { return nextSeq; }
+  uint32_t getOldestSeq() { return nextSeq > TRACE_RING_SIZE ? nextSeq - TRACE_RING_SIZE : 0; }
+  uint32_t getDroppedCount() { return droppedCount; }
+
+  static FlashName levelName(uint8_t level);
+};
+
+extern TraceBuffer traceLog;
+
+// Disabled levels expand to nothing, so their arguments are never evaluated
+#if TRACE_LEVEL >= TRACE_LEVEL_ERROR
+#define TRACE_ERROR(id, ...) traceLog.record(TRACE_LEVEL_ERROR, id, ##__VA_ARGS__)
+#define TRACE_ERROR_S(id, ...) traceLog.recordStr(TRACE_LEVEL_ERROR, id, __VA_ARGS__)
+#else
+#define TRACE_ERROR(id, ...) do {} while (0)
+#define TRACE_ERROR_S(id, ...) do {} while (0)
+#endif
+
+#if TRACE_LEVEL >= TRACE_LEVEL_WARN
+#define TRACE_WARN(id, ...) traceLog.record(TRACE_LEVEL_WARN, id, ##__VA_ARGS__)
+#define TRACE_WARN_S(id, ...) traceLog.recordStr(TRACE_LEVEL_WARN, id, __VA_ARGS__)
+#else
+#define TRACE_WARN(id, ...) do {} while (0)
+#define TRACE_WARN_S(id, ...) do {} while (0)
+#endif
+
+#if TRACE_LEVEL >= TRACE_LEVEL_INFO
+#define TRACE_INFO(id, ...) traceLog.record(TRACE_LEVEL_INFO, id, ##__VA_ARGS__)
+#define TRACE_INFO_S(id, ...) traceLog.recordStr(TRACE_LEVEL_INFO, id, __VA_ARGS__)
+#define TRACE_INFO_F(id, ...) traceLog.recordFloat(TRACE_LEVEL_INFO, id, __VA_ARGS__)
+#else
+#define TRACE_INFO(id, ...) do {} while (0)
+#define TRACE_INFO_S(id, ...) do {} while (0)
+#define TRACE_INFO_F(id, ...) do {} while (0)
+#endif
+
+#if TRACE_LEVEL >= TRACE_LEVEL_DEBUG
+#define TRACE_DEBUG(id, ...) traceLog.record(TRACE_LEVEL_DEBUG, id, ##__VA_ARGS__)
+#define TRACE_DEBUG_S(id, ...) traceLog.recordStr(TRACE_LEVEL_DEBUG, id, __VA_ARGS__)
+#else
+#define TRACE_DEBUG(id, ...) do {} while (0)
+#define TRACE_DEBUG_S(id, ...) do {} while (0)
+#endif
+
+#endif
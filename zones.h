@@ -0,0 +1,123 @@
+#ifndef ZONES_H
+#define ZONES_H
+
+// Extra lighting circuits on one unit. Each zone shifts the unit's schedule
+// by its own offsets and applies its own cloud threshold and manual
+// override, but the whole table is evaluated in one pass against a snapshot
+// shared by every zone, so a zone costs a few comparisons per tick and never
+// another forecast lookup.
+
+#include <stdio.h>
+#include <string.h>
+#include "controller_core.h"
+#include "flash_string.h"
+
+#define MAX_ZONES 16
+#define ZONE_NAME_SIZE 12
+#define ZONE_NO_PIN -1
+
+enum ZoneFlag {
+  ZONE_ENABLED = 0x01,
+  ZONE_ACTIVE_HIGH = 0x02   // Relay logic, as relayOn is for the main circuit
+};
+
+// Persisted settings, 20 bytes per zone
+struct ZoneConfig {
+  char name[ZONE_NAME_SIZE];
+  int8_t pin;               // GPIO driving the zone's relay, ZONE_NO_PIN when unassigned
+  uint8_t flags;
+  int8_t sunriseOffset;     // Minutes earlier than the unit's sunrise, like sunriseOffset
+  int8_t sunsetOffset;
+  uint8_t cloudThreshold;   // Percent
+  uint8_t cloudHysteresis;  // Percent
+  uint8_t monitoringWindow; // Minutes
+  uint8_t loadTensW;        // Connected load in 10 W steps, for energy estimates; 0 when unknown
+};
+
+// Kept in RAM only; a reboot clears overrides and cloud triggers
+struct ZoneRuntime {
+  DecisionState decision;
+  uint32_t overrideStart;   // millis() when the manual override began
+  bool override;
+  bool overrideOn;
+  bool lightOn;
+};
+
+// Everything the zones share for one tick
+struct ZoneTick {
+  int currentTime;          // Minutes from midnight
+  int sunriseTime;          // The unit's schedule, its own offsets included
+  int sunsetTime;
+  int maxRetries;
+  uint32_t nowMs;
+  uint32_t overrideMs;      // How long a manual override lasts
+  CloudCoverageSource cloudSource; // Returns the tick's shared sample
+};
+
+inline void initZoneConfig(ZoneConfig &z, uint8_t index, int cloudThreshold, int cloudHysteresis, int monitoringWindow) {
+  memset(&z, 0, sizeof(z));
+  snprintf_P(z.name, sizeof(z.name), PSTR("Zone %d"), index + 1);
+  z.pin = ZONE_NO_PIN;
+  z.cloudThreshold = cloudThreshold;
+  z.cloudHysteresis = cloudHysteresis;
+  z.monitoringWindow = monitoringWindow;
+}
+
+inline void initZoneRuntime(ZoneRuntime &rt) {
+  initDecisionState(rt.decision);
+  rt.overrideStart = 0;
+  rt.override = false;
+  rt.overrideOn = false;
+  rt.lightOn = false;
+}
+
+inline bool zoneUsable(const ZoneConfig &z) {
+  return (z.flags & ZONE_ENABLED) && z.pin != ZONE_NO_PIN;
+}
+
+inline DecisionParams zoneDecisionParams(const ZoneConfig &z, const ZoneTick &tick) {
+  DecisionParams p;
+  p.sunriseTime = applySunOffset(tick.sunriseTime, z.sunriseOffset);
+  p.sunsetTime = applySunOffset(tick.sunsetTime, z.sunsetOffset);
+  p.monitoringWindow = z.monitoringWindow;
+  p.cloudThreshold = z.cloudThreshold;
+  p.cloudHysteresis = z.cloudHysteresis;
+  p.maxRetries = tick.maxRetries;
+  return p;
+}
+
+// One pass over the table. Returns a bit per zone whose light state changed;
+// the caller drives the relays for those.
+inline uint32_t evaluateZones(const ZoneConfig *configs, ZoneRuntime *runtime, int count, const ZoneTick &tick) {
+  uint32_t changed = 0;
+
+  for (int i = 0; i < count; i++) {
+    const ZoneConfig &z = configs[i];
+    ZoneRuntime &rt = runtime[i];
+    bool on = false;
+
+    if (rt.override && tick.nowMs - rt.overrideStart >= tick.overrideMs) {
+      rt.override = false;
+      rt.decision.state = NORMAL;
+    }
+
+    if (!zoneUsable(z)) {
+      rt.override = false;
+    } else if (rt.override) {
+      rt.decision.state = MANUAL;
+      on = rt.overrideOn;
+    } else {
+      DecisionParams p = zoneDecisionParams(z, tick);
+      updateMonitoringWindow(rt.decision, p, tick.currentTime);
+      on = shouldActivateLights(rt.decision, p, tick.currentTime, tick.cloudSource);
+    }
+
+    if (on != rt.lightOn) {
+      rt.lightOn = on;
+      changed |= 1UL << i;
+    }
+  }
+  return changed;
+}
+
+#endif